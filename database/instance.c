@@ -16,14 +16,72 @@ static dbstamp_t DoCLRawRead(CLDataBase *cd, dbstamp_t bts, dbstamp_t ets);
 static int RSTermRange(Query *q);
 static void RawScanCallBack(void *vcd, RawData *rd);
 static int SendResultMessage(CLDataBase *cd, Query *q, CLAnyMsg *msg);
+static int ExplainRow(void *info, char **data, int cols);
+static Query *ParseCLQuery(CLDataBase *cd, CLAnyMsg *msg, int *perror);
 
 static void RequestClientSort(CLDataBase *cd, Query *q);
 static void RequestClientLimit(CLDataBase *cd, Query *q);
 
-static void AddSortedResults(Query *q);
-static void SortAndLimitResults(Query *q);
+/*
+ * ResultSort - server side ORDER BY state, hung off q_ResultSort
+ *
+ *	With a LIMIT only the best q_StartRow + q_MaxRows rows are kept, in
+ *	a heap whose top is the worst row kept.  Without a LIMIT rows are
+ *	buffered in q_ResultBuffer and whenever SORT_RUNBYTES worth have
+ *	accumulated they are sorted and appended to a temporary file as a
+ *	run.  The runs are merged as the results are sent.
+ *
+ *	If the run file cannot be created, written or read rs_Error is set,
+ *	the run file is closed (which removes it) and the statement fails
+ *	with that error instead of returning rows.
+ */
+
+#define SORT_RUNBYTES	(4 * 1024 * 1024)
+#define SORT_RUNBUFSIZE	(64 * 1024)
+
+typedef struct SortRun {
+    off_t	sr_Off;		/* next byte of run to read */
+    off_t	sr_End;		/* end of run */
+    char	*sr_Buf;	/* read buffer, SORT_RUNBUFSIZE */
+    int		sr_BufOff;
+    int		sr_BufLen;
+    ResultRow	*sr_Row;	/* current row of run */
+} SortRun;
+
+typedef struct ResultSort {
+    int		rs_Limit;	/* rows to keep in rs_Heap, or -1 */
+    int		rs_Count;	/* rows in rs_Heap or q_ResultBuffer */
+    int		rs_HeapMax;	/* allocated size of rs_Heap */
+    int		rs_Bytes;	/* approximate size of buffered rows */
+    ResultRow	**rs_Heap;
+    int		rs_Fd;		/* run file, or -1 */
+    off_t	rs_FileOff;	/* append point of run file */
+    SortRun	*rs_Runs;
+    int		rs_NRuns;
+    int		rs_MaxRuns;
+    SortRun	**rs_Merge;	/* heap of runs with rows left */
+    int		rs_NMerge;
+    int		rs_Error;	/* run file error, or 0 */
+} ResultSort;
+
+static int AddSortedResults(Query *q);
+static int SortAndLimitResults(Query *q);
 static int SortResultsCompare(const void *vr1, const void *vr2);
+static int SortResultsRevCompare(const void *vr1, const void *vr2);
+static int SortRunCompare(const void *vr1, const void *vr2);
 static int SendSortedResults(CLDataBase *cd, Query *q);
+static ResultRow *NextSortedResult(Query *q);
+static void FreeResultSort(Query *q);
+static void sortResultBuffer(Query *q);
+static int spillSortRun(Query *q, ResultSort *rs);
+static void failSortRun(ResultSort *rs, int error, const char *what);
+static ResultRow *readSortRun(ResultSort *rs, SortRun *run);
+static int readSortRunBytes(ResultSort *rs, SortRun *run, void *buf, int bytes);
+static int resultRowBytes(const ResultRow *row);
+static const ColData *resultData(const ColI *ci, const ColData *ccd, ColData *tmp, char *buf);
+static void resultSortText(Query *q, ResultRow *row);
+static void heapUp(void **heap, int i, int (*cmp)(const void *, const void *));
+static void heapDown(void **heap, int n, int i, int (*cmp)(const void *, const void *));
 
 static int ActiveQueries;
 
@@ -103,22 +161,27 @@ DatabaseInstanceThread(CLDataBase *cd)
 		 * Run a query within a transaction
 		 */
 		{
-		    Query *q = GetQuery(cd->cd_Db);
-		    int type;
-		    token_t t;
-
-		    type = SqlInit(
-				&t, 
-				msg->cma_Pkt.cp_Data, 
-				msg->cma_Pkt.cp_Bytes - sizeof(msg->cma_Pkt)
-			    );
-		    type = ParseSql(&t, q, type);
-		    q->q_QryCopy = safe_strndup(msg->cma_Pkt.cp_Data, msg->cma_Pkt.cp_Bytes - sizeof(msg->cma_Pkt));
-		    if (type & TOKF_ERROR) {
-			msg->cma_Pkt.cp_Error = -(int)(type & TOKF_ERRMASK);
+		    Query *q;
+
+		    if ((q = ParseCLQuery(cd, msg, &error)) == NULL) {
+			msg->cma_Pkt.cp_Error = error;
 			WriteCLMsg(cd->cd_Iow, msg, 1);
 			msg = NULL;
-			FreeQuery(q);
+		    } else if (q->q_Flags & QF_EXPLAIN) {
+			/*
+			 * Return the plan (and for EXPLAIN ANALYZE the
+			 * counters) instead of the query's results.
+			 */
+			q->q_TermInfo = cd;
+			q->q_StallCount = 0;
+			++ActiveQueries;
+			error = ExplainQuery(q, ExplainRow, q);
+			--ActiveQueries;
+			DBASSERT(ActiveQueries >= 0);
+			msg->cma_Pkt.cp_Error = error;
+			WriteCLMsg(cd->cd_Iow, msg, 1);
+			msg = NULL;
+			RelQuery(q);
 		    } else {
 			/*
 			 * Issue the query, then return the error/count
@@ -130,9 +193,15 @@ DatabaseInstanceThread(CLDataBase *cd)
 			++ActiveQueries;
 			error = RunQuery(q);	/* error or record count */
 
-			if (!listIsEmpty(&q->q_ResultBuffer)) {
-			    SortAndLimitResults(q);
-			    error = SendSortedResults(cd, q);
+			if (q->q_ResultSort != NULL) {
+			    if (error >= 0)
+				error = SortAndLimitResults(q);
+			    if (error >= 0) {
+				error = SendSortedResults(cd, q);
+			    } else {
+				FreeResultBuffer(q);
+				FreeResultSort(q);
+			    }
 			    q->q_Flags &= ~(QF_CLIENT_ORDER|QF_CLIENT_LIMIT);
 			}
 			msg->cma_Pkt.cp_Error = error;
@@ -165,22 +234,18 @@ DatabaseInstanceThread(CLDataBase *cd)
 		 * anything.
 		 */
 		{
-		    Query *q = GetQuery(cd->cd_Db);
-		    int type;
-		    token_t t;
-
-		    type = SqlInit(
-				&t, 
-				msg->cma_Pkt.cp_Data, 
-				msg->cma_Pkt.cp_Bytes - sizeof(msg->cma_Pkt)
-			    );
-		    type = ParseSql(&t, q, type);
-		    if (type & TOKF_ERROR) {
-			/* XXX Rel? I think guards are separated out, */
-			/* we should be ok to Free */
-			FreeQuery(q);
-		    } else {
-			if (q->q_TermOp != QOP_SELECT) {
+		    Query *q;
+
+		    /* XXX Rel? I think guards are separated out, */
+		    /* we should be ok to Free (on parse failure) */
+		    if ((q = ParseCLQuery(cd, msg, &error)) != NULL) {
+			/*
+			 * A plain EXPLAIN never runs the query
+			 */
+			if (q->q_TermOp != QOP_SELECT &&
+			    (q->q_Flags & (QF_EXPLAIN|QF_EXPLAIN_ANALYZE)) !=
+				QF_EXPLAIN
+			) {
 			    q->q_TermFunc = NULL;
 			    ++ActiveQueries;
 			    RunQuery(q);	/* error or record count */
@@ -434,6 +499,7 @@ DatabaseInstanceThread(CLDataBase *cd)
 	}
 	CloseDatabase(cd->cd_Db, 0);
     }
+    FreePrepCache(&cd->cd_PrepCache);
     freeNotify(cd->cd_NotifyInt);
     cd->cd_NotifyInt = NULL;
     dbinfo("drd_database: stop instance %s\n", cd->cd_DBName);
@@ -441,6 +507,60 @@ DatabaseInstanceThread(CLDataBase *cd)
 }
 
 
+/*
+ * ParseCLQuery() - parse the query of a RUN or REC message
+ *
+ *	The query text is NUL terminated.  A parameter block following
+ *	the NUL (see clientmsg.h) makes it a prepared statement, which
+ *	is instantiated through the instance's statement cache.  Returns
+ *	NULL and sets *perror on failure.
+ */
+static Query *
+ParseCLQuery(CLDataBase *cd, CLAnyMsg *msg, int *perror)
+{
+    const char *data = msg->cma_Pkt.cp_Data;
+    int bytes = msg->cma_Pkt.cp_Bytes - sizeof(msg->cma_Pkt);
+    Query *q;
+    token_t t;
+    int type;
+    int len;
+
+    for (len = 0; len < bytes && data[len]; ++len)
+	;
+    if (bytes - len - 1 >= CLPARAM_MINSIZE) {
+	ColData *params;
+	int nparams;
+
+	nparams = DecodeCLParams(data + len + 1, bytes - len - 1, &params);
+	if (nparams < 0) {
+	    *perror = nparams;
+	    return(NULL);
+	}
+	q = PrepareQuery(&cd->cd_PrepCache, cd->cd_Db, data, len,
+			params, nparams, perror);
+	free(params);
+	return(q);
+    }
+
+    q = GetQuery(cd->cd_Db);
+    if (len < bytes)
+	bytes = len + 1;
+    type = SqlInit(&t, data, bytes);
+    type = ParseSql(&t, q, type);
+    if (type & TOKF_ERROR) {
+	*perror = -(int)(type & TOKF_ERRMASK);
+	FreeQuery(q);
+	return(NULL);
+    }
+    if (q->q_NParams) {
+	*perror = DBERR_PARAM_COUNT;
+	FreeQuery(q);
+	return(NULL);
+    }
+    q->q_QryCopy = safe_strndup(data, bytes);
+    return(q);
+}
+
 static dbstamp_t
 DoCLRawRead(CLDataBase *cd, dbstamp_t bts, dbstamp_t ets)
 {
@@ -499,10 +619,17 @@ DoCLRawRead(CLDataBase *cd, dbstamp_t bts, dbstamp_t ets)
 }
 
 
-static void
+/*
+ * AddSortedResults() - save a result row for server side sorting
+ *
+ *	Returns 0, or a negative error if a sorted run could not be
+ *	spilled.
+ */
+static int
 AddSortedResults(Query *q)
 {
     ResultRow *row = NULL;
+    ResultSort *rs;
     ColI *ci;
     int i;
 
@@ -519,8 +646,14 @@ AddSortedResults(Query *q)
 	row->rr_SortDataLen = zalloc(sizeof(int) * row->rr_NumSortCols);
     }
 
+    /*
+     * Display columns are kept as text, the sort columns as stored
+     * since the binary data types sort correctly as bytes.
+     */
     for (ci = q->q_ColIQBase, i = 0; ci != NULL; ci = ci->ci_QNext, i++) {
-	ColData *ccd = ci->ci_CData;
+	ColData tmp;
+	char buf[DATATYPE_FMTSIZE];
+	const ColData *ccd = resultData(ci, ci->ci_CData, &tmp, buf);
 	char *data = NULL;
 
 	if (ccd->cd_Data != NULL) {
@@ -569,55 +702,106 @@ AddSortedResults(Query *q)
     }
     DBASSERT(i == row->rr_NumSortCols);
 
-    if ((q->q_Flags & QF_WITH_LIMIT) &&
-	 q->q_StartRow == 0 &&
-	 q->q_MaxRows == 1) {
-	/* Special case for handling common LIMIT 1 queries. */
-	ResultRow *head = getHead(&q->q_ResultBuffer);
-	if (head != NULL) {
-	    q->q_CountRows = 1;
-	    if (SortResultsCompare(&row, &head) > 0) {
-		FreeResultRow(row);
-		return;
-	    }
-	    else {
-		removeNode(&head->rr_Node);
-		FreeResultRow(head);
-	    }
+    if ((rs = q->q_ResultSort) == NULL) {
+	rs = zalloc(sizeof(ResultSort));
+	rs->rs_Limit = -1;
+	rs->rs_Fd = -1;
+	if ((q->q_Flags & QF_WITH_LIMIT) &&
+	    q->q_StartRow + q->q_MaxRows >= 0
+	) {
+	    rs->rs_Limit = q->q_StartRow + q->q_MaxRows;
 	}
+	q->q_ResultSort = rs;
     }
-    addTail(&q->q_ResultBuffer, &row->rr_Node);
+
+    /*
+     * Without a limit buffer the row, spilling a sorted run once the
+     * buffer gets too large.
+     */
+    if (rs->rs_Limit < 0) {
+	addTail(&q->q_ResultBuffer, &row->rr_Node);
+	++rs->rs_Count;
+	rs->rs_Bytes += resultRowBytes(row) + sizeof(ResultRow);
+	if (rs->rs_Bytes >= SORT_RUNBYTES)
+	    return(spillSortRun(q, rs));
+	return(0);
+    }
+
+    /*
+     * With a limit keep the best rs_Limit rows.  The top of the heap is
+     * the worst row kept and is replaced if the new row is better.
+     */
+    if (rs->rs_Count < rs->rs_Limit) {
+	if (rs->rs_Count == rs->rs_HeapMax) {
+	    rs->rs_HeapMax = rs->rs_HeapMax ? rs->rs_HeapMax * 2 : 16;
+	    if (rs->rs_HeapMax > rs->rs_Limit)
+		rs->rs_HeapMax = rs->rs_Limit;
+	    rs->rs_Heap = safe_realloc(rs->rs_Heap,
+				sizeof(ResultRow *) * rs->rs_HeapMax);
+	}
+	rs->rs_Heap[rs->rs_Count] = row;
+	heapUp((void **)rs->rs_Heap, rs->rs_Count, SortResultsRevCompare);
+	++rs->rs_Count;
+    } else if (rs->rs_Count && SortResultsCompare(&row, &rs->rs_Heap[0]) < 0) {
+	FreeResultRow(rs->rs_Heap[0]);
+	rs->rs_Heap[0] = row;
+	heapDown((void **)rs->rs_Heap, rs->rs_Count, 0, SortResultsRevCompare);
+    } else {
+	FreeResultRow(row);
+    }
+    return(0);
 }
 
-static void
+/*
+ * SortAndLimitResults() - prepare the sorted results for sending
+ *
+ *	Sorts the heap or the buffered rows onto q_ResultBuffer, or if runs
+ *	were spilled, spills the remaining rows and primes the merge (see
+ *	NextSortedResult()).  Returns 0 or a negative error.
+ */
+static int
 SortAndLimitResults(Query *q)
 {
-    ResultRow **sorttable;
-    ResultRow *row;
-    int i = 0;
+    ResultSort *rs = q->q_ResultSort;
+    int i;
 
-    sorttable = malloc(sizeof(ResultRow *) * q->q_CountRows);
-    while ((row = remHead(&q->q_ResultBuffer)) != NULL) {
-	sorttable[i] = row;
-	i++;
+    if (rs->rs_Limit >= 0) {
+	if (rs->rs_Count > 0) {
+	    qsort(rs->rs_Heap, rs->rs_Count, sizeof(ResultRow *),
+		  SortResultsCompare);
+	}
+	for (i = 0; i < rs->rs_Count; i++) {
+	    if (i < q->q_StartRow) {
+		FreeResultRow(rs->rs_Heap[i]);
+		continue;
+	    }
+	    addTail(&q->q_ResultBuffer, &rs->rs_Heap[i]->rr_Node);
+	}
+	rs->rs_Count = 0;
+	return(0);
     }
-
-    DBASSERT(i == q->q_CountRows);
-    if (q->q_CountRows > 0) {
-	qsort(sorttable, q->q_CountRows, sizeof(ResultRow *),
-	      SortResultsCompare);
+    if (rs->rs_NRuns == 0) {
+	sortResultBuffer(q);
+	return(0);
     }
-
-    for (i = 0; i < q->q_CountRows; i++) {
-	if ((q->q_Flags & QF_WITH_LIMIT) &&
-	    (i < q->q_StartRow || i >= q->q_StartRow + q->q_MaxRows)) {
-	    FreeResultRow(sorttable[i]);
-	    continue;
+    if (rs->rs_Count && spillSortRun(q, rs) < 0)
+	return(rs->rs_Error);
+
+    rs->rs_Merge = safe_malloc(sizeof(SortRun *) * rs->rs_NRuns);
+    rs->rs_NMerge = 0;
+    for (i = 0; i < rs->rs_NRuns; ++i) {
+	SortRun *run = &rs->rs_Runs[i];
+
+	run->sr_Buf = safe_malloc(SORT_RUNBUFSIZE);
+	if ((run->sr_Row = readSortRun(rs, run)) != NULL) {
+	    rs->rs_Merge[rs->rs_NMerge] = run;
+	    heapUp((void **)rs->rs_Merge, rs->rs_NMerge, SortRunCompare);
+	    ++rs->rs_NMerge;
+	} else if (rs->rs_Error) {
+	    return(rs->rs_Error);
 	}
-	addTail(&q->q_ResultBuffer, &sorttable[i]->rr_Node);
     }
-
-    free(sorttable);
+    return(0);
 }
 
 static int
@@ -660,6 +844,21 @@ SortResultsCompare(const void *vr1, const void *vr2)
     return(r);
 }
 
+static int
+SortResultsRevCompare(const void *vr1, const void *vr2)
+{
+    return(SortResultsCompare(vr2, vr1));
+}
+
+static int
+SortRunCompare(const void *vr1, const void *vr2)
+{
+    const SortRun *r1 = *(void **)vr1;
+    const SortRun *r2 = *(void **)vr2;
+
+    return(SortResultsCompare(&r1->sr_Row, &r2->sr_Row));
+}
+
 
 static int
 SendSortedResults(CLDataBase *cd, Query *q)
@@ -673,7 +872,8 @@ SendSortedResults(CLDataBase *cd, Query *q)
     int sr;
     int r = 0;
 
-    while ((row = remHead(&q->q_ResultBuffer)) != NULL) {
+    while ((row = NextSortedResult(q)) != NULL) {
+	resultSortText(q, row);
 	cols = 0;
 	bytes = offsetof(CLRowMsg, rm_Offsets[1]);
 
@@ -743,11 +943,452 @@ SendSortedResults(CLDataBase *cd, Query *q)
 	    break;
 	r += sr;
     }
+    if (row == NULL && q->q_ResultSort && q->q_ResultSort->rs_Error)
+	r = q->q_ResultSort->rs_Error;
 
     FreeResultBuffer(q);
+    FreeResultSort(q);
     return(r);
 }
 
+/*
+ * NextSortedResult() - return the next sorted row to send, or NULL
+ *
+ *	NULL is also returned if a run could not be read, with rs_Error set.
+ */
+static ResultRow *
+NextSortedResult(Query *q)
+{
+    ResultSort *rs = q->q_ResultSort;
+    SortRun *run;
+    ResultRow *row;
+
+    if (rs == NULL || rs->rs_NMerge == 0)
+	return(remHead(&q->q_ResultBuffer));
+
+    run = rs->rs_Merge[0];
+    row = run->sr_Row;
+    if ((run->sr_Row = readSortRun(rs, run)) == NULL && rs->rs_Error) {
+	FreeResultRow(row);
+	return(NULL);
+    }
+    if (run->sr_Row == NULL)
+	rs->rs_Merge[0] = rs->rs_Merge[--rs->rs_NMerge];
+    heapDown((void **)rs->rs_Merge, rs->rs_NMerge, 0, SortRunCompare);
+    return(row);
+}
+
+/*
+ * FreeResultSort() - throw away the sort state and any unsent rows
+ */
+static void
+FreeResultSort(Query *q)
+{
+    ResultSort *rs;
+    int i;
+
+    if ((rs = q->q_ResultSort) == NULL)
+	return;
+    q->q_ResultSort = NULL;
+
+    if (rs->rs_Limit >= 0) {
+	for (i = 0; i < rs->rs_Count; ++i)
+	    FreeResultRow(rs->rs_Heap[i]);
+    }
+    if (rs->rs_Heap)
+	free(rs->rs_Heap);
+    for (i = 0; i < rs->rs_NRuns; ++i) {
+	SortRun *run = &rs->rs_Runs[i];
+
+	if (run->sr_Row)
+	    FreeResultRow(run->sr_Row);
+	if (run->sr_Buf)
+	    free(run->sr_Buf);
+    }
+    if (rs->rs_Runs)
+	free(rs->rs_Runs);
+    if (rs->rs_Merge)
+	free(rs->rs_Merge);
+    if (rs->rs_Fd >= 0)
+	close(rs->rs_Fd);
+    zfree(rs, sizeof(ResultSort));
+}
+
+/*
+ * sortResultBuffer() - sort the rows in q_ResultBuffer in place
+ */
+static void
+sortResultBuffer(Query *q)
+{
+    ResultSort *rs = q->q_ResultSort;
+    ResultRow **sorttable;
+    ResultRow *row;
+    int i = 0;
+
+    sorttable = safe_malloc(sizeof(ResultRow *) * (rs->rs_Count + 1));
+    while ((row = remHead(&q->q_ResultBuffer)) != NULL) {
+	sorttable[i] = row;
+	i++;
+    }
+
+    DBASSERT(i == rs->rs_Count);
+    if (rs->rs_Count > 0) {
+	qsort(sorttable, rs->rs_Count, sizeof(ResultRow *),
+	      SortResultsCompare);
+    }
+    for (i = 0; i < rs->rs_Count; i++)
+	addTail(&q->q_ResultBuffer, &sorttable[i]->rr_Node);
+
+    free(sorttable);
+}
+
+/*
+ * spillSortRun() - sort the buffered rows and append them to the run file
+ *
+ *	The run file is created in the database directory and unlinked
+ *	immediately, it goes away when it is closed.  A row is stored as
+ *	rr_NumCols and rr_NumSortCols followed by the length (-1 if NULL)
+ *	and data of each column, then the length and flags, a NULL
+ *	indicator and the data of each sort column.
+ *
+ *	Returns 0, or a negative error if the run file could not be created
+ *	or written (see failSortRun()).  The buffered rows are consumed
+ *	either way.
+ */
+static int
+spillSortRun(Query *q, ResultSort *rs)
+{
+    ResultRow *row;
+    SortRun *run;
+    char *buf;
+    int bytes = 0;
+    int off = 0;
+    int i;
+
+    sortResultBuffer(q);
+
+    if (rs->rs_Fd < 0 && rs->rs_Error == 0) {
+	char *path;
+
+	safe_asprintf(&path, "%s/.drd_sort.XXXXXX", DefaultDBDir());
+	rs->rs_Fd = mkstemp(path);
+	if (rs->rs_Fd < 0)
+	    failSortRun(rs, DBERR_CANT_CREATE, "create");
+	else
+	    unlink(path);
+	safe_free(&path);
+    }
+    if (rs->rs_Error) {
+	FreeResultBuffer(q);
+	rs->rs_Count = 0;
+	rs->rs_Bytes = 0;
+	return(rs->rs_Error);
+    }
+
+    for (row = getHead(&q->q_ResultBuffer); row; row = getListSucc(&q->q_ResultBuffer, &row->rr_Node))
+	bytes += resultRowBytes(row);
+    buf = safe_malloc(bytes);
+
+    while ((row = remHead(&q->q_ResultBuffer)) != NULL) {
+	int32_t v;
+
+	v = row->rr_NumCols;
+	bcopy(&v, buf + off, sizeof(v));
+	off += sizeof(v);
+	v = row->rr_NumSortCols;
+	bcopy(&v, buf + off, sizeof(v));
+	off += sizeof(v);
+	for (i = 0; i < row->rr_NumCols; ++i) {
+	    v = (row->rr_Data[i] == NULL) ? -1 : row->rr_DataLen[i];
+	    bcopy(&v, buf + off, sizeof(v));
+	    off += sizeof(v);
+	    if (v > 0) {
+		bcopy(row->rr_Data[i], buf + off, v);
+		off += v;
+	    }
+	}
+	for (i = 0; i < row->rr_NumSortCols; ++i) {
+	    v = row->rr_SortDataLen[i];
+	    bcopy(&v, buf + off, sizeof(v));
+	    off += sizeof(v);
+	    v = (row->rr_SortData[i] == NULL);
+	    bcopy(&v, buf + off, sizeof(v));
+	    off += sizeof(v);
+	    v = row->rr_SortDataLen[i] & RR_SORTDATALEN_MASK;
+	    if (v > 0) {
+		bcopy(row->rr_SortData[i], buf + off, v);
+		off += v;
+	    }
+	}
+	FreeResultRow(row);
+    }
+    DBASSERT(off <= bytes);
+
+    if (pwrite(rs->rs_Fd, buf, off, rs->rs_FileOff) != off) {
+	failSortRun(rs, DBERR_TABLE_WRITE, "write");
+	free(buf);
+	rs->rs_Count = 0;
+	rs->rs_Bytes = 0;
+	return(rs->rs_Error);
+    }
+    free(buf);
+
+    if (rs->rs_NRuns == rs->rs_MaxRuns) {
+	rs->rs_MaxRuns = rs->rs_MaxRuns ? rs->rs_MaxRuns * 2 : 16;
+	rs->rs_Runs = safe_realloc(rs->rs_Runs,
+				   sizeof(SortRun) * rs->rs_MaxRuns);
+    }
+    run = &rs->rs_Runs[rs->rs_NRuns++];
+    bzero(run, sizeof(SortRun));
+    run->sr_Off = rs->rs_FileOff;
+    run->sr_End = rs->rs_FileOff + off;
+    rs->rs_FileOff += off;
+    rs->rs_Count = 0;
+    rs->rs_Bytes = 0;
+    return(0);
+}
+
+/*
+ * failSortRun() - record a run file error and get rid of the run file
+ *
+ *	The run file was unlinked when it was created so closing it removes
+ *	it.  Only the first error is kept.
+ */
+static void
+failSortRun(ResultSort *rs, int error, const char *what)
+{
+    dbwarning("drd_database: sort file %s failed: %s\n",
+	what, strerror(errno));
+    if (rs->rs_Error == 0)
+	rs->rs_Error = error;
+    if (rs->rs_Fd >= 0) {
+	close(rs->rs_Fd);
+	rs->rs_Fd = -1;
+    }
+}
+
+/*
+ * readSortRun() - read the next row of a run, NULL at the end of the run
+ *
+ *	NULL is also returned with rs_Error set if the run could not be
+ *	read, including a run ending in the middle of a row.
+ */
+static ResultRow *
+readSortRun(ResultSort *rs, SortRun *run)
+{
+    ResultRow *row;
+    int32_t v[2];
+    int r = 0;
+    int i;
+
+    if (readSortRunBytes(rs, run, v, sizeof(v)) < 0)
+	return(NULL);
+
+    row = zalloc(sizeof(ResultRow));
+    initNode(&row->rr_Node);
+    row->rr_NumCols = v[0];
+    row->rr_NumSortCols = v[1];
+    if (row->rr_NumCols) {
+	row->rr_Data = zalloc(sizeof(char *) * row->rr_NumCols);
+	row->rr_DataLen = zalloc(sizeof(int) * row->rr_NumCols);
+    }
+    if (row->rr_NumSortCols) {
+	row->rr_SortData = zalloc(sizeof(char *) * row->rr_NumSortCols);
+	row->rr_SortDataLen = zalloc(sizeof(int) * row->rr_NumSortCols);
+    }
+    for (i = 0; r == 0 && i < row->rr_NumCols; ++i) {
+	if ((r = readSortRunBytes(rs, run, &v[0], sizeof(v[0]))) < 0)
+	    break;
+	if (v[0] < 0)
+	    continue;
+	row->rr_DataLen[i] = v[0];
+	if (v[0] == 0) {
+	    row->rr_Data[i] = "";
+	} else {
+	    row->rr_Data[i] = zalloc(v[0]);
+	    r = readSortRunBytes(rs, run, row->rr_Data[i], v[0]);
+	}
+    }
+    for (i = 0; r == 0 && i < row->rr_NumSortCols; ++i) {
+	int bytes;
+
+	if ((r = readSortRunBytes(rs, run, v, sizeof(v))) < 0)
+	    break;
+	row->rr_SortDataLen[i] = v[0];
+	if (v[1])
+	    continue;
+	bytes = v[0] & RR_SORTDATALEN_MASK;
+	if (bytes == 0) {
+	    row->rr_SortData[i] = "";
+	} else {
+	    row->rr_SortData[i] = zalloc(bytes);
+	    r = readSortRunBytes(rs, run, row->rr_SortData[i], bytes);
+	}
+    }
+
+    /*
+     * A run ending part way through a row is as bad as a failed read.
+     */
+    if (r < 0) {
+	if (rs->rs_Error == 0) {
+	    errno = EIO;
+	    failSortRun(rs, DBERR_TABLE_READ, "read");
+	}
+	FreeResultRow(row);
+	row = NULL;
+    }
+    return(row);
+}
+
+/*
+ * readSortRunBytes() - copy the next bytes of a run
+ *
+ *	Returns -1 at the end of the run or if the run file could not be
+ *	read, in which case rs_Error is set.
+ */
+static int
+readSortRunBytes(ResultSort *rs, SortRun *run, void *buf, int bytes)
+{
+    while (bytes > 0) {
+	int n;
+
+	if (run->sr_BufOff == run->sr_BufLen) {
+	    off_t left = run->sr_End - run->sr_Off;
+
+	    if (left == 0 || rs->rs_Error)
+		return(-1);
+	    n = (left > SORT_RUNBUFSIZE) ? SORT_RUNBUFSIZE : (int)left;
+	    if (pread(rs->rs_Fd, run->sr_Buf, n, run->sr_Off) != n) {
+		failSortRun(rs, DBERR_TABLE_READ, "read");
+		return(-1);
+	    }
+	    run->sr_Off += n;
+	    run->sr_BufOff = 0;
+	    run->sr_BufLen = n;
+	}
+	n = run->sr_BufLen - run->sr_BufOff;
+	if (n > bytes)
+	    n = bytes;
+	bcopy(run->sr_Buf + run->sr_BufOff, buf, n);
+	run->sr_BufOff += n;
+	buf = (char *)buf + n;
+	bytes -= n;
+    }
+    return(0);
+}
+
+/*
+ * resultRowBytes() - size of a row as stored in a run
+ */
+static int
+resultRowBytes(const ResultRow *row)
+{
+    int bytes = sizeof(int32_t) * 2;
+    int i;
+
+    for (i = 0; i < row->rr_NumCols; ++i)
+	bytes += sizeof(int32_t) + row->rr_DataLen[i];
+    for (i = 0; i < row->rr_NumSortCols; ++i) {
+	bytes += sizeof(int32_t) * 2 +
+		 (row->rr_SortDataLen[i] & RR_SORTDATALEN_MASK);
+    }
+    return(bytes);
+}
+
+/*
+ * resultData() - return a result column's data as text
+ *
+ *	Binary data types are formatted into buf and returned through tmp,
+ *	anything else is returned as is.
+ */
+static const ColData *
+resultData(const ColI *ci, const ColData *ccd, ColData *tmp, char *buf)
+{
+    int n;
+
+    if ((n = DataTypeToString(ci->ci_DataType, ccd, buf)) < 0)
+	return(ccd);
+    *tmp = *ccd;
+    tmp->cd_Data = buf;
+    tmp->cd_Bytes = n;
+    return(tmp);
+}
+
+/*
+ * resultSortText() - convert the sort-only columns of a sorted row to
+ *		      text before it is sent.  The display columns already
+ *		      are, see AddSortedResults().
+ */
+static void
+resultSortText(Query *q, ResultRow *row)
+{
+    ColI *ci;
+    int i;
+
+    for (ci = q->q_ColIQSortBase, i = 0; ci != NULL; ci = ci->ci_QSortNext, i++) {
+	int len = row->rr_SortDataLen[i] & RR_SORTDATALEN_MASK;
+	char buf[DATATYPE_FMTSIZE];
+	const ColData *ccd;
+	ColData raw;
+	ColData tmp;
+	char *data;
+
+	if (row->rr_SortDataLen[i] & RR_SORTSHOW_MASK)
+	    continue;
+	bzero(&raw, sizeof(raw));
+	raw.cd_Data = row->rr_SortData[i];
+	raw.cd_Bytes = len;
+	if ((ccd = resultData(ci, &raw, &tmp, buf)) == &raw)
+	    continue;
+	data = zalloc(ccd->cd_Bytes);
+	bcopy(ccd->cd_Data, data, ccd->cd_Bytes);
+	zfree(row->rr_SortData[i], len);
+	row->rr_SortData[i] = data;
+	row->rr_SortDataLen[i] = (row->rr_SortDataLen[i] & ~RR_SORTDATALEN_MASK) | ccd->cd_Bytes;
+    }
+    DBASSERT(i == row->rr_NumSortCols);
+}
+
+/*
+ * heapUp(), heapDown() - maintain a binary heap ordered by cmp, smallest
+ *			  element at heap[0].  cmp is called qsort-style.
+ */
+static void
+heapUp(void **heap, int i, int (*cmp)(const void *, const void *))
+{
+    while (i > 0) {
+	int p = (i - 1) / 2;
+	void *t;
+
+	if (cmp(&heap[i], &heap[p]) >= 0)
+	    break;
+	t = heap[i];
+	heap[i] = heap[p];
+	heap[p] = t;
+	i = p;
+    }
+}
+
+static void
+heapDown(void **heap, int n, int i, int (*cmp)(const void *, const void *))
+{
+    for (;;) {
+	int c = i * 2 + 1;
+	void *t;
+
+	if (c >= n)
+	    break;
+	if (c + 1 < n && cmp(&heap[c + 1], &heap[c]) < 0)
+	    ++c;
+	if (cmp(&heap[c], &heap[i]) >= 0)
+	    break;
+	t = heap[i];
+	heap[i] = heap[c];
+	heap[c] = t;
+	i = c;
+    }
+}
+
 
 /*
  * RSTermRange()
@@ -761,6 +1402,9 @@ RSTermRange(Query *q)
     /*TableI *ti = cd->cd_DSTerm;*/	/* XXX q_TableIQBase */
     CLAnyMsg *msg;
     ColI *ci;
+    const ColData *ccd;
+    ColData tmp;
+    char buf[DATATYPE_FMTSIZE];
     int cols;
     int bytes;
     int off;
@@ -768,15 +1412,9 @@ RSTermRange(Query *q)
     int r = 0;
 
     if (q->q_Flags & QF_WITH_ORDER) {
-	if (q->q_CountRows <= 500) {
-	    AddSortedResults(q);
-	    return(1); 
-	}
-	else if (!listIsEmpty(&q->q_ResultBuffer)) {
-	    r = SendSortedResults(cd, q);
-	    if (r < 0)
-		return(r);
-	}
+	if ((r = AddSortedResults(q)) < 0)
+	    return(r);
+	return(1); 
     }
 
     /*
@@ -787,25 +1425,23 @@ RSTermRange(Query *q)
      *
      * Row data includes selected data and any data required for
      * sorting.  Sorting is a client-side operation, not a server-side
-     * operation.
+     * operation.  Binary data types are sent as text (formatted once
+     * for the size and once more into the message).
      */
     cols = 0;
     bytes = offsetof(CLRowMsg, rm_Offsets[1]);
 
     for (ci = q->q_ColIQBase; ci; ci = ci->ci_QNext) {
-	ColData *ccd = ci->ci_CData;
-
+	ccd = resultData(ci, ci->ci_CData, &tmp, buf);
 	if (ccd->cd_Data)
 	    bytes += ((ccd->cd_Bytes + 1) + 3) & ~3;
 	bytes += sizeof(int);	/* rm_Offsets entry */
 	++cols;
     }
     for (ci = q->q_ColIQSortBase; ci; ci = ci->ci_QSortNext) {
-	ColData *ccd;
-
 	if (ci->ci_Flags & CIF_ORDER)	/* already included */
 	    continue;
-	ccd = ci->ci_CData;
+	ccd = resultData(ci, ci->ci_CData, &tmp, buf);
 	if (ccd->cd_Data)
 	    bytes += ((ccd->cd_Bytes + 1) + 3) & ~3;
 	bytes += sizeof(int);	/* rm_Offsets entry */
@@ -822,8 +1458,7 @@ RSTermRange(Query *q)
     cols = 0;
 
     for (ci = q->q_ColIQBase; ci; ci = ci->ci_QNext) {
-	ColData *ccd = ci->ci_CData;
-
+	ccd = resultData(ci, ci->ci_CData, &tmp, buf);
 	msg->a_RowMsg.rm_Offsets[cols] = off;
 	++cols;
 	if (ccd->cd_Data) {
@@ -839,13 +1474,11 @@ RSTermRange(Query *q)
     msg->a_RowMsg.rm_ShowCount = cols;
 
     for (ci = q->q_ColIQSortBase; ci; ci = ci->ci_QSortNext) {
-	ColData *ccd;
-
 	if (ci->ci_Flags & CIF_ORDER)	/* already included */
 	    continue;
 	msg->a_RowMsg.rm_Offsets[cols] = off;
 	++cols;
-	ccd = ci->ci_CData;
+	ccd = resultData(ci, ci->ci_CData, &tmp, buf);
 	if (ccd->cd_Data) {
 	    bcopy(
 		ccd->cd_Data, 
@@ -912,6 +1545,46 @@ SendResultMessage(CLDataBase *cd, Query *q, CLAnyMsg *msg)
 }
 
 
+/*
+ * ExplainRow() - return one EXPLAIN row to the client
+ *
+ *	Called by ExplainQuery(), built like an RSTermRange() row without
+ *	sort columns.
+ */
+static int
+ExplainRow(void *info, char **data, int cols)
+{
+    Query *q = info;
+    CLDataBase *cd = q->q_TermInfo;
+    CLAnyMsg *msg;
+    int bytes;
+    int off;
+    int i;
+
+    bytes = offsetof(CLRowMsg, rm_Offsets[cols + 1]);
+    for (i = 0; i < cols; ++i) {
+	if (data[i])
+	    bytes += ((strlen(data[i]) + 1) + 3) & ~3;
+    }
+    msg = BuildCLMsg(CLCMD_RESULT, bytes);
+
+    off = offsetof(CLRowMsg, rm_Offsets[cols+1]) -
+	    offsetof(CLRowMsg, rm_Msg.cm_Pkt.cp_Data[0]);
+    for (i = 0; i < cols; ++i) {
+	msg->a_RowMsg.rm_Offsets[i] = off;
+	if (data[i]) {
+	    int len = strlen(data[i]);
+
+	    bcopy(data[i], msg->cma_Pkt.cp_Data + off, len);
+	    off = ((off + len + 1) + 3) & ~3;
+	}
+    }
+    msg->a_RowMsg.rm_Offsets[cols] = off;
+    msg->a_RowMsg.rm_ShowCount = cols;
+    msg->a_RowMsg.rm_Count = cols;
+
+    return(SendResultMessage(cd, q, msg));
+}
 
 static void
 RawScanCallBack(void *vcd, RawData *rd)
@@ -12,6 +12,17 @@
 Prototype void task_main(int ac, char **av);
 
 static void profExit(int sigNo);
+static void IndexerThread(DataBase *db);
+
+/*
+ * Background index maintenance, see IndexerThread().  Updated indexes are
+ * synchronized every INDEXER_SYNC passes.
+ */
+#define INDEXER_SYNC	8
+
+static int IndexerInterval = 1000;	/* ms between passes, 0 disables */
+static int IndexerStop;
+static int IndexerRunning;
 
 /*
  * MainDatabaseSubFork() - 	Subprocess to manage a specific database
@@ -50,6 +61,33 @@ task_main(int ac, char **av)
 	case 'f':
 	    fd = strtol((*ptr ? ptr : av[++i]), NULL, 0);
 	    break;
+	case 'm':
+	    SetDataMapCacheSize(strtoul((*ptr ? ptr : av[++i]), NULL, 0));
+	    break;
+	case 'i':
+	    IndexerInterval = strtol((*ptr ? ptr : av[++i]), NULL, 0);
+	    break;
+	case 's':
+	    /*
+	     * -s bytes or -s table=bytes
+	     */
+	    {
+		char *tabName = NULL;
+		char *eq;
+
+		if (*ptr == 0)
+		    ptr = av[++i];
+		if ((eq = strchr(ptr, '=')) != NULL) {
+		    tabName = ptr;
+		    *eq = 0;
+		    ptr = eq + 1;
+		}
+		SetIndexSlop(tabName, strtol(ptr, NULL, 0));
+	    }
+	    break;
+	case 'p':
+	    SetParallelScan(strtol((*ptr ? ptr : av[++i]), NULL, 0));
+	    break;
 	case 'q':
 	    DebugOpt = 0;
 	    break;
@@ -112,6 +150,14 @@ task_main(int ac, char **av)
     msg->a_HelloMsg.hm_BlockSize = GetSysBlockSize(db);
     WriteCLMsg(cd->cd_Iow, msg, 1);
 
+    /*
+     * Keep the indexes up to date in the background
+     */
+    if (IndexerInterval > 0) {
+	IndexerRunning = 1;
+	taskCreate(IndexerThread, db);
+    }
+
     /*
      * Loop reading commands
      */
@@ -162,10 +208,47 @@ task_main(int ac, char **av)
 	}
     }
     dbinfo("%s Exiting (%s)\n", av[0], cd->cd_DBName);
+    dbinfo("%s buffer cache inhits=%qd hothits=%qd misses=%qd "
+	"ghosthits=%qd evictions=%qd\n",
+	cd->cd_DBName,
+	BCStats.bs_InHits,
+	BCStats.bs_HotHits,
+	BCStats.bs_Misses,
+	BCStats.bs_GhostHits,
+	BCStats.bs_Evictions
+    );
+    IndexerStop = 1;
+    while (IndexerRunning)
+	taskSleep(10);
     CloseDatabase(db, 1);
     CloseCLDataBase(cd);
 }
 
+/*
+ * IndexerThread() -	Background index maintenance
+ *
+ *	Periodically brings the open indexes of the database up to date
+ *	so queries rarely have to index the end of a table themselves.
+ *	Indexes are only synchronized (fsync()'d) every INDEXER_SYNC
+ *	passes, an index left unsynchronized by a crash is regenerated
+ *	on startup.
+ */
+static void
+IndexerThread(DataBase *db)
+{
+    int pass = 0;
+
+    while (IndexerStop == 0) {
+	taskSleep(IndexerInterval);
+	if (IndexerStop)
+	    break;
+	++pass;
+	UpdateDatabaseIndexes(db, (pass % INDEXER_SYNC) ? IUF_NOSYNC : 0);
+    }
+    UpdateDatabaseIndexes(db, 0);
+    IndexerRunning = 0;
+}
+
 void 
 profExit(int sigNo)
 {
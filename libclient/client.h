@@ -33,6 +33,7 @@ typedef struct CLDataBase {
     struct RPSummary *cd_RPSummary;	/* used by replicator */
     struct RPList   *cd_RPList;		/* used by replicator */
     struct DataBase *cd_Db;		/* used by replicator/database.c */
+    struct PrepCache *cd_PrepCache;	/* used by database/instance.c */
     struct TableI   *cd_DSTerm;		/* used by replicator/database.c */
     struct RouteInfo *cd_Route;		/* used by replicator */
     dbstamp_t	    cd_ActiveMinCTs;	/* active MinCTs if in COMMIT1 state */
@@ -84,6 +85,14 @@ typedef struct CLRes {
     int		cr_Error;	/* operating error */
 } CLRes;
 
+/*
+ * CLStmt - A prepared query (see PrepareCLTrans())
+ */
+typedef struct CLStmt {
+    CLDataBase	*cs_Instance;
+    char	*cs_Query;
+} CLStmt;
+
 #define ORDER_STRING_COLMASK	0x000FFFF
 #define ORDER_STRING_FWD	0x0010000
 #define ORDER_STRING_REV	0x0020000
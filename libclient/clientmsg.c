@@ -16,9 +16,15 @@ Export int WriteCLMsg(iofd_t iofd, CLAnyMsg *msg, int flushMe);
 Export void SendCLMsg(iofd_t iofd, CLAnyMsg *msg, iofd_t xfd);
 Export CLAnyMsg *BuildCLMsg(cm_cmd_t cmd, int len);
 Export CLAnyMsg *BuildCLMsgStr(cm_cmd_t cmd, const char *str);
+Export CLAnyMsg *BuildCLMsgData(cm_cmd_t cmd, const void *data, int bytes);
+Export CLAnyMsg *BuildCLParamMsg(cm_cmd_t cmd, const char *qry, const char **params, const int *lens, int nparams);
+Export int DecodeCLParams(const char *data, int bytes, ColData **pparams);
 Export CLAnyMsg *BuildCLHelloMsgStr(const char *str);
 Export void FreeCLMsg(CLAnyMsg *cm);
 
+static void clPutInt32(char *ptr, int32_t v);
+static int32_t clGetInt32(const char *ptr);
+
 static CLAnyMsg *CLFreeMsg;
 
 /*
@@ -341,15 +347,132 @@ BuildCLMsg(cm_cmd_t cmd, int len)
 CLAnyMsg *
 BuildCLMsgStr(cm_cmd_t cmd, const char *str)
 {
-    int len = strlen(str) + 1;
+    return(BuildCLMsgData(cmd, str, strlen(str) + 1));
+}
+
+CLAnyMsg *
+BuildCLMsgData(cm_cmd_t cmd, const void *data, int bytes)
+{
     CLAnyMsg *msg;
 
-    msg = BuildCLMsg(cmd, offsetof(CLMsg, cm_Pkt.cp_Data[len]));
-    bcopy(str, msg->cma_Pkt.cp_Data, len);
+    msg = BuildCLMsg(cmd, offsetof(CLMsg, cm_Pkt.cp_Data[bytes]));
+    bcopy(data, msg->cma_Pkt.cp_Data, bytes);
+
+    return(msg);
+}
+
+/*
+ * BuildCLParamMsg() - build a query message with a parameter block
+ *
+ *	A NULL params[i] is SQL NULL.  If lens is NULL the parameters are
+ *	NUL terminated strings.
+ */
+CLAnyMsg *
+BuildCLParamMsg(cm_cmd_t cmd, const char *qry, const char **params, const int *lens, int nparams)
+{
+    CLAnyMsg *msg;
+    char *ptr;
+    int qlen = strlen(qry) + 1;
+    int bytes = qlen + 4;
+    int i;
 
+    for (i = 0; i < nparams; ++i) {
+	bytes += 4;
+	if (params[i])
+	    bytes += lens ? lens[i] : strlen(params[i]);
+    }
+    msg = BuildCLMsg(cmd, offsetof(CLMsg, cm_Pkt.cp_Data[bytes]));
+    ptr = msg->cma_Pkt.cp_Data;
+    bcopy(qry, ptr, qlen);
+    ptr += qlen;
+    clPutInt32(ptr, nparams);
+    ptr += 4;
+    for (i = 0; i < nparams; ++i) {
+	int len = CLPARAM_NULL;
+
+	if (params[i])
+	    len = lens ? lens[i] : strlen(params[i]);
+	clPutInt32(ptr, len);
+	ptr += 4;
+	if (len > 0) {
+	    bcopy(params[i], ptr, len);
+	    ptr += len;
+	}
+    }
+    DBASSERT(ptr == msg->cma_Pkt.cp_Data + bytes);
     return(msg);
 }
 
+/*
+ * DecodeCLParams() - decode a parameter block
+ *
+ *	data and bytes cover everything following the query's NUL, which
+ *	must be at least CLPARAM_MINSIZE bytes.  *pparams is set to a
+ *	malloc'd array whose entries point into data, the caller free()s
+ *	it.  Returns the number of parameters or DBERR_PARAM_COUNT
+ *	if the block is malformed.
+ */
+int
+DecodeCLParams(const char *data, int bytes, ColData **pparams)
+{
+    ColData *params;
+    int32_t count;
+    int off = 4;
+    int i;
+
+    *pparams = NULL;
+    DBASSERT(bytes >= CLPARAM_MINSIZE);
+    count = clGetInt32(data);
+    if (count < 0 || count > (bytes - off) / 4)
+	return(DBERR_PARAM_COUNT);
+    params = safe_malloc(sizeof(ColData) * (count + 1));
+    bzero(params, sizeof(ColData) * (count + 1));
+    for (i = 0; i < count; ++i) {
+	int32_t len;
+
+	if (bytes - off < 4)
+	    break;
+	len = clGetInt32(data + off);
+	off += 4;
+	if (len == CLPARAM_NULL)
+	    continue;
+	if (len < 0 || len > bytes - off)
+	    break;
+	params[i].cd_Data = data + off;
+	params[i].cd_Bytes = len;
+	off += len;
+    }
+    /*
+     * Only padding may follow the block
+     */
+    if (i != count || bytes - off >= CLPARAM_MINSIZE) {
+	free(params);
+	return(DBERR_PARAM_COUNT);
+    }
+    *pparams = params;
+    return(count);
+}
+
+static void
+clPutInt32(char *ptr, int32_t v)
+{
+    u_int32_t n = (u_int32_t)v;
+
+    ptr[0] = (char)(n >> 24);
+    ptr[1] = (char)(n >> 16);
+    ptr[2] = (char)(n >> 8);
+    ptr[3] = (char)n;
+}
+
+static int32_t
+clGetInt32(const char *ptr)
+{
+    const u_int8_t *p = (const u_int8_t *)ptr;
+
+    return((int32_t)(((u_int32_t)p[0] << 24) | ((u_int32_t)p[1] << 16) |
+		     ((u_int32_t)p[2] << 8) | (u_int32_t)p[3]));
+}
+
 CLAnyMsg *
 BuildCLHelloMsgStr(const char *str)
 {
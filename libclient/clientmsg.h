@@ -227,3 +227,16 @@ typedef union CLAnyMsg {
 #define CLCMD_RESULT_ORDER	0x40	/* a_OrderMsg		*/
 #define CLCMD_RESULT_LIMIT	0x41	/* a_LimitMsg		*/
 
+/*
+ * Prepared statement parameters.  The NUL terminated query text of a
+ * CLCMD_RUN_QUERY_TRAN or CLCMD_REC_QUERY_TRAN may be followed by a
+ * parameter block holding the values of its '?' place holders: an int32
+ * count, then for each parameter an int32 length (CLPARAM_NULL for SQL
+ * NULL) followed by that many bytes of data.  The block is carried as
+ * part of the query text, so unlike the packet header its int32s are
+ * always msb-first.  Fewer than CLPARAM_MINSIZE bytes after the NUL are
+ * padding, not a parameter block.
+ */
+#define CLPARAM_NULL	(-1)
+#define CLPARAM_MINSIZE	4
+
@@ -11,11 +11,13 @@ struct CLDataBase;
 struct CLInstance;
 struct CLRes;
 struct CLRow;
+struct CLStmt;
 
 typedef struct CLDataBase *database_t;
 typedef struct CLInstance *instance_t;
 typedef struct CLRes *res_t;
 typedef struct CLRow *row_t;
+typedef struct CLStmt *stmt_t;
 typedef u_int32_t	cluser_t;
 
 #define CLTYPE_RO	1
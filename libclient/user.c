@@ -23,6 +23,10 @@ Export int Commit1CLTrans(database_t cd, dbstamp_t *minCTs);
 Export int Commit2CLTrans(database_t cd, dbstamp_t cts);
 Export res_t QueryCLTrans(database_t cd, const char *qry, int *perror);
 Export void RecordQueryCLTrans(database_t cd, const char *qry, int *perror);
+Export void RecordQueryCLTransData(database_t cd, const char *data, int bytes, int *perror);
+Export stmt_t PrepareCLTrans(database_t cd, const char *qry, int *perror);
+Export res_t ExecuteCLTrans(database_t cd, stmt_t st, const char **params, const int *lens, int nparams, int *perror);
+Export void FreeCLStmt(stmt_t st);
 Export int ResCount(res_t res);
 Export int ResColumns(res_t res);
 Export void SetCLAuditTrail(database_t cd, cluser_t (*func)(void *info), void *info);
@@ -39,6 +43,7 @@ Prototype tlock_t OCLLock;
 
 static int sayHello(database_t cd, const char *dbName);
 static CLAnyMsg *readCLMsgSkipData(database_t cd);
+static CLRes *runCLQuery(database_t cd, CLAnyMsg *msg, int *perror);
 static CLRow *genRowRecord(CLRes *res, CLAnyMsg *msg, CLRow *row);
 static void sortCLRows(CLRes *res);
 static int sortCLCompare(const void *r1, const void *r2);
@@ -547,7 +552,6 @@ Commit2CLTrans(CLDataBase *cd, dbstamp_t cts)
 CLRes *
 QueryCLTrans(CLDataBase *cd, const char *qry, int *perror)
 {
-    CLRes *res = NULL;
     CLAnyMsg *msg;
 
     DBASSERT(cd->cd_Level != 0);
@@ -561,6 +565,68 @@ QueryCLTrans(CLDataBase *cd, const char *qry, int *perror)
 	LogWrite(DEBUGPRI, "%p %d QUERY %s", cd, cd->cd_Level, qry);
 
     msg = BuildCLMsgStr(CLCMD_RUN_QUERY_TRAN, qry);
+    return(runCLQuery(cd, msg, perror));
+}
+
+/*
+ * PrepareCLTrans() - Prepare a query with '?' parameters
+ *
+ *	Returns a handle for ExecuteCLTrans().  The server keeps the parsed
+ *	and planned query per instance, keyed by its text, so the handle
+ *	is only a copy of the text and may be used at any transaction
+ *	level.  Errors in the query are reported by ExecuteCLTrans().
+ */
+CLStmt *
+PrepareCLTrans(CLDataBase *cd, const char *qry, int *perror)
+{
+    CLStmt *st = zalloc(sizeof(CLStmt));
+
+    *perror = 0;
+    st->cs_Instance = cd;
+    st->cs_Query = safe_strdup(qry);
+    return(st);
+}
+
+/*
+ * ExecuteCLTrans() - Execute a prepared query, return results
+ *
+ *	params[] holds the nparams values for the query's '?' place holders
+ *	in order, a NULL entry binds SQL NULL.  If lens is NULL the values
+ *	are NUL terminated strings.  Otherwise as per QueryCLTrans().
+ */
+CLRes *
+ExecuteCLTrans(CLDataBase *cd, CLStmt *st, const char **params, const int *lens, int nparams, int *perror)
+{
+    CLAnyMsg *msg;
+
+    DBASSERT(cd->cd_Level != 0);
+    DBASSERT(st->cs_Instance == cd);
+
+    *perror = -1;
+
+    if (DebugOpt)
+	LogWrite(DEBUGPRI, "%p %d EXECUTE %s (%d)", cd, cd->cd_Level, st->cs_Query, nparams);
+
+    msg = BuildCLParamMsg(CLCMD_RUN_QUERY_TRAN, st->cs_Query,
+			params, lens, nparams);
+    return(runCLQuery(cd, msg, perror));
+}
+
+void
+FreeCLStmt(CLStmt *st)
+{
+    safe_free(&st->cs_Query);
+    zfree(st, sizeof(CLStmt));
+}
+
+/*
+ * runCLQuery() - Send a query message and collect the results
+ */
+static CLRes *
+runCLQuery(CLDataBase *cd, CLAnyMsg *msg, int *perror)
+{
+    CLRes *res = NULL;
+
     WriteCLMsg(cd->cd_Iow, msg, 1);
 
     while ((msg = readCLMsgSkipData(cd)) != NULL) {
@@ -815,6 +881,18 @@ sortCLCompare(const void *vr1, const void *vr2)
 
 void
 RecordQueryCLTrans(CLDataBase *cd, const char *qry, int *perror)
+{
+    RecordQueryCLTransData(cd, qry, strlen(qry) + 1, perror);
+}
+
+/*
+ * RecordQueryCLTransData() - Record a query given as raw message data
+ *
+ *	The data is the query text including its NUL and any parameter
+ *	block (see clientmsg.h).  Used to pass recorded queries through.
+ */
+void
+RecordQueryCLTransData(CLDataBase *cd, const char *data, int bytes, int *perror)
 {
     CLAnyMsg *msg;
 
@@ -822,7 +900,7 @@ RecordQueryCLTrans(CLDataBase *cd, const char *qry, int *perror)
 
     *perror = -1;
 
-    msg = BuildCLMsgStr(CLCMD_REC_QUERY_TRAN, qry);
+    msg = BuildCLMsgData(CLCMD_REC_QUERY_TRAN, data, bytes);
     WriteCLMsg(cd->cd_Iow, msg, 0);
 }
 
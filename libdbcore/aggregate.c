@@ -0,0 +1,599 @@
+/*
+ * LIBDBCORE/AGGREGATE.C	- Hash aggregation terminator (GROUP BY)
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	The parser registers aggregates and GROUP BY columns with
+ *	AddAggregate() and AddAggregateGroup().  TermRange() folds each
+ *	record into its group with TermRangeAggregate() and RunQuery()
+ *	returns the groups with EmitAggregates().  See aggregate.h.
+ */
+
+#include "defs.h"
+#include "aggregate.h"
+
+Prototype int AggregateLookup(const char *name, int len);
+Prototype int AddAggregate(Query *q, int func, ColI *ci);
+Prototype int AddAggregateGroup(Query *q, ColI *ci);
+Prototype int CheckAggregate(Query *q);
+Prototype int TermRangeAggregate(Query *q);
+Prototype int EmitAggregates(Query *q, int r, int (*func)(Query *q));
+Prototype void FreeAggregate(Query *q);
+
+static Aggregate *aggGet(Query *q);
+static int aggGrouped(Aggregate *ag, ColI *ci);
+static AggGroup *aggGroup(Aggregate *ag);
+static int aggGroupKey(Aggregate *ag);
+static void aggGrow(Aggregate *ag);
+static void aggAccumulate(AggFunc *af, AggAcc *aa);
+static void aggResult(AggFunc *af, AggAcc *aa);
+static int aggCompare(AggFunc *af, const ColData *cd, const AggAcc *aa);
+static int aggNumber(const ColData *cd, int dataType, int64_t *pi, double *pd);
+static void aggFreeGroups(Aggregate *ag);
+
+static const struct {
+    const char	*an_Name;
+    int		an_Func;
+} AggNames[] = {
+    { "count",	AGG_COUNT },
+    { "sum",	AGG_SUM },
+    { "min",	AGG_MIN },
+    { "max",	AGG_MAX },
+    { "avg",	AGG_AVG }
+};
+
+/*
+ * AggregateLookup() - map an aggregate function name to AGG_*
+ *
+ *	Returns 0 if the name is not an aggregate function.
+ */
+int
+AggregateLookup(const char *name, int len)
+{
+    int i;
+
+    for (i = 0; i < arysize(AggNames); ++i) {
+	if (strlen(AggNames[i].an_Name) == len &&
+	    strncasecmp(name, AggNames[i].an_Name, len) == 0
+	) {
+	    return(AggNames[i].an_Func);
+	}
+    }
+    return(0);
+}
+
+/*
+ * AddAggregate() - add an aggregate to the query's result columns
+ *
+ *	ci is the column aggregated, NULL for COUNT(*).  The result column
+ *	is named after the function, e.g. sum(price).
+ */
+int
+AddAggregate(Query *q, int func, ColI *ci)
+{
+    Aggregate *ag = aggGet(q);
+    AggFunc *af;
+    ColI *oci;
+    const char *fname = "count";
+    char *name = NULL;
+    int dataType = DATATYPE_STRING;
+    int len;
+    int i;
+
+    for (i = 0; i < arysize(AggNames); ++i) {
+	if (AggNames[i].an_Func == func)
+	    fname = AggNames[i].an_Name;
+    }
+    if (ci)
+	safe_asprintf(&name, "%s(%.*s)", fname, ci->ci_ColNameLen, ci->ci_ColName);
+    else
+	safe_asprintf(&name, "%s(*)", fname);
+    len = strlen(name);
+
+    /*
+     * MIN and MAX return a value of the column, the other functions
+     * return numbers as text.
+     */
+    if (ci && (func == AGG_MIN || func == AGG_MAX))
+	dataType = ci->ci_DataType;
+
+    af = zalloc(sizeof(AggFunc));
+    af->af_Func = func;
+    af->af_ColI = ci;
+    af->af_Index = ag->ag_NFuncs++;
+    *ag->ag_FuncApp = af;
+    ag->ag_FuncApp = &af->af_Next;
+
+    oci = zalloc(sizeof(ColI) + len + 1);
+    oci->ci_Size = sizeof(ColI) + len + 1;
+    oci->ci_ColName = (char *)(oci + 1);
+    oci->ci_ColNameLen = len;
+    bcopy(name, oci->ci_ColName, len);
+    oci->ci_TableI = ci ? ci->ci_TableI : q->q_TableIQBase;
+    oci->ci_DataType = dataType;
+    oci->ci_Flags = CIF_ORDER;
+    oci->ci_CData = &af->af_OutData;
+    af->af_OutData.cd_DataType = dataType;
+    af->af_OutColI = oci;
+    safe_free(&name);
+
+    *q->q_ColIQAppend = oci;
+    q->q_ColIQAppend = &oci->ci_QNext;
+    oci->ci_OrderIndex = q->q_OrderCount;
+    ++q->q_OrderCount;
+    return(0);
+}
+
+/*
+ * AddAggregateGroup() - add a GROUP BY column
+ *
+ *	Returns -1 if the column is already a GROUP BY column.
+ */
+int
+AddAggregateGroup(Query *q, ColI *ci)
+{
+    Aggregate *ag = aggGet(q);
+
+    if (aggGrouped(ag, ci))
+	return(-1);
+    ag->ag_GroupCols = safe_realloc(ag->ag_GroupCols,
+			    sizeof(ColI *) * (ag->ag_NGroupCols + 1));
+    ag->ag_GroupCols[ag->ag_NGroupCols++] = ci;
+    return(0);
+}
+
+/*
+ * CheckAggregate() - check the columns of an aggregate query
+ *
+ *	Selected and ORDER BY columns must be GROUP BY columns.  Returns -1
+ *	if one is not.
+ */
+int
+CheckAggregate(Query *q)
+{
+    Aggregate *ag = q->q_Agg;
+    AggFunc *af;
+    ColI *ci;
+
+    for (ci = q->q_ColIQBase; ci; ci = ci->ci_QNext) {
+	for (af = ag->ag_Funcs; af; af = af->af_Next) {
+	    if (af->af_OutColI == ci)
+		break;
+	}
+	if (af == NULL && aggGrouped(ag, ci) == 0)
+	    return(-1);
+    }
+    for (ci = q->q_ColIQSortBase; ci; ci = ci->ci_QSortNext) {
+	if (aggGrouped(ag, ci) == 0)
+	    return(-1);
+    }
+    return(0);
+}
+
+/*
+ * TermRangeAggregate() - fold the current record into its group
+ */
+int
+TermRangeAggregate(Query *q)
+{
+    Aggregate *ag = q->q_Agg;
+    AggGroup *gr = aggGroup(ag);
+    AggFunc *af;
+
+    for (af = ag->ag_Funcs; af; af = af->af_Next)
+	aggAccumulate(af, &gr->gr_Acc[af->af_Index]);
+    return(0);
+}
+
+/*
+ * EmitAggregates() - return the groups once the scan is done
+ *
+ *	r is the result of the scan, the groups are returned through func
+ *	(the selection terminator) if it succeeded.  Returns the sum of
+ *	func's returns or a negative error code.  The groups are thrown
+ *	away either way.
+ */
+int
+EmitAggregates(Query *q, int r, int (*func)(Query *q))
+{
+    Aggregate *ag = q->q_Agg;
+    AggGroup *gr;
+    AggFunc *af;
+    int i;
+
+    if (r >= 0 && ag->ag_First == NULL && ag->ag_NGroupCols == 0)
+	aggGroup(ag);
+
+    for (gr = ag->ag_First; r >= 0 && gr; gr = gr->gr_Next) {
+	const char *ptr = gr->gr_Key;
+	int rv;
+
+	for (i = 0; i < ag->ag_NGroupCols; ++i) {
+	    ColData *cd = ag->ag_GroupCols[i]->ci_CData;
+	    int bytes;
+
+	    bcopy(ptr, &bytes, sizeof(bytes));
+	    ptr += sizeof(bytes);
+	    if (bytes < 0) {
+		cd->cd_Data = NULL;
+		cd->cd_Bytes = 0;
+	    } else {
+		cd->cd_Data = ptr;
+		cd->cd_Bytes = bytes;
+		ptr += bytes;
+	    }
+	}
+	for (af = ag->ag_Funcs; af; af = af->af_Next)
+	    aggResult(af, &gr->gr_Acc[af->af_Index]);
+	if ((rv = func(q)) < 0)
+	    r = rv;
+	else
+	    r += rv;
+    }
+
+    for (i = 0; i < ag->ag_NGroupCols; ++i) {
+	ColData *cd = ag->ag_GroupCols[i]->ci_CData;
+
+	cd->cd_Data = NULL;
+	cd->cd_Bytes = 0;
+    }
+    aggFreeGroups(ag);
+    return(r);
+}
+
+/*
+ * FreeAggregate() - free a query's aggregation state
+ *
+ *	Called from ResetQuery().  The result columns are owned by the
+ *	Aggregate, the GROUP BY columns by their table instances.
+ */
+void
+FreeAggregate(Query *q)
+{
+    Aggregate *ag;
+    AggFunc *af;
+
+    if ((ag = q->q_Agg) == NULL)
+	return;
+    q->q_Agg = NULL;
+    aggFreeGroups(ag);
+    while ((af = ag->ag_Funcs) != NULL) {
+	ag->ag_Funcs = af->af_Next;
+	zfree(af->af_OutColI, af->af_OutColI->ci_Size);
+	zfree(af, sizeof(AggFunc));
+    }
+    safe_free((char **)&ag->ag_GroupCols);
+    safe_free(&ag->ag_KeyBuf);
+    zfree(ag, sizeof(Aggregate));
+}
+
+static Aggregate *
+aggGet(Query *q)
+{
+    Aggregate *ag;
+
+    if ((ag = q->q_Agg) == NULL) {
+	ag = zalloc(sizeof(Aggregate));
+	ag->ag_FuncApp = &ag->ag_Funcs;
+	ag->ag_App = &ag->ag_First;
+	q->q_Agg = ag;
+    }
+    return(ag);
+}
+
+static int
+aggGrouped(Aggregate *ag, ColI *ci)
+{
+    int i;
+
+    for (i = 0; i < ag->ag_NGroupCols; ++i) {
+	if (ag->ag_GroupCols[i] == ci)
+	    return(1);
+    }
+    return(0);
+}
+
+/*
+ * aggGroup() - locate or create the current record's group
+ */
+static AggGroup *
+aggGroup(Aggregate *ag)
+{
+    AggGroup *gr;
+    u_int32_t hv = 2166136261U;
+    int bytes;
+    int i;
+
+    bytes = aggGroupKey(ag);
+    for (i = 0; i < bytes; ++i)
+	hv = (hv ^ (u_int8_t)ag->ag_KeyBuf[i]) * 16777619U;
+
+    if (ag->ag_Buckets == NULL) {
+	ag->ag_Mask = AGG_MINBUCKETS - 1;
+	ag->ag_Buckets = zalloc(sizeof(AggGroup *) * AGG_MINBUCKETS);
+    }
+    for (gr = ag->ag_Buckets[hv & ag->ag_Mask]; gr; gr = gr->gr_HNext) {
+	if (gr->gr_Hv == hv && gr->gr_KeyBytes == bytes &&
+	    bcmp(gr->gr_Key, ag->ag_KeyBuf, bytes) == 0
+	) {
+	    return(gr);
+	}
+    }
+
+    gr = zalloc(offsetof(AggGroup, gr_Acc[ag->ag_NFuncs]));
+    gr->gr_Hv = hv;
+    gr->gr_KeyBytes = bytes;
+    gr->gr_Key = safe_malloc(bytes + 1);
+    bcopy(ag->ag_KeyBuf, gr->gr_Key, bytes);
+    gr->gr_HNext = ag->ag_Buckets[hv & ag->ag_Mask];
+    ag->ag_Buckets[hv & ag->ag_Mask] = gr;
+    *ag->ag_App = gr;
+    ag->ag_App = &gr->gr_Next;
+    if (++ag->ag_Count > (ag->ag_Mask + 1) * 2)
+	aggGrow(ag);
+    return(gr);
+}
+
+/*
+ * aggGroupKey() - build the current record's group key in ag_KeyBuf
+ *
+ *	For each GROUP BY column the length of the value (-1 for NULL)
+ *	followed by the value.  Returns the length of the key.
+ */
+static int
+aggGroupKey(Aggregate *ag)
+{
+    int bytes = 0;
+    int i;
+
+    for (i = 0; i < ag->ag_NGroupCols; ++i) {
+	const ColData *cd = ag->ag_GroupCols[i]->ci_CData;
+	int len = cd->cd_Data ? cd->cd_Bytes : -1;
+	int need = bytes + sizeof(len) + ((len > 0) ? len : 0);
+
+	if (need > ag->ag_KeySize) {
+	    ag->ag_KeySize = (need + 255) & ~255;
+	    ag->ag_KeyBuf = safe_realloc(ag->ag_KeyBuf, ag->ag_KeySize);
+	}
+	bcopy(&len, ag->ag_KeyBuf + bytes, sizeof(len));
+	bytes += sizeof(len);
+	if (len > 0) {
+	    bcopy(cd->cd_Data, ag->ag_KeyBuf + bytes, len);
+	    bytes += len;
+	}
+    }
+    return(bytes);
+}
+
+static void
+aggGrow(Aggregate *ag)
+{
+    int n = (ag->ag_Mask + 1) * 2;
+    AggGroup *gr;
+
+    zfree(ag->ag_Buckets, sizeof(AggGroup *) * (ag->ag_Mask + 1));
+    ag->ag_Buckets = zalloc(sizeof(AggGroup *) * n);
+    ag->ag_Mask = n - 1;
+    for (gr = ag->ag_First; gr; gr = gr->gr_Next) {
+	gr->gr_HNext = ag->ag_Buckets[gr->gr_Hv & ag->ag_Mask];
+	ag->ag_Buckets[gr->gr_Hv & ag->ag_Mask] = gr;
+    }
+}
+
+/*
+ * aggAccumulate() - fold the current record into an accumulator
+ */
+static void
+aggAccumulate(AggFunc *af, AggAcc *aa)
+{
+    const ColData *cd;
+    int64_t iv;
+    double dv;
+
+    if (af->af_Func == AGG_COUNTSTAR) {
+	++aa->aa_Count;
+	return;
+    }
+    cd = af->af_ColI->ci_CData;
+    if (cd->cd_Data == NULL)
+	return;
+
+    switch(af->af_Func) {
+    case AGG_COUNT:
+	++aa->aa_Count;
+	break;
+    case AGG_SUM:
+    case AGG_AVG:
+	switch(aggNumber(cd, af->af_ColI->ci_DataType, &iv, &dv)) {
+	case 1:
+	    if ((iv > 0 && aa->aa_ISum > AGG_INT64_MAX - iv) ||
+		(iv < 0 && aa->aa_ISum < AGG_INT64_MIN - iv)
+	    ) {
+		aa->aa_Flags |= AAF_REAL;
+	    } else {
+		aa->aa_ISum += iv;
+	    }
+	    break;
+	case 2:
+	    aa->aa_Flags |= AAF_REAL;
+	    break;
+	default:
+	    return;
+	}
+	aa->aa_DSum += dv;
+	++aa->aa_Count;
+	break;
+    case AGG_MIN:
+    case AGG_MAX:
+	if ((aa->aa_Flags & AAF_SET) == 0 ||
+	    (af->af_Func == AGG_MIN && aggCompare(af, cd, aa) < 0) ||
+	    (af->af_Func == AGG_MAX && aggCompare(af, cd, aa) > 0)
+	) {
+	    safe_free(&aa->aa_Data);
+	    aa->aa_Data = safe_malloc(cd->cd_Bytes + 1);
+	    bcopy(cd->cd_Data, aa->aa_Data, cd->cd_Bytes);
+	    aa->aa_Bytes = cd->cd_Bytes;
+	    aa->aa_Flags |= AAF_SET;
+	}
+	++aa->aa_Count;
+	break;
+    }
+}
+
+/*
+ * aggResult() - set an aggregate's result column from a group
+ */
+static void
+aggResult(AggFunc *af, AggAcc *aa)
+{
+    ColData *cd = &af->af_OutData;
+
+    cd->cd_Data = NULL;
+    cd->cd_Bytes = 0;
+
+    switch(af->af_Func) {
+    case AGG_COUNTSTAR:
+    case AGG_COUNT:
+	snprintf(af->af_Buf, sizeof(af->af_Buf), "%lld",
+	    (long long)aa->aa_Count);
+	break;
+    case AGG_SUM:
+	if (aa->aa_Count == 0)
+	    return;
+	if (aa->aa_Flags & AAF_REAL) {
+	    snprintf(af->af_Buf, sizeof(af->af_Buf), "%.15g", aa->aa_DSum);
+	} else {
+	    snprintf(af->af_Buf, sizeof(af->af_Buf), "%lld",
+		(long long)aa->aa_ISum);
+	}
+	break;
+    case AGG_AVG:
+	if (aa->aa_Count == 0)
+	    return;
+	snprintf(af->af_Buf, sizeof(af->af_Buf), "%.15g",
+	    aa->aa_DSum / (double)aa->aa_Count);
+	break;
+    case AGG_MIN:
+    case AGG_MAX:
+	if (aa->aa_Flags & AAF_SET) {
+	    cd->cd_Data = aa->aa_Data;
+	    cd->cd_Bytes = aa->aa_Bytes;
+	}
+	return;
+    }
+    cd->cd_Data = af->af_Buf;
+    cd->cd_Bytes = strlen(af->af_Buf);
+}
+
+/*
+ * aggCompare() - compare a value against the MIN/MAX so far
+ *
+ *	Returns < 0, 0 or > 0 as the value is less than, equal to or
+ *	greater than the accumulator's.
+ */
+static int
+aggCompare(AggFunc *af, const ColData *cd, const AggAcc *aa)
+{
+    int dataType = af->af_ColI->ci_DataType;
+    dataop_func_t *opary;
+    ColData cur;
+    int64_t i1;
+    int64_t i2;
+    double d1;
+    double d2;
+
+    bzero(&cur, sizeof(cur));
+    cur.cd_Data = aa->aa_Data;
+    cur.cd_Bytes = aa->aa_Bytes;
+    cur.cd_DataType = dataType;
+
+    /*
+     * Binary data types are ordered by their data type's operators.
+     */
+    if (!DATATYPE_BINARY(dataType) &&
+	aggNumber(cd, dataType, &i1, &d1) &&
+	aggNumber(&cur, dataType, &i2, &d2)
+    ) {
+	if (d1 < d2)
+	    return(-1);
+	if (d1 > d2)
+	    return(1);
+	return(0);
+    }
+    opary = DataTypeFuncAry[dataType];
+    if (opary[DATAOP_LT](cd, &cur) > 0)
+	return(-1);
+    if (opary[DATAOP_GT](cd, &cur) > 0)
+	return(1);
+    return(0);
+}
+
+/*
+ * aggNumber() - interpret a value as a number
+ *
+ *	Returns 1 for an integer (*pi and *pd set), 2 for any other number
+ *	(*pd set), 0 if the value is not a number.  Strings are parsed,
+ *	the binary numeric types are decoded.  A TIMESTAMP is not a number.
+ */
+static int
+aggNumber(const ColData *cd, int dataType, int64_t *pi, double *pd)
+{
+    int bytes = cd->cd_Bytes;
+    char buf[64];
+    char *end;
+
+    if (DATATYPE_BINARY(dataType)) {
+	if (bytes != DATATYPE_BINSIZE)
+	    return(0);
+	switch(dataType) {
+	case DATATYPE_INT:
+	    *pi = BinToInt64(cd->cd_Data);
+	    *pd = (double)*pi;
+	    return(1);
+	case DATATYPE_DOUBLE:
+	    *pd = BinToDouble(cd->cd_Data);
+	    return(2);
+	case DATATYPE_DECIMAL:
+	    *pd = (double)BinToInt64(cd->cd_Data) / DATATYPE_DECUNIT;
+	    return(2);
+	}
+	return(0);
+    }
+    if (bytes == 0 || bytes >= sizeof(buf))
+	return(0);
+    bcopy(cd->cd_Data, buf, bytes);
+    buf[bytes] = 0;
+
+    errno = 0;
+    *pi = strtoll(buf, &end, 10);
+    if (*end == 0 && end != buf && errno == 0) {
+	*pd = (double)*pi;
+	return(1);
+    }
+    *pd = strtod(buf, &end);
+    if (*end == 0 && end != buf)
+	return(2);
+    return(0);
+}
+
+static void
+aggFreeGroups(Aggregate *ag)
+{
+    AggGroup *gr;
+    int i;
+
+    while ((gr = ag->ag_First) != NULL) {
+	ag->ag_First = gr->gr_Next;
+	for (i = 0; i < ag->ag_NFuncs; ++i)
+	    safe_free(&gr->gr_Acc[i].aa_Data);
+	safe_free(&gr->gr_Key);
+	zfree(gr, offsetof(AggGroup, gr_Acc[ag->ag_NFuncs]));
+    }
+    ag->ag_App = &ag->ag_First;
+    ag->ag_Count = 0;
+    if (ag->ag_Buckets) {
+	zfree(ag->ag_Buckets, sizeof(AggGroup *) * (ag->ag_Mask + 1));
+	ag->ag_Buckets = NULL;
+    }
+}
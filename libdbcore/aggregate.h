@@ -0,0 +1,90 @@
+/*
+ * LIBDBCORE/AGGREGATE.H	- Aggregate functions and GROUP BY
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ * Notes on aggregation:
+ *
+ *	A SELECT may list COUNT(*), COUNT(col), SUM(col), MIN(col),
+ *	MAX(col) and AVG(col) and may group its records with GROUP BY.
+ *	Every other selected (or ORDER BY) column must be a GROUP BY
+ *	column.  Such a query hangs an Aggregate off q_Agg.
+ *
+ *	TermRange() hands each record of the query to TermRangeAggregate()
+ *	instead of the terminator function.  The record's GROUP BY values
+ *	are hashed and the record is folded into its group's accumulators.
+ *	Once the scan is done EmitAggregates() runs the normal selection
+ *	terminator once per group, in the order the groups were first
+ *	seen, so ORDER BY and LIMIT apply to groups.  The GROUP BY
+ *	columns' ColData are pointed at the group's values for the call
+ *	and each aggregate is a result column of its own (af_OutColI)
+ *	with its value in af_OutData.  Without GROUP BY there is exactly
+ *	one group, even if no record was found.
+ *
+ *	SUM and AVG ignore values which are not numbers, SUM stays an
+ *	integer for as long as every value is one.  String values are
+ *	parsed, INT, DOUBLE and DECIMAL values are decoded (a TIMESTAMP is
+ *	not a number).  MIN and MAX return a value of the column's data
+ *	type.  They compare strings numerically when both are numbers and
+ *	use the column's data type otherwise.  NULLs are ignored except
+ *	by COUNT(*), an aggregate over no values is NULL (0 for COUNT).
+ */
+
+#define AGG_COUNTSTAR	1
+#define AGG_COUNT	2
+#define AGG_SUM		3
+#define AGG_MIN		4
+#define AGG_MAX		5
+#define AGG_AVG		6
+
+#define AGG_MINBUCKETS	256
+#define AGG_NUMSIZE	32		/* formatted COUNT/SUM/AVG */
+#define AGG_INT64_MAX	((int64_t)0x7FFFFFFFFFFFFFFFLL)
+#define AGG_INT64_MIN	(-AGG_INT64_MAX - 1)
+
+typedef struct AggFunc {
+    struct AggFunc *af_Next;	/* in selection order */
+    int		af_Func;	/* AGG_* */
+    int		af_Index;	/* accumulator index in groups */
+    ColI	*af_ColI;	/* column aggregated, NULL for COUNT(*) */
+    ColI	*af_OutColI;	/* result column (in q_ColIQBase) */
+    ColData	af_OutData;	/* af_OutColI->ci_CData */
+    char	af_Buf[AGG_NUMSIZE];
+} AggFunc;
+
+typedef struct AggAcc {
+    int64_t	aa_Count;	/* values (records for COUNT(*)) */
+    int64_t	aa_ISum;	/* SUM while every value is an integer */
+    double	aa_DSum;
+    int		aa_Flags;	/* AAF_* */
+    int		aa_Bytes;	/* MIN/MAX value */
+    char	*aa_Data;
+} AggAcc;
+
+#define AAF_REAL	0x0001	/* SUM saw a non-integer, use aa_DSum */
+#define AAF_SET		0x0002	/* MIN/MAX has a value */
+
+typedef struct AggGroup {
+    struct AggGroup *gr_HNext;	/* hash chain */
+    struct AggGroup *gr_Next;	/* in order of creation */
+    u_int32_t	gr_Hv;
+    int		gr_KeyBytes;
+    char	*gr_Key;	/* GROUP BY values, see aggGroupKey() */
+    AggAcc	gr_Acc[1];	/* extended, one per AggFunc */
+} AggGroup;
+
+typedef struct Aggregate {
+    AggFunc	*ag_Funcs;
+    AggFunc	**ag_FuncApp;
+    int		ag_NFuncs;
+    int		ag_NGroupCols;
+    ColI	**ag_GroupCols;	/* GROUP BY columns */
+    int		ag_Mask;	/* buckets - 1 */
+    int		ag_Count;	/* groups */
+    AggGroup	**ag_Buckets;
+    AggGroup	*ag_First;	/* in order of creation */
+    AggGroup	**ag_App;
+    int		ag_KeySize;	/* allocated size of ag_KeyBuf */
+    char	*ag_KeyBuf;
+} Aggregate;
@@ -0,0 +1,425 @@
+/*
+ * LIBDBCORE/BATCH.C	- Evaluate a table instance's ranges a batch at a time
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	DefaultIndexScanRangeOp1() hands the record pass of an unindexed
+ *	scan to BatchScanRange().  If every range remaining in the chain
+ *	is a constant restriction on the same table instance, the records
+ *	are located a block at a time and the ranges are evaluated over
+ *	column vectors.  See batch.h.
+ */
+
+#include "defs.h"
+#include "batch.h"
+
+Prototype int BatchScanRange(Range *r, int *pcount);
+Prototype struct BatchScan *BatchScanOpen(Range *r);
+Prototype void BatchScanNext(struct BatchScan *bs, Range *r, DataMap **pdm);
+Prototype int BatchRunRecord(struct BatchScan *bs, Range *r, int sel);
+Prototype void BatchScanClose(struct BatchScan *bs);
+
+static Range *batchUsable(Range *r, BatchScan *bs);
+static int batchAddCol(BatchScan *bs, const ColData *cd);
+static void batchDecode(BatchScan *bs, int i, const RecHead *rh);
+static void batchFilter(BatchScan *bs, Range *r, u_int32_t *map);
+
+/*
+ * BatchScanRange() - run the record pass of DefaultIndexScanRangeOp1()
+ *
+ *	Returns -1 if the caller must scan the records itself, otherwise
+ *	the range has been run and its result is stored in *pcount.  The
+ *	caller has already collected the deletions and restores
+ *	ti_RanBeg afterwords.
+ */
+int
+BatchScanRange(Range *r, int *pcount)
+{
+    TableI *ti = r->r_TableI;
+    RawData *rd = ti->ti_RData;
+    DataMap *dm = NULL;
+    BatchScan *bs;
+    int count;
+    int rv;
+
+    if ((bs = BatchScanOpen(r)) == NULL)
+	return(-1);
+
+    count = 0;
+    rv = 0;
+    SelectBegTableRec(ti, 0);
+
+    while (ti->ti_RanBeg.p_Ro > 0) {
+	dbpos_t next;
+	int i;
+
+	/*
+	 * cooperative multitasking
+	 */
+	taskQuantum();
+
+	BatchScanNext(bs, r, &dm);
+	next = ti->ti_RanBeg;
+
+	for (i = 0; i < bs->bs_NRecs; ++i) {
+	    if (BATCH_TEST(bs->bs_Pass, i) == 0)
+		continue;
+	    ti->ti_RanBeg.p_Ro = bs->bs_Ro[i];
+	    rd->rd_Rh = bs->bs_Rh[i];
+	    rv = BatchRunRecord(bs, r, BATCH_TEST(bs->bs_Sel, i) != 0);
+	    if (rv < 0)
+		break;
+	    count += rv;
+	}
+
+	ti->ti_RanBeg = next;
+	if (rv < 0) {
+	    count = rv;
+	    break;
+	}
+    }
+
+    if (dm)
+	dm->dm_Table->ta_RelDataMap(&dm, 0);
+    if (rd->rd_Map)
+	rd->rd_Map->dm_Table->ta_RelDataMap(&rd->rd_Map, 0);
+    BatchScanClose(bs);
+    *pcount = count;
+    return(0);
+}
+
+/*
+ * BatchScanOpen() - set up a batched scan of r, or return NULL
+ *
+ *	The scan must be the unrestricted record pass of an unindexed
+ *	table (ti_ScanOneOnly 0) and the range chain must qualify, see
+ *	batchUsable().
+ */
+BatchScan *
+BatchScanOpen(Range *r)
+{
+    TableI *ti = r->r_TableI;
+    BatchScan *bs;
+
+    if (ti->ti_ScanOneOnly != 0 ||
+	ti->ti_ScanRangeOp != DefaultIndexScanRangeOp1 ||
+	(r->r_Type & ROPF_CONST) == 0 ||
+	(r->r_Flags & RF_FORCESAVE)
+    ) {
+	return(NULL);
+    }
+
+    /*
+     * UPDATE and CLONE read every record with RDF_ALLOC so the
+     * unmentioned columns are known, leave those alone.
+     */
+    if (ti->ti_Query && (ti->ti_Query->q_TermOp == QOP_UPDATE ||
+	ti->ti_Query->q_TermOp == QOP_CLONE))
+	return(NULL);
+
+    bs = safe_malloc(sizeof(BatchScan));
+    bs->bs_NCols = 0;
+    bs->bs_NRecs = 0;
+    if ((bs->bs_Last = batchUsable(r, bs)) == NULL) {
+	free(bs);
+	return(NULL);
+    }
+    return(bs);
+}
+
+void
+BatchScanClose(BatchScan *bs)
+{
+    free(bs);
+}
+
+/*
+ * BatchScanNext() - load and evaluate the next batch of records
+ *
+ *	ti_RanBeg must be positioned on a record.  The valid records
+ *	following it in its block are located and the columns the ranges
+ *	test are pulled out of them.  ti_RanBeg is left positioned on the
+ *	first record of the next batch (p_Ro is -1 at the end of the range).
+ *
+ *	bs_Pass is set for the records satisfying r and bs_Sel for the
+ *	records also satisfying every later range.  The caller's *pdm
+ *	holds the block, bs_Rh[] remains valid until the next call.  The
+ *	terminator may move rd_Map around so we do not rely on it.
+ */
+void
+BatchScanNext(BatchScan *bs, Range *r, DataMap **pdm)
+{
+    TableI *ti = r->r_TableI;
+    Table *tab = ti->ti_RanBeg.p_Tab;
+    int blockSize = tab->ta_Meta->tf_BlockSize;
+    const char *blk;
+    dbpos_t bpos;
+    dboff_t ro;
+    Range *nr;
+    int i;
+
+    bpos = ti->ti_RanBeg;
+    bpos.p_Ro &= ~(dboff_t)(blockSize - 1);
+    blk = (const char *)tab->ta_GetDataMap(&bpos, pdm, blockSize);
+    DBASSERT(((const BlockHead *)blk)->bh_Magic == BH_MAGIC);
+
+    bs->bs_NRecs = 0;
+    ro = ti->ti_RanBeg.p_Ro;
+
+    for (;;) {
+	const RecHead *rh = (const RecHead *)(blk + (ro - bpos.p_Ro));
+	dboff_t nro;
+
+	DBASSERT(RH_ISRECORD(rh));
+	++ti->ti_DebugScanCount;
+
+	ti->ti_RData->rd_Rh = rh;
+	if (RecordIsValid(ti) >= 0) {
+	    bs->bs_Ro[bs->bs_NRecs] = ro;
+	    bs->bs_Rh[bs->bs_NRecs] = rh;
+	    batchDecode(bs, bs->bs_NRecs, rh);
+	    if (++bs->bs_NRecs == BATCH_RECS)
+		break;
+	}
+
+	/*
+	 * Stop at the end of the block or of the range,
+	 * SelectNextTableRec() takes it from there.
+	 */
+	nro = ro + rh->rh_Size;
+	if (nro == ti->ti_RanEnd.p_Ro || (nro & (blockSize - 1)) == 0)
+	    break;
+	if (((const RecHead *)(blk + (nro - bpos.p_Ro)))->rh_Magic == 0)
+	    break;
+	ro = nro;
+    }
+
+    ti->ti_RanBeg.p_Ro = ro;
+    SelectNextTableRec(ti, 0);
+
+    /*
+     * Run each range down its column vector.
+     */
+    for (i = 0; i < BATCH_WORDS; ++i)
+	bs->bs_Pass[i] = 0;
+    for (i = 0; i < bs->bs_NRecs; ++i)
+	bs->bs_Pass[i >> 5] |= 1U << (i & 31);
+
+    batchFilter(bs, r, bs->bs_Pass);
+    bcopy(bs->bs_Pass, bs->bs_Sel, sizeof(bs->bs_Sel));
+    for (nr = r; nr != bs->bs_Last; ) {
+	nr = nr->r_Next.ra_RangePtr;
+	batchFilter(bs, nr, bs->bs_Sel);
+    }
+}
+
+/*
+ * BatchRunRecord() - run a record satisfying r through the terminator
+ *
+ *	ti_RanBeg and rd_Rh must be positioned on the record and sel must
+ *	be non-zero if the record also satisfies the later ranges.  This
+ *	follows the record pass of DefaultIndexScanRangeOp1().  The later
+ *	ranges would have been run from within that loop, after the
+ *	deletion and commit checks, so the record goes straight to the
+ *	terminator.
+ */
+int
+BatchRunRecord(BatchScan *bs, Range *r, int sel)
+{
+    TableI *ti = r->r_TableI;
+    RawData *rd = ti->ti_RData;
+    const RecHead *rh = rd->rd_Rh;
+    Range *last = bs->bs_Last;
+    int rv;
+
+    /*
+     * Normal scan removes deleted records.
+     */
+    if (RecordIsValidForCommitTestOnly(ti) < 0) {
+	if (sel)
+	    RecordIsValidForCommit(ti);
+	return(0);
+    }
+    if (rh->rh_Flags & RHF_DELETE)
+	return(0);
+    DBASSERT(r->r_DelHash != NULL);
+    if (MatchDelHash(r->r_DelHash, rh) == 0)
+	return(0);
+    if (sel == 0)
+	return(0);
+
+    /*
+     * cooperative multitasking
+     */
+    taskQuantum();
+
+    ReadDataRecord(rd, &ti->ti_RanBeg, RDF_READ | RDF_ZERO);
+    ++ti->ti_ScanOneOnly;
+    rv = last->r_RunRange(last->r_Next);
+    --ti->ti_ScanOneOnly;
+    return(rv);
+}
+
+/*
+ * batchUsable() - check the range chain and set up the column vectors
+ *
+ *	Every range from r to the terminator must be a constant restriction
+ *	on r's table instance, on an ordinary column or the virtual table
+ *	id (the range HLResolveNullScans() adds to an unrestricted scan).
+ *	The later ranges would otherwise be run record by record through
+ *	RunRange() with ti_ScanOneOnly set, which only tests them against
+ *	the record.
+ *
+ *	Returns the last range, or NULL if the chain cannot be batched.
+ */
+static Range *
+batchUsable(Range *r, BatchScan *bs)
+{
+    TableI *ti = r->r_TableI;
+
+    for (;;) {
+	if (batchAddCol(bs, r->r_Col) < 0)
+	    return(NULL);
+	if (r->r_RunRange != RunRange)
+	    break;
+	r = r->r_Next.ra_RangePtr;
+	if (r->r_TableI != ti ||
+	    (r->r_Type & ROPF_CONST) == 0 ||
+	    (r->r_Flags & RF_FORCESAVE)
+	) {
+	    return(NULL);
+	}
+    }
+    return(r);
+}
+
+/*
+ * batchAddCol() - add the range's column to the vectors if not present
+ *
+ *	The column must be one of the table instance's columns, which
+ *	ReadDataRecord() would load, or CID_RAW_VTID.  The other special
+ *	(__*) columns are not supported.  A deletion's timestamp, for
+ *	example, differs from its record's (see pscan.h).
+ */
+static int
+batchAddCol(BatchScan *bs, const ColData *cd)
+{
+    col_t colId = (col_t)cd->cd_ColId;
+    int i;
+    int j;
+
+    if (colId < CID_RAW_LIMIT && colId != CID_RAW_VTID)
+	return(-1);
+    for (i = 0; i < bs->bs_NCols; ++i) {
+	if (bs->bs_ColIds[i] == colId)
+	    return(0);
+	if (bs->bs_ColIds[i] > colId)
+	    break;
+    }
+    if (bs->bs_NCols == BATCH_COLS)
+	return(-1);
+
+    /*
+     * Insert in sorted order, batchDecode() walks the record's
+     * columns and ours in parallel.
+     */
+    for (j = bs->bs_NCols; j > i; --j) {
+	bs->bs_ColIds[j] = bs->bs_ColIds[j-1];
+	bcopy(bs->bs_Vec[j-1], bs->bs_Vec[j], sizeof(bs->bs_Vec[j]));
+    }
+    bs->bs_ColIds[i] = colId;
+    ++bs->bs_NCols;
+
+    for (j = 0; j < BATCH_RECS; ++j) {
+	ColData *vcd = &bs->bs_Vec[i][j];
+
+	bzero(vcd, sizeof(ColData));
+	vcd->cd_ColId = cd->cd_ColId;
+	vcd->cd_DataType = cd->cd_DataType;
+    }
+    return(0);
+}
+
+/*
+ * batchDecode() - load record i of the column vectors from rh
+ *
+ *	Columns missing from the record are NULL, as ReadDataRecord()
+ *	leaves them with RDF_ZERO.
+ */
+static void
+batchDecode(BatchScan *bs, int i, const RecHead *rh)
+{
+    int offset;
+    int j;
+    int k;
+
+    for (k = 0; k < bs->bs_NCols; ++k) {
+	bs->bs_Vec[k][i].cd_Data = NULL;
+	bs->bs_Vec[k][i].cd_Bytes = 0;
+    }
+
+    offset = offsetof(RecHead, rh_Cols[rh->rh_NCols]);
+    k = 0;
+
+    /*
+     * CID_RAW_VTID sorts ahead of the record's columns and comes from
+     * the header, as in ReadDataRecord().
+     */
+    if (k < bs->bs_NCols && bs->bs_ColIds[k] == CID_RAW_VTID) {
+	bs->bs_Vec[k][i].cd_Data = (const void *)&rh->rh_VTableId;
+	bs->bs_Vec[k][i].cd_Bytes = sizeof(rh->rh_VTableId);
+	++k;
+    }
+
+    for (j = 0; j < rh->rh_NCols && k < bs->bs_NCols; ++j) {
+	const ColHead *ch = &rh->rh_Cols[j];
+	int bytes;
+
+	if (ch->ch_Bytes < BSIZE_EXT_BASE) {
+	    bytes = ch->ch_Bytes;
+	} else {
+	    bytes = *(int32_t *)((char *)rh + offset);
+	    offset += 4;
+	}
+	while (k < bs->bs_NCols && bs->bs_ColIds[k] < ch->ch_ColId)
+	    ++k;
+	if (k < bs->bs_NCols && bs->bs_ColIds[k] == ch->ch_ColId) {
+	    ColData *cd = &bs->bs_Vec[k][i];
+
+	    if (bytes)
+		cd->cd_Data = (const char *)rh + offset;
+	    else
+		cd->cd_Data = "";
+	    cd->cd_Bytes = bytes;
+	    ++k;
+	}
+	offset += ALIGN4(bytes);
+    }
+}
+
+/*
+ * batchFilter() - clear the bits of the records failing range r
+ */
+static void
+batchFilter(BatchScan *bs, Range *r, u_int32_t *map)
+{
+    int (*opFunc)(const ColData *c1, const ColData *c2) = r->r_OpFunc;
+    const ColData *cst = r->r_Const;
+    const ColData *vec;
+    col_t colId = (col_t)r->r_Col->cd_ColId;
+    int i;
+
+    for (i = 0; bs->bs_ColIds[i] != colId; ++i)
+	;
+    vec = bs->bs_Vec[i];
+
+    for (i = 0; i < bs->bs_NRecs; ++i) {
+	if (map[i >> 5] == 0) {
+	    i |= 31;
+	    continue;
+	}
+	if (BATCH_TEST(map, i) && opFunc(&vec[i], cst) < 0)
+	    BATCH_CLR(map, i);
+    }
+}
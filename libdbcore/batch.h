@@ -0,0 +1,44 @@
+/*
+ * LIBDBCORE/BATCH.H	- Batched evaluation of a table instance's ranges
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ * Notes on batched scans:
+ *
+ *	An unindexed scan normally decodes every record into the table
+ *	instance's RawData and recurses through RunRange() once for each
+ *	later range on the same table instance.  When the remainder of
+ *	the range chain consists only of constant restrictions on this
+ *	table instance, DefaultIndexScanRangeOp1() hands the scan to
+ *	BatchScanRange() instead.
+ *
+ *	Up to BATCH_RECS records of one block are located, and only the
+ *	columns the ranges test are pulled out of them into one ColData
+ *	vector per column.  Each range is then run down its column vector,
+ *	clearing the bits of the records it rejects in a selection bitmap.
+ *	Only the survivors are fully read and handed to the terminator.
+ *
+ *	Deletion tracking and commit conflict checks are applied to the
+ *	records satisfying the first range, exactly as the record at a
+ *	time scan does.
+ */
+
+#define BATCH_RECS		256		/* records per batch */
+#define BATCH_COLS		8		/* distinct columns tested */
+#define BATCH_WORDS		(BATCH_RECS / 32)
+
+#define BATCH_TEST(map, i)	((map)[(i) >> 5] & (1U << ((i) & 31)))
+#define BATCH_CLR(map, i)	((map)[(i) >> 5] &= ~(1U << ((i) & 31)))
+
+typedef struct BatchScan {
+    Range	*bs_Last;		/* last range, calls the terminator */
+    int		bs_NCols;
+    int		bs_NRecs;
+    col_t	bs_ColIds[BATCH_COLS];	/* sorted */
+    dboff_t	bs_Ro[BATCH_RECS];
+    const RecHead *bs_Rh[BATCH_RECS];
+    u_int32_t	bs_Pass[BATCH_WORDS];	/* records satisfying the first range */
+    u_int32_t	bs_Sel[BATCH_WORDS];	/* records satisfying every range */
+    ColData	bs_Vec[BATCH_COLS][BATCH_RECS];
+} BatchScan;
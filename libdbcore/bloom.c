@@ -0,0 +1,374 @@
+/*
+ * LIBDBCORE/BLOOM.C	- Per-block Bloom filters used to skip table blocks
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	A block's filter is built by WriteDataRecord() when the table
+ *	append point moves past it, alongside its zone map entry, and
+ *	sequential scans ask BloomSkipBlock() whether an exactly matched
+ *	constant can be in the block before mapping it.  See bloom.h for
+ *	the file layout.
+ */
+
+#include "defs.h"
+#include "bloom.h"
+
+Prototype void OpenBloomFilter(Table *tab);
+Prototype void CloseBloomFilter(Table *tab);
+Prototype void BloomCloseBlock(Table *tab, dboff_t blkRo);
+Prototype void BloomOpenBlock(Table *tab, dboff_t ro);
+Prototype int BloomSkipBlock(TableI *ti, Table *tab, dboff_t blkRo, dboff_t limit);
+
+static int bloomHeadValid(Table *tab, const BloomHead *bf);
+static void bloomRemap(BloomMap *bm);
+static off_t bloomOffset(Table *tab, dboff_t blkRo);
+static const BloomEntry *bloomEntry(Table *tab, dboff_t blkRo, int remap);
+static void bloomKey(col_t colId, const void *data, int bytes, u_int32_t *h1, u_int32_t *h2);
+static int bloomExcludes(TableI *ti, const BloomEntry *be, int nbits, Range *r);
+
+/*
+ * OpenBloomFilter() -	open the block filter file for a physical table
+ *
+ *	Called once the table's meta data has been validated.  The file
+ *	is (re)initialized if it does not match the table.  Block filters
+ *	are optional, if we cannot open the file the table simply has none.
+ */
+void
+OpenBloomFilter(Table *tab)
+{
+    BloomMap *bm;
+    BloomHead bf;
+    int fd;
+
+    if (tab->ta_Bloom != NULL)
+	return;
+
+    bm = zalloc(sizeof(BloomMap));
+    bm->bm_FilterBytes = tab->ta_Meta->tf_BlockSize / BF_RATIO;
+    safe_asprintf(&bm->bm_FilePath, "%s/%s.bf0",
+	tab->ta_Db->db_DirPath, tab->ta_Name);
+    if ((fd = open(bm->bm_FilePath, O_RDWR|O_CREAT, 0660)) < 0) {
+	safe_free(&bm->bm_FilePath);
+	zfree(bm, sizeof(BloomMap));
+	return;
+    }
+    bm->bm_Fd = fd;
+    bm->bm_Base = NULL;
+
+    /*
+     * Fasttrack validation, then validate again under an exclusive lock
+     * and reset the file if it belongs to some other incarnation of the
+     * table.
+     */
+    bzero(&bf, sizeof(bf));
+    if (read(fd, &bf, sizeof(bf)) != sizeof(bf) || !bloomHeadValid(tab, &bf)) {
+	hflock_ex(fd, 0);
+	lseek(fd, 0L, 0);
+	bzero(&bf, sizeof(bf));
+	if (read(fd, &bf, sizeof(bf)) != sizeof(bf) ||
+	    !bloomHeadValid(tab, &bf)
+	) {
+	    char *buf = zalloc(BF_HEADSIZE);
+
+	    bf.bf_Magic = BF_MAGIC;
+	    bf.bf_Version = BF_VERSION;
+	    bf.bf_HeadSize = BF_HEADSIZE;
+	    bf.bf_EntrySize = BE_SIZE(bm->bm_FilterBytes);
+	    bf.bf_BlockSize = tab->ta_Meta->tf_BlockSize;
+	    bf.bf_FilterBytes = bm->bm_FilterBytes;
+	    bf.bf_DataOff = tab->ta_Meta->tf_DataOff;
+	    bf.bf_Generation = tab->ta_Meta->tf_Generation;
+	    bcopy(&bf, buf, sizeof(bf));
+
+	    ftruncate(fd, 0);
+	    lseek(fd, 0L, 0);
+	    if (write(fd, buf, BF_HEADSIZE) != BF_HEADSIZE)
+		ftruncate(fd, 0);
+	    zfree(buf, BF_HEADSIZE);
+	}
+	hflock_un(fd, 0);
+    }
+    bloomRemap(bm);
+    tab->ta_Bloom = bm;
+}
+
+void
+CloseBloomFilter(Table *tab)
+{
+    BloomMap *bm;
+
+    if ((bm = tab->ta_Bloom) != NULL) {
+	tab->ta_Bloom = NULL;
+	if (bm->bm_Base != NULL)
+	    munmap((void *)bm->bm_Base, bm->bm_MapSize);
+	close(bm->bm_Fd);
+	safe_free(&bm->bm_FilePath);
+	zfree(bm, sizeof(BloomMap));
+    }
+}
+
+/*
+ * BloomCloseBlock() -	build the filter for a block which will not change
+ *
+ *	The entry is written with BEF_VALID clear and then validated, so
+ *	a concurrent reader never uses a partially written entry.  If the
+ *	block holds too many values for its filter to be useful the entry
+ *	is simply left invalid.
+ */
+void
+BloomCloseBlock(Table *tab, dboff_t blkRo)
+{
+    BloomMap *bm;
+    BloomEntry *be;
+    const char *base;
+    const RecHead *rh;
+    DataMap *dm = NULL;
+    dbpos_t pos;
+    off_t off;
+    int blockSize;
+    int entrySize;
+    int nbits;
+    int boff;
+    int i;
+
+    if ((bm = tab->ta_Bloom) == NULL)
+	return;
+    if ((off = bloomOffset(tab, blkRo)) < 0)
+	return;
+
+    blockSize = tab->ta_Meta->tf_BlockSize;
+    entrySize = BE_SIZE(bm->bm_FilterBytes);
+    nbits = bm->bm_FilterBytes * 8;
+    be = zalloc(entrySize);
+
+    pos.p_Tab = tab;
+    pos.p_Ro = blkRo;
+    base = tab->ta_GetDataMap(&pos, &dm, blockSize);
+    DBASSERT(((const BlockHead *)base)->bh_Magic == BH_MAGIC);
+
+    for (boff = sizeof(BlockHead); boff < blockSize; boff += rh->rh_Size) {
+	int offset;
+
+	rh = (const RecHead *)(base + boff);
+	if (!RH_ISRECORD(rh))
+	    break;
+	offset = offsetof(RecHead, rh_Cols[rh->rh_NCols]);
+	for (i = 0; i < rh->rh_NCols; ++i) {
+	    const ColHead *ch = &rh->rh_Cols[i];
+	    u_int32_t h1;
+	    u_int32_t h2;
+	    int bytes;
+	    int k;
+
+	    if (ch->ch_Bytes < BSIZE_EXT_BASE) {
+		bytes = ch->ch_Bytes;
+	    } else {
+		bytes = *(int32_t *)((char *)rh + offset);
+		offset += 4;
+	    }
+	    if (ch->ch_ColId >= CID_RAW_LIMIT) {
+		bloomKey(ch->ch_ColId, (const char *)rh + offset, bytes,
+		    &h1, &h2);
+		for (k = 0; k < BF_NPROBES; ++k) {
+		    u_int32_t bit = (h1 + k * h2) & (nbits - 1);
+		    be->be_Bits[bit >> 3] |= 1 << (bit & 7);
+		}
+		++be->be_Count;
+	    }
+	    offset += ALIGN4(bytes);
+	}
+    }
+    dm->dm_Table->ta_RelDataMap(&dm, 0);
+
+    if (be->be_Count <= nbits / BF_MAXLOAD) {
+	lseek(bm->bm_Fd, off, 0);
+	if (write(bm->bm_Fd, be, entrySize) == entrySize) {
+	    be->be_Flags = BEF_VALID;
+	    lseek(bm->bm_Fd, off, 0);
+	    write(bm->bm_Fd, &be->be_Flags, sizeof(be->be_Flags));
+	}
+    }
+    zfree(be, entrySize);
+}
+
+/*
+ * BloomOpenBlock() -	a record is being appended at ro
+ *
+ *	Throws away a filter for a block the append point has been backed
+ *	up into after a crash, see ZoneMapOpenBlock().
+ */
+void
+BloomOpenBlock(Table *tab, dboff_t ro)
+{
+    const BloomEntry *be;
+    dboff_t blkRo;
+
+    if (tab->ta_Bloom == NULL)
+	return;
+    blkRo = ro & ~(dboff_t)(tab->ta_Meta->tf_BlockSize - 1);
+    be = bloomEntry(tab, blkRo, 0);
+    if (be != NULL && (be->be_Flags & BEF_VALID)) {
+	int32_t flags = 0;
+
+	lseek(tab->ta_Bloom->bm_Fd, bloomOffset(tab, blkRo), 0);
+	write(tab->ta_Bloom->bm_Fd, &flags, sizeof(flags));
+    }
+}
+
+/*
+ * BloomSkipBlock() -	return 1 if a sequential scan may skip the block
+ *
+ *	Same rules as ZoneMapSkipBlock(): the block must lie entirely
+ *	below limit and only ti_ZoneRange is used unless the scan returns
+ *	every record.
+ */
+int
+BloomSkipBlock(TableI *ti, Table *tab, dboff_t blkRo, dboff_t limit)
+{
+    const BloomEntry *be;
+    Range *r;
+
+    if (tab->ta_Bloom == NULL)
+	return(0);
+    if (blkRo + tab->ta_Meta->tf_BlockSize > limit)
+	return(0);
+    if ((be = bloomEntry(tab, blkRo, 1)) == NULL ||
+	(be->be_Flags & BEF_VALID) == 0
+    ) {
+	return(0);
+    }
+    for (r = ti->ti_ZoneRange; r; r = r->r_NextSame) {
+	if (bloomExcludes(ti, be, tab->ta_Bloom->bm_FilterBytes * 8, r))
+	    return(1);
+	if (ti->ti_ScanOneOnly >= 0)
+	    break;
+    }
+    return(0);
+}
+
+static int
+bloomHeadValid(Table *tab, const BloomHead *bf)
+{
+    const TableFile *tf = tab->ta_Meta;
+
+    return(bf->bf_Magic == BF_MAGIC &&
+	bf->bf_Version == BF_VERSION &&
+	bf->bf_HeadSize == BF_HEADSIZE &&
+	bf->bf_BlockSize == tf->tf_BlockSize &&
+	bf->bf_FilterBytes == tf->tf_BlockSize / BF_RATIO &&
+	bf->bf_EntrySize == BE_SIZE(bf->bf_FilterBytes) &&
+	bf->bf_DataOff == tf->tf_DataOff &&
+	bf->bf_Generation == tf->tf_Generation);
+}
+
+/*
+ * bloomRemap() - map the block filter file if it has grown
+ */
+static void
+bloomRemap(BloomMap *bm)
+{
+    struct stat st;
+
+    if (fstat(bm->bm_Fd, &st) < 0 || st.st_size <= bm->bm_MapSize)
+	return;
+    if (bm->bm_Base != NULL)
+	munmap((void *)bm->bm_Base, bm->bm_MapSize);
+    bm->bm_Base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, bm->bm_Fd, 0);
+    if (bm->bm_Base == MAP_FAILED) {
+	bm->bm_Base = NULL;
+	bm->bm_MapSize = 0;
+    } else {
+	bm->bm_MapSize = st.st_size;
+    }
+}
+
+static off_t
+bloomOffset(Table *tab, dboff_t blkRo)
+{
+    const TableFile *tf = tab->ta_Meta;
+
+    if (blkRo < tf->tf_DataOff)
+	return(-1);
+    return(BF_HEADSIZE +
+	(off_t)((blkRo - tf->tf_DataOff) / tf->tf_BlockSize) *
+	BE_SIZE(tab->ta_Bloom->bm_FilterBytes));
+}
+
+static const BloomEntry *
+bloomEntry(Table *tab, dboff_t blkRo, int remap)
+{
+    BloomMap *bm = tab->ta_Bloom;
+    off_t size = BE_SIZE(bm->bm_FilterBytes);
+    off_t off;
+
+    if ((off = bloomOffset(tab, blkRo)) < 0)
+	return(NULL);
+    if (off + size > bm->bm_MapSize) {
+	if (remap == 0)
+	    return(NULL);
+	bloomRemap(bm);
+	if (off + size > bm->bm_MapSize)
+	    return(NULL);
+    }
+    return((const BloomEntry *)(bm->bm_Base + off));
+}
+
+/*
+ * bloomKey() -	hash a (column id, value) pair
+ *
+ *	A 64 bit FNV-1a hash is split in two for double hashing.  The
+ *	second hash is forced odd so the probes cover the whole filter.
+ */
+static void
+bloomKey(col_t colId, const void *data, int bytes, u_int32_t *h1, u_int32_t *h2)
+{
+    const u_int8_t *ptr = data;
+    u_int64_t hv = 14695981039346656037ULL;
+
+    hv = (hv ^ (colId & 0xFF)) * 1099511628211ULL;
+    hv = (hv ^ ((colId >> 8) & 0xFF)) * 1099511628211ULL;
+    while (bytes-- > 0)
+	hv = (hv ^ *ptr++) * 1099511628211ULL;
+    *h1 = (u_int32_t)hv;
+    *h2 = (u_int32_t)(hv >> 32) | 1;
+}
+
+/*
+ * bloomExcludes() -	return 1 if no record in the block can satisfy r
+ *
+ *	Only byte-for-byte matches (the string EQEQ operator) of a user
+ *	column against a non-empty constant are considered.  Records which
+ *	do not have the column at all compare as the empty string and are
+ *	not in the filter.
+ */
+static int
+bloomExcludes(TableI *ti, const BloomEntry *be, int nbits, Range *r)
+{
+    const ColData *cd;
+    u_int32_t h1;
+    u_int32_t h2;
+    int k;
+
+    if (r->r_Type != ROP_CONST || r->r_OpId != ROP_EQEQ)
+	return(0);
+    if (r->r_OpFunc != DataTypeFuncAry[DATATYPE_STRING][DATAOP_EQEQ])
+	return(0);
+    if ((r->r_Flags & RF_FORCESAVE) && ti->ti_ScanOneOnly >= 0)
+	return(0);
+    if ((col_t)r->r_Col->cd_ColId < CID_RAW_LIMIT)
+	return(0);
+    cd = r->r_Const;
+    if (cd->cd_Data == NULL || cd->cd_Bytes == 0)
+	return(0);
+    if (be->be_Count == 0)
+	return(1);
+
+    bloomKey(r->r_Col->cd_ColId, cd->cd_Data, cd->cd_Bytes, &h1, &h2);
+    for (k = 0; k < BF_NPROBES; ++k) {
+	u_int32_t bit = (h1 + k * h2) & (nbits - 1);
+	if ((be->be_Bits[bit >> 3] & (1 << (bit & 7))) == 0)
+	    return(1);
+    }
+    return(0);
+}
@@ -0,0 +1,63 @@
+/*
+ * LIBDBCORE/BLOOM.H	- Per-block Bloom filters of a physical table
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ * Notes on block filters:
+ *
+ *	When a data block is closed out (see WriteDataRecord()) the
+ *	(column id, value) pairs of the user columns of every record in
+ *	the block are added to a Bloom filter.  A sequential scan for an
+ *	exact match against a constant asks the filter whether the block
+ *	can hold the value before mapping the block, see BloomSkipBlock().
+ *	This lets equality lookups on unindexed columns skip most of a
+ *	table without requiring a btree per column.
+ *
+ *	The filters live in a sidecar file, <table>.bf0, as an array of
+ *	BloomEntry's indexed by block number.  Each filter is
+ *	tf_BlockSize / BF_RATIO bytes.  As with zone maps the file is only
+ *	a hint, an entry is not used unless BEF_VALID is set and the file
+ *	is reset when the table's generation changes.  A block with so
+ *	many values that its filter would be mostly ones is left invalid.
+ */
+
+#define BF_RATIO		16		/* block bytes per filter byte */
+#define BF_NPROBES		4		/* bits set per value */
+#define BF_MAXLOAD		6		/* min filter bits per value */
+
+typedef struct BloomEntry {
+    int32_t	be_Flags;	/* BEF_* */
+    int32_t	be_Count;	/* number of values added */
+    u_int8_t	be_Bits[4];	/* extended to the filter size */
+} BloomEntry;
+
+#define BEF_VALID	0x0001
+
+#define BE_SIZE(bytes)	(offsetof(BloomEntry, be_Bits[0]) + (bytes))
+
+typedef struct BloomHead {
+    int32_t	bf_Magic;
+    int32_t	bf_Version;
+    int32_t	bf_HeadSize;	/* offset of first BloomEntry */
+    int32_t	bf_EntrySize;	/* BE_SIZE(bf_FilterBytes) */
+    int32_t	bf_BlockSize;	/* table block size */
+    int32_t	bf_FilterBytes;	/* bytes of filter per block */
+    dboff_t	bf_DataOff;	/* table offset of block 0 */
+    dbstamp_t	bf_Generation;	/* must match tf_Generation */
+} BloomHead;
+
+#define BF_MAGIC	0x424C4F4D
+#define BF_VERSION	1
+#define BF_HEADSIZE	512
+
+/*
+ * BloomMap - in-memory reference to a table's block filter file
+ */
+typedef struct BloomMap {
+    int		bm_Fd;
+    int		bm_FilterBytes;
+    const char	*bm_Base;	/* read-only mapping of the file */
+    off_t	bm_MapSize;
+    char	*bm_FilePath;
+} BloomMap;
@@ -11,38 +11,108 @@
 #include "btree.h"
 
 Prototype void OpenBTreeIndex(Index *index);
+Prototype const void *btreeGetIndexMap(Index *index, IndexMap **pmap, dboff_t ro, int bytes);
+Prototype void btreeRelIndexMap(IndexMap **pmap, int freeLastClose);
+Prototype void btreeSynchronize(Index *index);
+Prototype void btreeUnSynchronize(Index *index);
+Prototype int btreeIndexWrite(Index *index, off_t off, void *data, int bytes);
+Prototype void btreeIndexFSync(Index *index);
+
+/*
+ * BulkRun, BulkBuild -	state for a bulk index update
+ *
+ *	Keys are sorted in core BT_BULKKEYS at a time.  If the tree was
+ *	empty and they do not all fit the sorted runs are spilled to a
+ *	scratch file and merged, and the sorted keys are packed into leaves
+ *	with the internal levels built as the leaves fill up, bb_Level[]
+ *	holding the node currently being filled at each level.  If the tree
+ *	was not empty each batch is inserted as soon as it has been sorted.
+ *
+ *	Nothing is published until the new tree is complete, so if the
+ *	scratch file cannot be used the build is simply abandoned and the
+ *	caller falls back to inserting the keys one at a time.
+ */
+typedef struct BulkRun {
+    off_t	br_Off;		/* next key in the scratch file */
+    int		br_Left;	/* keys not yet read from the scratch file */
+    int		br_Index;	/* next key in br_Keys */
+    int		br_Count;	/* keys in br_Keys */
+    BTreeKey	*br_Keys;	/* BT_BULKREAD keys */
+} BulkRun;
+
+typedef struct BulkBuild {
+    TableI	*bb_TableI;
+    Index	*bb_Index;
+    int		bb_Insert;	/* tree not empty, insert sorted keys */
+    dboff_t	*bb_Appro;	/* index append point */
+    int		bb_Fd;		/* scratch file or -1 */
+    off_t	bb_FileOff;
+    int		bb_Count;	/* keys in bb_Keys */
+    BTreeKey	*bb_Keys;	/* BT_BULKKEYS */
+    int		bb_NRuns;
+    BulkRun	*bb_Runs;
+    int		bb_TopLevel;
+    int		bb_LevelCount[BT_BULKLEVELS];
+    BTreeKey	bb_Level[BT_BULKLEVELS][BT_MAXELM];
+    dboff_t	bb_FirstElm;
+    dboff_t	bb_LastElm;
+    dboff_t	bb_Root;
+} BulkBuild;
 
 static void CloseBTreeIndex(Index *index);
 static void BTreeSetTableRange(TableI *ti, Table *tab, const ColData *colData, Range *r, int flags);
-static void BTreeUpdateIndex(TableI *ti, Table *tab, const ColData *colData);
+static int BTreeUpdateIndex(TableI *ti, Table *tab, const ColData *colData, int flags);
 static void BTreeUpdateTableRange(TableI *ti, Range *r);
+static void BTreeUpdateCompoundRange(TableI *ti, Range *r);
 static void BTreeNextTableRec(TableI *ti);
 static void BTreePrevTableRec(TableI *ti);
-static int BTreeCacheCheck(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos, dbpos_t *bbeg, dbpos_t *bend);
-static int BTreeFindBoundsFwd(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos);
-static int BTreeFindBoundsRev(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos);
+static const RecHead *BTreeCoverRec(TableI *ti, dbpos_t *pos);
+static int BTreeCacheCheck(TableI *ti, Index *index, BTreeKey *cmp, dbpos_t *bpos, dbpos_t *bbeg, dbpos_t *bend);
+static int BTreeFindBoundsFwd(TableI *ti, Index *index, BTreeKey *cmp, dbpos_t *bpos);
+static int BTreeFindBoundsRev(TableI *ti, Index *index, BTreeKey *cmp, dbpos_t *bpos);
 
 static const BTreeNode *btreeRead(Index *index, IndexMap **pim, dboff_t bnro, int *elm);
 static const BTreeNode *btreeReadReScan(Index *index, IndexMap **pin, dbpos_t *bpos, int *elm);
+static const BTreeNode *btreePrevLeaf(Index *index, IndexMap **pim, const BTreeNode *bn, dbpos_t *bpos);
 static dboff_t btreeReadOffset(Index *index, dboff_t bnro);
-static int btreeCompare(Index *index, const BTreeElm *b1, const BTreeElm *b2);
-static int btreeCompareSearchFwd(Index *index, const BTreeNode *bn, int elm, BTreeElm *cmp);
-static int btreeCompareSearchRev(Index *index, const BTreeNode *bn, int elm, BTreeElm *cmp);
-static int btreeInsert(TableI *ti, Index *index, dboff_t bnro, BTreeElm *be, dboff_t *appro, int flags);
-static void btreeSplit(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeElm *be, dboff_t *appro, int flags);
-static void btreeInsertPhys(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeElm *be, dboff_t *appro, int flags);
+static void btreeSetKey(BTreeKey *bk, const void *data, int bytes);
+static int btreeAddKeyComp(BTreeKey *bk, const ColData *cd);
+static void btreeSetRecordKey(Index *index, BTreeKey *bk, const RawData *rd, const ColData *colData);
+static void btreeGetKey(const BTreeNode *bn, int elm, BTreeKey *bk);
+static void btreePackNode(Index *index, BTreeNode *bn, const BTreeKey *keys, int count);
+static int btreeCompareBytes(int fold, const u_int8_t *d1, int l1, int t1, const u_int8_t *d2, int l2, int t2);
+static int btreeCompare(Index *index, const BTreeKey *k1, const BTreeKey *k2);
+static int btreeComparePfx(Index *index, const BTreeKey *cmp, const BTreeNode *bn);
+static int btreeCompareSfx(Index *index, const BTreeKey *cmp, const BTreeNode *bn, int elm);
+static int btreeCompareKey(Index *index, const BTreeKey *cmp, const BTreeNode *bn, int elm);
+static int btreeCompareSearchFwd(Index *index, const BTreeNode *bn, int elm, BTreeKey *cmp);
+static int btreeCompareSearchRev(Index *index, const BTreeNode *bn, int elm, BTreeKey *cmp);
+static void btreeInsertRoot(TableI *ti, Index *index, BTreeKey *be, dboff_t *appro);
+static int btreeInsert(TableI *ti, Index *index, dboff_t bnro, BTreeKey *be, dboff_t *appro, int flags);
+static void btreeSplit(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeKey *be, dboff_t *appro, int flags);
+static void btreeInsertPhys(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeKey *be, dboff_t *appro, int flags);
 static dboff_t btreeAppend(Index *index, BTreeNode *bn, dboff_t *appro);
-static const void *btreeGetIndexMap(Index *index, IndexMap **pmap, dboff_t ro, int bytes);
-static void btreeRelIndexMap(IndexMap **pmap, int freeLastClose);
+static dboff_t btreeAppendData(Index *index, const void *data, int bytes, dboff_t *appro);
+static u_int32_t btreeAppendCover(Index *index, const RecHead *rh, dboff_t *appro);
+static BulkBuild *btreeBulkInit(TableI *ti, Index *index, dboff_t *appro);
+static int btreeBulkAdd(BulkBuild *bb, const BTreeKey *bk);
+static int btreeBulkSpill(BulkBuild *bb);
+static void btreeBulkSort(BulkBuild *bb);
+static int btreeBulkFinish(BulkBuild *bb);
+static int btreeBulkMerge(BulkBuild *bb);
+static void btreeBulkEmit(BulkBuild *bb, BTreeKey *bk);
+static int btreeBulkRead(BulkBuild *bb, BulkRun *br);
+static void btreeBulkHeapDown(BulkBuild *bb, int *heap, int count, int i);
+static void btreeBulkPush(BulkBuild *bb, int level, const BTreeKey *bk);
+static void btreeBulkFlush(BulkBuild *bb, int level);
+static int btreeBulkCompare(Index *index, const BTreeKey *k1, const BTreeKey *k2);
+static int btreeBulkSortCmp(const void *v1, const void *v2);
 static void btreeCachePurge(void);
-static void btreeSynchronize(Index *index);
-static void btreeUnSynchronize(Index *index);
-static int btreeIndexWrite(Index *index, off_t off, void *data, int bytes);
-static void btreeIndexFSync(Index *index);
 
 static IndexMap *BTreeIndexAry[BTREE_HSIZE];
 static int BTreeIndexCount;
 static int BTreePurgeIndex;
+static Index *BTreeBulkIndex;	/* for btreeBulkSortCmp() */
 
 /*
  * OpenBTreeIndex() -	open/create a btree-based index for a table vt & colid
@@ -60,17 +130,39 @@ OpenBTreeIndex(Index *index)
     BTreeNode bn;
     int error = 0;
     int tempOpt = 0;
+    int i;
 
     safe_asprintf(&p1, tab->ta_Name, 0);
-    safe_asprintf(&index->i_FilePath, "%s/%s.vt%04x.i%04x.o%02x", 
+    safe_asprintf(&index->i_FilePath, "%s/%s.vt%04x.i%04x", 
 	tab->ta_Db->db_DirPath, 
 	p1,
 	index->i_VTable,
-	index->i_ColId,
-	index->i_OpClass
+	index->i_ColId
     );
     safe_free(&p1);
 
+    /*
+     * Compound indexes append the remaining columns, e.g. i0401-0403
+     */
+    for (i = 1; i < index->i_NCols; ++i) {
+	safe_replacef(&index->i_FilePath, "%s-%04x",
+	    index->i_FilePath, index->i_ColIds[i]);
+    }
+
+    /*
+     * Covering indexes add the extra columns, e.g. c0405-0406, or just
+     * 'c' if the key alone covers.
+     */
+    if (index->i_NCover >= 0) {
+	safe_replacef(&index->i_FilePath, "%s.c", index->i_FilePath);
+	for (i = 0; i < index->i_NCover; ++i) {
+	    safe_replacef(&index->i_FilePath, "%s%s%04x",
+		index->i_FilePath, (i ? "-" : ""), index->i_CoverIds[i]);
+	}
+    }
+    safe_replacef(&index->i_FilePath, "%s.o%02x",
+	index->i_FilePath, index->i_OpClass);
+
     /*
      * If this a temporary table, create a temporary file (reuse the
      * namespace, there could be many threads using the same file name)
@@ -290,10 +382,13 @@ OpenBTreeIndex(Index *index)
 	initList(&index->i_BTreeCacheList);
 	index->i_ScanRangeOp = DefaultIndexScanRangeOp2;
 	index->i_SetTableRange = BTreeSetTableRange;
+	index->i_UpdateIndex = BTreeUpdateIndex;
 	index->i_UpdateTableRange = BTreeUpdateTableRange;
 	index->i_NextTableRec = BTreeNextTableRec;
 	index->i_PrevTableRec = BTreePrevTableRec;
 	index->i_Close = CloseBTreeIndex;
+	if (index->i_NCover >= 0)
+	    index->i_CoverRec = BTreeCoverRec;
 	index->i_PosCache.p_IRo = (dboff_t)-1;
     } else {
 	CloseBTreeIndex(index);
@@ -363,9 +458,9 @@ BTreeSetTableRange(TableI *ti, Table *tab, const ColData *colData, Range *r, int
 
     if (flags & TABRAN_INIT) {
 	if ((flags & TABRAN_SYNCIDX) && (bt->bt_TabAppend != tab->ta_Append))
-	    BTreeUpdateIndex(ti, tab, colData);
-	else if (bt->bt_TabAppend + BT_SLOP < tab->ta_Append)
-	    BTreeUpdateIndex(ti, tab, colData);
+	    BTreeUpdateIndex(ti, tab, colData, 0);
+	else if (bt->bt_TabAppend + tab->ta_IndexSlop < tab->ta_Append)
+	    BTreeUpdateIndex(ti, tab, colData, 0);
 	ti->ti_Append = tab->ta_Append;
 	ti->ti_IndexAppend = bt->bt_TabAppend;
     }
@@ -402,22 +497,32 @@ BTreeSetTableRange(TableI *ti, Table *tab, const ColData *colData, Range *r, int
  *	We obtain the update lock for the index while updating.  The lock
  *	must be thread-cooperative since the select may switch away from
  *	the thread.
+ *
+ *	If IUF_NOSYNC is set the index is left unsynchronized, allowing the
+ *	caller to batch the fsync()s (see UpdateDatabaseIndexes()).  Otherwise
+ *	the index is synchronized even if it was already up to date.
+ *
+ *	Returns 1 if the index was updated, 0 if it was already up to date.
  */
 
-static void
-BTreeUpdateIndex(TableI *ti, Table *tab, const ColData *colData)
+static int
+BTreeUpdateIndex(TableI *ti, Table *tab, const ColData *colData, int flags)
 {
     Index *index = ti->ti_Index;
     const BTreeHead *bt = index->i_BTreeHead;
+    BulkBuild *bb = NULL;
     dboff_t appro;
+    dboff_t gap;
     int oflags;
 
     if ((bt->bt_Flags & BTF_TEMP) == 0)
 	t_flock_ex(&index->i_FLock);
     if (bt->bt_TabAppend >= tab->ta_Append) {
+	if ((flags & IUF_NOSYNC) == 0)
+	    btreeSynchronize(index);
 	if ((bt->bt_Flags & BTF_TEMP) == 0)
 	    t_flock_un(&index->i_FLock);
-	return;
+	return(0);
     }
 
     /*
@@ -432,9 +537,24 @@ BTreeUpdateIndex(TableI *ti, Table *tab, const ColData *colData)
     oflags = ti->ti_Flags;
     ti->ti_Index = NULL;
     ti->ti_Flags = TABRAN_SLOP;
-    DefaultSetTableRange(ti, tab, colData, NULL, TABRAN_SLOP|TABRAN_INIT);
 
+    /*
+     * If a large portion of the table is unindexed the keys are sorted
+     * first.  An empty tree is then built bottom-up, otherwise the keys
+     * are inserted in sorted order which keeps btreeInsert() working on
+     * the same few nodes.
+     */
+    gap = tab->ta_Append - bt->bt_TabAppend;
+    if (gap >= BT_BULKMIN)
+	bb = btreeBulkInit(ti, index, &appro);
+
+    /*
+     * A failed bulk build has not touched the tree, we restart from
+     * scratch without it (anything it appended is overwritten).
+     */
+retry:
     appro = bt->bt_Append;
+    DefaultSetTableRange(ti, tab, colData, NULL, TABRAN_SLOP|TABRAN_INIT);
     if (bt->bt_TabAppend != 0) {
 	ti->ti_RanBeg.p_Ro = bt->bt_TabAppend;
 	SelectBegTableRec(ti, 0);
@@ -450,45 +570,30 @@ BTreeUpdateIndex(TableI *ti, Table *tab, const ColData *colData)
 	rh = ti->ti_RData->rd_Rh;
 
 	/*
-	 * Insert an element into the tree.  0 is returned on success,
-	 * -1 if a split occured (and 'be' will contain the new node
-	 * we have to add).  btreeAppend() is told to retarget both
-	 * element's bn_Parent fields to the new record.
+	 * Insert an element into the tree, or queue it for the bulk
+	 * update.
 	 *
 	 * we skip elements that do not belong to the requested vtable.
 	 */
 	if (index->i_VTable == 0 || index->i_VTable == rh->rh_VTableId) {
-	    BTreeElm be;
+	    BTreeKey be;
 	    /*
-	     * Construct temporary BTreeElm to hold the database reference
+	     * Construct temporary BTreeKey to hold the database reference
 	     * being added.
 	     */
-	    bzero(&be, sizeof(be));
-	    be.be_Ro = ti->ti_RanBeg.p_Ro;
+	    btreeSetRecordKey(index, &be, ti->ti_RData, colData);
+	    be.bk_Ro = ti->ti_RanBeg.p_Ro;
 	    if (rh->rh_Flags & RHF_DELETE)
-		be.be_Flags |= BEF_DELETED;
-	    if (colData->cd_Bytes > BT_DATALEN) 
-		be.be_Len = BT_DATALEN;
-	    else
-		be.be_Len = colData->cd_Bytes;
-	    bcopy(colData->cd_Data, be.be_Data, be.be_Len);
-
-	    if (btreeInsert(ti, index, bt->bt_Root, &be, &appro, BIF_FIRST|BIF_LAST) < 0) {
-		BTreeNode bn;
-		dboff_t res;
-
-		bzero(&bn, sizeof(bn));
-		bn.bn_Count = 2;
-		bn.bn_Elms[0].be_Ro = bt->bt_Root;
-		bn.bn_Elms[0].be_Flags = 0;
-		bn.bn_Elms[1] = be;
-		res = btreeAppend(index, &bn, &appro);
-		btreeIndexWrite(
-		    index,
-		    offsetof(BTreeHead, bt_Root),
-		    &res,
-		    sizeof(dboff_t)
-		);
+		be.bk_Flags |= BEF_DELETED;
+	    if (index->i_NCover >= 0)
+		be.bk_Cover = btreeAppendCover(index, rh, &appro);
+
+	    if (bb == NULL) {
+		btreeInsertRoot(ti, index, &be, &appro);
+	    } else if (btreeBulkAdd(bb, &be) < 0) {
+		btreeBulkFinish(bb);
+		bb = NULL;
+		goto retry;
 	    }
 	}
 
@@ -499,6 +604,10 @@ BTreeUpdateIndex(TableI *ti, Table *tab, const ColData *colData)
 	taskQuantum();
 	SelectNextTableRec(ti, 0);
     }
+    if (bb && btreeBulkFinish(bb) < 0) {
+	bb = NULL;
+	goto retry;
+    }
     ti->ti_Index = index;
     ti->ti_Flags = oflags;
     btreeIndexWrite(
@@ -513,9 +622,11 @@ BTreeUpdateIndex(TableI *ti, Table *tab, const ColData *colData)
 	&appro,
 	sizeof(dboff_t)
     );
-    btreeSynchronize(index);
+    if ((flags & IUF_NOSYNC) == 0)
+	btreeSynchronize(index);
     if ((bt->bt_Flags & BTF_TEMP) == 0)
 	t_flock_un(&index->i_FLock);
+    return(1);
 }
 
 /*
@@ -539,13 +650,21 @@ BTreeUpdateTableRange(TableI *ti, Range *r)
 
     DBASSERT(ti->ti_ScanOneOnly <= 0);
 
+    /*
+     * Compound indexes restrict the range using all the clauses at once
+     */
+    if (ti->ti_Index->i_NCols > 1 && r != NULL) {
+	BTreeUpdateCompoundRange(ti, r);
+	r = NULL;
+    }
+
     /*
      * Only constant expressions
      */
     for (; r && ti->ti_RanBeg.p_Ro >= 0; r = r->r_NextSame) {
 	dbpos_t bbeg = ti->ti_RanBeg;
 	dbpos_t bend = ti->ti_RanEnd;
-	BTreeElm be;
+	BTreeKey be;
 	int foundFwd;
 	int foundRev;
 
@@ -575,15 +694,18 @@ BTreeUpdateTableRange(TableI *ti, Range *r)
 	    continue;
 
 	/*
-	 * Construct BTreeElm out of range constant
+	 * Construct BTreeKey out of range constant.  Only the part of a
+	 * LIKE pattern before the first '%' can restrict the range.
 	 */
-	bzero(&be, sizeof(be));
-	be.be_Ro = 0;
-	if (r->r_Const->cd_Bytes > BT_DATALEN) 
-	    be.be_Len = BT_DATALEN;
-	else
-	    be.be_Len = r->r_Const->cd_Bytes;
-	bcopy(r->r_Const->cd_Data, be.be_Data, be.be_Len);
+	if (r->r_OpId == ROP_LIKE) {
+	    int n = LikePrefixLen(r->r_Const->cd_Data, r->r_Const->cd_Bytes);
+
+	    if (n == 0)
+		continue;
+	    btreeSetKey(&be, r->r_Const->cd_Data, n);
+	} else {
+	    btreeSetKey(&be, r->r_Const->cd_Data, r->r_Const->cd_Bytes);
+	}
 
 	/*
 	 * Restrict range
@@ -625,13 +747,13 @@ BTreeUpdateTableRange(TableI *ti, Range *r)
 	case ROP_LIKE:
 	case ROP_RLIKE:
 	    foundFwd = BTreeFindBoundsFwd(ti, ti->ti_Index, &be, &bbeg);
-	    if (be.be_Len && be.be_Len < BT_DATALEN) {
-		unsigned char c = tolower(be.be_Data[be.be_Len-1]);
+	    if (be.bk_Len && be.bk_Len < BT_MAXKEYLEN) {
+		unsigned char c = tolower(be.bk_Data[be.bk_Len-1]);
 		if (c == 0xFF) {
-		    while (be.be_Len < BT_DATALEN)
-			be.be_Data[be.be_Len++] = 0xFF;
+		    while (be.bk_Len < BT_MAXKEYLEN)
+			be.bk_Data[be.bk_Len++] = 0xFF;
 		} else {
-		    be.be_Data[be.be_Len-1] = c + 1;
+		    be.bk_Data[be.bk_Len-1] = c + 1;
 		}
 	    }
 	    foundRev = BTreeFindBoundsRev(ti, ti->ti_Index, &be, &bend);
@@ -646,12 +768,16 @@ BTreeUpdateTableRange(TableI *ti, Range *r)
 		IndexMap *im2 = NULL;
 		const BTreeNode *bn1;
 		const BTreeNode *bn2;
+		BTreeKey bk1;
+		BTreeKey bk2;
 		int elm1;
 		int elm2;
 
 		bn1 = btreeRead(ti->ti_Index, &im1, bbeg.p_IRo, &elm1);
 		bn2 = btreeRead(ti->ti_Index, &im2, bend.p_IRo, &elm2);
-		if (btreeCompare(ti->ti_Index, &bn1->bn_Elms[elm1], &bn2->bn_Elms[elm2]) > 0) {
+		btreeGetKey(bn1, elm1, &bk1);
+		btreeGetKey(bn2, elm2, &bk2);
+		if (btreeCompare(ti->ti_Index, &bk1, &bk2) > 0) {
 		    ti->ti_RanBeg.p_Ro = -1;
 		    ti->ti_RanEnd.p_Ro = -1;
 		} else {
@@ -728,6 +854,123 @@ BTreeUpdateTableRange(TableI *ti, Range *r)
 	BTreePrevTableRec(ti);
 }
 
+/*
+ * BTreeUpdateCompoundRange() - restrict a compound index range
+ *
+ *	Collect the constant clauses matching the columns making up the
+ *	compound index.  The longest run of leading columns with exact
+ *	matches forms a key prefix.  An inequality on the column following
+ *	the prefix may further restrict the range, otherwise the range is
+ *	simply everything starting with the prefix.  Unless the key is
+ *	complete the bounds are flagged truncated, since a truncated key
+ *	compares equal to anything it prefixes.
+ *
+ *	The clauses are still tested during the scan so the range only
+ *	needs to be conservative.
+ */
+static void
+BTreeUpdateCompoundRange(TableI *ti, Range *r)
+{
+    Index *index = ti->ti_Index;
+    const ColData *eqAry[INDEX_MAXCOLS];
+    const ColData *loAry[INDEX_MAXCOLS];
+    const ColData *hiAry[INDEX_MAXCOLS];
+    dbpos_t bbeg = ti->ti_RanBeg;
+    dbpos_t bend = ti->ti_RanEnd;
+    BTreeKey lo;
+    BTreeKey hi;
+    int foundFwd;
+    int foundRev;
+    int n;
+    int i;
+
+    bzero(eqAry, sizeof(eqAry));
+    bzero(loAry, sizeof(loAry));
+    bzero(hiAry, sizeof(hiAry));
+    for (; r; r = r->r_NextSame) {
+	if (r->r_Type != ROP_CONST || (r->r_Flags & RF_FORCESAVE))
+	    continue;
+	if (r->r_OpClass != index->i_OpClass)
+	    continue;
+	for (i = 0; i < index->i_NCols; ++i) {
+	    if ((col_t)r->r_Col->cd_ColId == index->i_ColIds[i])
+		break;
+	}
+	if (i == index->i_NCols)
+	    continue;
+	switch(r->r_OpId) {
+	case ROP_EQEQ:
+	    eqAry[i] = r->r_Const;
+	    break;
+	case ROP_LT:
+	case ROP_LTEQ:
+	    hiAry[i] = r->r_Const;
+	    break;
+	case ROP_GT:
+	case ROP_GTEQ:
+	    loAry[i] = r->r_Const;
+	    break;
+	default:
+	    break;
+	}
+    }
+    for (n = 0; n < index->i_NCols && eqAry[n]; ++n)
+	;
+    if (n == 0)
+	return;
+
+    /*
+     * Construct the key prefix, then the low and high bounds
+     */
+    bzero(&lo, offsetof(BTreeKey, bk_Data));
+    for (i = 0; i < n; ++i)
+	btreeAddKeyComp(&lo, eqAry[i]);
+    hi = lo;
+    if (n < index->i_NCols) {
+	if (loAry[n])
+	    btreeAddKeyComp(&lo, loAry[n]);
+	if (hiAry[n])
+	    btreeAddKeyComp(&hi, hiAry[n]);
+	lo.bk_Flags |= BEF_TRUNC;
+	hi.bk_Flags |= BEF_TRUNC;
+    }
+
+    foundFwd = BTreeFindBoundsFwd(ti, index, &lo, &bbeg);
+    foundRev = BTreeFindBoundsRev(ti, index, &hi, &bend);
+
+    /*
+     * We must find something for both searches and they must not have
+     * passed each other (see the LIKE case in BTreeUpdateTableRange()).
+     */
+    if (foundFwd >= 0 && foundRev >= 0) {
+	IndexMap *im1 = NULL;
+	IndexMap *im2 = NULL;
+	const BTreeNode *bn1;
+	const BTreeNode *bn2;
+	BTreeKey bk1;
+	BTreeKey bk2;
+	int elm1;
+	int elm2;
+
+	bn1 = btreeRead(index, &im1, bbeg.p_IRo, &elm1);
+	bn2 = btreeRead(index, &im2, bend.p_IRo, &elm2);
+	btreeGetKey(bn1, elm1, &bk1);
+	btreeGetKey(bn2, elm2, &bk2);
+	if (btreeCompare(index, &bk1, &bk2) > 0) {
+	    ti->ti_RanBeg.p_Ro = -1;
+	    ti->ti_RanEnd.p_Ro = -1;
+	} else {
+	    ti->ti_RanBeg = bbeg;
+	    ti->ti_RanEnd = bend;
+	}
+	btreeRelIndexMap(&im1, 0);
+	btreeRelIndexMap(&im2, 0);
+    } else {
+	ti->ti_RanBeg.p_Ro = -1;
+	ti->ti_RanEnd.p_Ro = -1;
+    }
+}
+
 /*
  * BTreeNextTableRec()
  *
@@ -890,6 +1133,12 @@ again:
  *
  *	This code yields approximately 2.3x improvement in scan speed.
  *
+ *	When a.key is itself scanned through its index the keys arrive in
+ *	index order (backwards), so the two indexes can be walked together
+ *	like a merge join.  If the key is not in the cached leaf we follow
+ *	B back up to BT_MERGELEAFS leaves, which is usually much cheaper
+ *	than descending from the root again.
+ *
  *	The return codes are as follows:
  *
  *	-1	We could not do a blessed thing (well, we could do something
@@ -914,7 +1163,7 @@ again:
  */
 
 static int
-BTreeCacheCheck(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos, dbpos_t *bbeg, dbpos_t *bend)
+BTreeCacheCheck(TableI *ti, Index *index, BTreeKey *cmp, dbpos_t *bpos, dbpos_t *bbeg, dbpos_t *bend)
 {
     const BTreeNode *bn;
     IndexMap *im = NULL;
@@ -923,7 +1172,7 @@ BTreeCacheCheck(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos, dbpos_t
 
     ++ti->ti_DebugIndexScanCount;
     bn = btreeReadReScan(index, &im, bpos, &elm);
-    r = btreeCompare(index, &bn->bn_Elms[elm], cmp);
+    r = -btreeCompareKey(index, cmp, bn, elm);
     DBASSERT(bn->bn_Flags & BNF_LEAF);
     if (r == 0) {
 	r = -1;
@@ -933,7 +1182,7 @@ BTreeCacheCheck(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos, dbpos_t
 	 */
 	int lastElm = bn->bn_Count - 1;
 
-	if (elm != lastElm && btreeCompare(index, &bn->bn_Elms[lastElm], cmp) > 0) {
+	if (elm != lastElm && btreeCompareKey(index, cmp, bn, lastElm) < 0) {
 	    bend->p_Ro = bn->bn_Elms[lastElm].be_Ro;
 	    bend->p_IRo = (bpos->p_IRo & ~(dboff_t)BT_INDEXMASK) + lastElm;
 	    elm = btreeCompareSearchFwd(index, bn, elm, cmp);
@@ -958,10 +1207,37 @@ BTreeCacheCheck(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos, dbpos_t
 	/*
 	 * elm compares > 0
 	 *
-	 * Backwards scan case (more typical)
+	 * Backwards scan case (more typical).  If the key sorts before
+	 * the whole leaf, step back through the preceding leaves.  lpos
+	 * tracks the last element of the leaf we stepped to, which
+	 * sorts >= cmp.
 	 */
-	if (btreeCompare(index, &bn->bn_Elms[0], cmp) < 0) {
-	    elm = btreeCompareSearchRev(index, bn, elm, cmp);
+	dbpos_t lpos = *bpos;
+	int steps = 0;
+
+	while (btreeCompareKey(index, cmp, bn, 0) < 0 && steps < BT_MERGELEAFS) {
+	    ++steps;
+	    ++ti->ti_DebugIndexScanCount;
+	    if ((bn = btreePrevLeaf(index, &im, bn, &lpos)) == NULL)
+		break;
+	    elm = (int)lpos.p_IRo & BT_INDEXMASK;
+	}
+
+	if (bn == NULL ||
+	    (steps && btreeCompareKey(index, cmp, bn, elm) > 0)
+	) {
+	    /*
+	     * cmp sorts before the first element of the index, or
+	     * between two leaves.  Nothing matches.
+	     */
+	    bbeg->p_Ro = (dboff_t)-1;
+	    bbeg->p_IRo = (dboff_t)-1;
+	    bend->p_Ro = (dboff_t)-1;
+	    bend->p_IRo = (dboff_t)-1;
+	    r = 1;
+	} else if (btreeCompareKey(index, cmp, bn, 0) > 0) {
+	    if (btreeCompareKey(index, cmp, bn, elm) < 0)
+		elm = btreeCompareSearchRev(index, bn, elm, cmp);
 	    if ((r = btreeCompareSearchFwd(index, bn, 0, cmp)) > elm) {
 		bbeg->p_Ro = (dboff_t)-1;
 		bbeg->p_IRo = (dboff_t)-1;
@@ -969,15 +1245,17 @@ BTreeCacheCheck(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos, dbpos_t
 		bend->p_IRo = (dboff_t)-1;
 	    } else {
 		bbeg->p_Ro = bn->bn_Elms[r].be_Ro;
-		bbeg->p_IRo = (bpos->p_IRo & ~(dboff_t)BT_INDEXMASK) + r;
+		bbeg->p_IRo = (lpos.p_IRo & ~(dboff_t)BT_INDEXMASK) + r;
 		bend->p_Ro = bn->bn_Elms[elm].be_Ro;
-		bend->p_IRo = (bpos->p_IRo & ~(dboff_t)BT_INDEXMASK) + elm;
+		bend->p_IRo = (lpos.p_IRo & ~(dboff_t)BT_INDEXMASK) + elm;
 	    }
 	    r = 1;
-	} else {
-	    bend->p_Ro = bpos->p_Ro;
-	    bend->p_IRo = bpos->p_IRo;
+	} else if (btreeCompareKey(index, cmp, bn, elm) < 0) {
+	    bend->p_Ro = lpos.p_Ro;
+	    bend->p_IRo = lpos.p_IRo;
 	    r = 0;
+	} else {
+	    r = -1;
 	}
     }
     btreeRelIndexMap(&im, 0);
@@ -993,7 +1271,7 @@ BTreeCacheCheck(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos, dbpos_t
  *	matching element, and +1 if we found a following element.
  */
 static int
-BTreeFindBoundsFwd(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos)
+BTreeFindBoundsFwd(TableI *ti, Index *index, BTreeKey *cmp, dbpos_t *bpos)
 {
     const BTreeNode *bn;
     IndexMap *im = NULL;
@@ -1016,7 +1294,7 @@ BTreeFindBoundsFwd(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos)
     for (;;) {
 	++ti->ti_DebugIndexScanCount;
 	while (elm < bn->bn_Count) {
-	    if (btreeCompare(index, cmp, &bn->bn_Elms[elm]) <= 0)
+	    if (btreeCompareKey(index, cmp, bn, elm) <= 0)
 		break;
 	    ++elm;
 	}
@@ -1046,7 +1324,7 @@ BTreeFindBoundsFwd(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos)
 	bn = btreeRead(index, &im, bpos->p_IRo, &elm);
 	/* elm starts at 0 */
 	while (elm < bn->bn_Count) {
-	    if (btreeCompare(index, cmp, &bn->bn_Elms[elm]) <= 0)
+	    if (btreeCompareKey(index, cmp, bn, elm) <= 0)
 		break;
 	    ++elm;
 	}
@@ -1085,7 +1363,7 @@ BTreeFindBoundsFwd(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos)
     }
     bpos->p_IRo = (bpos->p_IRo & ~(dboff_t)BT_INDEXMASK) + elm;
     bpos->p_Ro = bn->bn_Elms[elm].be_Ro;
-    foundFwd = (btreeCompare(index, cmp, &bn->bn_Elms[elm]) != 0);
+    foundFwd = (btreeCompareKey(index, cmp, bn, elm) != 0);
     btreeRelIndexMap(&im, 0);
     return(foundFwd);
 }
@@ -1097,7 +1375,7 @@ BTreeFindBoundsFwd(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos)
  */
 
 static int
-BTreeFindBoundsRev(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos)
+BTreeFindBoundsRev(TableI *ti, Index *index, BTreeKey *cmp, dbpos_t *bpos)
 {
     const BTreeNode *bn;
     IndexMap *im = NULL;
@@ -1120,7 +1398,7 @@ BTreeFindBoundsRev(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos)
     for (;;) {
 	++ti->ti_DebugIndexScanCount;
 	while (elm >= 0) {
-	    if (btreeCompare(index, cmp, &bn->bn_Elms[elm]) >= 0)
+	    if (btreeCompareKey(index, cmp, bn, elm) >= 0)
 		break;
 	    --elm;
 	}
@@ -1151,7 +1429,7 @@ BTreeFindBoundsRev(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos)
 	bn = btreeRead(index, &im, bpos->p_IRo, &elm);
 	elm = bn->bn_Count - 1;
 	while (elm >= 0) {
-	    if (btreeCompare(index, cmp, &bn->bn_Elms[elm]) >= 0)
+	    if (btreeCompareKey(index, cmp, bn, elm) >= 0)
 		break;
 	    --elm;
 	}
@@ -1193,11 +1471,42 @@ BTreeFindBoundsRev(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos)
     }
     bpos->p_IRo = (bpos->p_IRo & ~(dboff_t)BT_INDEXMASK) + elm;
     bpos->p_Ro = bn->bn_Elms[elm].be_Ro;
-    foundRev = (btreeCompare(index, cmp, &bn->bn_Elms[elm]) != 0);
+    foundRev = (btreeCompareKey(index, cmp, bn, elm) != 0);
     btreeRelIndexMap(&im, 0);
     return(foundRev);
 }
 
+/*
+ * btreeInsertRoot() -	insert new element into btree, growing the tree
+ *
+ *	If the root had to be split a new root is created referencing the
+ *	old root and the new split node.
+ */
+static void
+btreeInsertRoot(TableI *ti, Index *index, BTreeKey *be, dboff_t *appro)
+{
+    const BTreeHead *bt = index->i_BTreeHead;
+
+    if (btreeInsert(ti, index, bt->bt_Root, be, appro, BIF_FIRST|BIF_LAST) < 0) {
+	BTreeKey keys[2];
+	BTreeNode bn;
+	dboff_t res;
+
+	bzero(&keys[0], sizeof(keys[0]));
+	keys[0].bk_Ro = bt->bt_Root;
+	keys[1] = *be;
+	bzero(&bn, sizeof(bn));
+	btreePackNode(index, &bn, keys, 2);
+	res = btreeAppend(index, &bn, appro);
+	btreeIndexWrite(
+	    index,
+	    offsetof(BTreeHead, bt_Root),
+	    &res,
+	    sizeof(dboff_t)
+	);
+    }
+}
+
 /*
  * btreeInsert() -	insert new element into btree
  *
@@ -1211,7 +1520,7 @@ BTreeFindBoundsRev(TableI *ti, Index *index, BTreeElm *cmp, dbpos_t *bpos)
  *	this routine.
  */
 static int
-btreeInsert(TableI *ti, Index *index, dboff_t bnro, BTreeElm *be, dboff_t *appro, int flags)
+btreeInsert(TableI *ti, Index *index, dboff_t bnro, BTreeKey *be, dboff_t *appro, int flags)
 {
     const BTreeNode *bn;
     IndexMap *im = NULL;
@@ -1231,7 +1540,7 @@ btreeInsert(TableI *ti, Index *index, dboff_t bnro, BTreeElm *be, dboff_t *appro
     ++ti->ti_DebugIndexInsertCount;
     bn = btreeRead(index, &im, bnro, &dummy);
     for (i = 0; i < bn->bn_Count; ++i) {
-	if (btreeCompare(index, be, &bn->bn_Elms[i]) < 0)
+	if (btreeCompareKey(index, be, bn, i) < 0)
 	    break;
     }
     --i;
@@ -1301,25 +1610,32 @@ btreeInsert(TableI *ti, Index *index, dboff_t bnro, BTreeElm *be, dboff_t *appro
  *	Stores the split node in be on return.
  */
 static void
-btreeSplit(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeElm *be, dboff_t *appro, int flags)
+btreeSplit(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeKey *be, dboff_t *appro, int flags)
 {
     const BTreeHead *bt;
-    BTreeElm tmpbe = *be;
+    BTreeKey tmpbe = *be;
+    BTreeKey keys[BT_MAXELM];
     BTreeNode bn1;
     BTreeNode bn2;
     const int HALF = BT_MAXELM / 2;
+    int j;
+
+    /*
+     * Each half gets its own (possibly longer) common prefix, so the
+     * keys have to be expanded and repacked rather than copied.
+     */
+    for (j = 0; j < BT_MAXELM; ++j)
+	btreeGetKey(bn, j, &keys[j]);
 
     bzero(&bn1, sizeof(bn1));
     bn1.bn_Parent = bn->bn_Parent;
-    bn1.bn_Count = HALF;
     bn1.bn_Flags = bn->bn_Flags;
-    bcopy(&bn->bn_Elms[0], &bn1.bn_Elms[0], HALF * sizeof(BTreeElm));
+    btreePackNode(index, &bn1, &keys[0], HALF);
 
     bzero(&bn2, sizeof(bn2));
     bn2.bn_Parent = 0;
-    bn2.bn_Count = HALF;
     bn2.bn_Flags = bn->bn_Flags;
-    bcopy(&bn->bn_Elms[HALF], &bn2.bn_Elms[0], HALF * sizeof(BTreeElm));
+    btreePackNode(index, &bn2, &keys[HALF], HALF);
 
     /*
      * Update bn1
@@ -1329,9 +1645,10 @@ btreeSplit(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeElm *be,
     /*
      * Update returned be (and obtain ro of bn2)
      */
-    *be = bn2.bn_Elms[0];
-    be->be_Flags = 0;
-    be->be_Ro = btreeAppend(index, &bn2, appro);
+    *be = keys[HALF];
+    be->bk_Flags &= ~BEF_DELETED;
+    be->bk_Cover = 0;
+    be->bk_Ro = btreeAppend(index, &bn2, appro);
 
     bt = index->i_BTreeHead;
 
@@ -1342,7 +1659,7 @@ btreeSplit(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeElm *be,
      * if we fix it up here first.
      */
     if ((bt->bt_LastElm & ~(dboff_t)BT_INDEXMASK) == bnro) {
-	dboff_t lastro = be->be_Ro + (HALF - 1);
+	dboff_t lastro = be->bk_Ro + (HALF - 1);
 	btreeIndexWrite(
 	    index,
 	    offsetof(BTreeHead, bt_LastElm),
@@ -1359,12 +1676,12 @@ btreeSplit(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeElm *be,
 	/*btreeInsertPhys(index, be->be_Ro, &bn2, 0, NULL, 0);*/
     } else {
 	btreeInsertPhys(index, bnro, &bn1, 0, NULL, appro, 0);
-	btreeInsertPhys(index, be->be_Ro, &bn2, i - HALF, &tmpbe, appro, flags);
+	btreeInsertPhys(index, be->bk_Ro, &bn2, i - HALF, &tmpbe, appro, flags);
     }
 }
 
 static void
-btreeInsertPhys(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeElm *be, dboff_t *appro, int flags)
+btreeInsertPhys(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeKey *be, dboff_t *appro, int flags)
 {
     const BTreeHead *bt;
     BTreeNode nbn;
@@ -1372,13 +1689,19 @@ btreeInsertPhys(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeElm
     bzero(&nbn, sizeof(nbn));
 
     if (be) {
+	BTreeKey keys[BT_MAXELM];
+	int j;
+
+	DBASSERT(bn->bn_Count < BT_MAXELM);
+	for (j = 0; j < i; ++j)
+	    btreeGetKey(bn, j, &keys[j]);
+	keys[i] = *be;
+	for (j = i; j < bn->bn_Count; ++j)
+	    btreeGetKey(bn, j, &keys[j+1]);
+
 	nbn.bn_Parent = bn->bn_Parent;
-	nbn.bn_Count = bn->bn_Count + 1;
 	nbn.bn_Flags = bn->bn_Flags;
-
-	bcopy(&bn->bn_Elms[0], &nbn.bn_Elms[0], i * sizeof(BTreeElm));
-	bcopy(be, &nbn.bn_Elms[i], sizeof(BTreeElm));
-	bcopy(&bn->bn_Elms[i], &nbn.bn_Elms[i+1], (bn->bn_Count - i) * sizeof(BTreeElm));
+	btreePackNode(index, &nbn, keys, bn->bn_Count + 1);
 	btreeIndexWrite(
 	    index,
 	    bnro,
@@ -1448,22 +1771,61 @@ btreeInsertPhys(Index *index, dboff_t bnro, const BTreeNode *bn, int i, BTreeElm
     }
 }
 
+/*
+ * btreeAppend() -	append a new node to the index
+ *
+ *	Any children of a non-leaf node are retargeted to the new node.
+ */
 dboff_t
 btreeAppend(Index *index, BTreeNode *bn, dboff_t *appro)
+{
+    dboff_t bnro;
+
+    bnro = btreeAppendData(index, bn, sizeof(BTreeNode), appro);
+
+    if ((bn->bn_Flags & BNF_LEAF) == 0) {
+	int i;
+
+	for (i = 0; i < bn->bn_Count; ++i) {
+	    dboff_t par;
+
+	    DBASSERT(bn->bn_Elms[i].be_Ro != 0);
+	    par = bnro + i;
+	    btreeIndexWrite(
+		index,
+		bn->bn_Elms[i].be_Ro + offsetof(BTreeNode, bn_Parent),
+		&par,
+		sizeof(dboff_t)
+	    );
+	}
+    }
+    return(bnro);
+}
+
+/*
+ * btreeAppendData() -	append raw data to the index
+ *
+ *	The data is aligned the same as a node and will not cross a cache
+ *	block boundry.  *appro is updated and the offset of the data is
+ *	returned.
+ */
+static dboff_t
+btreeAppendData(Index *index, const void *data, int bytes, dboff_t *appro)
 {
     static char *ZBuf;
     const BTreeHead *bt;
-    dboff_t bnro;
+    dboff_t ro;
 
+    DBASSERT(bytes <= BT_CACHESIZE);
     bt = index->i_BTreeHead;
-    bnro = (*appro + BT_INDEXMASK) & ~(dboff_t)BT_INDEXMASK;	/* align */
+    ro = (*appro + BT_INDEXMASK) & ~(dboff_t)BT_INDEXMASK;	/* align */
 
     /*
      * If we would otherwise write across a cache block boundry, align
      * to the next cache block
      */
-    if ((bnro ^ (bnro + (sizeof(BTreeNode) - 1))) & ~(dboff_t)BT_CACHEMASK) {
-	bnro = (bnro + BT_CACHEMASK) & ~(dboff_t)BT_CACHEMASK;
+    if ((ro ^ (ro + (bytes - 1))) & ~(dboff_t)BT_CACHEMASK) {
+	ro = (ro + BT_CACHEMASK) & ~(dboff_t)BT_CACHEMASK;
     }
 
     /*
@@ -1471,7 +1833,7 @@ btreeAppend(Index *index, BTreeNode *bn, dboff_t *appro)
      * spill file.  Note that the first block is never spilled.
      */
     if (index->i_Fd < 0 &&
-	bnro >= BT_CACHESIZE &&
+	ro >= BT_CACHESIZE &&
 	(index->i_BTreeHead->bt_Flags & BTF_TEMP)
     ) {
 	fprintf(stderr, 
@@ -1487,8 +1849,8 @@ btreeAppend(Index *index, BTreeNode *bn, dboff_t *appro)
      * Extend the index file if necessary, use real writes to try to
      * keep the file fairly contiguous.
      */
-    if (bnro + sizeof(BTreeNode) > bt->bt_ExtAppend) {
-	dboff_t curapp = bnro;
+    if (ro + bytes > bt->bt_ExtAppend) {
+	dboff_t curapp = ro;
 	dboff_t extapp = bt->bt_ExtAppend + BT_CACHESIZE;
 
 	if (ZBuf == NULL)
@@ -1507,191 +1869,898 @@ btreeAppend(Index *index, BTreeNode *bn, dboff_t *appro)
 	);
     }
 
-    btreeIndexWrite(index, bnro, bn, sizeof(BTreeNode));
+    btreeIndexWrite(index, ro, (void *)data, bytes);
+    *appro = ro + bytes;
+    return(ro);
+}
 
-    if ((bn->bn_Flags & BNF_LEAF) == 0) {
-	int i;
+/*
+ * btreeAppendCover() -	append a covering copy of a table record
+ *
+ *	The copy holds the record header and only those columns which are
+ *	part of the key or the cover set, but retains the original rh_Size
+ *	and rh_Hv so deletions can still be paired up with their records.
+ *	The 64 bit data hash is not copied and the copy is always marked
+ *	RHMAGIC.
+ *
+ *	Returns the cover reference for the leaf element, or 0 if the copy
+ *	would be too large (the scan then falls back to the table record).
+ */
+static u_int32_t
+btreeAppendCover(Index *index, const RecHead *rh, dboff_t *appro)
+{
+    union {
+	BTreeCover	bc;
+	char		buf[RD_COVERSIZE];
+    } u;
+    RecHead *nrh = &u.bc.bc_Rh;
+    int soff;
+    int doff;
+    int ncols;
+    int bytes;
+    int i;
+    int j;
+    dboff_t ro;
 
-	for (i = 0; i < bn->bn_Count; ++i) {
-	    dboff_t par;
+    /*
+     * Count the columns we keep to locate the start of the copied data
+     */
+    ncols = 0;
+    for (i = 0; i < rh->rh_NCols; ++i) {
+	col_t colId = rh->rh_Cols[i].ch_ColId;
+
+	for (j = 0; j < index->i_NCols && index->i_ColIds[j] != colId; ++j)
+	    ;
+	if (j == index->i_NCols) {
+	    for (j = 0; j < index->i_NCover && index->i_CoverIds[j] != colId; ++j)
+		;
+	    if (j == index->i_NCover)
+		continue;
+	}
+	++ncols;
+    }
+    doff = offsetof(BTreeCover, bc_Rh) + offsetof(RecHead, rh_Cols[ncols]);
+    if (doff > (int)sizeof(u))
+	return(0);
+    bzero(&u, sizeof(u));
+    bcopy(rh, nrh, offsetof(RecHead, rh_Cols[0]));
+    nrh->rh_NCols = ncols;
+    nrh->rh_Magic = RHMAGIC;	/* no 64 bit data hash, see RecHash64() */
 
-	    DBASSERT(bn->bn_Elms[i].be_Ro != 0);
-	    par = bnro + i;
-	    btreeIndexWrite(
-		index,
-		bn->bn_Elms[i].be_Ro + offsetof(BTreeNode, bn_Parent),
-		&par,
-		sizeof(dboff_t)
-	    );
+    /*
+     * Copy the column headers and data (including any extended size
+     * field) in record order.
+     */
+    soff = offsetof(RecHead, rh_Cols[rh->rh_NCols]);
+    ncols = 0;
+    for (i = 0; i < rh->rh_NCols; ++i) {
+	const ColHead *ch = &rh->rh_Cols[i];
+	int keep;
+
+	bytes = ch->ch_Bytes;
+	if (ch->ch_Bytes >= BSIZE_EXT_BASE)
+	    bytes = *(int32_t *)((char *)rh + soff) + 4;
+	bytes = ALIGN4(bytes);
+
+	for (j = 0; j < index->i_NCols && index->i_ColIds[j] != ch->ch_ColId; ++j)
+	    ;
+	keep = (j != index->i_NCols);
+	for (j = 0; keep == 0 && j < index->i_NCover; ++j) {
+	    if (index->i_CoverIds[j] == ch->ch_ColId)
+		keep = 1;
+	}
+	if (keep) {
+	    if (doff + bytes > (int)sizeof(u))
+		return(0);
+	    nrh->rh_Cols[ncols++] = *ch;
+	    bcopy((const char *)rh + soff, u.buf + doff, bytes);
+	    doff += bytes;
 	}
+	soff += bytes;
     }
-    *appro = bnro + sizeof(BTreeNode);
-    return(bnro);
+    u.bc.bc_Bytes = doff;
+
+    ro = btreeAppendData(index, &u, doff, appro);
+    if ((ro >> BT_COVERSHIFT) > (dboff_t)0xFFFFFFFFU)
+	return(0);
+    return((u_int32_t)(ro >> BT_COVERSHIFT));
 }
 
 /*
- * btreeRead() -	Read the BTreeNode and set the index offset
+ * btreeBulkInit() -	start a bulk index update
  *
- *	The offset, bnro, consists of the base offset of the BTreeNode plus
- *	the element index.
- *
- *	Reads the btree node containing the specified index offset and
- *	sets *elm to the element index within the node.  
+ *	The caller feeds every new key to btreeBulkAdd(), then calls
+ *	btreeBulkFinish() to add them to the tree.
  */
-
-static const BTreeNode *
-btreeRead(Index *index, IndexMap **pim, dboff_t bnro, int *elm)
+static BulkBuild *
+btreeBulkInit(TableI *ti, Index *index, dboff_t *appro)
 {
-    *elm = bnro & BT_INDEXMASK;
-    bnro &= ~(dboff_t)BT_INDEXMASK;
-
-    return(btreeGetIndexMap(index, pim, bnro, sizeof(BTreeNode)));
+    BulkBuild *bb = zalloc(sizeof(BulkBuild));
+
+    bb->bb_TableI = ti;
+    bb->bb_Index = index;
+    bb->bb_Insert = (index->i_BTreeHead->bt_FirstElm != 0);
+    bb->bb_Appro = appro;
+    bb->bb_Fd = -1;
+    bb->bb_Keys = safe_malloc(sizeof(BTreeKey) * BT_BULKKEYS);
+    return(bb);
 }
 
 /*
- * btreeReadReScan() -	Read the BTreeNode and set the index offset
+ * btreeBulkAdd() -	queue a key for the bulk update
  *
- *	Similar to btreeRead(), but this routine is typically entered
- *	when regaining a node lock on the btree.  This routine is
- *	responsible for checking the Ro at the existing IRo to determine
- *	if a btree insert has moved our current cursor.
+ *	Returns -1 if the keys could not be spilled, in which case the
+ *	caller must abandon the bulk update.
  */
-
-static const BTreeNode *
-btreeReadReScan(Index *index, IndexMap **pim, dbpos_t *bpos, int *elm)
+static int
+btreeBulkAdd(BulkBuild *bb, const BTreeKey *bk)
 {
-    const BTreeNode *bn;
-    dboff_t bnro;
-
-    *elm = (int)bpos->p_IRo & BT_INDEXMASK;
-    bnro = bpos->p_IRo & ~(dboff_t)BT_INDEXMASK;
-
-    bn = btreeGetIndexMap(index, pim, bnro, sizeof(BTreeNode));
-    DBASSERT(bn->bn_Flags & BNF_LEAF);
-
-    /*
-     *	If an insert has moved our current cursor, we must iterate forwards
-     *	in the BTree to locate the new IRo for our existing Ro.  As a special
-     *	case the split code may reorder a node backwards up to the beginning
-     *	of the leaf (and no further) before begining the forward search.
-     */
-    if (bn->bn_Elms[*elm].be_Ro != bpos->p_Ro) {
-	*elm = 0;
-	bpos->p_IRo &= ~(dboff_t)BT_INDEXMASK;
-
-	while (bn->bn_Elms[*elm].be_Ro != bpos->p_Ro) {
-	    while (++*elm == bn->bn_Count) {
-		DBASSERT(bn->bn_Parent != 0);
-		bn = btreeRead(index, pim, bn->bn_Parent, elm);
-	    }
-	    while ((bn->bn_Flags & BNF_LEAF) == 0) {
-		bpos->p_IRo = bn->bn_Elms[*elm].be_Ro - 1;
-		bn = btreeRead(index, pim, bn->bn_Elms[*elm].be_Ro, elm);
-	    }
-	    ++bpos->p_IRo;
+    if (bb->bb_Count == BT_BULKKEYS) {
+	if (bb->bb_Insert) {
+	    int i;
+
+	    btreeBulkSort(bb);
+	    for (i = 0; i < bb->bb_Count; ++i)
+		btreeBulkEmit(bb, &bb->bb_Keys[i]);
+	    bb->bb_Count = 0;
+	} else if (btreeBulkSpill(bb) < 0) {
+	    return(-1);
 	}
     }
-
-    DBASSERT(bn->bn_Elms[*elm].be_Ro == bpos->p_Ro);
-    return(bn);
+    bb->bb_Keys[bb->bb_Count++] = *bk;
+    return(0);
 }
 
-static dboff_t
-btreeReadOffset(Index *index, dboff_t bnro)
+/*
+ * btreeBulkSort() -	sort the in-core keys
+ */
+static void
+btreeBulkSort(BulkBuild *bb)
 {
-    int elm;
-    const BTreeNode *bn;
-    IndexMap *im = NULL;
-
-    bn = btreeRead(index, &im, bnro, &elm);
-    bnro = bn->bn_Elms[elm].be_Ro;
-    btreeRelIndexMap(&im, 0);
-    return(bnro);
+    BTreeBulkIndex = bb->bb_Index;
+    qsort(bb->bb_Keys, bb->bb_Count, sizeof(BTreeKey), btreeBulkSortCmp);
 }
 
+/*
+ * btreeBulkSpill() -	sort the in-core keys and write them out as a run
+ *
+ *	The scratch file is unlinked as soon as it is created.  Returns -1
+ *	if the scratch file could not be created or written.
+ */
+static int
+btreeBulkSpill(BulkBuild *bb)
+{
+    Index *index = bb->bb_Index;
+    BulkRun *br;
+    int bytes;
+
+    if (bb->bb_Fd < 0) {
+	char *path;
+
+	safe_asprintf(&path, "%s.%d.bulk", index->i_FilePath, (int)getpid());
+	bb->bb_Fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0660);
+	if (bb->bb_Fd >= 0)
+	    remove(path);
+	safe_free(&path);
+	if (bb->bb_Fd < 0)
+	    return(-1);
+    }
+    btreeBulkSort(bb);
+
+    bytes = bb->bb_Count * sizeof(BTreeKey);
+    if (pwrite(bb->bb_Fd, bb->bb_Keys, bytes, bb->bb_FileOff) != bytes)
+	return(-1);
+
+    bb->bb_Runs = safe_realloc(bb->bb_Runs,
+			sizeof(BulkRun) * (bb->bb_NRuns + 1));
+    br = &bb->bb_Runs[bb->bb_NRuns++];
+    bzero(br, sizeof(BulkRun));
+    br->br_Off = bb->bb_FileOff;
+    br->br_Left = bb->bb_Count;
+
+    bb->bb_FileOff += bytes;
+    bb->bb_Count = 0;
+    return(0);
+}
+
+/*
+ * btreeBulkFinish() -	add the sorted keys to the tree
+ *
+ *	When building a new tree bt_LastElm is written before the root and
+ *	bt_FirstElm last, since a scan only looks at the tree once
+ *	bt_FirstElm is set.
+ *
+ *	The BulkBuild is always freed.  Returns -1 if the scratch file
+ *	failed, in which case the tree has not been touched.
+ */
+static int
+btreeBulkFinish(BulkBuild *bb)
+{
+    Index *index = bb->bb_Index;
+    int error = 0;
+    int level;
+    int i;
+
+    if (bb->bb_NRuns) {
+	if (bb->bb_Count)
+	    error = btreeBulkSpill(bb);
+	if (error == 0)
+	    error = btreeBulkMerge(bb);
+    } else {
+	btreeBulkSort(bb);
+	for (i = 0; i < bb->bb_Count; ++i)
+	    btreeBulkEmit(bb, &bb->bb_Keys[i]);
+    }
+
+    /*
+     * Flush the partially filled nodes from the bottom up.  The lone
+     * element left at the top level references the root.
+     */
+    if (error == 0 && bb->bb_LevelCount[0]) {
+	for (level = 0; ; ++level) {
+	    if (level > 0 && level == bb->bb_TopLevel &&
+		bb->bb_LevelCount[level] == 1
+	    ) {
+		bb->bb_Root = bb->bb_Level[level][0].bk_Ro;
+		break;
+	    }
+	    btreeBulkFlush(bb, level);
+	}
+	btreeIndexWrite(
+	    index,
+	    offsetof(BTreeHead, bt_LastElm),
+	    &bb->bb_LastElm,
+	    sizeof(dboff_t)
+	);
+	btreeIndexWrite(
+	    index,
+	    offsetof(BTreeHead, bt_Root),
+	    &bb->bb_Root,
+	    sizeof(dboff_t)
+	);
+	btreeIndexWrite(
+	    index,
+	    offsetof(BTreeHead, bt_FirstElm),
+	    &bb->bb_FirstElm,
+	    sizeof(dboff_t)
+	);
+    }
+
+    for (i = 0; i < bb->bb_NRuns; ++i)
+	safe_free((char **)&bb->bb_Runs[i].br_Keys);
+    safe_free((char **)&bb->bb_Runs);
+    safe_free((char **)&bb->bb_Keys);
+    if (bb->bb_Fd >= 0)
+	close(bb->bb_Fd);
+    zfree(bb, sizeof(BulkBuild));
+    return(error);
+}
+
+/*
+ * btreeBulkMerge() -	merge the sorted runs into the tree
+ *
+ *	A heap of run indexes ordered by each run's next key selects the
+ *	next key to emit.  Runs are only spilled when building a new tree,
+ *	so a read error leaves nothing but unreferenced nodes behind.
+ *	Returns -1 on a read error.
+ */
 static int
-btreeCompare(Index *index, const BTreeElm *b1, const BTreeElm *b2)
+btreeBulkMerge(BulkBuild *bb)
+{
+    int *heap = safe_malloc(sizeof(int) * bb->bb_NRuns);
+    int count = 0;
+    int error = 0;
+    int n;
+    int i;
+
+    DBASSERT(bb->bb_Insert == 0);
+    for (i = 0; i < bb->bb_NRuns; ++i) {
+	BulkRun *br = &bb->bb_Runs[i];
+
+	br->br_Keys = safe_malloc(sizeof(BTreeKey) * BT_BULKREAD);
+	if ((n = btreeBulkRead(bb, br)) < 0)
+	    error = -1;
+	else if (n)
+	    heap[count++] = i;
+    }
+    for (i = count / 2 - 1; i >= 0; --i)
+	btreeBulkHeapDown(bb, heap, count, i);
+
+    while (count && error == 0) {
+	BulkRun *br = &bb->bb_Runs[heap[0]];
+
+	btreeBulkEmit(bb, &br->br_Keys[br->br_Index++]);
+	if ((n = btreeBulkRead(bb, br)) < 0)
+	    error = -1;
+	else if (n == 0)
+	    heap[0] = heap[--count];
+	btreeBulkHeapDown(bb, heap, count, 0);
+	taskQuantum();
+    }
+    free(heap);
+    return(error);
+}
+
+/*
+ * btreeBulkEmit() -	add the next key in sorted order to the tree
+ */
+static void
+btreeBulkEmit(BulkBuild *bb, BTreeKey *bk)
+{
+    if (bb->bb_Insert)
+	btreeInsertRoot(bb->bb_TableI, bb->bb_Index, bk, bb->bb_Appro);
+    else
+	btreeBulkPush(bb, 0, bk);
+}
+
+/*
+ * btreeBulkRead() -	make sure the run has a key available
+ *
+ *	Returns 0 if the run has been exhausted, -1 on a read error.
+ */
+static int
+btreeBulkRead(BulkBuild *bb, BulkRun *br)
+{
+    if (br->br_Index == br->br_Count) {
+	int n = (br->br_Left < BT_BULKREAD) ? br->br_Left : BT_BULKREAD;
+	int bytes = n * sizeof(BTreeKey);
+
+	if (n == 0)
+	    return(0);
+	if (pread(bb->bb_Fd, br->br_Keys, bytes, br->br_Off) != bytes)
+	    return(-1);
+	br->br_Off += bytes;
+	br->br_Left -= n;
+	br->br_Index = 0;
+	br->br_Count = n;
+    }
+    return(1);
+}
+
+static void
+btreeBulkHeapDown(BulkBuild *bb, int *heap, int count, int i)
 {
+    for (;;) {
+	const BulkRun *br1;
+	const BulkRun *br2;
+	int j = i * 2 + 1;
+	int t;
+
+	if (j >= count)
+	    break;
+	if (j + 1 < count) {
+	    br1 = &bb->bb_Runs[heap[j]];
+	    br2 = &bb->bb_Runs[heap[j+1]];
+	    if (btreeBulkCompare(bb->bb_Index,
+		    &br2->br_Keys[br2->br_Index],
+		    &br1->br_Keys[br1->br_Index]) < 0) {
+		++j;
+	    }
+	}
+	br1 = &bb->bb_Runs[heap[i]];
+	br2 = &bb->bb_Runs[heap[j]];
+	if (btreeBulkCompare(bb->bb_Index,
+		&br1->br_Keys[br1->br_Index],
+		&br2->br_Keys[br2->br_Index]) <= 0) {
+	    break;
+	}
+	t = heap[i];
+	heap[i] = heap[j];
+	heap[j] = t;
+	i = j;
+    }
+}
+
+/*
+ * btreeBulkPush() -	add a key to the node being filled at a level
+ *
+ *	Level 0 holds the leaves.  A full node is written out first.
+ */
+static void
+btreeBulkPush(BulkBuild *bb, int level, const BTreeKey *bk)
+{
+    DBASSERT(level < BT_BULKLEVELS);
+    if (bb->bb_LevelCount[level] == BT_MAXELM)
+	btreeBulkFlush(bb, level);
+    bb->bb_Level[level][bb->bb_LevelCount[level]++] = *bk;
+    if (bb->bb_TopLevel < level)
+	bb->bb_TopLevel = level;
+}
+
+/*
+ * btreeBulkFlush() -	write out the node being filled at a level
+ *
+ *	The node's first key becomes its separator in the level above, just
+ *	like btreeSplit() does.  btreeAppend() retargets the children.
+ */
+static void
+btreeBulkFlush(BulkBuild *bb, int level)
+{
+    int count = bb->bb_LevelCount[level];
+    BTreeKey sep;
+    BTreeNode bn;
+
+    DBASSERT(count > 0);
+    bzero(&bn, sizeof(bn));
+    if (level == 0)
+	bn.bn_Flags |= BNF_LEAF;
+    btreePackNode(bb->bb_Index, &bn, bb->bb_Level[level], count);
+
+    sep = bb->bb_Level[level][0];
+    sep.bk_Flags &= ~BEF_DELETED;
+    sep.bk_Cover = 0;
+    sep.bk_Ro = btreeAppend(bb->bb_Index, &bn, bb->bb_Appro);
+    if (level == 0) {
+	if (bb->bb_FirstElm == 0)
+	    bb->bb_FirstElm = sep.bk_Ro;
+	bb->bb_LastElm = sep.bk_Ro + (count - 1);
+    }
+    bb->bb_LevelCount[level] = 0;
+    btreeBulkPush(bb, level + 1, &sep);
+}
+
+/*
+ * btreeBulkCompare() -	order keys for a bulk build
+ *
+ *	Equal keys are kept in table order, as btreeInsert() would.
+ */
+static int
+btreeBulkCompare(Index *index, const BTreeKey *k1, const BTreeKey *k2)
+{
+    int r;
+
+    if ((r = btreeCompare(index, k1, k2)) == 0) {
+	if (k1->bk_Ro < k2->bk_Ro)
+	    r = -1;
+	else if (k1->bk_Ro > k2->bk_Ro)
+	    r = 1;
+    }
+    return(r);
+}
+
+static int
+btreeBulkSortCmp(const void *v1, const void *v2)
+{
+    return(btreeBulkCompare(BTreeBulkIndex, v1, v2));
+}
+
+/*
+ * BTreeCoverRec() -	return the covering copy of the record at pos
+ *
+ *	The copy is placed in the table instance's RawData since the index
+ *	mapping cannot be held across the scan.  NULL is returned if the
+ *	element has no copy.
+ */
+static const RecHead *
+BTreeCoverRec(TableI *ti, dbpos_t *pos)
+{
+    Index *index = ti->ti_Index;
+    RawData *rd = ti->ti_RData;
+    IndexMap *im = NULL;
+    const BTreeNode *bn;
+    const BTreeCover *bc;
+    dboff_t ro;
+    int elm;
+
+    bn = btreeReadReScan(index, &im, pos, &elm);
+    if ((ro = (dboff_t)bn->bn_Elms[elm].be_Cover << BT_COVERSHIFT) == 0) {
+	btreeRelIndexMap(&im, 0);
+	return(NULL);
+    }
+    bc = btreeGetIndexMap(index, &im, ro, sizeof(BTreeCover));
+    DBASSERT(bc->bc_Bytes <= RD_COVERSIZE);
+    bc = btreeGetIndexMap(index, &im, ro, bc->bc_Bytes);
+    if (rd->rd_CoverBuf == NULL)
+	rd->rd_CoverBuf = zalloc(RD_COVERSIZE);
+    bcopy(&bc->bc_Rh, rd->rd_CoverBuf, bc->bc_Bytes - offsetof(BTreeCover, bc_Rh));
+    btreeRelIndexMap(&im, 0);
+    return((const RecHead *)rd->rd_CoverBuf);
+}
+
+/*
+ * btreeRead() -	Read the BTreeNode and set the index offset
+ *
+ *	The offset, bnro, consists of the base offset of the BTreeNode plus
+ *	the element index.
+ *
+ *	Reads the btree node containing the specified index offset and
+ *	sets *elm to the element index within the node.  
+ */
+
+static const BTreeNode *
+btreeRead(Index *index, IndexMap **pim, dboff_t bnro, int *elm)
+{
+    *elm = bnro & BT_INDEXMASK;
+    bnro &= ~(dboff_t)BT_INDEXMASK;
+
+    return(btreeGetIndexMap(index, pim, bnro, sizeof(BTreeNode)));
+}
+
+/*
+ * btreePrevLeaf() -	Locate the leaf preceding leaf bn
+ *
+ *	Recurses up until a parent has a previous element and back down
+ *	its last elements, as in BTreePrevTableRec().  bpos is set to the
+ *	last element of the leaf.  NULL is returned if bn is the first
+ *	leaf of the index.
+ */
+
+static const BTreeNode *
+btreePrevLeaf(Index *index, IndexMap **pim, const BTreeNode *bn, dbpos_t *bpos)
+{
+    dboff_t bnro = 0;
+    int elm = 0;
+
+    while (--elm < 0) {
+	if (bn->bn_Parent == 0)
+	    return(NULL);
+	bn = btreeRead(index, pim, bn->bn_Parent, &elm);
+    }
+    while ((bn->bn_Flags & BNF_LEAF) == 0) {
+	bnro = bn->bn_Elms[elm].be_Ro;
+	bn = btreeRead(index, pim, bnro, &elm);
+	elm = bn->bn_Count - 1;
+	DBASSERT(elm >= 0);
+    }
+    bpos->p_IRo = (bnro & ~(dboff_t)BT_INDEXMASK) + elm;
+    bpos->p_Ro = bn->bn_Elms[elm].be_Ro;
+    return(bn);
+}
+
+/*
+ * btreeReadReScan() -	Read the BTreeNode and set the index offset
+ *
+ *	Similar to btreeRead(), but this routine is typically entered
+ *	when regaining a node lock on the btree.  This routine is
+ *	responsible for checking the Ro at the existing IRo to determine
+ *	if a btree insert has moved our current cursor.
+ */
+
+static const BTreeNode *
+btreeReadReScan(Index *index, IndexMap **pim, dbpos_t *bpos, int *elm)
+{
+    const BTreeNode *bn;
+    dboff_t bnro;
+
+    *elm = (int)bpos->p_IRo & BT_INDEXMASK;
+    bnro = bpos->p_IRo & ~(dboff_t)BT_INDEXMASK;
+
+    bn = btreeGetIndexMap(index, pim, bnro, sizeof(BTreeNode));
+    DBASSERT(bn->bn_Flags & BNF_LEAF);
+
+    /*
+     *	If an insert has moved our current cursor, we must iterate forwards
+     *	in the BTree to locate the new IRo for our existing Ro.  As a special
+     *	case the split code may reorder a node backwards up to the beginning
+     *	of the leaf (and no further) before begining the forward search.
+     */
+    if (bn->bn_Elms[*elm].be_Ro != bpos->p_Ro) {
+	*elm = 0;
+	bpos->p_IRo &= ~(dboff_t)BT_INDEXMASK;
+
+	while (bn->bn_Elms[*elm].be_Ro != bpos->p_Ro) {
+	    while (++*elm == bn->bn_Count) {
+		DBASSERT(bn->bn_Parent != 0);
+		bn = btreeRead(index, pim, bn->bn_Parent, elm);
+	    }
+	    while ((bn->bn_Flags & BNF_LEAF) == 0) {
+		bpos->p_IRo = bn->bn_Elms[*elm].be_Ro - 1;
+		bn = btreeRead(index, pim, bn->bn_Elms[*elm].be_Ro, elm);
+	    }
+	    ++bpos->p_IRo;
+	}
+    }
+
+    DBASSERT(bn->bn_Elms[*elm].be_Ro == bpos->p_Ro);
+    return(bn);
+}
+
+static dboff_t
+btreeReadOffset(Index *index, dboff_t bnro)
+{
+    int elm;
+    const BTreeNode *bn;
+    IndexMap *im = NULL;
+
+    bn = btreeRead(index, &im, bnro, &elm);
+    bnro = bn->bn_Elms[elm].be_Ro;
+    btreeRelIndexMap(&im, 0);
+    return(bnro);
+}
+
+/*
+ * btreeSetKey() -	construct a search key from raw column data
+ *
+ *	Data beyond BT_MAXKEYLEN is dropped and the key is flagged
+ *	BEF_TRUNC.
+ */
+static void
+btreeSetKey(BTreeKey *bk, const void *data, int bytes)
+{
+    bzero(bk, offsetof(BTreeKey, bk_Data));
+    if (bytes > BT_MAXKEYLEN) {
+	bytes = BT_MAXKEYLEN;
+	bk->bk_Flags |= BEF_TRUNC;
+    }
+    bk->bk_Len = bytes;
+    bcopy(data, bk->bk_Data, bytes);
+}
+
+/*
+ * btreeAddKeyComp() -	append one column to a compound key
+ *
+ *	Each column is escaped (0x00 becomes 0x00 0x01) and terminated with
+ *	0x00 0x00, so a byte-wise compare of two compound keys orders them
+ *	column by column.  Returns -1 if the key had to be truncated.
+ */
+static int
+btreeAddKeyComp(BTreeKey *bk, const ColData *cd)
+{
+    const u_int8_t *ptr = (const u_int8_t *)cd->cd_Data;
+    int i;
+
+    if (bk->bk_Flags & BEF_TRUNC)
+	return(-1);
+    for (i = 0; i <= cd->cd_Bytes; ++i) {
+	int n = (i == cd->cd_Bytes || ptr[i] == 0) ? 2 : 1;
+
+	if (bk->bk_Len + n > BT_MAXKEYLEN) {
+	    bk->bk_Flags |= BEF_TRUNC;
+	    return(-1);
+	}
+	if (i == cd->cd_Bytes) {
+	    bk->bk_Data[bk->bk_Len++] = 0;
+	    bk->bk_Data[bk->bk_Len++] = 0;
+	} else if (ptr[i] == 0) {
+	    bk->bk_Data[bk->bk_Len++] = 0;
+	    bk->bk_Data[bk->bk_Len++] = 1;
+	} else {
+	    bk->bk_Data[bk->bk_Len++] = ptr[i];
+	}
+    }
+    return(0);
+}
+
+/*
+ * btreeSetRecordKey() - construct the index key for the current record
+ *
+ *	Simple indexes use colData directly.  Compound indexes pull each of
+ *	their columns out of the record's raw data.
+ */
+static void
+btreeSetRecordKey(Index *index, BTreeKey *bk, const RawData *rd, const ColData *colData)
+{
+    const ColData *cd;
+    int i;
+
+    if (index->i_NCols == 1) {
+	btreeSetKey(bk, colData->cd_Data, colData->cd_Bytes);
+	return;
+    }
+    bzero(bk, offsetof(BTreeKey, bk_Data));
+    for (i = 0; i < index->i_NCols; ++i) {
+	for (cd = rd->rd_ColBase; cd; cd = cd->cd_Next) {
+	    if ((col_t)cd->cd_ColId == index->i_ColIds[i])
+		break;
+	}
+	DBASSERT(cd != NULL);
+	if (btreeAddKeyComp(bk, cd) < 0)
+	    break;
+    }
+}
+
+/*
+ * btreeGetKey() -	expand element elm of node bn into a full key
+ */
+static void
+btreeGetKey(const BTreeNode *bn, int elm, BTreeKey *bk)
+{
+    const BTreeElm *be = &bn->bn_Elms[elm];
+
+    bk->bk_Ro = be->be_Ro;
+    bk->bk_Flags = be->be_Flags;
+    bk->bk_Cover = be->be_Cover;
+    bk->bk_Len = bn->bn_PfxLen + be->be_Len;
+    bcopy(bn->bn_Pfx, bk->bk_Data, bn->bn_PfxLen);
+    bcopy(be->be_Data, bk->bk_Data + bn->bn_PfxLen, be->be_Len);
+}
+
+/*
+ * btreePackNode() -	store count keys into the node, prefix-compressed
+ *
+ *	The longest prefix common to all keys (up to BT_PFXLEN) is stored
+ *	once in the node and stripped from each element.  Suffixes longer
+ *	than BT_DATALEN are truncated and flagged BEF_TRUNC.  The caller
+ *	is responsible for bn_Parent and bn_Flags.
+ */
+static void
+btreePackNode(Index *index, BTreeNode *bn, const BTreeKey *keys, int count)
+{
+    int pfx = 0;
+    int i;
+
+    if (count && (index->i_OpClass == ROP_EQEQ || index->i_OpClass == ROP_LIKE)) {
+	pfx = keys[0].bk_Len;
+	if (pfx > BT_PFXLEN)
+	    pfx = BT_PFXLEN;
+	for (i = 1; i < count && pfx; ++i) {
+	    const BTreeKey *bk = &keys[i];
+	    int j;
+
+	    if (pfx > bk->bk_Len)
+		pfx = bk->bk_Len;
+	    for (j = 0; j < pfx && bk->bk_Data[j] == keys[0].bk_Data[j]; ++j)
+		;
+	    pfx = j;
+	}
+    }
+    bn->bn_Count = count;
+    bn->bn_PfxLen = pfx;
+    bcopy(keys[0].bk_Data, bn->bn_Pfx, pfx);
+
+    for (i = 0; i < count; ++i) {
+	const BTreeKey *bk = &keys[i];
+	BTreeElm *be = &bn->bn_Elms[i];
+	int n = bk->bk_Len - pfx;
+
+	be->be_Ro = bk->bk_Ro;
+	be->be_Flags = bk->bk_Flags;
+	be->be_Cover = bk->bk_Cover;
+	if (n > BT_DATALEN) {
+	    n = BT_DATALEN;
+	    be->be_Flags |= BEF_TRUNC;
+	}
+	be->be_Len = n;
+	bcopy(bk->bk_Data + pfx, be->be_Data, n);
+    }
+}
+
+/*
+ * btreeCompareBytes() - compare two possibly-truncated key strings
+ *
+ *	If one string is a proper prefix of the other it sorts first,
+ *	unless it was truncated in which case we cannot tell the two
+ *	apart and return a match.
+ */
+static int
+btreeCompareBytes(int fold, const u_int8_t *d1, int l1, int t1, const u_int8_t *d2, int l2, int t2)
+{
+    int n = (l1 < l2) ? l1 : l2;
     int j;
 
+    if (fold) {
+	/*
+	 * The standard 'same' comparison is case insensitive.
+	 */
+	for (j = 0; j < n; ++j) {
+	    int c1 = tolower(d1[j]);
+	    int c2 = tolower(d2[j]);
+
+	    if (c1 != c2)
+		return((c1 < c2) ? -1 : 1);
+	}
+    } else if ((j = memcmp(d1, d2, n)) != 0) {
+	return((j < 0) ? -1 : 1);
+    }
+    if (l1 < l2)
+	return(t1 ? 0 : -1);
+    if (l1 > l2)
+	return(t2 ? 0 : 1);
+    return(0);
+}
+
+/*
+ * btreeCompare() -	compare two fully expanded keys
+ */
+static int
+btreeCompare(Index *index, const BTreeKey *k1, const BTreeKey *k2)
+{
     switch(index->i_OpClass) {
     case ROP_STAMP_EQEQ:
-	if (*(dbstamp_t *)b1->be_Data < *(dbstamp_t *)b2->be_Data)
+	if (*(dbstamp_t *)k1->bk_Data < *(dbstamp_t *)k2->bk_Data)
 	    return(-1);
-	if (*(dbstamp_t *)b1->be_Data > *(dbstamp_t *)b2->be_Data)
+	if (*(dbstamp_t *)k1->bk_Data > *(dbstamp_t *)k2->bk_Data)
 	    return(1);
 	break;
     case ROP_VTID_EQEQ:
-	if (*(vtable_t *)b1->be_Data < *(vtable_t *)b2->be_Data)
+	if (*(vtable_t *)k1->bk_Data < *(vtable_t *)k2->bk_Data)
 	    return(-1);
-	if (*(vtable_t *)b1->be_Data > *(vtable_t *)b2->be_Data)
+	if (*(vtable_t *)k1->bk_Data > *(vtable_t *)k2->bk_Data)
 	    return(1);
 	break;
     case ROP_USERID_EQEQ:
-	if (*(u_int32_t *)b1->be_Data < *(u_int32_t *)b2->be_Data)
+	if (*(u_int32_t *)k1->bk_Data < *(u_int32_t *)k2->bk_Data)
 	    return(-1);
-	if (*(u_int32_t *)b1->be_Data > *(u_int32_t *)b2->be_Data)
+	if (*(u_int32_t *)k1->bk_Data > *(u_int32_t *)k2->bk_Data)
 	    return(1);
 	break;
     case ROP_OPCODE_EQEQ:
-	if (*(u_int8_t *)b1->be_Data < *(u_int8_t *)b2->be_Data)
+	if (*(u_int8_t *)k1->bk_Data < *(u_int8_t *)k2->bk_Data)
 	    return(-1);
-	if (*(u_int8_t *)b1->be_Data > *(u_int8_t *)b2->be_Data)
+	if (*(u_int8_t *)k1->bk_Data > *(u_int8_t *)k2->bk_Data)
 	    return(1);
 	break;
     case ROP_LIKE:
-	for (j = 0; j != BT_DATALEN; ++j) {
-	    /*
-	     * break out (return match) on exact match
-	     */
-	    if (j == b1->be_Len && j == b2->be_Len)
-		break;
-
-	    /*
-	     * If left hand string EOF or left hand string less then right
-	     * hand, return -1 (left hand is less then right hand).
-	     *
-	     * The standard 'same' comparison is case insensitive.
-	     */
-	    if (j == b1->be_Len || tolower(b1->be_Data[j]) < tolower(b2->be_Data[j]))
-		return(-1);
-
-	    /*
-	     * If right hand string EOF or left hand string greater then right
-	     * hand, return +1 (left hand is greater then right hand).  
-	     * Otherwise loop.
-	     */
-	    if (j == b2->be_Len || tolower(b1->be_Data[j]) > tolower(b2->be_Data[j]))
-		return(1);
-	}
-	/*
-	 * Return match if we hit the end of our key cache buffer
-	 */
-	break;
     case ROP_EQEQ:
-	for (j = 0; j != BT_DATALEN; ++j) {
-	    /*
-	     * break out (return match) on exact match
-	     */
-	    if (j == b1->be_Len && j == b2->be_Len)
-		break;
+	return(btreeCompareBytes(
+	    (index->i_OpClass == ROP_LIKE),
+	    k1->bk_Data, k1->bk_Len, k1->bk_Flags & BEF_TRUNC,
+	    k2->bk_Data, k2->bk_Len, k2->bk_Flags & BEF_TRUNC
+	));
+    default:
+	DBASSERT(0);
+	break;
+    }
+    return(0);
+}
 
-	    /*
-	     * If left hand string EOF or left hand string less then right
-	     * hand, return -1 (left hand is less then right hand).
-	     */
-	    if (j == b1->be_Len || b1->be_Data[j] < b2->be_Data[j])
-		return(-1);
+/*
+ * btreeComparePfx() -	compare a search key against a node's common prefix
+ *
+ *	A non-zero return means the search key compares the same way
+ *	against every element in the node, and the per-element compare
+ *	can be skipped entirely.
+ */
+static int
+btreeComparePfx(Index *index, const BTreeKey *cmp, const BTreeNode *bn)
+{
+    if (bn->bn_PfxLen == 0)
+	return(0);
+    return(btreeCompareBytes(
+	(index->i_OpClass == ROP_LIKE),
+	cmp->bk_Data, cmp->bk_Len, cmp->bk_Flags & BEF_TRUNC,
+	bn->bn_Pfx, bn->bn_PfxLen, 1
+    ));
+}
 
-	    /*
-	     * If right hand string EOF or left hand string greater then right
-	     * hand, return +1 (left hand is greater then right hand).  
-	     * Otherwise loop.
-	     */
-	    if (j == b2->be_Len || b1->be_Data[j] > b2->be_Data[j])
-		return(1);
-	}
+/*
+ * btreeCompareSfx() -	compare a search key against element elm, assuming
+ *			the node's common prefix has already matched.
+ */
+static int
+btreeCompareSfx(Index *index, const BTreeKey *cmp, const BTreeNode *bn, int elm)
+{
+    const BTreeElm *be = &bn->bn_Elms[elm];
+    int pfx = bn->bn_PfxLen;
+
+    switch(index->i_OpClass) {
+    case ROP_STAMP_EQEQ:
+	if (*(dbstamp_t *)cmp->bk_Data < *(dbstamp_t *)be->be_Data)
+	    return(-1);
+	if (*(dbstamp_t *)cmp->bk_Data > *(dbstamp_t *)be->be_Data)
+	    return(1);
 	break;
+    case ROP_VTID_EQEQ:
+	if (*(vtable_t *)cmp->bk_Data < *(vtable_t *)be->be_Data)
+	    return(-1);
+	if (*(vtable_t *)cmp->bk_Data > *(vtable_t *)be->be_Data)
+	    return(1);
+	break;
+    case ROP_USERID_EQEQ:
+	if (*(u_int32_t *)cmp->bk_Data < *(u_int32_t *)be->be_Data)
+	    return(-1);
+	if (*(u_int32_t *)cmp->bk_Data > *(u_int32_t *)be->be_Data)
+	    return(1);
+	break;
+    case ROP_OPCODE_EQEQ:
+	if (*(u_int8_t *)cmp->bk_Data < *(u_int8_t *)be->be_Data)
+	    return(-1);
+	if (*(u_int8_t *)cmp->bk_Data > *(u_int8_t *)be->be_Data)
+	    return(1);
+	break;
+    case ROP_LIKE:
+    case ROP_EQEQ:
+	/*
+	 * A search key shorter than the prefix can only get here if it
+	 * was truncated, in which case it matches.
+	 */
+	if (cmp->bk_Len < pfx)
+	    return(0);
+	return(btreeCompareBytes(
+	    (index->i_OpClass == ROP_LIKE),
+	    cmp->bk_Data + pfx, cmp->bk_Len - pfx, cmp->bk_Flags & BEF_TRUNC,
+	    be->be_Data, be->be_Len, be->be_Flags & BEF_TRUNC
+	));
     default:
 	DBASSERT(0);
 	break;
@@ -1699,19 +2768,39 @@ btreeCompare(Index *index, const BTreeElm *b1, const BTreeElm *b2)
     return(0);
 }
 
+/*
+ * btreeCompareKey() -	compare a search key against element elm of bn
+ */
+static int
+btreeCompareKey(Index *index, const BTreeKey *cmp, const BTreeNode *bn, int elm)
+{
+    int r;
+
+    if ((r = btreeComparePfx(index, cmp, bn)) != 0)
+	return(r);
+    return(btreeCompareSfx(index, cmp, bn, elm));
+}
+
 /*
  * The compare at <elm> is < 0.  Locate the first node going forwards whos
  * copare is >= 0.  Use a binary search.
+ *
+ * The node prefix is compared only once.  If it does not match, every
+ * element compares the same way and we can return immediately.
  */
 static int
-btreeCompareSearchFwd(Index *index, const BTreeNode *bn, int elm, BTreeElm *cmp)
+btreeCompareSearchFwd(Index *index, const BTreeNode *bn, int elm, BTreeKey *cmp)
 {
     int try;
     int last = bn->bn_Count - 1;
+    int r;
+
+    if ((r = btreeComparePfx(index, cmp, bn)) != 0)
+	return((r > 0) ? last : elm);
 
     while (elm != last) {
 	try = (elm + last + 1) / 2;	/* elm < 0 so slide towards last */
-	if (btreeCompare(index, &bn->bn_Elms[try], cmp) < 0) {
+	if (btreeCompareSfx(index, cmp, bn, try) > 0) {
 	    elm = try;
 	} else {
 	    if (last == try)
@@ -1726,16 +2815,22 @@ btreeCompareSearchFwd(Index *index, const BTreeNode *bn, int elm, BTreeElm *cmp)
 /*
  * The compare at <elm> is > 0.  Locate the first node going backwards whos
  * copare is <= 0.  Use a binary search.
+ *
+ * The node prefix is compared only once (see btreeCompareSearchFwd()).
  */
 static int
-btreeCompareSearchRev(Index *index, const BTreeNode *bn, int elm, BTreeElm *cmp)
+btreeCompareSearchRev(Index *index, const BTreeNode *bn, int elm, BTreeKey *cmp)
 {
     int try;
     int first = 0;
+    int r;
+
+    if ((r = btreeComparePfx(index, cmp, bn)) != 0)
+	return((r < 0) ? first : elm);
 
     while (elm != first) {
 	try = (first + elm) / 2;	/* elm > 0 so slide towards first */
-	if (btreeCompare(index, &bn->bn_Elms[try], cmp) > 0) {
+	if (btreeCompareSfx(index, cmp, bn, try) < 0) {
 	    elm = try;
 	} else {
 	    if (first == try)
@@ -1747,7 +2842,14 @@ btreeCompareSearchRev(Index *index, const BTreeNode *bn, int elm, BTreeElm *cmp)
     return(elm);
 }
 
-static const void *
+/*
+ * btreeGetIndexMap() -	map part of an index file through the index cache
+ *
+ *	The cache, and the write and synchronization support routines
+ *	below, are also used by the hash index (see hash.c).  They only
+ *	rely on the common IndexHead portion of the index header.
+ */
+const void *
 btreeGetIndexMap(Index *index, IndexMap **pmap, dboff_t ro, int bytes)
 {
     IndexMap *im;
@@ -1813,7 +2915,7 @@ btreeGetIndexMap(Index *index, IndexMap **pmap, dboff_t ro, int bytes)
     return(im->im_Base + (int)(ro - im->im_Ro));
 }
 
-static void
+void
 btreeRelIndexMap(IndexMap **pmap, int freeLastClose)
 {
     IndexMap *im;
@@ -1944,7 +3046,7 @@ btreeUnSynchronize(Index *index)
     btreeIndexFSync(index);
 }
 
-static int
+int
 btreeIndexWrite(Index *index, off_t off, void *data, int bytes)
 {
     /*
@@ -1970,7 +3072,7 @@ btreeIndexWrite(Index *index, off_t off, void *data, int bytes)
     return(-1);
 }
 
-static void
+void
 btreeIndexFSync(Index *index)
 {
     if ((index->i_BTreeHead->bt_Flags & BTF_TEMP) == 0) {
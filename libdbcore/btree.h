@@ -12,36 +12,101 @@
  *	space.
  *
  *	NOTE! Minimum data length is sizeof(dbstamp_t), usually 8 bytes
+ *
+ * Notes on key storage:
+ *
+ *	Each node stores the longest prefix common to all of its keys
+ *	once (bn_Pfx), and each element stores only the remainder of its
+ *	key (be_Data, up to BT_DATALEN bytes).  Keys may therefore be
+ *	distinguished out to BT_MAXKEYLEN bytes as long as the keys sharing
+ *	a node are similar, which is the common case for long identifiers.
+ *	A key which could not be stored in full is flagged BEF_TRUNC and
+ *	compares equal to anything it is a prefix of.
+ *
+ *	Only string opclasses (ROP_EQEQ, ROP_LIKE) are prefix-compressed.
+ *	All other opclasses always store a zero-length node prefix.
+ *
+ * Notes on covering indexes:
+ *
+ *	A covering index (i_NCover >= 0) appends a partial copy of each
+ *	indexed record to the index file, consisting of the record header
+ *	and the key and cover columns only.  be_Cover locates the copy
+ *	(in BT_COVERSHIFT units, 0 if there is none) and allows a scan to
+ *	run without touching the table at all.  The copy keeps the original
+ *	rh_Size so pending deletions can still be matched up.
+ *
+ *	The cover columns are declared per table (USING COVER), every btree
+ *	index on such a table is covering.  An index-only scan is only used
+ *	when the query reads nothing but key and cover columns.
  */
 
 #define BT_MAXELM		64		    /* elements per node */
-#define BT_DATALEN		8		    /* cached key data */
+#define BT_DATALEN		16		    /* per-element key suffix */
+#define BT_PFXLEN		48		    /* per-node common prefix */
+#define BT_MAXKEYLEN		(BT_PFXLEN + BT_DATALEN)
 #define BT_INDEXMASK		(BT_MAXELM - 1)	    /* used to align data */
 #define BT_CACHESIZE		(64 * 1024)
 #define BT_CACHEMASK		(BT_CACHESIZE - 1)
 #define BT_MAXCACHE		(MAX_BTREE_CACHE / BT_CACHESIZE)
+#define BT_COVERSHIFT		6		    /* be_Cover granularity */
 
 /*
  * The database does not require the BTree index to be in synch.  BT_SLOP
- * is the amount of slop we allow before we try to bring the BTree up to
- * date.  This improves performance for both small and large transactions.
- * However, please note that unsynchronized records are scanned sequentially
- * and too-large a SLOP can result in O(N^2) behavior (N = unindexed records).
- * We recommend a value between 512 bytes and 4K.
+ * is the default amount of slop we allow before a query tries to bring the
+ * BTree up to date (see ta_IndexSlop and SetIndexSlop()).  This improves
+ * performance for both small and large transactions.  However, please note
+ * that unsynchronized records are scanned sequentially and too-large a SLOP
+ * can result in O(N^2) behavior (N = unindexed records).  We recommend a
+ * value between 512 bytes and 4K unless a background indexer keeps the
+ * indexes up to date (see UpdateDatabaseIndexes()).
  */
 #define BT_SLOP			(1 * 1024)
 
+/*
+ * A bulk (bottom-up) build replaces record-at-a-time insertion when at
+ * least BT_BULKMIN bytes of the table are unindexed, see BTreeUpdateIndex().
+ * BT_BULKKEYS keys are sorted in core at a time.
+ */
+#define BT_BULKMIN		(4 * 1024 * 1024)
+#define BT_BULKKEYS		32768
+#define BT_BULKREAD		128		    /* per run when merging */
+#define BT_BULKLEVELS		8
+
+/*
+ * An equality join between two btree-indexed columns walks both indexes
+ * in the same direction.  BTreeCacheCheck() follows the inner index back
+ * from the previous match by up to BT_MERGELEAFS leaves before it falls
+ * back to a search from the root.
+ */
+#define BT_MERGELEAFS		4
+
 #define BTREE_HSIZE		(BT_MAXCACHE * 2)
 #define BTREE_HMASK		(BTREE_HSIZE - 1)
 
 typedef struct BTreeElm {
     dboff_t	be_Ro;		/* offset of subtree or phys tab if leaf */
-    int16_t	be_Len;		/* length as stored (up to BT_DATALEN) */
-    u_int16_t	be_Flags;	/* (reserved) */
+    int16_t	be_Len;		/* suffix length as stored (up to BT_DATALEN) */
+    u_int16_t	be_Flags;	/* BEF_* */
+    u_int32_t	be_Cover;	/* (leaf) covering copy of record, or 0 */
     u_int8_t	be_Data[BT_DATALEN];
 } BTreeElm;
 
 #define BEF_DELETED	0x0001	/* indicates leaf element marked deleted */
+#define BEF_TRUNC	0x0002	/* stored key is a truncated prefix */
+
+/*
+ * BTreeKey
+ *
+ *	An uncompressed key, used for searches and to shuffle elements
+ *	around during inserts and splits.  Never stored on disk.
+ */
+typedef struct BTreeKey {
+    dboff_t	bk_Ro;
+    int16_t	bk_Len;		/* length of key in bk_Data */
+    u_int16_t	bk_Flags;	/* BEF_* */
+    u_int32_t	bk_Cover;	/* see be_Cover */
+    u_int8_t	bk_Data[BT_MAXKEYLEN];
+} BTreeKey;
 
 /*
  * BTreeNode
@@ -52,11 +117,26 @@ typedef struct BTreeNode {
     dboff_t	bn_Parent;	/* offset of parent, ORd with index */
     int16_t	bn_Count;
     u_int16_t	bn_Flags;
+    int16_t	bn_PfxLen;	/* length of common key prefix */
+    u_int16_t	bn_Unused01;
+    u_int8_t	bn_Pfx[BT_PFXLEN];
     BTreeElm	bn_Elms[BT_MAXELM];
 } BTreeNode;
 
 #define BNF_LEAF	0x0001
 
+/*
+ * BTreeCover
+ *
+ *	Covering copy of a table record, see be_Cover.  bc_Bytes is the
+ *	size of the whole structure including the record copy.
+ */
+typedef struct BTreeCover {
+    int32_t	bc_Bytes;
+    int32_t	bc_Unused01;
+    RecHead	bc_Rh;		/* (partial) record follows */
+} BTreeCover;
+
 typedef struct BTreeHead {
     IndexHead	bt_Head;
     dboff_t	bt_Root;	/* offset of root node */
@@ -77,7 +157,7 @@ typedef struct BTreeHead {
 #define BTF_TEMP	0x00000002	/* temporary index */
 
 #define BT_MAGIC	0x4255FCD2
-#define BT_VERSION	2
+#define BT_VERSION	4
 
 /*
  * BTreeInsert() function flags
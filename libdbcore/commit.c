@@ -419,6 +419,8 @@ Commit2(DataBase *db, dbstamp_t cts, rhuser_t userid, int flags)
 
 		WriteDataRecord(parTab, NULL, rh, rh->rh_VTableId,
 		    cts, userid, rh->rh_Flags);
+		if (parTab->ta_Stats)
+		    StatsCommitRecord(parTab, rh);
 		didAny = 1;
 		lastOp = rh->rh_Flags;
 	    }
@@ -10,49 +10,255 @@
  *    this file contains global variables and routines to support the datamap
  *    file ops.
  *
- *    At the moment our garbage collection code is rather poor, but it 
- *    accomplishes our main goal of not mmap()ing too much data.  Keep in
- *    mind that the kernel will cache file data whether we mmap() it or not,
- *    and unmapping it here should not effect the kernel filesystem buffer
- *    cache much at all.
+ *    Replacement uses the 2Q algorithm.  A block referenced for the first
+ *    time is queued on the FIFO BCInList.  If it is referenced again
+ *    shortly after being evicted from BCInList (we remember recently
+ *    evicted blocks on the BCGhostList) it is queued on the LRU BCHotList
+ *    instead.  BCInList is limited to a fraction of the cache, so a
+ *    sequential scan cycles through BCInList without evicting the hot
+ *    blocks that index probes depend on.
+ *
+ *    Keep in mind that the kernel will cache file data whether we mmap() it
+ *    or not, and unmapping it here should not effect the kernel filesystem
+ *    buffer cache much at all.
  */
 
 #include "defs.h"
 
+/*
+ * DataMapGhost - remembers a block recently evicted from BCInList.  The
+ * table pointer is only compared, never dereferenced.
+ */
+typedef struct DataMapGhost {
+    Node		dg_Node;	/* BCGhostList */
+    struct DataMapGhost	*dg_HNext;
+    struct Table	*dg_Table;
+    dboff_t		dg_Ro;
+    int			dg_Hi;		/* BCGhostHash index */
+} DataMapGhost;
+
+#define DM_INSHARE	4	/* BCInList gets 1/DM_INSHARE of the cache */
+#define DM_GHOSTSHARE	2	/* ghosts cover 1/DM_GHOSTSHARE of the cache */
+#define DM_MAXSCAN	(DM_HSIZE / 4)	/* blocks examined per collection */
+
+#define QNODE_TO_DM(node)	\
+	((DataMap *)((char *)(node) - offsetof(DataMap, dm_QNode)))
+
 Export u_long	BCMemoryUsed;
 Export u_long	BCMemoryLimit;
+Export DataMapStats BCStats;
+Export void SetDataMapCacheSize(u_long bytes);
 
 Prototype DataMap *BCHash[DM_HSIZE];
 Prototype void DataMapGarbageCollect(void);
+Prototype void DataMapAccess(DataMap *dm);
+Prototype void DataMapDequeue(DataMap *dm);
+Prototype void DataMapForgetTable(Table *tab);
+
+static void dataMapPurge(List *list, int inOnly, int *maxscan);
+static void dataMapEvict(DataMap *dm);
+static void dataMapAddGhost(Table *tab, dboff_t ro);
+static int dataMapRemGhost(Table *tab, dboff_t ro);
+static void dataMapFreeGhost(DataMapGhost *dg);
 
 DataMap	*BCHash[DM_HSIZE];
 u_long	BCMemoryUsed;
 u_long	BCMemoryLimit = MAX_DATAMAP_CACHE;	/* typically 1G */
+DataMapStats BCStats;
+
+static List BCInList = INITLIST(BCInList);
+static List BCHotList = INITLIST(BCHotList);
+static List BCGhostList = INITLIST(BCGhostList);
+static DataMapGhost *BCGhostHash[DM_HSIZE];
+static u_long BCInBytes;
+static int BCGhostCount;
+
+/*
+ * SetDataMapCacheSize() - set the amount of table data we keep mapped
+ */
+void
+SetDataMapCacheSize(u_long bytes)
+{
+    if (bytes < MIN_DATAMAP_BLOCK * DM_INSHARE)
+	bytes = MIN_DATAMAP_BLOCK * DM_INSHARE;
+    BCMemoryLimit = bytes;
+    if (BCMemoryUsed > BCMemoryLimit)
+	DataMapGarbageCollect();
+}
+
+/*
+ * DataMapAccess() - account for a lookup of dm and requeue it
+ *
+ *	Called by the OpenDataMap routines for each block looked up, dm
+ *	must be referenced.  The lookup is counted in BCStats.
+ */
+void
+DataMapAccess(DataMap *dm)
+{
+    switch(dm->dm_Queue) {
+    case DMQ_NONE:
+	++BCStats.bs_Misses;
+	if (dataMapRemGhost(dm->dm_Table, dm->dm_Ro)) {
+	    ++BCStats.bs_GhostHits;
+	    dm->dm_Queue = DMQ_HOT;
+	    addTail(&BCHotList, &dm->dm_QNode);
+	} else {
+	    dm->dm_Queue = DMQ_IN;
+	    addTail(&BCInList, &dm->dm_QNode);
+	    BCInBytes += dm->dm_Table->ta_BCBlockSize;
+	}
+	break;
+    case DMQ_IN:
+	/*
+	 * 2Q leaves blocks on the FIFO, a block re-referenced shortly after
+	 * its first reference is not necessarily hot.
+	 */
+	++BCStats.bs_InHits;
+	break;
+    case DMQ_HOT:
+	++BCStats.bs_HotHits;
+	removeNode(&dm->dm_QNode);
+	addTail(&BCHotList, &dm->dm_QNode);
+	break;
+    }
+}
+
+/*
+ * DataMapDequeue() - remove dm from its replacement queue
+ *
+ *	Called when a DataMap is freed or reused for another block.
+ */
+void
+DataMapDequeue(DataMap *dm)
+{
+    if (dm->dm_Queue == DMQ_NONE)
+	return;
+    if (dm->dm_Queue == DMQ_IN)
+	BCInBytes -= dm->dm_Table->ta_BCBlockSize;
+    removeNode(&dm->dm_QNode);
+    dm->dm_Queue = DMQ_NONE;
+}
+
+/*
+ * DataMapForgetTable() - discard ghosts belonging to a table being freed
+ */
+void
+DataMapForgetTable(Table *tab)
+{
+    DataMapGhost *dg;
+    DataMapGhost *ndg;
+
+    for (dg = getHead(&BCGhostList); dg; dg = ndg) {
+	ndg = getListSucc(&BCGhostList, &dg->dg_Node);
+	if (dg->dg_Table == tab)
+	    dataMapFreeGhost(dg);
+    }
+}
 
 /*
- * DataMapGarbageCollect() - free up non-persitent datamap blocks
+ * DataMapGarbageCollect() - free up non-persistent datamap blocks
+ *
+ *	Called when BCMemoryUsed exceeds BCMemoryLimit, frees unreferenced
+ *	blocks until we are down to 3/4 of the limit.  BCInList is trimmed
+ *	to its share first, then the least recently used hot blocks go,
+ *	and finally whatever else is on BCInList.
+ *
+ *	At most DM_MAXSCAN blocks are examined per call, so a cache full of
+ *	referenced blocks does not turn every allocation into a full scan.
  */
 void
 DataMapGarbageCollect(void)
 {
-    static int DMapPurgeIndex;
-    int maxscan = DM_HSIZE / 4;
+    int maxscan = DM_MAXSCAN;
+
+    dataMapPurge(&BCInList, 1, &maxscan);
+    dataMapPurge(&BCHotList, 0, &maxscan);
+    dataMapPurge(&BCInList, 0, &maxscan);
+}
+
+static void
+dataMapPurge(List *list, int inOnly, int *maxscan)
+{
+    Node *node;
+    Node *nnode;
+
+    for (node = getHead(list); node; node = nnode) {
+	DataMap *dm = QNODE_TO_DM(node);
+
+	if (BCMemoryUsed <= BCMemoryLimit / 4 * 3)
+	    break;
+	if (inOnly && BCInBytes <= BCMemoryLimit / DM_INSHARE)
+	    break;
+	if (*maxscan == 0)
+	    break;
+	--*maxscan;
+	nnode = getListSucc(list, node);
+	if (dm->dm_Refs == 0)
+	    dataMapEvict(dm);
+    }
+}
+
+/*
+ * dataMapEvict() - free an unreferenced block
+ *
+ *	Blocks evicted from BCInList are remembered as ghosts.
+ */
+static void
+dataMapEvict(DataMap *dm)
+{
+    if (dm->dm_Queue == DMQ_IN)
+	dataMapAddGhost(dm->dm_Table, dm->dm_Ro);
+    ++BCStats.bs_Evictions;
+    ++dm->dm_Refs;
+    dm->dm_Table->ta_RelDataMap(&dm, 1);
+}
+
+static void
+dataMapAddGhost(Table *tab, dboff_t ro)
+{
+    DataMapGhost *dg;
+    int hi = (ro / tab->ta_BCBlockSize) & DM_HMASK;
 
-    printf("*** DataMapGarbageCollect ***\n");
+    dg = zalloc(sizeof(DataMapGhost));
+    dg->dg_Table = tab;
+    dg->dg_Ro = ro;
+    dg->dg_Hi = hi;
+    dg->dg_HNext = BCGhostHash[hi];
+    BCGhostHash[hi] = dg;
+    addTail(&BCGhostList, &dg->dg_Node);
+    ++BCGhostCount;
 
-    while (BCMemoryUsed > BCMemoryLimit / 4 * 3 && maxscan) {
-	DataMap *dm;
-	int hv = --DMapPurgeIndex & DM_HMASK;
+    while (BCGhostCount > BCMemoryLimit / MIN_DATAMAP_BLOCK / DM_GHOSTSHARE)
+	dataMapFreeGhost(getHead(&BCGhostList));
+}
+
+/*
+ * dataMapRemGhost() - remove a ghost, return 1 if it existed
+ */
+static int
+dataMapRemGhost(Table *tab, dboff_t ro)
+{
+    DataMapGhost *dg;
+    int hi = (ro / tab->ta_BCBlockSize) & DM_HMASK;
 
-restart:
-	for (dm = BCHash[hv]; dm; dm = dm->dm_HNext) {
-	    if (dm->dm_Refs == 0) {
-		++dm->dm_Refs;
-		dm->dm_Table->ta_RelDataMap(&dm, 1);
-		goto restart;
-	    }
+    for (dg = BCGhostHash[hi]; dg; dg = dg->dg_HNext) {
+	if (dg->dg_Table == tab && dg->dg_Ro == ro) {
+	    dataMapFreeGhost(dg);
+	    return(1);
 	}
-	--maxscan;
     }
+    return(0);
 }
 
+static void
+dataMapFreeGhost(DataMapGhost *dg)
+{
+    DataMapGhost **pdg;
+
+    for (pdg = &BCGhostHash[dg->dg_Hi]; *pdg != dg; pdg = &(*pdg)->dg_HNext)
+	DBASSERT(*pdg != NULL);
+    *pdg = dg->dg_HNext;
+    removeNode(&dg->dg_Node);
+    --BCGhostCount;
+    zfree(dg, sizeof(DataMapGhost));
+}
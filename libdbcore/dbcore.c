@@ -70,31 +70,105 @@ Prototype int DbPgSize;
 Prototype int DbPgMask;
 Prototype List DbList;
 
+Prototype rhhash64_t RecHash64(const RecHead *rh);
 Prototype dboff_t WriteDataRecord(Table *tab, RawData *rd, const RecHead *rh, vtable_t vt, dbstamp_t ts, rhuser_t userid, rhflags_t flags);
 Prototype void RewindDataWrites(Table *tab, dboff_t appRo);
 Prototype void DestroyTableCaches(Table *tab);
 
 static void removeRecur(const char *path);
 static int SizeDataRecord(RawData *rd, const RecHead *rh, int *pcount);
+static rhhash64_t rhHash64(const RecHead *rh);
+static int getTableICover(TableI *ti, const col_t *colIds, int ncols, col_t *coverIds);
 
 int DbPgSize;
 int DbPgMask;
 List DbList = INITLIST(DbList);
 
 /*
- * rhHash() - hash data fields for quicker matching
+ * rhHash64() - 64 bit hash of the data fields of an RHMAGIC_HV64 record
+ *
+ *	Covers rh_Cols[0] through the end of the column data.  The bulk of
+ *	the record is consumed 32 bytes at a time into four independent
+ *	lanes (the xxHash64 round) which the compiler can vectorize or at
+ *	least pipeline.  Record data is always 4-byte aligned so the tail
+ *	is consumed 4 bytes at a time.  Never returns 0.
  */
 
-__inline rhhash_t
-rhHash(const RecHead *rh)
+#define HV64_P1		11400714785074694791ULL
+#define HV64_P2		14029467366897019727ULL
+#define HV64_P3		1609587929392839161ULL
+#define HV64_P4		9650029242287828579ULL
+#define HV64_ROTL(v, n)	(((v) << (n)) | ((v) >> (64 - (n))))
+#define HV64_ROUND(acc, v)	\
+	((acc) = HV64_ROTL((acc) + (v) * HV64_P2, 31) * HV64_P1)
+
+static rhhash64_t
+rhHash64(const RecHead *rh)
 {
-    rhhash_t hv = 0xA4FC;
-    int c0off = offsetof(RecHead, rh_Cols[0]);
+    const char *ptr = (const char *)&rh->rh_Cols[0];
+    int bytes = rh->rh_Size - offsetof(RecHead, rh_Cols[0]) -
+		sizeof(rhhash64_t);
+    u_int64_t hv;
+
+    if (bytes >= 32) {
+	u_int64_t lane[4];
+	u_int64_t v[4];
+	int i;
 
-    while (c0off < rh->rh_Size) {
-	hv = (hv ^ *(const rhhash_t *)((const char *)rh + c0off)) + 1;
-	c0off += sizeof(rhhash_t);
+	lane[0] = HV64_P1 + HV64_P2;
+	lane[1] = HV64_P2;
+	lane[2] = 0;
+	lane[3] = -HV64_P1;
+	while (bytes >= 32) {
+	    bcopy(ptr, v, sizeof(v));
+	    for (i = 0; i < 4; ++i)
+		HV64_ROUND(lane[i], v[i]);
+	    ptr += 32;
+	    bytes -= 32;
+	}
+	hv = HV64_ROTL(lane[0], 1) + HV64_ROTL(lane[1], 7) +
+	     HV64_ROTL(lane[2], 12) + HV64_ROTL(lane[3], 18);
+	for (i = 0; i < 4; ++i) {
+	    u_int64_t acc = 0;
+
+	    HV64_ROUND(acc, lane[i]);
+	    hv = (hv ^ acc) * HV64_P1 + HV64_P4;
+	}
+    } else {
+	hv = HV64_P4 + HV64_P1;
+    }
+    hv += rh->rh_Size;
+    while (bytes >= 4) {
+	u_int32_t v;
+
+	bcopy(ptr, &v, sizeof(v));
+	hv ^= (u_int64_t)v * HV64_P1;
+	hv = HV64_ROTL(hv, 23) * HV64_P2 + HV64_P3;
+	ptr += 4;
+	bytes -= 4;
     }
+    hv ^= hv >> 33;
+    hv *= HV64_P2;
+    hv ^= hv >> 29;
+    hv *= HV64_P3;
+    hv ^= hv >> 32;
+    return(hv ? hv : 1);
+}
+
+/*
+ * RecHash64() - return the 64 bit data hash of a record, or 0 if the
+ *		 record predates RHMAGIC_HV64.
+ */
+
+rhhash64_t
+RecHash64(const RecHead *rh)
+{
+    rhhash64_t hv;
+
+    if (rh->rh_Magic != RHMAGIC_HV64)
+	return(0);
+    bcopy((const char *)rh + rh->rh_Size - sizeof(rhhash64_t),
+	&hv, sizeof(hv));
     return(hv);
 }
 
@@ -493,6 +567,7 @@ OpenTable(DataBase *db, const char *name, const char *ext, DBCreateOptions *dbc,
 	tab->ta_Ext = strdup(ext);
 	tab->ta_Fd = -1;
 	tab->ta_TTsSlot = -1;
+	tab->ta_IndexSlop = GetIndexSlop(name);
 	initList(&tab->ta_BCList);
 	initList(&tab->ta_WaitList);
 
@@ -597,6 +672,7 @@ CloseTable(Table *tab, int freeLastClose)
 	Table **pt;
 
 	DestroyTableCaches(tab);
+	FreeTableStats(tab);
 	if (tab->ta_TTs)
 	    DestroyConflictArea(tab);
 	if (tab->ta_Meta)
@@ -673,6 +749,7 @@ DestroyTableCaches(Table *tab)
 	dm->dm_Table->ta_RelDataMap(&dm, 1);
     }
     DBASSERT(tab->ta_BCCount == 0);
+    DataMapForgetTable(tab);
 }
 
 /************************************************************************
@@ -935,6 +1012,86 @@ UnLockDatabase(DataBase *db)
     UnLockTable(db->db_SysTable);
 }
 
+/*
+ * getTableICover() -	determine the cover columns of a btree index
+ *
+ *	A table with columns flagged USING COVER (CIF_COVER) stores a copy
+ *	of the key and cover columns in every btree index on the table.
+ *	The cover columns which are not part of the key are returned in
+ *	coverIds[] (sorted, at most INDEX_MAXCOVER, further flagged
+ *	columns are ignored), so each key maps to exactly one index file.
+ *
+ *	Returns the number of extra columns or -1 if the index is not
+ *	covering.
+ */
+static int
+getTableICover(TableI *ti, const col_t *colIds, int ncols, col_t *coverIds)
+{
+    ColI *ci;
+    int ncover = -1;
+    int i;
+
+    if (colIds[0] < CID_RAW_LIMIT)
+	return(-1);
+
+    for (ci = ti->ti_FirstColI; ci; ci = ci->ci_Next) {
+	if ((ci->ci_Flags & (CIF_COVER|CIF_DELETED)) != CIF_COVER)
+	    continue;
+	if (ncover < 0)
+	    ncover = 0;
+	for (i = 0; i < ncols && colIds[i] != ci->ci_ColId; ++i)
+	    ;
+	if (i != ncols)
+	    continue;
+	for (i = ncover; i > 0 && coverIds[i-1] > ci->ci_ColId; --i) {
+	    if (i < INDEX_MAXCOVER)
+		coverIds[i] = coverIds[i-1];
+	}
+	if (i < INDEX_MAXCOVER)
+	    coverIds[i] = ci->ci_ColId;
+	if (ncover < INDEX_MAXCOVER)
+	    ++ncover;
+    }
+    return(ncover);
+}
+
+/*
+ * tableICovered() -	determine whether an index-only scan is possible
+ *
+ *	Only selections and counts qualify.  Every user column the table
+ *	instance reads (see rd_ColBase) must be part of the index key or
+ *	one of its cover columns.  Special columns are derived from the
+ *	record header, which the index always copies.
+ */
+static int
+tableICovered(TableI *ti, const Index *index)
+{
+    ColData *cd;
+    int i;
+
+    if (ti->ti_Query == NULL)
+	return(0);
+    if (ti->ti_Query->q_TermOp != QOP_SELECT &&
+	ti->ti_Query->q_TermOp != QOP_COUNT)
+	return(0);
+
+    for (cd = ti->ti_RData->rd_ColBase; cd; cd = cd->cd_Next) {
+	col_t colId = (col_t)cd->cd_ColId;
+
+	if (colId < CID_RAW_LIMIT)
+	    continue;
+	for (i = 0; i < index->i_NCols && index->i_ColIds[i] != colId; ++i)
+	    ;
+	if (i != index->i_NCols)
+	    continue;
+	for (i = 0; i < index->i_NCover && index->i_CoverIds[i] != colId; ++i)
+	    ;
+	if (i == index->i_NCover)
+	    return(0);
+    }
+    return(1);
+}
+
 /*
  * setTableRange() - range the whole table and locate the first record
  *
@@ -946,6 +1103,11 @@ UnLockDatabase(DataBase *db)
  *	Indexed tables may be split if the index is not up to date.  Even
  *	if we are initializing for SLOP we have to call the index's 
  *	table ranging function to calculate the split.
+ *
+ *	If the query only needs columns available from a covering index,
+ *	the indexed part of the table is scanned index-only (TABRAN_COVER).
+ *	Whether an index is covering depends only on the table's declared
+ *	cover columns, never on the query.
  */
 
 static __inline void
@@ -955,11 +1117,32 @@ setTableRange(TableI *ti, Table *tab, Range *r, int flags)
 	DBASSERT(ti->ti_Index == NULL);
 	if (r) {
 	    col_t colId = (r->r_Col) ? (col_t)r->r_Col->cd_ColId : 0;
-	    ti->ti_Index = tab->ta_GetTableIndex(tab, ti->ti_VTable, colId,
-						r->r_OpClass);
+	    const col_t *colIds = &colId;
+	    int ncols = 1;
+	    col_t coverIds[INDEX_MAXCOVER];
+	    int ncover;
+
+	    /*
+	     * Use a compound index if the high level query code
+	     * determined that one applies to this range.
+	     */
+	    if (ti->ti_CompNCols > 1 && r == ti->ti_MarkRange) {
+		colIds = ti->ti_CompColIds;
+		ncols = ti->ti_CompNCols;
+	    }
+	    ncover = -1;
+	    if (colId != 0)
+		ncover = getTableICover(ti, colIds, ncols, coverIds);
+	    ti->ti_Index = tab->ta_GetTableIndex(tab, ti->ti_VTable,
+			    colIds, ncols, coverIds, ncover, r->r_OpClass);
 	}
     }
     if (ti->ti_Index) {
+	if ((flags & TABRAN_INDEX) && ti->ti_Index->i_CoverRec &&
+	    tableICovered(ti, ti->ti_Index)
+	) {
+	    flags |= TABRAN_COVER;
+	}
 	ti->ti_Flags = flags;
 	ti->ti_Index->i_SetTableRange(ti, tab, r->r_Col, r, flags);
     } else {
@@ -1121,6 +1304,7 @@ SelectBegTableRec(TableI *ti, int flags)
 	Table *tab = ti->ti_RanBeg.p_Tab;
 	int blockSize;
 	int boff;
+	int advice;
 
 	/*
 	 * Already at EOF, or found EOF.
@@ -1149,11 +1333,32 @@ SelectBegTableRec(TableI *ti, int flags)
 	blockSize = tab->ta_Meta->tf_BlockSize;
 	boff = (int)ti->ti_RanBeg.p_Ro & (blockSize - 1);
 
+	/*
+	 * A sequential scan entering a new block may be able to skip
+	 * it without mapping it, see ZoneMapSkipBlock() and
+	 * BloomSkipBlock().
+	 */
+	if (boff == 0 && ti->ti_ZoneRange &&
+	    (ti->ti_Flags & TABRAN_INDEX) == 0 &&
+	    (ZoneMapSkipBlock(ti, tab, ti->ti_RanBeg.p_Ro, ti->ti_Append) ||
+	     BloomSkipBlock(ti, tab, ti->ti_RanBeg.p_Ro, ti->ti_Append))
+	) {
+	    ti->ti_RanBeg.p_Ro = tab->ta_NextBlock(tab, NULL, ti->ti_RanBeg.p_Ro);
+	    continue;
+	}
+
 	pos2 = ti->ti_RanBeg;
 	pos2.p_Ro -= boff;
 	bh = tab->ta_GetDataMap(&pos2, &rd->rd_Map, blockSize);
 	DBASSERT(bh->bh_Magic == BH_MAGIC);
 
+	/*
+	 * Hint the access pattern, sequential scans read ahead.
+	 */
+	advice = (ti->ti_Flags & TABRAN_INDEX) ? DMA_RANDOM : DMA_SEQUENTIAL;
+	if (rd->rd_Map->dm_Advice != advice)
+	    tab->ta_AdviseDataMap(rd->rd_Map, advice);
+
 	if (ti->ti_Flags & TABRAN_INDEX) {
 	    DBASSERT(ti->ti_Index && ti->ti_Index->i_NextTableRec);
 	    DBASSERT(boff != 0);
@@ -1211,6 +1416,20 @@ SelectEndTableRec(TableI *ti, int flags)
     DBASSERT(ti->ti_RanEnd.p_Ro > 0);
     DBASSERT(ti->ti_RanEnd.p_Ro < tab->ta_Append);
 
+    /*
+     * Index-only scan, pull the record header and the covered columns
+     * from the index and leave the table alone.
+     */
+    if (ti->ti_Flags & TABRAN_COVER) {
+	const RecHead *rh;
+
+	if ((rh = ti->ti_Index->i_CoverRec(ti, &ti->ti_RanEnd)) != NULL) {
+	    rd->rd_Rh = rh;
+	    ReadDataRecord(rd, &ti->ti_RanEnd, flags | RDF_ZERO | RDF_USERH);
+	    return;
+	}
+    }
+
     /*
      * Get the block offset, access the block header and do sanity checks.
      * We must be an index to make this call!
@@ -1223,6 +1442,8 @@ SelectEndTableRec(TableI *ti, int flags)
     bh = tab->ta_GetDataMap(&pos2, &rd->rd_Map, blockSize);
     DBASSERT(bh->bh_Magic == BH_MAGIC);
     DBASSERT(boff != 0);
+    if (rd->rd_Map->dm_Advice != DMA_RANDOM)
+	tab->ta_AdviseDataMap(rd->rd_Map, DMA_RANDOM);
 
     /*
      * Everything is hunky dory, get the information (if RDF_READ not
@@ -1264,7 +1485,7 @@ SelectNextTableRec(TableI *ti, int flags)
 	rh = tab->ta_GetDataMap(&ti->ti_RanBeg, &rd->rd_Map, 
 	    sizeof(RecHead));
 	DBASSERT(rh != NULL);
-	DBASSERT(rh->rh_Magic == RHMAGIC);
+	DBASSERT(RH_ISRECORD(rh));
 
 	/*
 	 * Locate the following record, skipping over record and block
@@ -1287,6 +1508,15 @@ SelectNextTableRec(TableI *ti, int flags)
 	    blockSize = tab->ta_Meta->tf_BlockSize;
 	    boff = (int)ti->ti_RanBeg.p_Ro & (blockSize - 1);
 
+	    if (boff == 0 && ti->ti_ZoneRange &&
+		(ZoneMapSkipBlock(ti, tab, ti->ti_RanBeg.p_Ro, ti->ti_RanEnd.p_Ro) ||
+		 BloomSkipBlock(ti, tab, ti->ti_RanBeg.p_Ro, ti->ti_RanEnd.p_Ro))
+	    ) {
+		ti->ti_RanBeg.p_Ro =
+		    tab->ta_NextBlock(tab, NULL, ti->ti_RanBeg.p_Ro);
+		continue;
+	    }
+
 	    pos2 = ti->ti_RanBeg;
 	    pos2.p_Ro -= boff;
 	    bh = tab->ta_GetDataMap(&pos2, &rd->rd_Map, blockSize);
@@ -1400,7 +1630,7 @@ DeleteTableRec(Table *tab, dbpos_t *opos, vtable_t vt)
     rh = opos->p_Tab->ta_GetDataMap(opos, &dm, sizeof(RecHead));
     DBASSERT(tab->ta_Parent != NULL);
     DBASSERT(rh != NULL);
-    DBASSERT(rh->rh_Magic == RHMAGIC);
+    DBASSERT(RH_ISRECORD(rh));
     WriteDataRecord(tab, NULL, rh, vt, ts, 0, RHF_DELETE);
     if (dm)
 	dm->dm_Table->ta_RelDataMap(&dm, 0);
@@ -1448,7 +1678,8 @@ SizeDataRecord(RawData *rd, const RecHead *rh, int *pcount)
 		    ++count;
 	    }
 	}
-	bytes = offsetof(RecHead, rh_Cols[0]) + sizeof(ColHead) * count;
+	bytes = offsetof(RecHead, rh_Cols[0]) + sizeof(ColHead) * count +
+		sizeof(rhhash64_t);
 
 	if (rd) {
 	    for (cd = rd->rd_ColBase; cd; cd = cd->cd_Next) {
@@ -1499,9 +1730,20 @@ WriteDataRecord(
      * the meta-data caches.  We only care about non-root databases.  The
      * flag can get (semi-permanently) set on a root db, but we don't try to
      * cache schema at the root db level anyway so it's irrelevant.
+     *
+     * A meta-data write reaching the root bumps db_MetaGen, which
+     * invalidates prepared statements (see prepare.c).
      */
-    if ((vt & 3) != 0 || vt < VT_MIN_USER)
-	tab->ta_Db->db_Flags |= DBF_METACHANGE;
+    if ((vt & 3) != 0 || vt < VT_MIN_USER) {
+	DataBase *db = tab->ta_Db;
+
+	db->db_Flags |= DBF_METACHANGE;
+	if (db->db_PushType == DBPUSH_ROOT) {
+	    ++db->db_MetaGen;
+	    if (db->db_MetaTs < ts)
+		db->db_MetaTs = ts;
+	}
+    }
 
     /*
      * Maximum record size must fit in a block at the moment.  XXX
@@ -1572,6 +1814,15 @@ WriteDataRecord(
 	    dbpos_t pos2 = { tab, ro };
 	    int r;
 
+	    /*
+	     * Whether it was closed-out or filled exactly, the previous
+	     * block is now complete and can be summarized.
+	     */
+	    if (ro > tf->tf_DataOff) {
+		ZoneMapCloseBlock(tab, ro - tf->tf_BlockSize);
+		BloomCloseBlock(tab, ro - tf->tf_BlockSize);
+	    }
+
 	    bzero(&bh, sizeof(bh));
 	    bh.bh_Magic = BH_MAGIC;
 
@@ -1625,7 +1876,7 @@ WriteDataRecord(
 	    RecHead *nrh = zalloc(bytes);
 	    int r;
 
-	    nrh->rh_Magic = RHMAGIC;
+	    nrh->rh_Magic = RHMAGIC_HV64;
 	    nrh->rh_Flags = flags;
 	    nrh->rh_VTableId = vt;
 	    nrh->rh_Size = bytes;
@@ -1635,6 +1886,7 @@ WriteDataRecord(
 
 	    if (rh) {
 		DBASSERT(bytes >= sizeof(RecHead));
+		nrh->rh_Magic = rh->rh_Magic;
 		nrh->rh_Hv = rh->rh_Hv;
 		bcopy(
 		    &rh->rh_Cols[0],
@@ -1642,6 +1894,7 @@ WriteDataRecord(
 		    bytes - offsetof(RecHead, rh_Cols[0])
 		);
 	    } else {
+		rhhash64_t hv64;
 		int bcount;
 		int i;
 
@@ -1692,13 +1945,33 @@ WriteDataRecord(
 			++i;
 		    }
 		}
-		DBASSERT(bcount == bytes);
-		nrh->rh_Hv = rhHash(nrh);
+		DBASSERT(bcount + sizeof(rhhash64_t) == bytes);
+		hv64 = rhHash64(nrh);
+		bcopy(&hv64, (char *)nrh + bcount, sizeof(hv64));
+		nrh->rh_Hv = (rhhash_t)(hv64 ^ (hv64 >> 16) ^ (hv64 >> 32) ^
+				       (hv64 >> 48));
+	    }
+
+	    /*
+	     * Older code cannot read RHMAGIC_HV64 records, upgrade the
+	     * table file before the first one goes in.
+	     */
+	    if (nrh->rh_Magic == RHMAGIC_HV64 && tf->tf_Version < TF_VERSION) {
+		int32_t version = TF_VERSION;
+
+		tab->ta_WriteMeta(
+		    tab,
+		    offsetof(TableFile, tf_Version),
+		    &version,
+		    sizeof(version)
+		);
 	    }
 
 	    /*
 	     * Whew!  Now write it.
 	     */
+	    ZoneMapOpenBlock(tab, ro);
+	    BloomOpenBlock(tab, ro);
 	    {
 		dbpos_t pos2 = { tab, ro };
 		r = tab->ta_WriteFile(&pos2, nrh, nrh->rh_Size);
@@ -1771,7 +2044,7 @@ ReadDataRecord(RawData *rd, dbpos_t *pos, int flags)
     } else {
 	rh = pos->p_Tab->ta_GetDataMap(pos, &rd->rd_Map, sizeof(RecHead));
 	DBASSERT(rh != NULL);
-	DBASSERT(rh->rh_Magic == RHMAGIC);
+	DBASSERT(RH_ISRECORD(rh));
 	{
 	    int blkSize = rd->rd_Map->dm_Table->ta_Meta->tf_BlockSize;
 	    dboff_t ro = pos->p_Ro;
@@ -1927,7 +2200,7 @@ MapDataRecord(RawData *rd, dbpos_t *pos)
     rh = pos->p_Tab->ta_GetDataMap(pos, &rd->rd_Map, sizeof(RecHead));
 
     DBASSERT(rh != NULL);
-    DBASSERT(rh->rh_Magic == RHMAGIC);
+    DBASSERT(RH_ISRECORD(rh));
 
     {
 	int blkSize = rd->rd_Map->dm_Table->ta_Meta->tf_BlockSize;
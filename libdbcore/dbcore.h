@@ -19,6 +19,10 @@ struct Query;
 struct Conflict;
 struct ConflictPos;
 struct ResultRow;
+struct ZoneMap;
+struct BloomMap;
+struct ResultSort;
+struct PrepCache;
 
 #define ZBUF_SIZE		8192
 #define MAX_ID_BUF		64	/* schema, table, column names */
@@ -102,7 +106,13 @@ typedef struct TableFile {
 
 typedef TableFile	*TableFile_p;
 
-#define TF_VERSION		2
+/*
+ * Version 3 tables may contain RHMAGIC_HV64 records.  Version 2 tables
+ * are still opened and are upgraded when the first such record is
+ * written, older code refuses to open version 3 tables.
+ */
+#define TF_VERSION		3
+#define TF_VERSION_MIN		2	/* oldest version we can open */
 
 #define MIN_BLOCKSIZE		(4 * 1024)
 #define GUARENTEED_BLOCKSIZE	(128 * 1024 - sizeof(BlockHead))
@@ -168,6 +178,13 @@ typedef struct ColHead {
  *	table append point, the next record will occur at the beginning
  *	of the next block.
  *
+ *	Records written with RHMAGIC_HV64 carry a 64 bit hash of everything
+ *	from rh_Cols[0] through the end of the column data in their last
+ *	sizeof(rhhash64_t) bytes (included in rh_Size), and rh_Hv is folded
+ *	from it.  Older RHMAGIC records have only rh_Hv.  A record copied
+ *	from another record (deletions, replication) keeps its format, so
+ *	insert/delete pairs always match byte for byte.  See RecHash64().
+ *
  *	This structure must be aligned.
  */
 
@@ -175,7 +192,7 @@ typedef struct ColHead {
 #define VTABLE_ID_NUM	0x10000
 
 typedef struct RecHead {
-    rhmagic_t	rh_Magic;	/* 00 magic number (0xD1) */
+    rhmagic_t	rh_Magic;	/* 00 magic number (0xD1/0xD2) */
     rhflags_t	rh_Flags;	/* 01 tuple flags */
     vtable_t	rh_VTableId;	/* 02 Virtual table support */
     int32_t	rh_Size;	/* 04 aligned size of record */
@@ -188,6 +205,10 @@ typedef struct RecHead {
 } RecHead;
 
 #define RHMAGIC		((rhmagic_t)0xD1)
+#define RHMAGIC_HV64	((rhmagic_t)0xD2)	/* with 64 bit data hash */
+
+#define RH_ISRECORD(rh)	((rh)->rh_Magic == RHMAGIC || \
+			 (rh)->rh_Magic == RHMAGIC_HV64)
 
 #define RHF_INSERT	0x01
 #define RHF_UPDATE	0x02
@@ -210,12 +231,40 @@ typedef struct DataMap {
     const char		*dm_Base;
     dboff_t		dm_Ro;		/* includes encoded fileno */
     int			dm_Refs;
+    int			dm_Advice;	/* DMA_* access pattern hint */
+    int			dm_Queue;	/* DMQ_* replacement queue */
+    Node		dm_QNode;	/* replacement queue linkage */
 } DataMap;
 
 #define DM_HSIZE	(MAX_DATAMAP_CACHE / MIN_DATAMAP_BLOCK * 2)
 #define DM_HMASK	(DM_HSIZE-1)
 #define DM_REF_PERSIST	0x40000000
 
+/*
+ * Access pattern hints, see SelectBegTableRec().  Sequential scans read
+ * ahead DM_READAHEAD cache blocks.
+ */
+#define DMA_NORMAL	0
+#define DMA_SEQUENTIAL	1	/* sequential table scan */
+#define DMA_RANDOM	2	/* index probes */
+
+#define DM_READAHEAD	8
+
+#define DMQ_NONE	0	/* not queued (new) */
+#define DMQ_IN		1	/* referenced once, FIFO (2Q A1in) */
+#define DMQ_HOT		2	/* re-referenced, LRU (2Q Am) */
+
+/*
+ * DataMapStats - buffer cache counters, see DataMapAccess()
+ */
+typedef struct DataMapStats {
+    int64_t		bs_InHits;	/* found on the FIFO */
+    int64_t		bs_HotHits;	/* found on the LRU */
+    int64_t		bs_Misses;	/* not cached, including ghost hits */
+    int64_t		bs_GhostHits;	/* misses promoted straight to hot */
+    int64_t		bs_Evictions;
+} DataMapStats;
+
 /*
  * IndexMap - cache portions of an index
  */
@@ -241,7 +290,7 @@ typedef struct TableOps {
     void	(*to_OpenTableMeta)(struct Table *tab, struct DBCreateOptions *dbc, int *error);
     void	(*to_CacheTableMeta)(struct Table *tab);
     void	(*to_CloseTableMeta)(struct Table *tab);
-    Index_p	(*to_GetTableIndex)(struct Table *tab, vtable_t vt, col_t colId, int opId);
+    Index_p	(*to_GetTableIndex)(struct Table *tab, vtable_t vt, const col_t *colIds, int ncols, const col_t *coverIds, int ncover, int opId);
     const_void_ptr (*to_GetDataMap)(dbpos_t *pos, DataMap **pmap, int bytes);
     void	(*to_RelDataMap)(DataMap **pdm, int freeLastClose);
     int		(*to_WriteFile)(dbpos_t *pos, void *ptr, int bytes);
@@ -252,6 +301,7 @@ typedef struct TableOps {
     void	(*to_CleanSlate)(struct Table *tab);
     dboff_t	(*to_FirstBlock)(struct Table *tab);
     dboff_t	(*to_NextBlock)(struct Table *tab, const BlockHead *bh, dboff_t ro);
+    void	(*to_AdviseDataMap)(DataMap *dm, int advice);
 } TableOps;
 
 /*
@@ -282,6 +332,7 @@ typedef struct Table {
     struct DataBase	*ta_Db;		/* associated database */
     dboff_t		ta_Append;	/* copy of this table's append off */
     int			ta_Refs;	/* reference count */
+    int			ta_IndexSlop;	/* unindexed bytes tolerated by queries */
     bkpl_task_t		ta_LockingTask;	/* for debug assertions */
     int			ta_LockCnt;
     List		ta_WaitList;	/* tasks waiting on lock */
@@ -293,6 +344,9 @@ typedef struct Table {
     List		ta_BCList;	/* buffer cache DataMap's */
     int			ta_LogFileId;/* file identifier in log */
     struct Index	*ta_IndexBase;	/* indexes on table */
+    struct ZoneMap	*ta_ZoneMap;	/* block summaries (file tables) */
+    struct BloomMap	*ta_Bloom;	/* block filters (file tables) */
+    struct TableStats	*ta_Stats;	/* planner statistics (root tables) */
     TableOps		*ta_Ops;
 } Table;
 
@@ -310,6 +364,7 @@ typedef struct Table {
 #define ta_CleanSlate		ta_Ops->to_CleanSlate
 #define ta_FirstBlock		ta_Ops->to_FirstBlock
 #define ta_NextBlock		ta_Ops->to_NextBlock
+#define ta_AdviseDataMap	ta_Ops->to_AdviseDataMap
 
 #define TAF_HASCHILDREN	0x0002
 #define TAF_METALOCKED	0x0004		/* descriptor is locked */
@@ -358,6 +413,8 @@ typedef struct DataBase {
     u_int16_t	db_DataLogSeqNo;
     int		db_NextLogFileId;
     struct SchemaI *db_SchemaICache;	/* first non-root db level only */
+    int		db_MetaGen;		/* root only, meta-data writes */
+    dbstamp_t	db_MetaTs;		/* root only, latest meta-data write */
 } DataBase;
 
 #define DBPUSH_ROOT		1
@@ -396,6 +453,7 @@ typedef struct RawData {
     const RecHead *rd_Rh;
     ColData	*rd_ColBase;		/* column data (sorted) */
     int		rd_AllocSize;
+    char	*rd_CoverBuf;		/* index-only scan record copy */
     char	rd_CookVTId[5];
     char	rd_CookTimeStamp[17];
     char	rd_CookUserId[9];
@@ -407,6 +465,9 @@ typedef struct RawData {
 #define RDF_ZERO	0x0004
 #define RDF_FORCE	0x0008
 #define RDF_USERH	0x0010		/* use existing rd_Rh */
+#define RDF_PARAM	0x0020		/* (ColData) '?' query parameter */
+
+#define RD_COVERSIZE	1024		/* maximum covering record copy */
 
 /*
  * Index - index a [virtually tagged] physical table on a column
@@ -423,6 +484,17 @@ typedef struct RawData {
  *	can of course use a different index on each instance of the same
  *	table.
  *
+ *	An index may be compound, covering up to INDEX_MAXCOLS columns
+ *	(i_NCols > 1).  The key is the concatenation of the columns in
+ *	i_ColIds[] order, which gives us subsorts within a single index.
+ *	i_ColId is always the first (or only) column.
+ *
+ *	An index may also be covering (i_NCover >= 0), storing a copy of
+ *	the key columns plus up to INDEX_MAXCOVER additional columns
+ *	(i_CoverIds, declared with CIF_COVER) for each record.  A query
+ *	which needs no other columns can then be satisfied from the index
+ *	alone, see i_CoverRec.
+ *
  *	i_PosCache may optionally be managed by the index module to
  *	shortcut from-root searches.  This can wind up being quite
  *	useful for 'a.key = b.key' joins.
@@ -430,12 +502,19 @@ typedef struct RawData {
  *	XXX WARNING!  NOT REENTRANT (due to block cache).  FIXME
  */
     
+#define INDEX_MAXCOLS		4	/* maximum columns in compound index */
+#define INDEX_MAXCOVER		2	/* maximum extra columns in cover */
+
 typedef struct Index {
     Node	i_Node;		/* global LRU list */
     struct Index *i_Next;
     Table       *i_Table;
     vtable_t 	i_VTable;
     col_t	i_ColId;
+    int		i_NCols;		/* number of columns in key */
+    col_t	i_ColIds[INDEX_MAXCOLS];	/* compound key columns */
+    int		i_NCover;		/* extra cover columns, -1 if none */
+    col_t	i_CoverIds[INDEX_MAXCOVER];	/* extra cover columns */
     int		i_OpClass;
     int         i_Refs;
     int		(*i_ScanRangeOp)(struct Index *index, struct Range *r);
@@ -444,11 +523,15 @@ typedef struct Index {
     void	(*i_UpdateTableRange)(struct TableI *ti, struct Range *r);
     void	(*i_NextTableRec)(struct TableI *ti);
     void	(*i_PrevTableRec)(struct TableI *ti);
+    const RecHead *(*i_CoverRec)(struct TableI *ti, dbpos_t *pos);
+    int		(*i_UpdateIndex)(struct TableI *ti, struct Table *tab, const struct ColData *colData, int flags);
     dbpos_t	i_PosCache;
     char	*i_FilePath;
     FLock	i_FLock;
     union {
 	const struct BTreeHead	*BTreeHead;
+	const struct HashHead	*HashHead;
+	const struct TrgmHead	*TrgmHead;
     } i_Info;
     union {
 	List	BTreeCacheList;
@@ -459,6 +542,8 @@ typedef struct Index {
 
 #define i_Fd			i_FLock.fl_Fd
 #define i_BTreeHead		i_Info.BTreeHead
+#define i_HashHead		i_Info.HashHead
+#define i_TrgmHead		i_Info.TrgmHead
 #define i_BTreeCacheList	i_Cache.BTreeCacheList
 
 typedef int iflags_t;
@@ -498,7 +583,8 @@ typedef struct SchemaI {
  *	index for the search because we do not implement subsorts.  That is,
  *	since the index effectively renumbers the table, trying to use
  *	a second index based on the range results from the first index will
- *	simply not work.
+ *	simply not work.  Instead, constant restrictions on several columns
+ *	may be folded into a single compound index (see ti_CompColIds).
  *
  *	We must store ti_Append at the start of any given query in order
  *	to prevent the query from stepping over itself.  For example, to
@@ -529,6 +615,12 @@ typedef struct TableI {
     char	*ti_TableFile;
     int		(*ti_ScanRangeOp)(struct Index *index, struct Range *r);
     int		ti_Flags;
+    int		ti_CompNCols;	/* compound index columns (0 if none) */
+    col_t	ti_CompColIds[INDEX_MAXCOLS];
+    u_int32_t	ti_HashKey;	/* hash/trigram index, key being scanned */
+    u_int32_t	ti_TrgmSig;	/* trigram index, pattern signature */
+    struct Range *ti_ZoneRange;	/* sequential scan, skip blocks (zonemap.c) */
+    struct HashJoin *ti_HashJoin; /* inner side of a join (hashjoin.c) */
     int64_t	ti_DebugScanCount;
     int64_t	ti_DebugIndexScanCount;
     int64_t	ti_DebugIndexInsertCount;
@@ -539,6 +631,9 @@ typedef struct TableI {
 #define TABRAN_INDEX	0x0002	/* set range for indexed part of table */
 #define TABRAN_INIT	0x0004	/* initialize ti_[Index]Append, else use */
 #define TABRAN_SYNCIDX	0x0008	/* unconditionally synchronize the index */
+#define TABRAN_COVER	0x0010	/* indexed part is scanned index-only */
+
+#define IUF_NOSYNC	0x0001	/* i_UpdateIndex: leave index unsynchronized */
 
 /*
  * ColI - An Instance of a column in a table instance (in a query).
@@ -582,10 +677,17 @@ typedef struct ColI {
 #define CIF_SET_SPECIAL	0x0400	/* set QF_SPECIAL_WHERE in query if special */
 #define CIF_WILD	0x8000	/* allow wildcards */	
 #define CIF_DEFAULT	0x10000 /* column has default / default request */
+#define CIF_HASH	0x20000 /* use a hash index for equality */
+#define CIF_TRIGRAM	0x40000 /* use a trigram index for LIKE */
+#define CIF_COMPOUND	0x80000 /* part of the compound index key */
+#define CIF_COVER	0x100000 /* copied into covering indexes */
 
 typedef struct DelHash {
-    int			dh_Count;
+    int			dh_Count;	/* unmatched deletions */
     int			dh_Flags;
+    int			dh_Used;	/* slots in use or matched */
+    int			dh_Size;	/* slots in dh_Slots, 0 if none */
+    struct DelSlot	*dh_Slots;	/* open addressed, see delete.c */
 } DelHash;
 
 #define DHF_INTERRUPTED	0x0001
@@ -671,6 +773,8 @@ typedef struct Range {
 #define ROP_VTID_EQEQ	0x16
 #define ROP_USERID_EQEQ	0x17
 #define ROP_OPCODE_EQEQ	0x18
+#define ROP_HASH_EQEQ	0x19	/* opclass only, hash index (CIF_HASH) */
+#define ROP_TRGM_LIKE	0x1A	/* opclass only, trigram index (CIF_TRIGRAM) */
 
 
 /*
@@ -706,6 +810,10 @@ typedef struct Query {
     int		q_Error;	/* resolution/execution error */
     int		q_Flags;
     List	q_ResultBuffer; /* list, results if server sorted */
+    struct ResultSort *q_ResultSort; /* server sort state (database/) */
+    struct Aggregate *q_Agg;	/* aggregates / GROUP BY (aggregate.c) */
+    ColData	**q_Params;	/* '?' parameters in parse order */
+    int		q_NParams;
     char	*q_QryCopy;	/* for debugging only */
 } Query;
 
@@ -714,6 +822,8 @@ typedef struct Query {
 #define QF_SPECIAL_WHERE	0x0004	/* __special's in where clause */
 #define QF_WITH_ORDER		0x0008	/* contains order by clause */
 #define QF_WITH_LIMIT		0x0010	/* contains limit clause */
+#define QF_EXPLAIN		0x0020	/* EXPLAIN, see explain.c */
+#define QF_EXPLAIN_ANALYZE	0x0040	/* EXPLAIN ANALYZE, run the query */
 
 #define QF_CLIENT_ORDER		0x01000000
 #define QF_CLIENT_LIMIT		0x02000000
@@ -18,6 +18,7 @@ Prototype void Fault_TruncFile(Table *tab, int bytes);
 Prototype void Fault_CleanSlate(Table *tab);
 Prototype dboff_t Default_FirstBlock(Table *tab);
 Prototype dboff_t Default_NextBlock(Table *tab, const BlockHead *bh, dboff_t ro);
+Prototype void Default_AdviseDataMap(DataMap *dm, int advice);
 
 void 
 Fault_OpenTableMeta(Table *tab, DBCreateOptions *dbc, int *error)
@@ -70,9 +71,20 @@ Default_FirstBlock(Table *tab)
     return(tab->ta_Meta->tf_DataOff);
 }
 
+/*
+ * Default_NextBlock() - return the block following the one at ro
+ *
+ *	bh may be NULL if the block was skipped without being mapped
+ *	(see ZoneMapSkipBlock()).
+ */
 dboff_t
 Default_NextBlock(Table *tab, const BlockHead *bh, dboff_t ro)
 {
     return(ro + tab->ta_Meta->tf_BlockSize);
 }
 
+void
+Default_AdviseDataMap(DataMap *dm, int advice)
+{
+    dm->dm_Advice = advice;
+}
@@ -14,7 +14,7 @@ Prototype TableOps	TabFileOps;
 void File_OpenTableMeta(Table *tab, DBCreateOptions *dbc, int *error);
 void File_CloseTableMeta(Table *tab);
 void File_CacheTableMeta(Table *tab);
-Index *File_GetTableIndex(Table *tab, vtable_t vt, col_t colId, int opId);
+Index *File_GetTableIndex(Table *tab, vtable_t vt, const col_t *colIds, int ncols, const col_t *coverIds, int ncover, int opId);
 const void *File_GetDataMap(dbpos_t *pos, DataMap **pmap, int bytes);
 void File_RelDataMap(DataMap **pdm, int freeLastClose);
 int File_WriteFile(dbpos_t *pos, void *ptr, int bytes);
@@ -22,6 +22,7 @@ int File_WriteMeta(Table *tab, int off, void *ptr, int bytes);
 int File_FSync(Table *tab);
 int File_ExtendFile(Table *tab, int bytes);
 void File_TruncFile(Table *tab, int bytes);
+void File_AdviseDataMap(DataMap *dm, int advice);
 
 static void file_TableValidate(Table *tab, off_t fsize, int *error);
 static void file_TableCreateFile(Table *tab, DBCreateOptions *dbc, int *error);
@@ -41,7 +42,8 @@ TableOps	TabFileOps = {
     File_TruncFile,
     Fault_CleanSlate,
     Default_FirstBlock,
-    Default_NextBlock
+    Default_NextBlock,
+    File_AdviseDataMap
 };
 
 /*
@@ -142,6 +144,9 @@ File_OpenTableMeta(Table *tab, DBCreateOptions *dbc, int *error)
      */
     if (*error != 0) {
 	File_CloseTableMeta(tab);
+    } else {
+	OpenZoneMap(tab);
+	OpenBloomFilter(tab);
     }
 }
 
@@ -174,6 +179,8 @@ File_CacheTableMeta(Table *tab)
 void
 File_CloseTableMeta(Table *tab)
 {
+    CloseZoneMap(tab);
+    CloseBloomFilter(tab);
     if (tab->ta_Flags & TAF_METALOCKED) {
 	DBASSERT(tab->ta_Fd >= 0);
 	hflock_un(tab->ta_Fd, 0);
@@ -240,7 +247,7 @@ file_TableValidate(Table *tab, off_t fsize, int *error)
 	}
 	if (tf.tf_Blk.bh_Type != BH_TYPE_TABLE)
 	    *error = DBERR_TABLE_TYPE;
-	if (tf.tf_Version != TF_VERSION)
+	if (tf.tf_Version < TF_VERSION_MIN || tf.tf_Version > TF_VERSION)
 	    *error = DBERR_TABLE_VERSION;
 	if (tf.tf_Blk.bh_Magic != BH_MAGIC_TABLE)
 	    *error = DBERR_TABLE_MAGIC;
@@ -406,9 +413,13 @@ file_TableCreateFile(Table *tab, DBCreateOptions *dbc, int *error)
 }
 
 Index *
-File_GetTableIndex(Table *tab, vtable_t vt, col_t colId, int opId)
+File_GetTableIndex(Table *tab, vtable_t vt, const col_t *colIds, int ncols, const col_t *coverIds, int ncover, int opId)
 {
-    return(OpenIndex(tab, vt, colId, opId, OpenBTreeIndex));
+    if (opId == ROP_HASH_EQEQ)
+	return(OpenIndex(tab, vt, colIds, ncols, NULL, -1, opId, OpenHashIndex));
+    if (opId == ROP_TRGM_LIKE)
+	return(OpenIndex(tab, vt, colIds, ncols, NULL, -1, opId, OpenTrgmIndex));
+    return(OpenIndex(tab, vt, colIds, ncols, coverIds, ncover, opId, OpenBTreeIndex));
 }
 
 /************************************************************************
@@ -483,6 +494,7 @@ File_RelDataMap(DataMap **pdm, int freeLastClose)
 	*pdm = dm->dm_HNext;
 	dm->dm_HNext = NULL;
 	removeNode(&dm->dm_Node);
+	DataMapDequeue(dm);
 	--tab->ta_BCCount;
 	BCMemoryUsed -= tab->ta_BCBlockSize;
 	if (dm->dm_Base != MAP_FAILED) {
@@ -529,6 +541,7 @@ file_OpenDataMap(dbpos_t *pos)
     if (dm == NULL && preuse) {
 	dm = *preuse;
 	pdm = preuse;
+	DataMapDequeue(dm);
 	dm->dm_Ro = roBase;
     }
 
@@ -560,6 +573,7 @@ file_OpenDataMap(dbpos_t *pos)
     ++dm->dm_Refs;
     if (dm->dm_Base == MAP_FAILED) {
 	DBASSERT(dm->dm_Refs == 1);
+	dm->dm_Advice = DMA_NORMAL;
 	dm->dm_Base = mmap(NULL, tab->ta_BCBlockSize, PROT_READ, MAP_SHARED,
 	    tab->ta_Fd, roBase & ~((dboff_t)tab->ta_BCBlockSize - 1));
 	if (dm->dm_Base == MAP_FAILED) {
@@ -568,11 +582,51 @@ file_OpenDataMap(dbpos_t *pos)
 	    DBASSERT(0);
 	}
     }
+    DataMapAccess(dm);
     if (BCMemoryUsed > BCMemoryLimit)
 	DataMapGarbageCollect();
     return(dm);
 }
 
+/*
+ * File_AdviseDataMap() - tell the kernel how a mapped block is accessed
+ *
+ *	A block being scanned sequentially also starts read-ahead on the
+ *	following DM_READAHEAD blocks.  We only hint the kernel rather than
+ *	map them, mapping would take up slots in our own buffer cache.
+ *	Index probes touch a record or two per block, read-ahead would be
+ *	wasted.
+ */
+void
+File_AdviseDataMap(DataMap *dm, int advice)
+{
+    Table *tab = dm->dm_Table;
+
+    dm->dm_Advice = advice;
+    switch(advice) {
+    case DMA_SEQUENTIAL:
+	madvise((void *)dm->dm_Base, tab->ta_BCBlockSize, MADV_SEQUENTIAL);
+#ifdef POSIX_FADV_WILLNEED
+	{
+	    dboff_t ro = dm->dm_Ro + tab->ta_BCBlockSize;
+	    dboff_t bytes = (dboff_t)tab->ta_BCBlockSize * DM_READAHEAD;
+
+	    if (bytes > tab->ta_Append - ro)
+		bytes = tab->ta_Append - ro;
+	    if (bytes > 0)
+		posix_fadvise(tab->ta_Fd, ro, bytes, POSIX_FADV_WILLNEED);
+	}
+#endif
+	break;
+    case DMA_RANDOM:
+	madvise((void *)dm->dm_Base, tab->ta_BCBlockSize, MADV_RANDOM);
+	break;
+    default:
+	madvise((void *)dm->dm_Base, tab->ta_BCBlockSize, MADV_NORMAL);
+	break;
+    }
+}
+
 int
 File_WriteFile(dbpos_t *pos, void *ptr, int bytes)
 {
@@ -14,7 +14,7 @@ Prototype TableOps TabMemOps;
 void Mem_OpenTableMeta(Table *tab, DBCreateOptions *dbc, int *error);
 void Mem_CacheTableMeta(Table *tab);
 void Mem_CloseTableMeta(Table *tab);
-Index *Mem_GetTableIndex(Table *tab, vtable_t vt, col_t colId, int opId);
+Index *Mem_GetTableIndex(Table *tab, vtable_t vt, const col_t *colIds, int ncols, const col_t *coverIds, int ncover, int opId);
 const void *Mem_GetDataMap(dbpos_t *pos, DataMap **pmap, int bytes);
 void Mem_RelDataMap(DataMap **pdm, int freeLastClose);
 int Mem_WriteFile(dbpos_t *pos, void *ptr, int bytes);
@@ -40,7 +40,8 @@ TableOps	TabMemOps = {
     Mem_TruncFile,
     Mem_CleanSlate,
     Default_FirstBlock,
-    Default_NextBlock
+    Default_NextBlock,
+    Default_AdviseDataMap
 };
 
 #define MF_MAX_CACHE	16
@@ -154,14 +155,18 @@ Mem_CloseTableMeta(Table *tab)
  *	we would be screwed without one, so we get one.
  */
 Index *
-Mem_GetTableIndex(Table *tab, vtable_t vt, col_t colId, int opId)
+Mem_GetTableIndex(Table *tab, vtable_t vt, const col_t *colIds, int ncols, const col_t *coverIds, int ncover, int opId)
 {
     if (tab->ta_Db->db_Flags & DBF_READONLY)
 	return(NULL);
+    else if (opId == ROP_HASH_EQEQ)
+	return(OpenIndex(tab, vt, colIds, ncols, NULL, -1, opId, OpenHashIndex));
+    else if (opId == ROP_TRGM_LIKE)
+	return(OpenIndex(tab, vt, colIds, ncols, NULL, -1, opId, OpenTrgmIndex));
     else
-	return(OpenIndex(tab, vt, colId, opId, OpenBTreeIndex));
+	return(OpenIndex(tab, vt, colIds, ncols, coverIds, ncover, opId, OpenBTreeIndex));
 #if 0
-	return(OpenIndex(tab, vt, colId, opId, NULL)); /* instead of NULL */
+	return(OpenIndex(tab, vt, colIds, ncols, coverIds, ncover, opId, NULL)); /* instead of NULL */
 #endif
 }
 
@@ -233,6 +238,7 @@ Mem_RelDataMap(DataMap **pdm, int freeLastClose)
 	*pdm = dm->dm_HNext;
 	dm->dm_HNext = NULL;
 	removeNode(&dm->dm_Node);
+	DataMapDequeue(dm);
 	BCMemoryUsed -= tab->ta_BCBlockSize;
 	--tab->ta_BCCount;
 
@@ -296,6 +302,7 @@ mem_OpenDataMap(Table *tab, dboff_t ro)
     if (dm == NULL && preuse) {
 	dm = *preuse;
 	pdm = preuse;
+	DataMapDequeue(dm);
 	dm->dm_Ro = roBase;
 	if (roBase == 0)
 	    dm->dm_Refs |= DM_REF_PERSIST;
@@ -361,6 +368,7 @@ mem_OpenDataMap(Table *tab, dboff_t ro)
 	    }
 	}
     }
+    DataMapAccess(dm);
     if (BCMemoryUsed > BCMemoryLimit)
 	DataMapGarbageCollect();
     return(dm);
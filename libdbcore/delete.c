@@ -18,31 +18,41 @@
  *	Whenever possible the query scan iterates through a table backwards,
  *	making it possible to implment the table scan / delete matching in
  *	a single pass.
+ *
+ *	Each DelHash owns an open addressed table of DelSlot's which is
+ *	allocated on the first deletion and doubled as deletions accumulate,
+ *	so the cost of saving, matching and throwing away deletions is
+ *	proportional to the number of deletions seen by the scan rather
+ *	than to some fixed hash size.
  */
 
 #include "defs.h"
 
 Prototype void InitDelHash(DelHash *dh);
 Prototype void DoneDelHash(DelHash *dh);
-Prototype void SaveDelHash(DelHash *dh, dbpos_t *pos, rhhash_t hv, int recSize);
+Prototype void SaveDelHash(DelHash *dh, dbpos_t *pos, const RecHead *rh);
 Prototype int MatchDelHash(DelHash *dh, const RecHead *rh);
+Prototype int MatchDelHashCover(DelHash *dh, const RecHead *rh, dbpos_t *pos);
 
 /*
- * DelNode/DelHash - track deletions across physical table boundries
+ * DelSlot - a pending deletion.  ds_RecSize is 0 for a slot which has
+ *	     never been used and DS_MATCHED for a slot whose deletion has
+ *	     been matched up (probes must continue past it).
  */
 
-#define DHSIZE  8192
-#define DHMASK  (DHSIZE-1)
+#define DH_MINSIZE	64
+#define DS_MATCHED	-1
 
-typedef struct DelNode {
-    struct DelNode      *dn_Next;
-    struct DelHash	*dn_DelHash;
-    rhhash_t            dn_Hv;
-    dbpos_t             dn_Pos;         /* location of record */
-    int                 dn_RecSize;     /* size of record */
-} DelNode;
+typedef struct DelSlot {
+    rhhash_t            ds_Hv;
+    int                 ds_RecSize;     /* size of record */
+    rhhash64_t          ds_Hv64;        /* 0 if not available */
+    dbpos_t             ds_Pos;         /* location of record */
+} DelSlot;
 
-static DelNode	*DelHashAry[DHSIZE];
+static DelSlot *findDelSlot(DelHash *dh, const RecHead *rh, rhhash64_t hv64, DelSlot *ds);
+static void growDelHash(DelHash *dh);
+static int delSlotIndex(DelHash *dh, rhhash_t hv, int recSize);
 
 void
 InitDelHash(DelHash *dh)
@@ -54,45 +64,46 @@ void
 DoneDelHash(DelHash *dh)
 {
     /*
-     * If we were interrupted then we have to scan
-     * the delete hash for partial entries.  If we
-     * have WHERE clauses on special header fields
-     * (e.g. __timestamp), deletions may not match
-     * up either.  Otherwise there had better not be
-     * any partial entries.
+     * If we were interrupted then there may be partial entries.  If
+     * we have WHERE clauses on special header fields (e.g. __timestamp),
+     * deletions may not match up either.  Otherwise there had better
+     * not be any partial entries.
      */
-    if (dh->dh_Count && (dh->dh_Flags & (DHF_SPECIAL|DHF_INTERRUPTED))) {
-	int i;
-	for (i = 0; i < DHSIZE; ++i) {
-	    DelNode **pdn = &DelHashAry[i];
-	    DelNode *dn;
-
-	    while ((dn = *pdn) != NULL) {
-		if (dn->dn_DelHash == dh) {
-		    --dh->dh_Count;
-		    *pdn = dn->dn_Next;
-		    zfree(dn, sizeof(DelNode));
-		} else {
-		    pdn = &dn->dn_Next;
-		}
-	    }
-	}
-    }
+    if (dh->dh_Count && (dh->dh_Flags & (DHF_SPECIAL|DHF_INTERRUPTED)))
+	dh->dh_Count = 0;
     DBASSERT(dh->dh_Count == 0);
+    if (dh->dh_Slots) {
+	zfree(dh->dh_Slots, dh->dh_Size * sizeof(DelSlot));
+	dh->dh_Slots = NULL;
+    }
+    dh->dh_Size = 0;
+    dh->dh_Used = 0;
 }
 
+/*
+ * SaveDelHash() - remember the deletion rh located at pos
+ *
+ *	rh may be a covering copy of the record (see btreeAppendCover()),
+ *	which has the original rh_Hv and rh_Size but no 64 bit hash.
+ */
+
 void
-SaveDelHash(DelHash *dh, dbpos_t *pos, rhhash_t hv, int recSize)
+SaveDelHash(DelHash *dh, dbpos_t *pos, const RecHead *rh)
 {
-    DelNode *dn = zalloc(sizeof(DelNode));
-    DelNode **pdn = &DelHashAry[hv & DHMASK];
-
-    dn->dn_Next = *pdn;		/* XXX insert @ head not optimal */
-    dn->dn_DelHash = dh;
-    dn->dn_Pos = *pos;
-    dn->dn_Hv = hv;
-    dn->dn_RecSize = recSize;
-    *pdn = dn;
+    DelSlot *ds;
+    int i;
+
+    if ((dh->dh_Used + 1) * 4 > dh->dh_Size * 3)
+	growDelHash(dh);
+    i = delSlotIndex(dh, rh->rh_Hv, rh->rh_Size);
+    while (dh->dh_Slots[i].ds_RecSize != 0)
+	i = (i + 1) & (dh->dh_Size - 1);
+    ds = &dh->dh_Slots[i];
+    ds->ds_Hv = rh->rh_Hv;
+    ds->ds_RecSize = rh->rh_Size;
+    ds->ds_Hv64 = RecHash64(rh);
+    ds->ds_Pos = *pos;
+    ++dh->dh_Used;
     ++dh->dh_Count;
 }
 
@@ -104,40 +115,145 @@ SaveDelHash(DelHash *dh, dbpos_t *pos, rhhash_t hv, int recSize)
  *	in index.c which checks.  Thus we do not need a specific DelHash
  *	close routine.
  *
- *	Note that dn_IRo is not valid as stored since other clients might
+ *	Note that ds_Pos is not valid as stored since other clients might
  *	insert data into the tree while we are twiddling our thumbs.
+ *
+ *	When both the deletion and rh carry a 64 bit data hash, deletions
+ *	whose hash differs are skipped without accessing them.  A deletion
+ *	is only matched up once its record data compares equal, since
+ *	distinct records may share a hash.
  */
 
 int
 MatchDelHash(DelHash *dh, const RecHead *rh)
 {
-    DelNode *dn;
-    DelNode **pdn = &DelHashAry[rh->rh_Hv & DHMASK];
-    int r = -1;
-
-    while (r < 0 && (dn = *pdn) != NULL) {
-	if (dn->dn_DelHash == dh &&
-	    rh->rh_Hv == dn->dn_Hv &&
-	    rh->rh_Size == dn->dn_RecSize
+    DelSlot *ds = NULL;
+    rhhash64_t hv64 = RecHash64(rh);
+    int dataSize = rh->rh_Size - offsetof(RecHead, rh_Cols[0]);
+
+    while ((ds = findDelSlot(dh, rh, hv64, ds)) != NULL) {
+	DataMap *dm = NULL;
+	const RecHead *orh;
+	int r = -1;
+
+	orh = ds->ds_Pos.p_Tab->ta_GetDataMap(&ds->ds_Pos, &dm, rh->rh_Size);
+	if (orh && 
+	    orh->rh_Size == rh->rh_Size &&
+	    bcmp(&rh->rh_Cols[0], &orh->rh_Cols[0], dataSize) == 0
 	) {
-	    DataMap *dm = NULL;
-	    const RecHead *orh;
-	    int dataSize = rh->rh_Size - offsetof(RecHead, rh_Cols[0]);
-
-	    orh = dn->dn_Pos.p_Tab->ta_GetDataMap(&dn->dn_Pos,&dm,rh->rh_Size);
-	    if (orh && 
-		orh->rh_Size == rh->rh_Size &&
-		bcmp(&rh->rh_Cols[0], &orh->rh_Cols[0], dataSize) == 0
-	    ) {
-		r = 0;
-		--dh->dh_Count;
-		*pdn = dn->dn_Next;
-		zfree(dn, sizeof(DelNode));
-	    }
-	    dm->dm_Table->ta_RelDataMap(&dm, 0);
+	    r = 0;
+	    --dh->dh_Count;
+	    ds->ds_RecSize = DS_MATCHED;
 	}
-	pdn = &dn->dn_Next;	/* pdn invalid if r==0, is ok */
+	if (dm)
+	    dm->dm_Table->ta_RelDataMap(&dm, 0);
+	if (r == 0)
+	    return(0);
     }
+    return(-1);
+}
+
+
+/*
+ * MatchDelHashCover() - MatchDelHash() for an index-only scan
+ *
+ *	rh is a partial (covering) copy of the record at pos and cannot be
+ *	compared against the deletion directly.  The table record is only
+ *	accessed if a deletion with the same hash and size is pending.
+ */
+
+int
+MatchDelHashCover(DelHash *dh, const RecHead *rh, dbpos_t *pos)
+{
+    DataMap *dm = NULL;
+    const RecHead *orh;
+    int r;
+
+    if (findDelSlot(dh, rh, 0, NULL) == NULL)
+	return(-1);
+    orh = pos->p_Tab->ta_GetDataMap(pos, &dm, rh->rh_Size);
+    DBASSERT(orh != NULL);
+    r = MatchDelHash(dh, orh);
+    dm->dm_Table->ta_RelDataMap(&dm, 0);
     return(r);
 }
 
+/*
+ * findDelSlot() - locate the next pending deletion with rh's hash and size
+ *
+ *	hv64 is rh's 64 bit hash or 0.  Deletions whose 64 bit hash is known
+ *	and differs are skipped.  Pass NULL to start the probe and the
+ *	previous return value to continue it.  Returns NULL when the probe
+ *	reaches an unused slot.
+ */
+static DelSlot *
+findDelSlot(DelHash *dh, const RecHead *rh, rhhash64_t hv64, DelSlot *ds)
+{
+    int i;
+
+    if (dh->dh_Count == 0)
+	return(NULL);
+    if (ds == NULL)
+	i = delSlotIndex(dh, rh->rh_Hv, rh->rh_Size);
+    else
+	i = ((ds - dh->dh_Slots) + 1) & (dh->dh_Size - 1);
+
+    while ((ds = &dh->dh_Slots[i])->ds_RecSize != 0) {
+	if (ds->ds_Hv == rh->rh_Hv && ds->ds_RecSize == rh->rh_Size &&
+	    (hv64 == 0 || ds->ds_Hv64 == 0 || hv64 == ds->ds_Hv64)
+	) {
+	    return(ds);
+	}
+	i = (i + 1) & (dh->dh_Size - 1);
+    }
+    return(NULL);
+}
+
+/*
+ * growDelHash() - make room for another deletion
+ *
+ *	Pending deletions are rehashed into a table at most half full,
+ *	matched slots are dropped.
+ */
+static void
+growDelHash(DelHash *dh)
+{
+    DelSlot *oslots = dh->dh_Slots;
+    int osize = dh->dh_Size;
+    int nsize = DH_MINSIZE;
+    int i;
+
+    while (nsize < (dh->dh_Count + 1) * 2)
+	nsize <<= 1;
+    dh->dh_Slots = zalloc(nsize * sizeof(DelSlot));
+    dh->dh_Size = nsize;
+    dh->dh_Used = dh->dh_Count;
+
+    for (i = 0; i < osize; ++i) {
+	DelSlot *ds = &oslots[i];
+	int j;
+
+	if (ds->ds_RecSize <= 0)
+	    continue;
+	j = delSlotIndex(dh, ds->ds_Hv, ds->ds_RecSize);
+	while (dh->dh_Slots[j].ds_RecSize != 0)
+	    j = (j + 1) & (nsize - 1);
+	dh->dh_Slots[j] = *ds;
+    }
+    if (oslots)
+	zfree(oslots, osize * sizeof(DelSlot));
+}
+
+/*
+ * delSlotIndex() - initial probe for a deletion
+ *
+ *	The record hash is only 16 bits, fold in the record size to
+ *	spread large tables out.
+ */
+static int
+delSlotIndex(DelHash *dh, rhhash_t hv, int recSize)
+{
+    u_int32_t h = ((u_int32_t)hv << 16 | (recSize & 0xFFFF)) * 2654435761U;
+
+    return((h ^ (h >> 16)) & (dh->dh_Size - 1));
+}
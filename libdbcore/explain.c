@@ -0,0 +1,396 @@
+/*
+ * LIBDBCORE/EXPLAIN.C	- Describe how a query is run (EXPLAIN)
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	EXPLAIN returns one row per range, in the order the ranges are
+ *	run, which is the order HLPlanQuery() settled on.  The first row of
+ *	each table instance starts a new nesting level and names the index
+ *	it primes.  EXPLAIN ANALYZE runs the query first, counting instead
+ *	of returning the selected records, and adds the table instance's
+ *	scan counters to that first row plus a summary row for the query.
+ *
+ *	Columns:
+ *
+ *	    Level	nesting level of the table instance, 0 for the summary
+ *	    Table	[schema.]table[=alias], '*' for the summary
+ *	    Column	column the range tests
+ *	    Op		operator, 'join' for the outer side of a join
+ *	    Value	constant, or the column supplying a join's constant
+ *	    Access	index, scan (no index restriction) or filter
+ *	    Index	btree(cols) or hash(cols) for indexed access
+ *	    Scanned	records looked at			(ANALYZE only)
+ *	    IndexScanned  index elements looked at		(ANALYZE only)
+ *	    IndexInserted index elements added to bring	(ANALYZE only)
+ *			  indexes up to date
+ *	    Conflicts	phase-1 conflict checks			(ANALYZE only)
+ *	    Usecs	wall clock time to run the query, the summary row's
+ *			Value is the record count		(ANALYZE only)
+ *
+ *	EXPLAIN ANALYZE follows the summary row with one row per buffer
+ *	cache counter (see DataMapStats), Access 'cache', Column naming
+ *	the counter and Value the amount it went up by while the query
+ *	ran.  The cache is shared by every query of the database process
+ *	so this includes whatever else ran at the same time.
+ */
+
+#include "defs.h"
+
+Export int ExplainQuery(Query *q, int (*func)(void *info, char **data, int cols), void *info);
+
+#define EXPLAIN_COLS	12
+
+static void explainRange(Query *q, Range *r, int level, char **data);
+static void explainCounters(int64_t scan, int64_t iscan, int64_t iins, int64_t c1, char **data);
+static void explainColName(Query *q, const ColData *cd, int qualify, char **pstr);
+static const char *explainOpName(int opId);
+static const char *explainIndexType(int opClass);
+static void explainFree(char **data);
+static int explainCache(const DataMapStats *bc1, int (*func)(void *info, char **data, int cols), void *info);
+
+/*
+ * ExplainQuery() - return the plan (and counters) of a parsed query
+ *
+ *	func() is called with each row, EXPLAIN_COLS NUL terminated
+ *	strings, NULL for an empty column.  A negative return from func()
+ *	aborts.  Returns the number of rows or a negative error code.
+ */
+int
+ExplainQuery(Query *q, int (*func)(void *info, char **data, int cols), void *info)
+{
+    struct timeval tv1;
+    struct timeval tv2;
+    DataMapStats bc1;
+    char *data[EXPLAIN_COLS];
+    Range *r;
+    TableI *ti;
+    int count = 0;
+    int level = 0;
+    int rows = 0;
+    int error;
+
+    if (q->q_Flags & QF_EXPLAIN_ANALYZE) {
+	q->q_TermFunc = NULL;
+	q->q_DebugScanCount = 0;
+	q->q_DebugScanIndexCount = 0;
+	q->q_DebugInsertIndexCount = 0;
+	bc1 = BCStats;
+	gettimeofday(&tv1, NULL);
+	count = RunQuery(q);
+	gettimeofday(&tv2, NULL);
+	if (count < 0)
+	    return(count);
+	for (ti = q->q_TableIQBase; ti; ti = ti->ti_Next) {
+	    q->q_DebugScanCount += ti->ti_DebugScanCount;
+	    q->q_DebugScanIndexCount += ti->ti_DebugIndexScanCount;
+	    q->q_DebugInsertIndexCount += ti->ti_DebugIndexInsertCount;
+	}
+    }
+
+    r = (q->q_RunRange == RunRange) ? q->q_RangeArg.ra_RangePtr : NULL;
+    while (r) {
+	ti = r->r_TableI;
+	bzero(data, sizeof(data));
+	if (r->r_PrevSame == NULL)
+	    ++level;
+	explainRange(q, r, level, data);
+	if (r->r_PrevSame == NULL && (q->q_Flags & QF_EXPLAIN_ANALYZE)) {
+	    explainCounters(
+		ti->ti_DebugScanCount,
+		ti->ti_DebugIndexScanCount,
+		ti->ti_DebugIndexInsertCount,
+		ti->ti_DebugConflictC1Count,
+		data
+	    );
+	}
+	error = func(info, data, EXPLAIN_COLS);
+	explainFree(data);
+	if (error < 0)
+	    return(error);
+	++rows;
+	r = (r->r_RunRange == RunRange) ? r->r_Next.ra_RangePtr : NULL;
+    }
+
+    if (q->q_Flags & QF_EXPLAIN_ANALYZE) {
+	int64_t c1 = 0;
+
+	for (ti = q->q_TableIQBase; ti; ti = ti->ti_Next)
+	    c1 += ti->ti_DebugConflictC1Count;
+	bzero(data, sizeof(data));
+	data[0] = safe_strdup("0");
+	data[1] = safe_strdup("*");
+	safe_asprintf(&data[4], "%d", count);
+	explainCounters(
+	    q->q_DebugScanCount,
+	    q->q_DebugScanIndexCount,
+	    q->q_DebugInsertIndexCount,
+	    c1,
+	    data
+	);
+	safe_asprintf(&data[11], "%lld",
+	    (long long)(tv2.tv_sec - tv1.tv_sec) * 1000000 +
+	    (tv2.tv_usec - tv1.tv_usec)
+	);
+	error = func(info, data, EXPLAIN_COLS);
+	explainFree(data);
+	if (error < 0)
+	    return(error);
+	++rows;
+	if ((error = explainCache(&bc1, func, info)) < 0)
+	    return(error);
+	rows += error;
+    }
+    return(rows);
+}
+
+/*
+ * explainCache() - return the buffer cache counter rows
+ *
+ *	bc1 holds the counters from before the query ran.  Returns the
+ *	number of rows or a negative error code.
+ */
+static int
+explainCache(const DataMapStats *bc1, int (*func)(void *info, char **data, int cols), void *info)
+{
+    static const struct {
+	const char *name;
+	int off;
+    } Counters[] = {
+	{ "inhits", offsetof(DataMapStats, bs_InHits) },
+	{ "hothits", offsetof(DataMapStats, bs_HotHits) },
+	{ "misses", offsetof(DataMapStats, bs_Misses) },
+	{ "ghosthits", offsetof(DataMapStats, bs_GhostHits) },
+	{ "evictions", offsetof(DataMapStats, bs_Evictions) }
+    };
+    char *data[EXPLAIN_COLS];
+    int error;
+    int i;
+
+    for (i = 0; i < arysize(Counters); ++i) {
+	int64_t v1 = *(const int64_t *)((const char *)bc1 + Counters[i].off);
+	int64_t v2 = *(const int64_t *)((const char *)&BCStats + Counters[i].off);
+
+	bzero(data, sizeof(data));
+	data[0] = safe_strdup("0");
+	data[1] = safe_strdup("*");
+	data[2] = safe_strdup(Counters[i].name);
+	safe_asprintf(&data[4], "%lld", (long long)(v2 - v1));
+	data[5] = safe_strdup("cache");
+	error = func(info, data, EXPLAIN_COLS);
+	explainFree(data);
+	if (error < 0)
+	    return(error);
+    }
+    return(i);
+}
+
+/*
+ * explainRange() - describe one range (columns Level through Index)
+ */
+static void
+explainRange(Query *q, Range *r, int level, char **data)
+{
+    TableI *ti = r->r_TableI;
+    SchemaI *si = ti->ti_SchemaI;
+    int driver = (r->r_PrevSame == NULL);
+    int i;
+
+    safe_asprintf(&data[0], "%d", level);
+    if (ti->ti_AliasName && (ti->ti_AliasNameLen != ti->ti_TabNameLen ||
+	bcmp(ti->ti_AliasName, ti->ti_TabName, ti->ti_TabNameLen) != 0)
+    ) {
+	safe_asprintf(&data[1], "%.*s.%.*s=%.*s",
+	    si->si_ScmNameLen, si->si_ScmName,
+	    ti->ti_TabNameLen, ti->ti_TabName,
+	    ti->ti_AliasNameLen, ti->ti_AliasName
+	);
+    } else {
+	safe_asprintf(&data[1], "%.*s.%.*s",
+	    si->si_ScmNameLen, si->si_ScmName,
+	    ti->ti_TabNameLen, ti->ti_TabName
+	);
+    }
+    if (r->r_Col)
+	explainColName(q, r->r_Col, 0, &data[2]);
+
+    switch(r->r_Type) {
+    case ROP_JOIN:
+	data[3] = safe_strdup("join");
+	break;
+    case ROP_CONST:
+	data[3] = safe_strdup(explainOpName(r->r_OpId));
+	if (r->r_Const && r->r_Const->cd_Data) {
+	    char buf[DATATYPE_FMTSIZE];
+
+	    if (DataTypeToString(r->r_Const->cd_DataType, r->r_Const, buf) >= 0) {
+		data[4] = safe_strdup(buf);
+	    } else {
+		safe_asprintf(&data[4], "%.*s",
+		    r->r_Const->cd_Bytes, r->r_Const->cd_Data);
+	    }
+	}
+	break;
+    case ROP_JCONST:
+	data[3] = safe_strdup(explainOpName(r->r_OpId));
+	if (r->r_Const)
+	    explainColName(q, r->r_Const, 1, &data[4]);
+	break;
+    }
+
+    /*
+     * Only the first range of a table instance primes its index, see
+     * setTableRange().  A range which cannot narrow the index (or the
+     * pass-through range of an unrestricted table) means a full scan.
+     */
+    if (driver == 0) {
+	data[5] = safe_strdup("filter");
+    } else if (r->r_Col == NULL || r->r_Type == ROP_JOIN ||
+	HLIndexOp(r->r_OpId) == 0
+    ) {
+	data[5] = safe_strdup("scan");
+    } else {
+	data[5] = safe_strdup("index");
+	if (ti->ti_CompNCols > 1) {
+	    char *cols = NULL;
+
+	    for (i = 0; i < ti->ti_CompNCols; ++i) {
+		ColI *ci;
+		char *tmp = cols;
+
+		for (ci = ti->ti_FirstColI; ci; ci = ci->ci_Next) {
+		    if (ci->ci_ColId == ti->ti_CompColIds[i])
+			break;
+		}
+		if (ci) {
+		    safe_asprintf(&cols, "%s%s%.*s",
+			(tmp ? tmp : ""), (tmp ? "," : ""),
+			ci->ci_ColNameLen, ci->ci_ColName);
+		} else {
+		    safe_asprintf(&cols, "%s%s#%04x",
+			(tmp ? tmp : ""), (tmp ? "," : ""),
+			(int)ti->ti_CompColIds[i]);
+		}
+		safe_free(&tmp);
+	    }
+	    safe_asprintf(&data[6], "btree(%s)", cols);
+	    safe_free(&cols);
+	} else {
+	    safe_asprintf(&data[6], "%s(%s)",
+		explainIndexType(r->r_OpClass),
+		(data[2] ? data[2] : ""));
+	}
+    }
+}
+
+static void
+explainCounters(int64_t scan, int64_t iscan, int64_t iins, int64_t c1, char **data)
+{
+    safe_asprintf(&data[7], "%lld", (long long)scan);
+    safe_asprintf(&data[8], "%lld", (long long)iscan);
+    safe_asprintf(&data[9], "%lld", (long long)iins);
+    safe_asprintf(&data[10], "%lld", (long long)c1);
+}
+
+/*
+ * explainColName() - name the column a ColData belongs to
+ *
+ *	The ColData is one of the raw columns of some table instance of
+ *	the query.  With qualify the name is prefixed with the instance's
+ *	alias (or table name).
+ */
+static void
+explainColName(Query *q, const ColData *cd, int qualify, char **pstr)
+{
+    TableI *ti;
+    ColI *ci = NULL;
+
+    for (ti = q->q_TableIQBase; ti; ti = ti->ti_Next) {
+	const ColData *scan;
+
+	for (scan = ti->ti_RData->rd_ColBase; scan; scan = scan->cd_Next) {
+	    if (scan == cd)
+		break;
+	}
+	if (scan)
+	    break;
+    }
+    if (ti) {
+	for (ci = ti->ti_FirstColI; ci; ci = ci->ci_Next) {
+	    if (ci->ci_CData == cd || ci->ci_ColId == (col_t)cd->cd_ColId)
+		break;
+	}
+    }
+    if (ti && qualify) {
+	const char *name = ti->ti_AliasName ? ti->ti_AliasName : ti->ti_TabName;
+	int len = ti->ti_AliasName ? ti->ti_AliasNameLen : ti->ti_TabNameLen;
+
+	if (ci) {
+	    safe_asprintf(pstr, "%.*s.%.*s", len, name,
+		ci->ci_ColNameLen, ci->ci_ColName);
+	} else {
+	    safe_asprintf(pstr, "%.*s.#%04x", len, name, (int)cd->cd_ColId);
+	}
+    } else if (ci) {
+	safe_asprintf(pstr, "%.*s", ci->ci_ColNameLen, ci->ci_ColName);
+    } else {
+	safe_asprintf(pstr, "#%04x", (int)cd->cd_ColId);
+    }
+}
+
+static const char *
+explainOpName(int opId)
+{
+    switch(opId) {
+    case ROP_EQEQ:
+    case ROP_STAMP_EQEQ:
+    case ROP_VTID_EQEQ:
+    case ROP_USERID_EQEQ:
+    case ROP_OPCODE_EQEQ:
+	return("=");
+    case ROP_LT:
+    case ROP_STAMP_LT:
+	return("<");
+    case ROP_LTEQ:
+    case ROP_STAMP_LTEQ:
+	return("<=");
+    case ROP_GT:
+    case ROP_STAMP_GT:
+	return(">");
+    case ROP_GTEQ:
+    case ROP_STAMP_GTEQ:
+	return(">=");
+    case ROP_NOTEQ:
+	return("<>");
+    case ROP_LIKE:
+	return("LIKE");
+    case ROP_RLIKE:
+	return("LIKE (reversed)");
+    case ROP_SAME:
+	return("SAME");
+    case ROP_RSAME:
+	return("SAME (reversed)");
+    }
+    return("?");
+}
+
+static const char *
+explainIndexType(int opClass)
+{
+    switch(opClass) {
+    case ROP_HASH_EQEQ:
+	return("hash");
+    case ROP_TRGM_LIKE:
+	return("trigram");
+    }
+    return("btree");
+}
+
+static void
+explainFree(char **data)
+{
+    int i;
+
+    for (i = 0; i < EXPLAIN_COLS; ++i)
+	safe_free(&data[i]);
+}
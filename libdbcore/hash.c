@@ -0,0 +1,826 @@
+/*
+ * LIBDBCORE/HASH.C	- Implement linear hash indexing
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	A hash index trades the ordering of a btree for O(1) exact-match
+ *	lookups.  It is selected per column (see CIF_HASH and
+ *	GetIndexOpClass()) and only ever primed by an equality against a
+ *	constant.  See hash.h for the file layout.
+ */
+
+#include "defs.h"
+#include "btree.h"
+#include "hash.h"
+
+Prototype void OpenHashIndex(Index *index);
+
+/*
+ * HashBuild - used to build a new bucket chain when splitting a bucket
+ */
+typedef struct HashBuild {
+    int		hb_Bucket;
+    dboff_t	hb_Ro;		/* last page written, or 0 */
+    HashPage	hb_Page;	/* page being filled */
+} HashBuild;
+
+static void CloseHashIndex(Index *index);
+static void HashSetTableRange(TableI *ti, Table *tab, const ColData *colData, Range *r, int flags);
+static int HashUpdateIndex(TableI *ti, Table *tab, const ColData *colData, int flags);
+static void HashUpdateTableRange(TableI *ti, Range *r);
+static void HashNextTableRec(TableI *ti);
+static void HashPrevTableRec(TableI *ti);
+static u_int32_t hashKey(const void *data, int bytes);
+static int hashBucket(const HashHead *hh, u_int32_t hv);
+static int hashNBuckets(const HashHead *hh);
+static dboff_t hashGetBucket(Index *index, IndexMap **pim, int bucket);
+static void hashSetBucket(Index *index, int bucket, dboff_t pgro, dboff_t *appro);
+static void hashInsert(Index *index, int bucket, const HashElm *he, dboff_t *appro);
+static void hashSplit(Index *index, dboff_t *appro);
+static void hashBuildAdd(Index *index, HashBuild *hb, const HashElm *he, dboff_t *appro);
+static void hashBuildFlush(Index *index, HashBuild *hb, dboff_t *appro);
+static dboff_t hashAppend(Index *index, const void *data, int bytes, dboff_t *appro);
+static const HashPage *hashRead(Index *index, IndexMap **pim, dboff_t ro, int *elm);
+
+/*
+ * OpenHashIndex() -	Open a hash index file, creating it if necessary
+ *
+ *	Validation follows OpenBTreeIndex().  Temporary tables get a private
+ *	index file which is unlinked as soon as it has been created.
+ */
+
+void
+OpenHashIndex(Index *index)
+{
+    Table *tab = index->i_Table;
+    HashHead *hh;
+    char *p1;
+    int error = 0;
+    int tempOpt = 0;
+
+    DBASSERT(index->i_NCols == 1);
+    initList(&index->i_BTreeCacheList);
+
+    safe_asprintf(&p1, tab->ta_Name, 0);
+    safe_asprintf(&index->i_FilePath, "%s/%s.vt%04x.i%04x.o%02x",
+	tab->ta_Db->db_DirPath,
+	p1,
+	index->i_VTable,
+	index->i_ColId,
+	index->i_OpClass
+    );
+    safe_free(&p1);
+
+    if (tab->ta_Db->db_PushType != DBPUSH_ROOT) {
+	safe_replacef(
+	    &index->i_FilePath,
+	    "%s.%d.tmp",
+	    index->i_FilePath,
+	    (int)tab->ta_Db->db_Pid
+	);
+	tempOpt = 1;
+    }
+
+    hh = zalloc(sizeof(HashHead));
+
+    while (error == 0) {
+	int deleteMe = 0;
+	struct stat st;
+
+	if (tempOpt) {
+	    index->i_Fd = open(index->i_FilePath, O_RDWR|O_CREAT|O_TRUNC, 0660);
+	    if (index->i_Fd < 0) {
+		error = -1;
+		break;
+	    }
+	    remove(index->i_FilePath);
+	} else {
+	    index->i_Fd = open(index->i_FilePath, O_RDWR|O_CREAT, 0660);
+	    if (index->i_Fd < 0) {
+		error = -1;
+		break;
+	    }
+
+	    /*
+	     * Fasttrack validation
+	     */
+	    if (read(index->i_Fd, hh, sizeof(*hh)) == sizeof(*hh)) {
+		if (hh->hh_Magic == HX_MAGIC &&
+		    hh->hh_Version == HX_VERSION &&
+		    hh->hh_Generation == tab->ta_Meta->tf_Generation
+		) {
+		    break;
+		}
+	    }
+
+	    /*
+	     * Get exclusive lock, try to validate again.  If we cannot
+	     * validate we may have to delete/recreate the index file.
+	     */
+	    hflock_ex(index->i_Fd, 0);
+	    lseek(index->i_Fd, 0L, 0);
+	    if (read(index->i_Fd, hh, sizeof(*hh)) == sizeof(*hh)) {
+		if (hh->hh_Magic == HX_MAGIC &&
+		    hh->hh_Version == HX_VERSION &&
+		    hh->hh_Generation == tab->ta_Meta->tf_Generation
+		) {
+		    hflock_un(index->i_Fd, 0);
+		    break;
+		}
+		deleteMe = 1;
+	    }
+
+	    if (fstat(index->i_Fd, &st) < 0) {
+		hflock_un(index->i_Fd, 0);
+		error = -1;
+		break;
+	    }
+
+	    /*
+	     * If the file was unlinked while we were obtaining the lock
+	     * we have to try again.
+	     */
+	    if (st.st_nlink == 0) {
+		hflock_un(index->i_Fd, 0);
+		close(index->i_Fd);
+		continue;
+	    }
+	}
+
+	/*
+	 * File is unusable, we have to delete it and reaquire/recreate
+	 */
+	if (deleteMe) {
+	    remove(index->i_FilePath);
+	    hflock_un(index->i_Fd, 0);
+	    close(index->i_Fd);
+	    index->i_Fd = -1;
+	    continue;
+	}
+
+	/*
+	 * Creating new index file, setup the header.  The bucket directory
+	 * is allocated on the fly.
+	 */
+	bzero(hh, sizeof(*hh));
+	hh->hh_Magic = HX_MAGIC;
+	hh->hh_Version = 0;			/* operation in progress */
+	hh->hh_HeadSize = sizeof(HashHead);
+	hh->hh_Append = ALIGN128(sizeof(HashHead));
+	hh->hh_ExtAppend = (sizeof(HashHead) + BT_CACHEMASK) & ~BT_CACHEMASK;
+	hh->hh_TabAppend = tab->ta_FirstBlock(tab);
+	hh->hh_Generation = tab->ta_Meta->tf_Generation;
+	if (tempOpt)
+	    hh->hh_Flags |= HXF_TEMP;
+
+	ftruncate(index->i_Fd, hh->hh_ExtAppend);
+	lseek(index->i_Fd, 0, 0);
+	if (write(index->i_Fd, hh, sizeof(*hh)) != sizeof(*hh)) {
+	    error = -1;
+	    ftruncate(index->i_Fd, 0);
+	    if (tempOpt == 0)
+		hflock_un(index->i_Fd, 0);
+	    break;
+	}
+
+	/*
+	 * Lock-in changes prior to validating, then update the version
+	 * and flags, validating the index file.  A temporary index is
+	 * never synchronized.
+	 */
+	if (tempOpt == 0)
+	    fsync(index->i_Fd);
+	hh->hh_Version = HX_VERSION;
+	if (tempOpt == 0)
+	    hh->hh_Flags |= HXF_SYNCED;
+	lseek(index->i_Fd, offsetof(HashHead, hh_Head), 0);
+	if (write(index->i_Fd, &hh->hh_Head, sizeof(hh->hh_Head)) != sizeof(hh->hh_Head)) {
+	    error = -1;
+	    ftruncate(index->i_Fd, 0);
+	}
+	if (tempOpt == 0)
+	    hflock_un(index->i_Fd, 0);
+	break;
+    }
+    zfree(hh, sizeof(HashHead));
+
+    /*
+     * Map the header
+     */
+    if (error == 0) {
+	index->i_HashHead = mmap(
+			    NULL,
+			    sizeof(HashHead),
+			    PROT_READ,
+			    MAP_SHARED,
+			    index->i_Fd,
+			    0
+			);
+	if (index->i_HashHead == MAP_FAILED) {
+	    index->i_HashHead = NULL;
+	    error = -1;
+	}
+    }
+
+    /*
+     * Hash chains are kept in table order and can be scanned in reverse,
+     * so we can use DefaultIndexScanRangeOp2() just like the btree.
+     */
+    if (error == 0) {
+	index->i_ScanRangeOp = DefaultIndexScanRangeOp2;
+	index->i_SetTableRange = HashSetTableRange;
+	index->i_UpdateIndex = HashUpdateIndex;
+	index->i_UpdateTableRange = HashUpdateTableRange;
+	index->i_NextTableRec = HashNextTableRec;
+	index->i_PrevTableRec = HashPrevTableRec;
+	index->i_Close = CloseHashIndex;
+	index->i_PosCache.p_IRo = (dboff_t)-1;
+    } else {
+	CloseHashIndex(index);
+    }
+}
+
+static void
+CloseHashIndex(Index *index)
+{
+    IndexMap *im;
+    const HashHead *hh;
+
+    while ((im = getHead(&index->i_BTreeCacheList)) != NULL) {
+	DBASSERT(im->im_Refs == 0);
+	im->im_Refs = 1;
+	btreeRelIndexMap(&im, 1);
+    }
+    if ((hh = index->i_HashHead) != NULL) {
+	if ((hh->hh_Flags & HXF_TEMP) == 0) {
+	    t_flock_ex(&index->i_FLock);
+	    btreeSynchronize(index);
+	    t_flock_un(&index->i_FLock);
+	}
+	munmap((void *)hh, sizeof(HashHead));
+	index->i_HashHead = NULL;
+    }
+    if (index->i_Fd >= 0) {
+	close(index->i_Fd);
+	index->i_Fd = -1;
+    }
+    safe_free(&index->i_FilePath);
+}
+
+/*
+ * HashSetTableRange()	- update index if necessary and set indexed range
+ *
+ *	Same as BTreeSetTableRange(), except that the indexed range is
+ *	always restricted to a single key.
+ */
+
+static void
+HashSetTableRange(TableI *ti, Table *tab, const ColData *colData, Range *r, int flags)
+{
+    Index *index = ti->ti_Index;
+    const HashHead *hh = index->i_HashHead;
+
+    DBASSERT(ti->ti_ScanOneOnly <= 0);
+
+    if (flags & TABRAN_INIT) {
+	if ((flags & TABRAN_SYNCIDX) && (hh->hh_TabAppend != tab->ta_Append))
+	    HashUpdateIndex(ti, tab, colData, 0);
+	else if (hh->hh_TabAppend + tab->ta_IndexSlop < tab->ta_Append)
+	    HashUpdateIndex(ti, tab, colData, 0);
+	ti->ti_Append = tab->ta_Append;
+	ti->ti_IndexAppend = hh->hh_TabAppend;
+    }
+    if (flags & TABRAN_SLOP) {
+	DefaultSetTableRange(ti, tab, colData, r, flags & TABRAN_SLOP);
+	return;
+    }
+
+    ti->ti_RanBeg.p_Tab = tab;
+    ti->ti_RanEnd.p_Tab = tab;
+    ti->ti_ScanRangeOp = index->i_ScanRangeOp;
+
+    HashUpdateTableRange(ti, r);
+    SelectBegTableRec(ti, 0); 	/* to check degenerate EOF only */
+}
+
+/*
+ * HashUpdateIndex() -	Update index file by adding new records from the table
+ *
+ *	Same as BTreeUpdateIndex().  Buckets are split as the index grows.
+ */
+
+static int
+HashUpdateIndex(TableI *ti, Table *tab, const ColData *colData, int flags)
+{
+    Index *index = ti->ti_Index;
+    const HashHead *hh = index->i_HashHead;
+    int tempOpt = (hh->hh_Flags & HXF_TEMP);
+    dboff_t appro;
+    int64_t count;
+    int oflags;
+
+    if (tempOpt == 0)
+	t_flock_ex(&index->i_FLock);
+    if (hh->hh_TabAppend >= tab->ta_Append) {
+	if (tempOpt == 0) {
+	    if ((flags & IUF_NOSYNC) == 0)
+		btreeSynchronize(index);
+	    t_flock_un(&index->i_FLock);
+	}
+	return(0);
+    }
+    if (tempOpt == 0)
+	btreeUnSynchronize(index);
+
+    /*
+     * Temporarily remove the index reference so we can scan the physical
+     * table sequentially.  Locate the first record to scan.
+     */
+    oflags = ti->ti_Flags;
+    ti->ti_Index = NULL;
+    ti->ti_Flags = TABRAN_SLOP;
+    DefaultSetTableRange(ti, tab, colData, NULL, TABRAN_SLOP|TABRAN_INIT);
+
+    appro = hh->hh_Append;
+    count = hh->hh_Count;
+    if (hh->hh_TabAppend != 0) {
+	ti->ti_RanBeg.p_Ro = hh->hh_TabAppend;
+	SelectBegTableRec(ti, 0);
+    }
+
+    while (ti->ti_RanBeg.p_Ro > 0) {
+	const RecHead *rh;
+
+	ReadDataRecord(ti->ti_RData, &ti->ti_RanBeg, RDF_READ|RDF_ZERO);
+	rh = ti->ti_RData->rd_Rh;
+
+	if (index->i_VTable == 0 || index->i_VTable == rh->rh_VTableId) {
+	    HashElm he;
+
+	    he.he_Ro = ti->ti_RanBeg.p_Ro;
+	    he.he_Hv = hashKey(colData->cd_Data, colData->cd_Bytes);
+	    he.he_Flags = 0;
+	    if (rh->rh_Flags & RHF_DELETE)
+		he.he_Flags |= HEF_DELETED;
+	    hashInsert(index, hashBucket(hh, he.he_Hv), &he, &appro);
+	    if (++count > (int64_t)hashNBuckets(hh) * HX_FILL)
+		hashSplit(index, &appro);
+	}
+	taskQuantum();
+	SelectNextTableRec(ti, 0);
+    }
+    ti->ti_Index = index;
+    ti->ti_Flags = oflags;
+    btreeIndexWrite(
+	index,
+	offsetof(HashHead, hh_Count),
+	&count,
+	sizeof(int64_t)
+    );
+    btreeIndexWrite(
+	index,
+	offsetof(HashHead, hh_Append),
+	&appro,
+	sizeof(dboff_t)
+    );
+    btreeIndexWrite(
+	index,
+	offsetof(HashHead, hh_TabAppend),
+	&ti->ti_RanEnd.p_Ro,
+	sizeof(dboff_t)
+    );
+    if (tempOpt == 0) {
+	if ((flags & IUF_NOSYNC) == 0)
+	    btreeSynchronize(index);
+	t_flock_un(&index->i_FLock);
+    }
+    return(1);
+}
+
+/*
+ * HashUpdateTableRange() - restrict the range to a single key
+ *
+ *	GetIndexOpClass() only hands out ROP_HASH_EQEQ for exact matches
+ *	against a constant, so the range priming the table instance always
+ *	provides the key.  The range is set to the oldest and newest
+ *	elements in the key's bucket with a matching hash, and the scan
+ *	skips any other elements in between (see ti_HashKey).
+ */
+
+static void
+HashUpdateTableRange(TableI *ti, Range *r)
+{
+    Index *index = ti->ti_Index;
+    IndexMap *im = NULL;
+    dboff_t pgro;
+
+    DBASSERT(ti->ti_ScanOneOnly <= 0);
+    DBASSERT(r != NULL && (r->r_Type & ROPF_CONST));
+    DBASSERT((col_t)r->r_Col->cd_ColId == index->i_ColId);
+    DBASSERT(r->r_OpClass == index->i_OpClass);
+
+    ti->ti_HashKey = hashKey(r->r_Const->cd_Data, r->r_Const->cd_Bytes);
+    ti->ti_RanBeg.p_Ro = -1;
+    ti->ti_RanEnd.p_Ro = -1;
+
+    pgro = hashGetBucket(index, &im, hashBucket(index->i_HashHead, ti->ti_HashKey));
+    while (pgro) {
+	const HashPage *hp;
+	int i;
+
+	hp = btreeGetIndexMap(index, &im, pgro, sizeof(HashPage));
+	for (i = hp->hp_Count - 1; i >= 0; --i) {
+	    const HashElm *he = &hp->hp_Elms[i];
+
+	    if (he->he_Hv != ti->ti_HashKey || he->he_Ro >= ti->ti_IndexAppend)
+		continue;
+	    if (ti->ti_RanEnd.p_Ro < 0) {
+		ti->ti_RanEnd.p_Ro = he->he_Ro;
+		ti->ti_RanEnd.p_IRo = pgro + i;
+	    }
+	    ti->ti_RanBeg.p_Ro = he->he_Ro;
+	    ti->ti_RanBeg.p_IRo = pgro + i;
+	}
+	pgro = hp->hp_Older;
+    }
+    btreeRelIndexMap(&im, 0);
+}
+
+/*
+ * HashNextTableRec()
+ * HashPrevTableRec()
+ *
+ *	Step through the bucket chain, skipping elements belonging to other
+ *	keys and records beyond the saved index append point.  Pages are
+ *	never modified other then by appending elements, so p_IRo remains
+ *	valid for the life of the scan.
+ *
+ *	note:	The index-specific next/prev-table-rec does not have to
+ *		check for ti_ScanOneOnly.
+ */
+
+static void
+HashNextTableRec(TableI *ti)
+{
+    Index *index = ti->ti_Index;
+    IndexMap *im = NULL;
+
+    for (;;) {
+	const HashPage *hp;
+	const HashElm *he;
+	dboff_t pgro;
+	int elm;
+
+	if (ti->ti_RanBeg.p_Ro == ti->ti_RanEnd.p_Ro) {
+	    ti->ti_RanBeg.p_Ro = -1;
+	    break;
+	}
+	hp = hashRead(index, &im, ti->ti_RanBeg.p_IRo, &elm);
+	pgro = ti->ti_RanBeg.p_IRo & ~(dboff_t)HX_PAGEMASK;
+	if (++elm == hp->hp_Count) {
+	    if ((pgro = hp->hp_Newer) == 0) {
+		ti->ti_RanBeg.p_Ro = -1;
+		break;
+	    }
+	    hp = hashRead(index, &im, pgro, &elm);
+	}
+	he = &hp->hp_Elms[elm];
+	ti->ti_RanBeg.p_IRo = pgro + elm;
+	ti->ti_RanBeg.p_Ro = he->he_Ro;
+	if (he->he_Hv == ti->ti_HashKey && he->he_Ro < ti->ti_IndexAppend)
+	    break;
+    }
+    btreeRelIndexMap(&im, 0);
+}
+
+static void
+HashPrevTableRec(TableI *ti)
+{
+    Index *index = ti->ti_Index;
+    IndexMap *im = NULL;
+
+    for (;;) {
+	const HashPage *hp;
+	const HashElm *he;
+	dboff_t pgro;
+	int elm;
+
+	if (ti->ti_RanEnd.p_Ro == ti->ti_RanBeg.p_Ro) {
+	    ti->ti_RanEnd.p_Ro = -1;
+	    break;
+	}
+	hp = hashRead(index, &im, ti->ti_RanEnd.p_IRo, &elm);
+	pgro = ti->ti_RanEnd.p_IRo & ~(dboff_t)HX_PAGEMASK;
+	if (--elm < 0) {
+	    if ((pgro = hp->hp_Older) == 0) {
+		ti->ti_RanEnd.p_Ro = -1;
+		break;
+	    }
+	    hp = hashRead(index, &im, pgro, &elm);
+	    elm = hp->hp_Count - 1;
+	    DBASSERT(elm >= 0);
+	}
+	he = &hp->hp_Elms[elm];
+	ti->ti_RanEnd.p_IRo = pgro + elm;
+	ti->ti_RanEnd.p_Ro = he->he_Ro;
+	if (he->he_Hv == ti->ti_HashKey && he->he_Ro < ti->ti_IndexAppend)
+	    break;
+    }
+    btreeRelIndexMap(&im, 0);
+}
+
+/*
+ * hashKey() -	hash column data (FNV-1a)
+ *
+ *	NULL and empty data hash the same, just like the btree treats
+ *	them as the same key.
+ */
+static u_int32_t
+hashKey(const void *data, int bytes)
+{
+    const u_int8_t *ptr = data;
+    u_int32_t hv = 2166136261U;
+
+    while (bytes-- > 0)
+	hv = (hv ^ *ptr++) * 16777619U;
+    return(hv ^ (hv >> 16));
+}
+
+/*
+ * hashBucket() -	map a key hash to a bucket (linear hashing)
+ */
+static int
+hashBucket(const HashHead *hh, u_int32_t hv)
+{
+    u_int32_t n = HX_INITBUCKETS << hh->hh_Level;
+    int bucket = hv & (n - 1);
+
+    if (bucket < hh->hh_Split)
+	bucket = hv & (n * 2 - 1);
+    return(bucket);
+}
+
+static int
+hashNBuckets(const HashHead *hh)
+{
+    return((HX_INITBUCKETS << hh->hh_Level) + hh->hh_Split);
+}
+
+/*
+ * hashGetBucket() -	return the newest page in a bucket, or 0 if empty
+ */
+static dboff_t
+hashGetBucket(Index *index, IndexMap **pim, int bucket)
+{
+    const HashHead *hh = index->i_HashHead;
+    dboff_t segro;
+
+    if ((segro = hh->hh_Segs[bucket / HX_SEGBUCKETS]) == 0)
+	return(0);
+    segro += (bucket % HX_SEGBUCKETS) * sizeof(dboff_t);
+    return(*(const dboff_t *)btreeGetIndexMap(index, pim, segro, sizeof(dboff_t)));
+}
+
+/*
+ * hashSetBucket() -	set the newest page in a bucket
+ *
+ *	Directory segments are allocated as needed.
+ */
+static void
+hashSetBucket(Index *index, int bucket, dboff_t pgro, dboff_t *appro)
+{
+    const HashHead *hh = index->i_HashHead;
+    int seg = bucket / HX_SEGBUCKETS;
+    dboff_t segro;
+
+    if ((segro = hh->hh_Segs[seg]) == 0) {
+	segro = hashAppend(index, NULL, HX_SEGBUCKETS * sizeof(dboff_t), appro);
+	btreeIndexWrite(
+	    index,
+	    offsetof(HashHead, hh_Segs[seg]),
+	    &segro,
+	    sizeof(dboff_t)
+	);
+    }
+    btreeIndexWrite(
+	index,
+	segro + (bucket % HX_SEGBUCKETS) * sizeof(dboff_t),
+	&pgro,
+	sizeof(dboff_t)
+    );
+}
+
+/*
+ * hashInsert() -	append an element to a bucket
+ *
+ *	The element is added to the newest page in the bucket, or to a new
+ *	page if that one is full.  The element is written before the count
+ *	so a concurrent scan never sees a partial element.
+ */
+static void
+hashInsert(Index *index, int bucket, const HashElm *he, dboff_t *appro)
+{
+    IndexMap *im = NULL;
+    const HashPage *hp = NULL;
+    dboff_t pgro;
+
+    if ((pgro = hashGetBucket(index, &im, bucket)) != 0)
+	hp = btreeGetIndexMap(index, &im, pgro, sizeof(HashPage));
+
+    if (hp && hp->hp_Count < HX_MAXELM) {
+	int16_t count = hp->hp_Count + 1;
+
+	btreeIndexWrite(
+	    index,
+	    pgro + offsetof(HashPage, hp_Elms[hp->hp_Count]),
+	    (void *)he,
+	    sizeof(HashElm)
+	);
+	btreeIndexWrite(
+	    index,
+	    pgro + offsetof(HashPage, hp_Count),
+	    &count,
+	    sizeof(count)
+	);
+    } else {
+	HashPage np;
+	dboff_t npgro;
+
+	bzero(&np, sizeof(np));
+	np.hp_Older = pgro;
+	np.hp_Bucket = bucket;
+	np.hp_Count = 1;
+	np.hp_Elms[0] = *he;
+	npgro = hashAppend(index, &np, sizeof(np), appro);
+	if (pgro) {
+	    btreeIndexWrite(
+		index,
+		pgro + offsetof(HashPage, hp_Newer),
+		&npgro,
+		sizeof(dboff_t)
+	    );
+	}
+	hashSetBucket(index, bucket, npgro, appro);
+    }
+    btreeRelIndexMap(&im, 0);
+}
+
+/*
+ * hashSplit() -	split the next bucket
+ *
+ *	The elements of bucket hh_Split are redistributed between it and
+ *	bucket hh_Split + n, retaining table order.  Both chains are built
+ *	from scratch and the old chain is left intact for any scans in
+ *	progress.  The new bucket is published before the split point is
+ *	advanced and the old bucket is replaced last, so a concurrent
+ *	lookup always finds its key.
+ */
+static void
+hashSplit(Index *index, dboff_t *appro)
+{
+    const HashHead *hh = index->i_HashHead;
+    IndexMap *im = NULL;
+    const HashPage *hp;
+    HashBuild *hb;
+    int32_t ls[2];
+    int n = HX_INITBUCKETS << hh->hh_Level;
+    int bucket = hh->hh_Split;
+    dboff_t pgro;
+    int i;
+
+    if (n + bucket >= HX_MAXBUCKETS)
+	return;
+
+    hb = zalloc(sizeof(HashBuild) * 2);
+    hb[0].hb_Bucket = bucket;
+    hb[1].hb_Bucket = bucket + n;
+
+    /*
+     * Locate the oldest page then redistribute the elements going
+     * forwards.
+     */
+    pgro = hashGetBucket(index, &im, bucket);
+    while (pgro) {
+	hp = btreeGetIndexMap(index, &im, pgro, sizeof(HashPage));
+	if (hp->hp_Older == 0)
+	    break;
+	pgro = hp->hp_Older;
+    }
+    while (pgro) {
+	hp = btreeGetIndexMap(index, &im, pgro, sizeof(HashPage));
+	for (i = 0; i < hp->hp_Count; ++i) {
+	    const HashElm *he = &hp->hp_Elms[i];
+
+	    if ((he->he_Hv & (n * 2 - 1)) == bucket)
+		hashBuildAdd(index, &hb[0], he, appro);
+	    else
+		hashBuildAdd(index, &hb[1], he, appro);
+	}
+	pgro = hp->hp_Newer;
+    }
+    btreeRelIndexMap(&im, 0);
+    hashBuildFlush(index, &hb[0], appro);
+    hashBuildFlush(index, &hb[1], appro);
+
+    /*
+     * Publish
+     */
+    hashSetBucket(index, bucket + n, hb[1].hb_Ro, appro);
+    if (bucket + 1 == n) {
+	ls[0] = hh->hh_Level + 1;
+	ls[1] = 0;
+    } else {
+	ls[0] = hh->hh_Level;
+	ls[1] = bucket + 1;
+    }
+    btreeIndexWrite(index, offsetof(HashHead, hh_Level), ls, sizeof(ls));
+    hashSetBucket(index, bucket, hb[0].hb_Ro, appro);
+
+    zfree(hb, sizeof(HashBuild) * 2);
+}
+
+static void
+hashBuildAdd(Index *index, HashBuild *hb, const HashElm *he, dboff_t *appro)
+{
+    if (hb->hb_Page.hp_Count == HX_MAXELM)
+	hashBuildFlush(index, hb, appro);
+    hb->hb_Page.hp_Elms[hb->hb_Page.hp_Count++] = *he;
+}
+
+static void
+hashBuildFlush(Index *index, HashBuild *hb, dboff_t *appro)
+{
+    HashPage *hp = &hb->hb_Page;
+    dboff_t pgro;
+
+    if (hp->hp_Count == 0)
+	return;
+    hp->hp_Older = hb->hb_Ro;
+    hp->hp_Bucket = hb->hb_Bucket;
+    pgro = hashAppend(index, hp, sizeof(HashPage), appro);
+    if (hb->hb_Ro) {
+	btreeIndexWrite(
+	    index,
+	    hb->hb_Ro + offsetof(HashPage, hp_Newer),
+	    &pgro,
+	    sizeof(dboff_t)
+	);
+    }
+    hb->hb_Ro = pgro;
+    bzero(hp, sizeof(HashPage));
+}
+
+/*
+ * hashAppend() -	append data to the index file
+ *
+ *	Same as btreeAppendData().  If data is NULL the space is zero'd.
+ */
+static dboff_t
+hashAppend(Index *index, const void *data, int bytes, dboff_t *appro)
+{
+    static char *ZBuf;
+    const HashHead *hh = index->i_HashHead;
+    dboff_t ro;
+
+    DBASSERT(bytes <= 8192);
+    if (ZBuf == NULL)
+	ZBuf = zalloc(8192);
+
+    ro = (*appro + HX_PAGEMASK) & ~(dboff_t)HX_PAGEMASK;	/* align */
+    if ((ro ^ (ro + (bytes - 1))) & ~(dboff_t)BT_CACHEMASK)
+	ro = (ro + BT_CACHEMASK) & ~(dboff_t)BT_CACHEMASK;
+
+    if (ro + bytes > hh->hh_ExtAppend) {
+	dboff_t curapp = ro;
+	dboff_t extapp = hh->hh_ExtAppend + BT_CACHESIZE;
+
+	while (curapp < extapp) {
+	    int n = (extapp - curapp > 8192) ? 8192 : extapp - curapp;
+	    btreeIndexWrite(index, curapp, ZBuf, n);
+	    curapp += n;
+	}
+	btreeIndexWrite(
+	    index,
+	    offsetof(HashHead, hh_ExtAppend),
+	    &extapp,
+	    sizeof(dboff_t)
+	);
+    }
+    btreeIndexWrite(index, ro, (data ? (void *)data : ZBuf), bytes);
+    *appro = ro + bytes;
+    return(ro);
+}
+
+/*
+ * hashRead() -	map the page containing index offset ro
+ *
+ *	As with the btree, ro is the page offset plus the element index.
+ */
+static const HashPage *
+hashRead(Index *index, IndexMap **pim, dboff_t ro, int *elm)
+{
+    *elm = (int)ro & HX_PAGEMASK;
+    ro &= ~(dboff_t)HX_PAGEMASK;
+    return(btreeGetIndexMap(index, pim, ro, sizeof(HashPage)));
+}
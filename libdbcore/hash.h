@@ -0,0 +1,74 @@
+/*
+ * LIBDBCORE/HASH.H	- Linear hash index format
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ * Notes on the hash index:
+ *
+ *	The hash index supports exact-match lookups only (ROP_HASH_EQEQ).
+ *	Records are hashed into buckets using linear hashing: the table
+ *	starts out with HX_INITBUCKETS buckets and one bucket is split
+ *	each time the average bucket holds more than HX_FILL elements.
+ *
+ *	Each bucket is a doubly linked chain of pages, newest first, and
+ *	elements within a bucket are kept in table order.  Scanning a chain
+ *	backwards thus visits deletions before the records they delete, as
+ *	required by DefaultIndexScanRangeOp2().  Pages are only appended
+ *	to, a split builds new chains and abandons the old ones so a scan
+ *	in progress is never disturbed.
+ *
+ *	The directory mapping bucket numbers to chains is segmented, the
+ *	segment offsets live in the header.
+ *
+ *	Index file mappings, writes, and synchronization go through the
+ *	btree support routines, so HXF_SYNCED must match BTF_SYNCED.
+ */
+
+#define HX_MAXELM		64		/* elements per page */
+#define HX_PAGEMASK		(HX_MAXELM - 1)	/* used to align pages */
+#define HX_INITBUCKETS		64		/* buckets at level 0 */
+#define HX_SEGBUCKETS		1024		/* buckets per dir segment */
+#define HX_MAXSEGS		1024
+#define HX_MAXBUCKETS		(HX_SEGBUCKETS * HX_MAXSEGS)
+#define HX_FILL			32		/* average elements per bucket */
+
+typedef struct HashElm {
+    dboff_t	he_Ro;		/* offset of record in phys table */
+    u_int32_t	he_Hv;		/* full hash of key */
+    u_int32_t	he_Flags;	/* HEF_* */
+} HashElm;
+
+#define HEF_DELETED	0x0001	/* element references a deletion */
+
+typedef struct HashPage {
+    dboff_t	hp_Older;	/* next older page in bucket, or 0 */
+    dboff_t	hp_Newer;	/* next newer page in bucket, or 0 */
+    int32_t	hp_Bucket;	/* bucket (at time of creation) */
+    int16_t	hp_Count;
+    u_int16_t	hp_Flags;
+    HashElm	hp_Elms[HX_MAXELM];
+} HashPage;
+
+typedef struct HashHead {
+    IndexHead	hh_Head;
+    dboff_t	hh_TabAppend;	/* we are indexed up to this point */
+    dboff_t	hh_Append;	/* append point for new pages */
+    dboff_t	hh_ExtAppend;	/* append point for file extension */
+    dbstamp_t	hh_Generation;	/* generation number */
+    int64_t	hh_Count;	/* number of elements */
+    int32_t	hh_Level;	/* HX_INITBUCKETS << hh_Level buckets ... */
+    int32_t	hh_Split;	/* ... plus hh_Split already split */
+    dboff_t	hh_Segs[HX_MAXSEGS];	/* directory segments */
+} HashHead;
+
+#define hh_Flags	hh_Head.ih_Flags
+#define hh_Magic	hh_Head.ih_Magic
+#define hh_Version	hh_Head.ih_Version
+#define hh_HeadSize	hh_Head.ih_HeadSize
+
+#define HXF_SYNCED	0x00000001	/* hash file is intact (BTF_SYNCED) */
+#define HXF_TEMP	0x00000004	/* private file (unlike BTF_TEMP, on disk) */
+
+#define HX_MAGIC	0x4855FCD3
+#define HX_VERSION	1
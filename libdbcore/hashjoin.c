@@ -0,0 +1,324 @@
+/*
+ * LIBDBCORE/HASHJOIN.C	- Hash the inner side of an equality join
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	RunRange() hands the first range of every table instance to
+ *	HashJoinRange().  For the inner side of an equality join which
+ *	keeps rescanning the table we locate the visible records once,
+ *	hash them on the join column, and then run each outer record
+ *	against its bucket instead of against the whole table.  See
+ *	hashjoin.h.
+ */
+
+#include "defs.h"
+#include "hashjoin.h"
+
+Prototype int HashJoinRange(Range *r, int *pcount);
+Prototype void FreeHashJoin(TableI *ti);
+
+static int hashJoinUsable(Range *r);
+static int hashJoinBuild(Range *r, HashJoin *hj);
+static int hashJoinCollect(RangeArg a);
+static int hashJoinProbe(Range *r, HashJoin *hj);
+static void hashJoinGrow(HashJoin *hj);
+static u_int32_t hashJoinKey(const ColData *cd);
+
+/*
+ * HashJoinRange() - run the first range of a table instance via a hash
+ *
+ *	Returns -1 if the caller must scan the table itself, otherwise
+ *	the range has been run and its result is stored in *pcount.
+ *
+ *	The join is left as a nested loop for the first HJ_MINCALLS calls
+ *	and for as long as each call scans only a few records (e.g. the
+ *	join column is indexed).  The scan counter includes every later
+ *	range of the table instance, which is close enough.
+ */
+int
+HashJoinRange(Range *r, int *pcount)
+{
+    TableI *ti = r->r_TableI;
+    HashJoin *hj;
+
+    if (ti->ti_ScanOneOnly != 0)
+	return(-1);
+    if ((hj = ti->ti_HashJoin) == NULL) {
+	hj = zalloc(sizeof(HashJoin));
+	hj->hj_ScanBase = ti->ti_DebugScanCount;
+	if (hashJoinUsable(r) < 0)
+	    hj->hj_Flags |= HJF_FAILED;
+	ti->ti_HashJoin = hj;
+    }
+    if (hj->hj_Flags & HJF_FAILED)
+	return(-1);
+    if ((hj->hj_Flags & HJF_BUILT) == 0) {
+	if (hj->hj_Calls < HJ_MINCALLS ||
+	    ti->ti_DebugScanCount - hj->hj_ScanBase <=
+	    (int64_t)hj->hj_Calls * HJ_SCANRATIO
+	) {
+	    ++hj->hj_Calls;
+	    return(-1);
+	}
+	if (hashJoinBuild(r, hj) < 0) {
+	    hj->hj_Flags |= HJF_FAILED;
+	    return(-1);
+	}
+	hj->hj_Flags |= HJF_BUILT;
+    }
+    *pcount = hashJoinProbe(r, hj);
+    return(0);
+}
+
+/*
+ * FreeHashJoin() - throw away a table instance's join hash
+ *
+ *	Called at the end of RunQuery(), the hash is not valid once the
+ *	tables can change underneath it.
+ */
+void
+FreeHashJoin(TableI *ti)
+{
+    HashJoin *hj;
+
+    if ((hj = ti->ti_HashJoin) != NULL) {
+	ti->ti_HashJoin = NULL;
+	safe_free((char **)&hj->hj_Buckets);
+	safe_free((char **)&hj->hj_Ents);
+	zfree(hj, sizeof(HashJoin));
+    }
+}
+
+/*
+ * hashJoinUsable() - can the range be answered from a hash
+ *
+ *	Only byte-for-byte matches (the string EQEQ operator) of a user
+ *	column against the outer table of a read-only query qualify.
+ *	Queries which must see deleted or conflicting records, or which
+ *	modify tables, are left alone.
+ */
+static int
+hashJoinUsable(Range *r)
+{
+    TableI *ti = r->r_TableI;
+    Query *q = ti->ti_Query;
+
+    if (r->r_Type != ROP_JCONST || r->r_OpId != ROP_EQEQ)
+	return(-1);
+    if (r->r_OpFunc != DataTypeFuncAry[DATATYPE_STRING][DATAOP_EQEQ])
+	return(-1);
+    if (r->r_Flags & RF_FORCESAVE)
+	return(-1);
+    if ((col_t)r->r_Col->cd_ColId < CID_RAW_LIMIT)
+	return(-1);
+    if (q == NULL || (q->q_Flags & QF_SPECIAL_WHERE))
+	return(-1);
+    if (q->q_TermOp != QOP_SELECT && q->q_TermOp != QOP_COUNT)
+	return(-1);
+    if (ti->ti_Table->ta_Db->db_Flags & DBF_COMMIT1)
+	return(-1);
+    return(0);
+}
+
+/*
+ * hashJoinBuild() - locate and hash the visible records of the table
+ *
+ *	This is RunRange() with an unrestricted range whose terminator
+ *	records positions, so deletions are filtered out the usual way.
+ *	The scan is never indexed.
+ */
+static int
+hashJoinBuild(Range *r, HashJoin *hj)
+{
+    TableI *ti = r->r_TableI;
+    DelHash delHash;
+    Range br;
+    int error;
+    int i;
+
+    hj->hj_Col = r->r_Col;
+    hj->hj_TableI = ti;
+    hj->hj_Mask = HJ_MINBUCKETS - 1;
+    hj->hj_Buckets = safe_malloc(HJ_MINBUCKETS * sizeof(int));
+    for (i = 0; i < HJ_MINBUCKETS; ++i)
+	hj->hj_Buckets[i] = -1;
+
+    bzero(&br, sizeof(br));
+    br.r_Type = ROP_NOP;
+    br.r_TableI = ti;
+    br.r_RunRange = hashJoinCollect;
+    br.r_Next.ra_VoidPtr = hj;
+
+    InitDelHash(&delHash);
+    br.r_DelHash = &delHash;
+
+    error = 0;
+    for (
+	i = GetLastTable(ti, NULL);
+	i == 0;
+	i = GetPrevTable(ti, NULL)
+    ) {
+	if ((error = ti->ti_ScanRangeOp(ti->ti_Index, &br)) < 0) {
+	    delHash.dh_Flags |= DHF_INTERRUPTED;
+	    break;
+	}
+	error = 0;
+    }
+    CloseIndex(&ti->ti_Index, 0);
+    DoneDelHash(&delHash);
+
+    if (error < 0) {
+	safe_free((char **)&hj->hj_Buckets);
+	safe_free((char **)&hj->hj_Ents);
+	hj->hj_Count = 0;
+	hj->hj_Alloc = 0;
+	return(-1);
+    }
+    return(0);
+}
+
+/*
+ * hashJoinCollect() - terminator for hashJoinBuild(), hash one record
+ *
+ *	Gives up (returns -1) when the hash would exceed HJ_MAXBYTES.
+ */
+static int
+hashJoinCollect(RangeArg a)
+{
+    HashJoin *hj = a.ra_VoidPtr;
+    HashJoinEnt *he;
+    int i;
+
+    if (hj->hj_Count == hj->hj_Alloc) {
+	int n = hj->hj_Alloc ? hj->hj_Alloc * 2 : HJ_MINBUCKETS;
+
+	if ((size_t)n * (sizeof(HashJoinEnt) + sizeof(int)) > HJ_MAXBYTES)
+	    return(-1);
+	hj->hj_Ents = safe_realloc(hj->hj_Ents, n * sizeof(HashJoinEnt));
+	hj->hj_Alloc = n;
+    }
+    if (hj->hj_Count > hj->hj_Mask)
+	hashJoinGrow(hj);
+
+    he = &hj->hj_Ents[hj->hj_Count];
+    he->he_Hv = hashJoinKey(hj->hj_Col);
+    he->he_Pos = hj->hj_TableI->ti_RanBeg;
+    i = he->he_Hv & hj->hj_Mask;
+    he->he_Next = hj->hj_Buckets[i];
+    hj->hj_Buckets[i] = hj->hj_Count++;
+    return(0);
+}
+
+/*
+ * hashJoinProbe() - run the range against the records matching r_Const
+ *
+ *	Each record is presented exactly like the degenerate one-record
+ *	scan in DefaultIndexScanRangeOp1(), so later ranges on the same
+ *	table instance see an unindexed table positioned on the record.
+ *	The records have already been filtered against deletions, later
+ *	ranges are given an empty deletion hash.
+ */
+static int
+hashJoinProbe(Range *r, HashJoin *hj)
+{
+    TableI *ti = r->r_TableI;
+    RawData *rd = ti->ti_RData;
+    DelHash delHash;
+    u_int32_t hv;
+    int count;
+    int rv;
+    int i;
+
+    hv = hashJoinKey(r->r_Const);
+    count = 0;
+
+    InitDelHash(&delHash);
+    r->r_DelHash = &delHash;
+
+    for (i = hj->hj_Buckets[hv & hj->hj_Mask]; i >= 0; i = hj->hj_Ents[i].he_Next) {
+	const HashJoinEnt *he = &hj->hj_Ents[i];
+	Table *tab = he->he_Pos.p_Tab;
+
+	if (he->he_Hv != hv)
+	    continue;
+
+	/*
+	 * cooperative multitasking
+	 */
+	taskQuantum();
+
+	ti->ti_Flags = TABRAN_SLOP;
+	ti->ti_Append = tab->ta_Append;
+	ti->ti_ScanRangeOp = DefaultIndexScanRangeOp1;
+	ti->ti_RanBeg = he->he_Pos;
+	ti->ti_RanEnd.p_Tab = tab;
+	ti->ti_RanEnd.p_Ro = ti->ti_Append;
+	ti->ti_RanEnd.p_IRo = -1;
+
+	++ti->ti_DebugScanCount;
+	ReadDataRecord(rd, &ti->ti_RanBeg, RDF_READ | RDF_ZERO);
+	if (r->r_OpFunc(r->r_Col, r->r_Const) < 0)
+	    continue;
+
+	++ti->ti_ScanOneOnly;
+	rv = r->r_RunRange(r->r_Next);
+	--ti->ti_ScanOneOnly;
+	if (rv < 0) {
+	    count = rv;
+	    delHash.dh_Flags |= DHF_INTERRUPTED;
+	    break;
+	}
+	count += rv;
+    }
+    r->r_DelHash = NULL;
+    DoneDelHash(&delHash);
+
+    ti->ti_RanBeg.p_Tab = NULL;
+    ti->ti_RanBeg.p_Ro = -1;
+    ti->ti_RanEnd.p_Tab = NULL;
+    ti->ti_RanEnd.p_Ro = -1;
+    if (rd->rd_Map)
+	rd->rd_Map->dm_Table->ta_RelDataMap(&rd->rd_Map, 0);
+    return(count);
+}
+
+/*
+ * hashJoinGrow() - double the number of buckets
+ */
+static void
+hashJoinGrow(HashJoin *hj)
+{
+    int n = (hj->hj_Mask + 1) * 2;
+    int i;
+
+    free(hj->hj_Buckets);
+    hj->hj_Buckets = safe_malloc(n * sizeof(int));
+    hj->hj_Mask = n - 1;
+    for (i = 0; i < n; ++i)
+	hj->hj_Buckets[i] = -1;
+    for (i = 0; i < hj->hj_Count; ++i) {
+	HashJoinEnt *he = &hj->hj_Ents[i];
+	int j = he->he_Hv & hj->hj_Mask;
+
+	he->he_Next = hj->hj_Buckets[j];
+	hj->hj_Buckets[j] = i;
+    }
+}
+
+/*
+ * hashJoinKey() - hash a column value
+ *
+ *	A missing column compares as the empty string.
+ */
+static u_int32_t
+hashJoinKey(const ColData *cd)
+{
+    const u_int8_t *ptr = (const u_int8_t *)cd->cd_Data;
+    u_int32_t hv = 2166136261U;
+    int bytes;
+
+    for (bytes = cd->cd_Bytes; bytes > 0; --bytes)
+	hv = (hv ^ *ptr++) * 16777619U;
+    return(hv);
+}
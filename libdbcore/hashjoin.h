@@ -0,0 +1,52 @@
+/*
+ * LIBDBCORE/HASHJOIN.H	- In-memory hash of the inner side of a join
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ * Notes on hash joins:
+ *
+ *	An equality join (a.x = b.y) is run as a nested loop.  The inner
+ *	table instance's first range is a ROP_JCONST whose constant is the
+ *	outer table's current column, so the inner table is rescanned for
+ *	every outer record.  When no index restricts that rescan the join
+ *	costs a full scan of the inner table per outer record.
+ *
+ *	RunRange() lets HashJoinRange() watch the inner range.  Once it has
+ *	been run HJ_MINCALLS times and the rescans have looked at more than
+ *	HJ_SCANRATIO records per call on average, the visible records of
+ *	the inner table are located once, with the usual deletion tracking,
+ *	and hashed on the join column.  Every later call looks the outer
+ *	value up in the hash and only visits the records it finds.
+ *
+ *	The hash only holds record positions and lives until the end of
+ *	RunQuery().  If it would grow past HJ_MAXBYTES it is thrown away
+ *	and the join simply stays a nested loop.
+ */
+
+#define HJ_MINCALLS		4		/* nested loop calls first */
+#define HJ_SCANRATIO		32		/* records scanned per call */
+#define HJ_MAXBYTES		(32 * 1024 * 1024)
+#define HJ_MINBUCKETS		256
+
+typedef struct HashJoinEnt {
+    int		he_Next;	/* next entry in bucket or -1 */
+    u_int32_t	he_Hv;		/* hash of the join column */
+    dbpos_t	he_Pos;		/* location of record */
+} HashJoinEnt;
+
+typedef struct HashJoin {
+    int		hj_Flags;	/* HJF_* */
+    int		hj_Calls;	/* nested loop calls so far */
+    int64_t	hj_ScanBase;	/* ti_DebugScanCount at the first call */
+    TableI	*hj_TableI;	/* inner table instance */
+    const ColData *hj_Col;	/* join column (the range's r_Col) */
+    int		hj_Count;	/* entries in use */
+    int		hj_Alloc;	/* entries allocated */
+    int		hj_Mask;	/* buckets - 1 */
+    int		*hj_Buckets;
+    HashJoinEnt	*hj_Ents;
+} HashJoin;
+
+#define HJF_BUILT	0x0001
+#define HJF_FAILED	0x0002
@@ -8,6 +8,7 @@
  */
 
 #include "defs.h"
+#include "stats.h"
 
 Export Range *HLAddClause(Query *q, Range *lr, TableI *ti, const ColData *col1, const ColData *const2, int opId, int type);
 Export SchemaI *HLGetSchemaI(Query *q, const char *scmName, int scmLen);
@@ -16,14 +17,63 @@ Export TableI *HLFindTableI(Query *q, const char *useName, int useLen);
 Export ColI *HLGetColI(Query *q, const char *useName, int useLen, int flags);
 Export ColI *HLGetRawColI(Query *q, TableI *ti, col_t col);
 Export int HLResolveNullScans(Query *q);
+Export void HLPlanQuery(Query *q);
 Export int HLCheckFieldRestrictions(Query *q, int flags);
 Export int HLCheckDuplicate(Query *q);
 
 Prototype void FreeRangeList(Range *r);
+Prototype int HLIndexOp(int opId);
 
 static int OpEqEqVTIdMatch(const ColData *d1, const ColData *d2);
 static int OpEqEqUserIdMatch(const ColData *d1, const ColData *d2);
 static int OpEqEqOpCodeMatch(const ColData *d1, const ColData *d2);
+static int hlColFlags(TableI *ti, const ColData *col);
+static int hlCompoundType(Range *r);
+static void hlUpdateCompound(TableI *ti);
+
+/*
+ * Planner state, see HLPlanQuery()
+ */
+typedef struct PlanTable {
+    TableI	*pt_TableI;
+    const TableStats *pt_Stats;	/* NULL if never analyzed */
+    double	pt_Rows;	/* estimated records */
+    int		pt_Placed;	/* nesting level + 1, 0 if not placed yet */
+    Range	*pt_Last;	/* relinking */
+} PlanTable;
+
+typedef struct PlanRange {
+    Range	*pr_Range;
+    PlanTable	*pr_Table;	/* table instance restricted by the range */
+    PlanTable	*pr_Other;	/* JCONST: table instance supplying r_Const */
+    struct PlanRange *pr_Join;	/* JCONST: ROP_JOIN partner if reversible */
+    double	pr_Sel;		/* selectivity on pr_Table */
+    double	pr_RSel;	/* selectivity on pr_Other if reversed */
+    int		pr_Flags;	/* PRF_* */
+} PlanRange;
+
+#define PRF_INDEX	0x0001	/* narrows an index scan */
+#define PRF_DRIVER	0x0002	/* may prime the table's index */
+#define PRF_SELF	0x0004	/* JCONST within one table instance */
+
+#define PLAN_DEFROWS	1000.0		/* records, table never analyzed */
+#define PLAN_DEFEQSEL	0.1		/* exact match */
+#define PLAN_DEFRANGESEL (1.0 / 3.0)	/* inequality */
+#define PLAN_DEFLIKESEL	0.25		/* prefix match and the rest */
+
+static PlanTable *hlPlanTable(PlanTable *ptAry, int nt, const TableI *ti);
+static PlanTable *hlPlanConstTable(PlanTable *ptAry, int nt, const ColData *cd);
+static int hlPlanReady(PlanRange *prAry, int nr, PlanTable *pt);
+static int hlPlanApplies(PlanRange *pr, PlanTable *pt, double *psel);
+static double hlPlanCost(PlanRange *prAry, int nr, PlanTable *pt, double *prows, PlanRange **pdriver);
+static void hlPlanReverse(PlanRange *pr);
+static int hlPlanLikeNarrows(const Range *r);
+static double hlPlanSel(PlanTable *pt, const ColData *col, const ColData *cst, int opId);
+static double hlPlanEqSel(PlanTable *pt, col_t colId);
+static double hlPlanIneqSel(PlanTable *pt, col_t colId, const ColData *cst, int opId);
+static const ColStats *hlPlanColStats(PlanTable *pt, col_t colId);
+static int hlPlanBoundCmp(const StatsKey *sk, const ColData *cd);
+static double hlLog2(double n);
 
 /*
  * Generate a WHERE clause.  Clauses are ANDed.
@@ -173,7 +223,11 @@ HLAddClause(Query *q, Range *lr, TableI *ti, const ColData *col1,
     r->r_Col = col1;
     r->r_Const = const2;
     r->r_OpId = opId;
-    r->r_OpClass = GetIndexOpClass((col1 ? (col_t)col1->cd_ColId : 0), opId);
+    r->r_OpClass = GetIndexOpClass(
+			(col1 ? (col_t)col1->cd_ColId : 0),
+			((type & ROPF_CONST) ? hlColFlags(ti, col1) : 0),
+			opId
+		    );
     r->r_Type = type;
 
     if (ti->ti_MarkRange == NULL) {
@@ -188,9 +242,126 @@ HLAddClause(Query *q, Range *lr, TableI *ti, const ColData *col1,
 	}
 	DBASSERT(s != NULL);
     }
+    if (type == ROP_CONST)
+	hlUpdateCompound(ti);
     return(r);
 }
 
+/*
+ * hlColFlags() -	return the column flags for a range column
+ *
+ *	Only the flags affecting the choice of index are of interest, the
+ *	column may not have been resolved to a ColI at all.
+ */
+static int
+hlColFlags(TableI *ti, const ColData *col)
+{
+    ColI *ci;
+
+    if (col == NULL)
+	return(0);
+    for (ci = ti->ti_FirstColI; ci; ci = ci->ci_Next) {
+	if (ci->ci_ColId == (col_t)col->cd_ColId)
+	    return(ci->ci_Flags & (CIF_HASH|CIF_TRIGRAM));
+    }
+    return(0);
+}
+
+/*
+ * hlCompoundType() -	classify a range for compound indexing
+ *
+ *	Returns ROP_EQEQ if the range is an exact match against a constant,
+ *	ROP_LT if it is an inequality against a constant, and 0 if the range
+ *	cannot participate in a compound index key.
+ */
+static int
+hlCompoundType(Range *r)
+{
+    if (r->r_Type != ROP_CONST || (r->r_Flags & RF_FORCESAVE))
+	return(0);
+    if ((col_t)r->r_Col->cd_ColId < CID_RAW_LIMIT || r->r_OpClass != ROP_EQEQ)
+	return(0);
+    switch(r->r_OpId) {
+    case ROP_EQEQ:
+	return(ROP_EQEQ);
+    case ROP_LT:
+    case ROP_LTEQ:
+    case ROP_GT:
+    case ROP_GTEQ:
+	return(ROP_LT);
+    }
+    return(0);
+}
+
+/*
+ * hlUpdateCompound() - fold constant restrictions into a compound index
+ *
+ *	A table may declare a single compound index by flagging columns
+ *	USING COMPOUND (CIF_COMPOUND).  The key consists of the flagged
+ *	columns in column id order, at most INDEX_MAXCOLS of them (further
+ *	flagged columns are ignored), so a table never has more than one
+ *	compound index file per virtual table.
+ *
+ *	The compound index is used when the range priming the table
+ *	instance is an exact match against a constant on the first key
+ *	column and another constant restriction applies to the second key
+ *	column.  BTreeUpdateCompoundRange() narrows the range using the
+ *	longest run of exactly matched leading columns plus at most one
+ *	inequality.
+ *
+ *	The ranges are still evaluated normally during the scan, the
+ *	compound index only narrows the set of records we look at.
+ *
+ *	Every key column must be decoded into ti_RData since a query
+ *	bringing the index up to date (see BTreeUpdateIndex()) builds the
+ *	keys from it, even for key columns the query does not otherwise
+ *	reference.
+ */
+static void
+hlUpdateCompound(TableI *ti)
+{
+    Range *r = ti->ti_MarkRange;
+    col_t colAry[INDEX_MAXCOLS];
+    int typeAry[INDEX_MAXCOLS];
+    ColI *ci;
+    int ncols = 0;
+    int i;
+
+    ti->ti_CompNCols = 0;
+    if (hlCompoundType(r) != ROP_EQEQ)
+	return;
+
+    for (ci = ti->ti_FirstColI; ci; ci = ci->ci_Next) {
+	if ((ci->ci_Flags & (CIF_COMPOUND|CIF_DELETED)) != CIF_COMPOUND)
+	    continue;
+	for (i = ncols; i > 0 && colAry[i-1] > ci->ci_ColId; --i) {
+	    if (i < INDEX_MAXCOLS) {
+		colAry[i] = colAry[i-1];
+		typeAry[i] = typeAry[i-1];
+	    }
+	}
+	if (i < INDEX_MAXCOLS) {
+	    colAry[i] = ci->ci_ColId;
+	    typeAry[i] = ci->ci_DataType;
+	}
+	if (ncols < INDEX_MAXCOLS)
+	    ++ncols;
+    }
+    if (ncols < 2 || (col_t)r->r_Col->cd_ColId != colAry[0])
+	return;
+
+    for (r = r->r_NextSame; r; r = r->r_NextSame) {
+	if (hlCompoundType(r) && (col_t)r->r_Col->cd_ColId == colAry[1])
+	    break;
+    }
+    if (r) {
+	bcopy(colAry, ti->ti_CompColIds, ncols * sizeof(col_t));
+	ti->ti_CompNCols = ncols;
+	for (i = 0; i < ncols; ++i)
+	    (void)GetRawDataCol(ti->ti_RData, colAry[i], typeAry[i]);
+    }
+}
+
 /*
  * FreeRangeList() - called mainly by sync.c, query.c has its own
  *		     range freeing routine.
@@ -436,10 +607,13 @@ HLGetColI(Query *q, const char *useName, int useLen, int flags)
 	    }
 
 	    /*
-	     * INSERTs inherit column defaults
+	     * INSERTs inherit column defaults.  Defaults are kept as text
+	     * and were validated against the type by CREATE TABLE.
 	     */
-	    if ((flags & CIF_DEFAULT) && ci->ci_Const == NULL && ci->ci_Default)
+	    if ((flags & CIF_DEFAULT) && ci->ci_Const == NULL && ci->ci_Default) {
 		ci->ci_Const = GetConst(q, ci->ci_Default, ci->ci_DefaultLen);
+		(void)ConvertConst(q, &ci->ci_Const, ci->ci_DataType);
+	    }
 
 	    /*
 	     * Assign the record scan raw column to the column
@@ -560,6 +734,654 @@ HLResolveNullScans(Query *q)
     return(0);
 }
 
+/*
+ * HLPlanQuery() -	cost based ordering of the query's ranges
+ *
+ *	The parser links ranges in the order the WHERE clause was written,
+ *	and the first range of each table instance both fixes the nesting
+ *	order of the table instances and primes the table's index.  This
+ *	pass relinks the ranges using the statistics gathered by ANALYZE
+ *	(see stats.c), or rough defaults for tables never analyzed.
+ *
+ *	Table instances are nested greedily, at each level picking the
+ *	table which is cheapest to visit (per outer record, times the
+ *	number of outer records) given the tables already placed outside
+ *	of it.  Within a table instance the range narrowing the index
+ *	scan the most goes first and the remaining ranges follow, most
+ *	selective first.  An equality join whose constant side ends up
+ *	nested inside is turned around, other joins keep the table
+ *	supplying the constant outside.  Ties keep the parsed order.
+ *
+ *	Ranges on special (__*) columns only prime an index if they did
+ *	so already, see the RF_FORCESAVE notes in HLAddClause().  Queries
+ *	modifying tables keep their table order, and history scans, which
+ *	depend on the range order for their record order, are left alone.
+ */
+void
+HLPlanQuery(Query *q)
+{
+    PlanTable *ptAry;
+    PlanRange *prAry;
+    PlanTable **order;
+    PlanRange **seq;
+    Range *r;
+    Range *prev;
+    int (*termRun)(RangeArg next);
+    RangeArg termNext;
+    double outer;
+    int modify;
+    int nr;
+    int nt;
+    int ns;
+    int i;
+    int k;
+
+    if (q->q_RunRange != RunRange || (q->q_Flags & QF_RETURN_ALL))
+	return;
+
+    nr = 0;
+    for (r = q->q_RangeArg.ra_RangePtr; ; r = r->r_Next.ra_RangePtr) {
+	++nr;
+	if (r->r_RunRange != RunRange)
+	    break;
+    }
+    if (nr < 2)
+	return;
+    termRun = r->r_RunRange;
+    termNext = r->r_Next;
+
+    ptAry = zalloc(sizeof(PlanTable) * nr);
+    prAry = zalloc(sizeof(PlanRange) * nr);
+    order = zalloc(sizeof(PlanTable *) * nr);
+    seq = zalloc(sizeof(PlanRange *) * nr);
+
+    /*
+     * Table instances in their parsed nesting order
+     */
+    nt = 0;
+    r = q->q_RangeArg.ra_RangePtr;
+    for (i = 0; i < nr; ++i) {
+	PlanRange *pr = &prAry[i];
+
+	pr->pr_Range = r;
+	if ((pr->pr_Table = hlPlanTable(ptAry, nt, r->r_TableI)) == NULL) {
+	    pr->pr_Table = &ptAry[nt++];
+	    pr->pr_Table->pt_TableI = r->r_TableI;
+	}
+	if (i + 1 < nr)
+	    r = r->r_Next.ra_RangePtr;
+    }
+    for (i = 0; i < nt; ++i) {
+	PlanTable *pt = &ptAry[i];
+
+	if ((pt->pt_Stats = GetTableStats(pt->pt_TableI)) != NULL)
+	    pt->pt_Rows = (pt->pt_Stats->ts_Rows > 0) ? pt->pt_Stats->ts_Rows : 1;
+	else
+	    pt->pt_Rows = PLAN_DEFROWS;
+    }
+
+    /*
+     * Classify the ranges.  Give up if the table supplying a join
+     * constant cannot be determined.
+     */
+    for (i = 0; i < nr; ++i) {
+	PlanRange *pr = &prAry[i];
+	PlanTable *pt = pr->pr_Table;
+	int user;
+
+	r = pr->pr_Range;
+	user = (r->r_Col && (col_t)r->r_Col->cd_ColId >= CID_RAW_LIMIT &&
+		(r->r_Flags & RF_FORCESAVE) == 0);
+	if (r == pt->pt_TableI->ti_MarkRange)
+	    pr->pr_Flags |= PRF_DRIVER;
+
+	switch(r->r_Type) {
+	case ROP_CONST:
+	    pr->pr_Sel = hlPlanSel(pt, r->r_Col, r->r_Const, r->r_OpId);
+	    if (HLIndexOp(r->r_OpId) && hlPlanLikeNarrows(r))
+		pr->pr_Flags |= PRF_INDEX;
+	    if (user)
+		pr->pr_Flags |= PRF_DRIVER;
+	    break;
+	case ROP_JCONST:
+	    pr->pr_Sel = hlPlanSel(pt, r->r_Col, NULL, r->r_OpId);
+	    pr->pr_Other = hlPlanConstTable(ptAry, nt, r->r_Const);
+	    if (pr->pr_Other == NULL)
+		break;
+	    if (pr->pr_Other == pt) {
+		pr->pr_Other = NULL;
+		pr->pr_Flags = PRF_SELF;
+		break;
+	    }
+	    if (HLIndexOp(r->r_OpId))
+		pr->pr_Flags |= PRF_INDEX;
+	    if (user)
+		pr->pr_Flags |= PRF_DRIVER;
+	    if (user && i > 0 && r->r_OpId == ROP_EQEQ &&
+		prAry[i-1].pr_Range->r_Type == ROP_JOIN &&
+		prAry[i-1].pr_Range->r_Col == r->r_Const &&
+		(col_t)r->r_Const->cd_ColId >= CID_RAW_LIMIT &&
+		r->r_Const->cd_DataType != 0
+	    ) {
+		pr->pr_Join = &prAry[i-1];
+		pr->pr_RSel = hlPlanSel(pr->pr_Other, r->r_Const, NULL, ROP_EQEQ);
+	    }
+	    break;
+	case ROP_JOIN:
+	    pr->pr_Sel = 1.0;
+	    pr->pr_Flags |= PRF_DRIVER;
+	    break;
+	default:
+	    pr->pr_Sel = 1.0;
+	    break;
+	}
+	if (r->r_Type == ROP_JCONST && pr->pr_Other == NULL &&
+	    (pr->pr_Flags & PRF_SELF) == 0
+	) {
+	    break;
+	}
+    }
+    if (i != nr)
+	goto done;
+
+    /*
+     * Nest the table instances
+     */
+    modify = (q->q_TermOp != QOP_SELECT && q->q_TermOp != QOP_COUNT);
+    outer = 1.0;
+    for (k = 0; k < nt; ++k) {
+	PlanTable *best = NULL;
+	double bestCost = 0.0;
+	double bestRows = 0.0;
+
+	for (i = 0; i < nt; ++i) {
+	    PlanTable *pt = &ptAry[i];
+	    double rows;
+	    double cost;
+
+	    if (pt->pt_Placed || hlPlanReady(prAry, nr, pt) < 0)
+		continue;
+	    cost = hlPlanCost(prAry, nr, pt, &rows, NULL);
+	    cost = outer * (cost + rows);
+	    if (best == NULL || cost < bestCost) {
+		best = pt;
+		bestCost = cost;
+		bestRows = rows;
+	    }
+	    if (modify)
+		break;
+	}
+	DBASSERT(best != NULL);
+	best->pt_Placed = k + 1;
+	order[k] = best;
+	outer *= bestRows;
+	if (outer < 1.0)
+	    outer = 1.0;
+    }
+
+    /*
+     * Turn around equality joins whose constant side is now inside
+     */
+    for (i = 0; i < nr; ++i) {
+	PlanRange *pr = &prAry[i];
+
+	if (pr->pr_Join && pr->pr_Other->pt_Placed > pr->pr_Table->pt_Placed)
+	    hlPlanReverse(pr);
+    }
+
+    /*
+     * Sequence the ranges: for each table instance the driving range
+     * followed by the others, most selective first.
+     */
+    ns = 0;
+    for (k = 0; k < nt; ++k) {
+	PlanTable *pt = order[k];
+	PlanRange *driver = NULL;
+	int base = ns;
+	int j;
+
+	hlPlanCost(prAry, nr, pt, NULL, &driver);
+	if (driver == NULL) {
+	    for (i = 0; i < nr; ++i) {
+		PlanRange *pr = &prAry[i];
+
+		if (pr->pr_Table != pt || (pr->pr_Flags & PRF_DRIVER) == 0)
+		    continue;
+		if (pr->pr_Range == pt->pt_TableI->ti_MarkRange) {
+		    driver = pr;
+		    break;
+		}
+		if (driver == NULL || (pr->pr_Range->r_Type == ROP_JOIN &&
+		    driver->pr_Range->r_Type != ROP_JOIN)
+		) {
+		    driver = pr;
+		}
+	    }
+	}
+	if (driver == NULL) {
+	    for (i = 0; i < nr; ++i) {
+		if (prAry[i].pr_Table == pt &&
+		    (prAry[i].pr_Flags & PRF_SELF) == 0
+		) {
+		    driver = &prAry[i];
+		    break;
+		}
+	    }
+	}
+	DBASSERT(driver != NULL);
+	seq[ns++] = driver;
+	for (i = 0; i < nr; ++i) {
+	    PlanRange *pr = &prAry[i];
+
+	    if (pr->pr_Table != pt || pr == driver)
+		continue;
+	    for (j = ns; j > base + 1 && seq[j-1]->pr_Sel > pr->pr_Sel; --j)
+		seq[j] = seq[j-1];
+	    seq[j] = pr;
+	    ++ns;
+	}
+    }
+    DBASSERT(ns == nr);
+
+    /*
+     * Relink
+     */
+    for (k = 0; k < nt; ++k) {
+	order[k]->pt_TableI->ti_MarkRange = NULL;
+	order[k]->pt_Last = NULL;
+    }
+    prev = NULL;
+    for (i = 0; i < nr; ++i) {
+	PlanTable *pt = seq[i]->pr_Table;
+
+	r = seq[i]->pr_Range;
+	r->r_Prev = prev;
+	r->r_PrevSame = pt->pt_Last;
+	r->r_NextSame = NULL;
+	if (pt->pt_Last)
+	    pt->pt_Last->r_NextSame = r;
+	else
+	    pt->pt_TableI->ti_MarkRange = r;
+	pt->pt_Last = r;
+	if (prev) {
+	    prev->r_RunRange = RunRange;
+	    prev->r_Next.ra_RangePtr = r;
+	} else {
+	    q->q_RangeArg.ra_RangePtr = r;
+	}
+	prev = r;
+    }
+    prev->r_RunRange = termRun;
+    prev->r_Next = termNext;
+    for (k = 0; k < nt; ++k)
+	hlUpdateCompound(order[k]->pt_TableI);
+done:
+    zfree(seq, sizeof(PlanRange *) * nr);
+    zfree(order, sizeof(PlanTable *) * nr);
+    zfree(prAry, sizeof(PlanRange) * nr);
+    zfree(ptAry, sizeof(PlanTable) * nr);
+}
+
+static PlanTable *
+hlPlanTable(PlanTable *ptAry, int nt, const TableI *ti)
+{
+    int i;
+
+    for (i = 0; i < nt; ++i) {
+	if (ptAry[i].pt_TableI == ti)
+	    return(&ptAry[i]);
+    }
+    return(NULL);
+}
+
+/*
+ * hlPlanConstTable() - locate the table instance a join constant belongs to
+ */
+static PlanTable *
+hlPlanConstTable(PlanTable *ptAry, int nt, const ColData *cd)
+{
+    int i;
+
+    for (i = 0; i < nt; ++i) {
+	const ColData *scan;
+
+	for (scan = ptAry[i].pt_TableI->ti_RData->rd_ColBase; scan; scan = scan->cd_Next) {
+	    if (scan == cd)
+		return(&ptAry[i]);
+	}
+    }
+    return(NULL);
+}
+
+/*
+ * hlPlanReady() - may the table instance be placed at the next level
+ *
+ *	Joins which cannot be turned around need the table supplying the
+ *	constant outside.
+ */
+static int
+hlPlanReady(PlanRange *prAry, int nr, PlanTable *pt)
+{
+    int i;
+
+    for (i = 0; i < nr; ++i) {
+	PlanRange *pr = &prAry[i];
+
+	if (pr->pr_Table == pt && pr->pr_Other && pr->pr_Join == NULL &&
+	    pr->pr_Other->pt_Placed == 0
+	) {
+	    return(-1);
+	}
+    }
+    return(0);
+}
+
+/*
+ * hlPlanApplies() - does the range restrict the table instance
+ *
+ *	A join only applies to the table instance placed inside the other.
+ *	Returns -1 if the range does not apply, else its PRF_* flags, with
+ *	its selectivity in *psel.  ROP_JOIN ranges do not restrict anything
+ *	and are ignored.
+ */
+static int
+hlPlanApplies(PlanRange *pr, PlanTable *pt, double *psel)
+{
+    PlanTable *other;
+
+    if (pr->pr_Range->r_Type == ROP_JOIN)
+	return(-1);
+    if (pr->pr_Table == pt) {
+	other = pr->pr_Other;
+	if (other && (other->pt_Placed == 0 ||
+	    (pt->pt_Placed && other->pt_Placed > pt->pt_Placed))
+	) {
+	    return(-1);
+	}
+	*psel = pr->pr_Sel;
+	return(pr->pr_Flags);
+    }
+    if (pr->pr_Other == pt && pr->pr_Join) {
+	other = pr->pr_Table;
+	if (other->pt_Placed == 0 ||
+	    (pt->pt_Placed && other->pt_Placed > pt->pt_Placed)
+	) {
+	    return(-1);
+	}
+	*psel = pr->pr_RSel;
+	return(pr->pr_Flags);
+    }
+    return(-1);
+}
+
+/*
+ * hlPlanCost() - estimated cost of visiting a table instance once
+ *
+ *	The cost is the number of records scanned, using the best
+ *	applicable index, or the whole table.  *prows is set to the
+ *	number of records surviving all applicable ranges and *pdriver to
+ *	the range priming the index (NULL for a full scan).
+ */
+static double
+hlPlanCost(PlanRange *prAry, int nr, PlanTable *pt, double *prows, PlanRange **pdriver)
+{
+    double rows = pt->pt_Rows;
+    double cost = pt->pt_Rows;
+    PlanRange *driver = NULL;
+    int i;
+
+    for (i = 0; i < nr; ++i) {
+	PlanRange *pr = &prAry[i];
+	double sel;
+	int flags;
+
+	if ((flags = hlPlanApplies(pr, pt, &sel)) < 0)
+	    continue;
+	rows *= sel;
+	if ((flags & (PRF_DRIVER|PRF_INDEX)) == (PRF_DRIVER|PRF_INDEX)) {
+	    double c = pt->pt_Rows * sel + hlLog2(pt->pt_Rows) + 1.0;
+
+	    if (c < cost) {
+		cost = c;
+		driver = pr;
+	    }
+	}
+    }
+    if (prows)
+	*prows = rows;
+    if (pdriver)
+	*pdriver = driver;
+    return(cost);
+}
+
+/*
+ * hlPlanReverse() - turn an equality join around
+ *
+ *	The JCONST range moves to the table instance which supplied its
+ *	constant and the ROP_JOIN range marking the outer side moves the
+ *	other way, as if the parser had picked the other side.
+ */
+static void
+hlPlanReverse(PlanRange *pr)
+{
+    Range *r = pr->pr_Range;
+    Range *jr = pr->pr_Join->pr_Range;
+    PlanTable *pt = pr->pr_Table;
+    const ColData *col = r->r_Col;
+    const ColData *cst = r->r_Const;
+    double sel = pr->pr_Sel;
+
+    r->r_TableI = pr->pr_Other->pt_TableI;
+    r->r_Col = cst;
+    r->r_Const = col;
+    r->r_OpFunc = DataTypeFuncAry[cst->cd_DataType][DATAOP_EQEQ];
+    r->r_OpClass = GetIndexOpClass((col_t)cst->cd_ColId,
+			hlColFlags(r->r_TableI, cst), ROP_EQEQ);
+    pr->pr_Table = pr->pr_Other;
+    pr->pr_Other = pt;
+    pr->pr_Sel = pr->pr_RSel;
+    pr->pr_RSel = sel;
+
+    jr->r_TableI = pt->pt_TableI;
+    jr->r_Col = col;
+    jr->r_OpClass = GetIndexOpClass((col_t)col->cd_ColId, 0, -1);
+    pr->pr_Join->pr_Table = pt;
+}
+
+/*
+ * hlPlanLikeNarrows() - can a btree narrow a LIKE against a constant
+ *
+ *	A pattern starting with '%' has no prefix to look up, only the
+ *	trigram index can do anything with it.  Non-LIKE ranges and
+ *	parameters (not known yet) are assumed to narrow.
+ */
+static int
+hlPlanLikeNarrows(const Range *r)
+{
+    const ColData *cst = r->r_Const;
+
+    if (r->r_OpId != ROP_LIKE || r->r_OpClass == ROP_TRGM_LIKE)
+	return(1);
+    if (cst->cd_Flags & RDF_PARAM)
+	return(1);
+    return(LikePrefixLen(cst->cd_Data, cst->cd_Bytes) > 0);
+}
+
+/*
+ * HLIndexOp() - can the operator narrow an index scan
+ *
+ *	Also used by EXPLAIN to describe the access path.
+ */
+int
+HLIndexOp(int opId)
+{
+    switch(opId) {
+    case ROP_EQEQ:
+    case ROP_LT:
+    case ROP_LTEQ:
+    case ROP_GT:
+    case ROP_GTEQ:
+    case ROP_LIKE:
+    case ROP_RLIKE:
+    case ROP_STAMP_EQEQ:
+    case ROP_STAMP_LT:
+    case ROP_STAMP_LTEQ:
+    case ROP_STAMP_GT:
+    case ROP_STAMP_GTEQ:
+	return(1);
+    }
+    return(0);
+}
+
+/*
+ * hlPlanSel() - estimated fraction of records satisfying col OP cst
+ *
+ *	cst is NULL for joins.
+ */
+static double
+hlPlanSel(PlanTable *pt, const ColData *col, const ColData *cst, int opId)
+{
+    col_t colId;
+
+    if (col == NULL)
+	return(1.0);
+    colId = (col_t)col->cd_ColId;
+    if (colId < CID_RAW_LIMIT) {
+	switch(opId) {
+	case ROP_VTID_EQEQ:
+	    return(1.0);
+	case ROP_STAMP_LT:
+	case ROP_STAMP_LTEQ:
+	case ROP_STAMP_GT:
+	case ROP_STAMP_GTEQ:
+	    return(PLAN_DEFRANGESEL);
+	}
+	return(PLAN_DEFEQSEL);
+    }
+    switch(opId) {
+    case ROP_EQEQ:
+	return(hlPlanEqSel(pt, colId));
+    case ROP_NOTEQ:
+	return(1.0 - hlPlanEqSel(pt, colId));
+    case ROP_LT:
+    case ROP_LTEQ:
+    case ROP_GT:
+    case ROP_GTEQ:
+	return(hlPlanIneqSel(pt, colId, cst, opId));
+    case ROP_LIKE:
+	if (cst && cst->cd_Bytes == 0 && (cst->cd_Flags & RDF_PARAM) == 0)
+	    return(1.0);
+	break;
+    }
+    return(PLAN_DEFLIKESEL);
+}
+
+/*
+ * hlPlanEqSel() - estimated fraction of records matching one value
+ */
+static double
+hlPlanEqSel(PlanTable *pt, col_t colId)
+{
+    const ColStats *cs;
+    ColI *ci;
+    double sel;
+
+    if ((cs = hlPlanColStats(pt, colId)) != NULL) {
+	if (cs->cs_NDV <= 0)
+	    return(1.0 / pt->pt_Rows);
+	sel = 1.0 - (double)cs->cs_Nulls / pt->pt_Rows;
+	if (sel < 0.0)
+	    sel = 0.0;
+	sel /= (double)cs->cs_NDV;
+	if (sel < 1.0 / pt->pt_Rows)
+	    sel = 1.0 / pt->pt_Rows;
+	return(sel);
+    }
+    for (ci = pt->pt_TableI->ti_FirstColI; ci; ci = ci->ci_Next) {
+	if (ci->ci_ColId == colId && (ci->ci_Flags & CIF_UNIQUE))
+	    return(1.0 / pt->pt_Rows);
+    }
+    return(PLAN_DEFEQSEL);
+}
+
+/*
+ * hlPlanIneqSel() - estimated fraction of records on one side of a value
+ *
+ *	Interpolated from the histogram, assuming the constant sits in the
+ *	middle of the bucket it falls in.
+ */
+static double
+hlPlanIneqSel(PlanTable *pt, col_t colId, const ColData *cst, int opId)
+{
+    const ColStats *cs;
+    double frac;
+    int buckets;
+    int k;
+
+    cs = hlPlanColStats(pt, colId);
+    if (cs == NULL || cs->cs_NBounds < 2 || cst == NULL || cst->cd_Data == NULL)
+	return(PLAN_DEFRANGESEL);
+    for (k = 0; k < cs->cs_NBounds; ++k) {
+	if (hlPlanBoundCmp(&cs->cs_Bounds[k], cst) >= 0)
+	    break;
+    }
+    buckets = cs->cs_NBounds - 1;
+    if (k == 0)
+	frac = 0.0;
+    else if (k == cs->cs_NBounds)
+	frac = 1.0;
+    else
+	frac = (k - 0.5) / buckets;
+    if (opId == ROP_GT || opId == ROP_GTEQ)
+	frac = 1.0 - frac;
+    if (frac < 1.0 / pt->pt_Rows)
+	frac = 1.0 / pt->pt_Rows;
+    return(frac);
+}
+
+static const ColStats *
+hlPlanColStats(PlanTable *pt, col_t colId)
+{
+    int i;
+
+    if (pt->pt_Stats == NULL)
+	return(NULL);
+    for (i = 0; i < pt->pt_Stats->ts_NCols; ++i) {
+	if (pt->pt_Stats->ts_Cols[i].cs_ColId == colId)
+	    return(&pt->pt_Stats->ts_Cols[i]);
+    }
+    return(NULL);
+}
+
+/*
+ * hlPlanBoundCmp() - compare a histogram bound against a constant
+ *
+ *	Bounds only hold a prefix of the value, so is the constant.
+ */
+static int
+hlPlanBoundCmp(const StatsKey *sk, const ColData *cd)
+{
+    int n = (cd->cd_Bytes < STATS_KEYSIZE) ? cd->cd_Bytes : STATS_KEYSIZE;
+    int r;
+
+    r = memcmp(sk->sk_Data, cd->cd_Data, (sk->sk_Bytes < n) ? sk->sk_Bytes : n);
+    if (r == 0)
+	r = sk->sk_Bytes - n;
+    return(r);
+}
+
+static double
+hlLog2(double n)
+{
+    double l = 0.0;
+
+    while (n >= 2.0) {
+	n /= 2.0;
+	l += 1.0;
+    }
+    return(l);
+}
+
 /*
  * HLCheckFieldRestrictions() -		Check KEY and NOTNULL requirements
  *
@@ -606,8 +1428,16 @@ HLCheckFieldRestrictions(Query *q, int flags)
 	     * (the CIF_ORDER test below) need to be checked.
 	     */
 	    if (q->q_TermOp == QOP_INSERT || (ci->ci_Flags & CIF_ORDER)) {
-		if (ci->ci_Const == NULL || ci->ci_Const->cd_Data == NULL)
+		const ColData *cst = ci->ci_Const;
+
+		/*
+		 * A parameter is checked once its value is known
+		 */
+		if (cst == NULL ||
+		    (cst->cd_Data == NULL && (cst->cd_Flags & RDF_PARAM) == 0)
+		) {
 		    return(-1);
+		}
 	    } else {
 		/*
 		 * make sure the data is fetched if its a key field for
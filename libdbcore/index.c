@@ -13,29 +13,66 @@
 
 #include "defs.h"
 #include "conflict.h"
+#include "btree.h"
 
-Prototype Index *OpenIndex(Table *tab, vtable_t vt, col_t colId, int opClass, void (*func)(Index *));
+Prototype Index *OpenIndex(Table *tab, vtable_t vt, const col_t *colIds, int ncols, const col_t *coverIds, int ncover, int opClass, void (*func)(Index *));
 Prototype void CloseIndex(Index **pindex, int freeLastClose);
 Prototype void RewindTableIndexes(Table *tab);
 Prototype void DefaultSetTableRange(TableI *ti, Table *tab, const ColData *colData, Range *r, int flags);
 Prototype int DefaultIndexScanRangeOp1(Index *index, Range *r);
 Prototype int DefaultIndexScanRangeOp2(Index *index, Range *r);
 Prototype int ConflictScanRangeOp(Range *r, struct Conflict *co, int mySlot);
-Prototype int GetIndexOpClass(int colId, int opId);
+Prototype int GetIndexOpClass(int colId, int colFlags, int opId);
+Prototype int GetIndexSlop(const char *tabName);
+Export void SetIndexSlop(const char *tabName, int slop);
+Export int UpdateDatabaseIndexes(DataBase *db, int flags);
 
 static int ScanInstanceRemainderValid(TableI *ti, Range *r);
+static int updateTableIndex(Table *tab, Index *index, int flags);
+
+/*
+ * Per-table index slop policy, see SetIndexSlop()
+ */
+typedef struct IndexSlop {
+    struct IndexSlop	*is_Next;
+    char		*is_TabName;
+    int			is_Slop;
+} IndexSlop;
 
 List IndexLRUList = INITLIST(IndexLRUList);
 int IndexCount;
 
+static IndexSlop *IndexSlopBase;
+static int IndexSlopDefault = BT_SLOP;
+
+/*
+ * OpenIndex() -	locate or open an index on one or more columns
+ *
+ *	colIds[] holds ncols column ids.  More then one column results in
+ *	a compound index keyed on the columns in the order given.
+ *
+ *	If ncover is >= 0 the index is a covering index and additionally
+ *	stores the ncover columns in coverIds[] (which may be 0 columns if
+ *	only key columns were declared cover columns).  Covering and
+ *	non-covering indexes on the same key are distinct indexes.
+ */
 Index *
-OpenIndex(Table *tab, vtable_t vt, col_t colId, int opClass, void (*func)(Index *index))
+OpenIndex(Table *tab, vtable_t vt, const col_t *colIds, int ncols, const col_t *coverIds, int ncover, int opClass, void (*func)(Index *index))
 {
     Index *index;
     Index **pi;
 
+    DBASSERT(ncols > 0 && ncols <= INDEX_MAXCOLS);
+    DBASSERT(ncover <= INDEX_MAXCOVER);
+    if (ncover < 0)
+	ncover = -1;
+
     for (pi = &tab->ta_IndexBase; (index = *pi) != NULL; pi = &index->i_Next) {
-	if (index->i_ColId == colId &&
+	if (index->i_NCols == ncols &&
+	    bcmp(index->i_ColIds, colIds, ncols * sizeof(col_t)) == 0 &&
+	    index->i_NCover == ncover &&
+	    (ncover <= 0 ||
+	     bcmp(index->i_CoverIds, coverIds, ncover * sizeof(col_t)) == 0) &&
 	    index->i_VTable == vt &&
 	    index->i_OpClass == opClass
 	) {
@@ -46,7 +83,12 @@ OpenIndex(Table *tab, vtable_t vt, col_t colId, int opClass, void (*func)(Index
     }
     if (index == NULL) {
 	index = zalloc(sizeof(Index));
-	index->i_ColId = colId;
+	index->i_ColId = colIds[0];
+	index->i_NCols = ncols;
+	bcopy(colIds, index->i_ColIds, ncols * sizeof(col_t));
+	index->i_NCover = ncover;
+	if (ncover > 0)
+	    bcopy(coverIds, index->i_CoverIds, ncover * sizeof(col_t));
 	index->i_Next = tab->ta_IndexBase;
 	index->i_Table = tab;
 	index->i_VTable = vt;
@@ -60,7 +102,7 @@ OpenIndex(Table *tab, vtable_t vt, col_t colId, int opClass, void (*func)(Index
 
 	tab->ta_IndexBase = index;
 	++index->i_Refs;
-	if (colId != 0)
+	if (index->i_ColId != 0)
 	    func(index);
 	--index->i_Refs;
 	DBASSERT(index->i_ScanRangeOp != NULL);
@@ -184,6 +226,9 @@ DefaultSetTableRange(TableI *ti, Table *tab, const ColData *colData, Range *r, i
  * case where we want to see all available records, whether deleted or
  * not.
  *
+ * When the rest of the range chain only restricts this table instance
+ * by constants the record pass is done by BatchScanRange().
+ *
  * Note that r->r_DelHash is NULL when scanning the commit conflict
  * table, since this table represents transactionally inconsistent
  * data it makes no sense to try to track deletions and certainly makes
@@ -194,6 +239,7 @@ int
 DefaultIndexScanRangeOp1(Index *index, Range *r)
 {
     TableI *ti = r->r_TableI;
+    Range *zoneRange;
     dbpos_t ranBeg;
     int count;
     int rv;
@@ -203,6 +249,24 @@ DefaultIndexScanRangeOp1(Index *index, Range *r)
      */
     ranBeg = ti->ti_RanBeg;
 
+    /*
+     * Both passes below only look at records satisfying r, so whole
+     * blocks which cannot contain such a record may be skipped (see
+     * ZoneMapSkipBlock()).
+     */
+    zoneRange = ti->ti_ZoneRange;
+    ti->ti_ZoneRange = r;
+
+    /*
+     * A large enough table may be split across worker processes,
+     * see ParallelScanRange().
+     */
+    if (ParallelScanRange(r, &count) == 0) {
+	ti->ti_RanBeg = ranBeg;
+	ti->ti_ZoneRange = zoneRange;
+	return(count);
+    }
+
     /*
      * If not a degenerate case then look for delete records.  Without
      * an index we can't do a backwards scan so we have to pick-out
@@ -249,11 +313,9 @@ DefaultIndexScanRangeOp1(Index *index, Range *r)
 			continue;
 		    }
 		    DBASSERT(r->r_DelHash != NULL);
-		    SaveDelHash(r->r_DelHash, &ti->ti_RanBeg,
-				rh->rh_Hv, rh->rh_Size);
+		    SaveDelHash(r->r_DelHash, &ti->ti_RanBeg, rh);
 		} else if (r->r_Flags & RF_FORCESAVE) {
-		    SaveDelHash(r->r_DelHash, &ti->ti_RanBeg,
-				rh->rh_Hv, rh->rh_Size);
+		    SaveDelHash(r->r_DelHash, &ti->ti_RanBeg, rh);
 		}
 	    }
 	}
@@ -267,7 +329,9 @@ DefaultIndexScanRangeOp1(Index *index, Range *r)
     count = 0;
     rv = 0;
 
-    {
+    if (BatchScanRange(r, &count) == 0) {
+	/* evaluated a block at a time, see batch.c */
+    } else {
 	for (
 	    SelectBegTableRec(ti, 0);
 	    ti->ti_RanBeg.p_Ro > 0;
@@ -354,6 +418,7 @@ DefaultIndexScanRangeOp1(Index *index, Range *r)
 	}
     }
     ti->ti_RanBeg = ranBeg;
+    ti->ti_ZoneRange = zoneRange;
     if (rv < 0)
 	count = rv;
     return(count);
@@ -432,6 +497,8 @@ DefaultIndexScanRangeOp2(Index *index, Range *r)
 		flags = RDF_READ | RDF_ALLOC | RDF_ZERO;
 	    else
 		flags = RDF_READ | RDF_ZERO;
+	    if (ti->ti_Flags & TABRAN_COVER)	/* see SelectEndTableRec() */
+		flags |= RDF_USERH;
 	    ReadDataRecord(ti->ti_RData, &ti->ti_RanEnd, flags);
 	    rh = ti->ti_RData->rd_Rh;
 
@@ -448,8 +515,7 @@ DefaultIndexScanRangeOp2(Index *index, Range *r)
 		if (r->r_Flags & RF_FORCESAVE) {
 		    if (rh->rh_Flags & RHF_DELETE) {
 			DBASSERT(ti->ti_ScanOneOnly == 0);
-			SaveDelHash(r->r_DelHash, &ti->ti_RanEnd,
-				    rh->rh_Hv, rh->rh_Size);
+			SaveDelHash(r->r_DelHash, &ti->ti_RanEnd, rh);
 		    } else {
 			(void)MatchDelHash(r->r_DelHash, rh);
 		    }
@@ -467,13 +533,16 @@ DefaultIndexScanRangeOp2(Index *index, Range *r)
 	    }
 	    if (rh->rh_Flags & RHF_DELETE) {
 		DBASSERT(ti->ti_ScanOneOnly == 0);
-		SaveDelHash(r->r_DelHash, &ti->ti_RanEnd,
-			    rh->rh_Hv, rh->rh_Size);
+		SaveDelHash(r->r_DelHash, &ti->ti_RanEnd, rh);
 		continue;
 	    }
 	    DBASSERT(r->r_DelHash != NULL);
-	    if (MatchDelHash(r->r_DelHash, rh) == 0)
+	    if (ti->ti_Flags & TABRAN_COVER) {
+		if (MatchDelHashCover(r->r_DelHash, rh, &ti->ti_RanEnd) == 0)
+		    continue;
+	    } else if (MatchDelHash(r->r_DelHash, rh) == 0) {
 		continue;
+	    }
 	    ++ti->ti_ScanOneOnly;
 	    ti->ti_RanBeg = ti->ti_RanEnd;
 	    rv = r->r_RunRange(r->r_Next);
@@ -568,7 +637,7 @@ ConflictScanRangeOp(Range *r, Conflict *tts, int mySlot)
 		tts->co_Head->ch_Slots[slot].cs_Size
 	    );
 #endif
-	    DBASSERT(rh->rh_Magic == RHMAGIC);
+	    DBASSERT(RH_ISRECORD(rh));
 
 	    if (RecordIsValid(ti) < 0)
 		continue;
@@ -584,8 +653,15 @@ ConflictScanRangeOp(Range *r, Conflict *tts, int mySlot)
     return(rv);
 }
 
+/*
+ * GetIndexOpClass() -	Determine the index class for a column and operator
+ *
+ *	Exact matches against columns declared USING HASH (CIF_HASH) are
+ *	served by a hash index instead of a btree, and LIKE against columns
+ *	declared USING TRIGRAM (CIF_TRIGRAM) by a trigram index.
+ */
 int
-GetIndexOpClass(int colId, int opId)
+GetIndexOpClass(int colId, int colFlags, int opId)
 {
     int opClass;
 
@@ -603,8 +679,12 @@ GetIndexOpClass(int colId, int opId)
         opClass = ROP_OPCODE_EQEQ;
         break;
     default:
-        if (opId == ROP_LIKE || opId == ROP_RLIKE)
+        if (opId == ROP_LIKE && (colFlags & CIF_TRIGRAM))
+            opClass = ROP_TRGM_LIKE;
+        else if (opId == ROP_LIKE || opId == ROP_RLIKE)
             opClass = ROP_LIKE;
+        else if (opId == ROP_EQEQ && (colFlags & CIF_HASH))
+            opClass = ROP_HASH_EQEQ;
         else
             opClass = ROP_EQEQ;
         break;
@@ -612,3 +692,131 @@ GetIndexOpClass(int colId, int opId)
     return(opClass);
 }
 
+
+/*
+ * SetIndexSlop() -	Set the index slop policy for a table
+ *
+ *	The slop is the number of unindexed bytes a query will tolerate
+ *	at the end of a table before it brings the table's indexes up to
+ *	date itself.  A larger slop is appropriate when a background
+ *	indexer (see UpdateDatabaseIndexes()) keeps the indexes current.
+ *
+ *	A NULL tabName sets the default for tables without a policy of
+ *	their own.  The policy is applied to tables as they are opened.
+ */
+void
+SetIndexSlop(const char *tabName, int slop)
+{
+    IndexSlop *is;
+
+    if (tabName == NULL) {
+	IndexSlopDefault = slop;
+	return;
+    }
+    for (is = IndexSlopBase; is; is = is->is_Next) {
+	if (strcmp(is->is_TabName, tabName) == 0)
+	    break;
+    }
+    if (is == NULL) {
+	is = zalloc(sizeof(IndexSlop));
+	is->is_TabName = safe_strdup(tabName);
+	is->is_Next = IndexSlopBase;
+	IndexSlopBase = is;
+    }
+    is->is_Slop = slop;
+}
+
+/*
+ * GetIndexSlop() -	Return the index slop policy for a table
+ */
+int
+GetIndexSlop(const char *tabName)
+{
+    IndexSlop *is;
+
+    for (is = IndexSlopBase; is; is = is->is_Next) {
+	if (strcmp(is->is_TabName, tabName) == 0)
+	    return(is->is_Slop);
+    }
+    return(IndexSlopDefault);
+}
+
+/*
+ * UpdateDatabaseIndexes() - Bring all open indexes in a database up to date
+ *
+ *	Called periodically by a background task so queries do not have
+ *	to index the end of a table themselves.  Only indexes that have
+ *	already been opened are updated, we do not create new ones.
+ *
+ *	If IUF_NOSYNC is set updated indexes are left unsynchronized and
+ *	the next call without IUF_NOSYNC synchronizes them, which batches
+ *	the fsync()s of several updates together.
+ *
+ *	Returns the number of indexes that were updated.
+ */
+int
+UpdateDatabaseIndexes(DataBase *db, int flags)
+{
+    Table *tab;
+    Table *ntab;
+    Index *index;
+    Index *nindex;
+    int count = 0;
+    int error;
+    int i;
+
+    DBASSERT(db->db_PushType == DBPUSH_ROOT);
+
+    for (i = 0; i < TAB_HSIZE; ++i) {
+	for (tab = db->db_TabHash[i]; tab; tab = ntab) {
+	    ntab = tab->ta_Next;
+	    if (tab->ta_IndexBase == NULL)
+		continue;
+
+	    /*
+	     * Opening the table refreshes ta_Append.  The table and each
+	     * index are referenced while we work on them, since updating
+	     * an index may switch to other threads.
+	     */
+	    error = 0;
+	    if (OpenTableByTab(tab, NULL, &error) == NULL)
+		continue;
+	    for (index = tab->ta_IndexBase; index; index = nindex) {
+		++index->i_Refs;
+		if (index->i_UpdateIndex)
+		    count += updateTableIndex(tab, index, flags);
+		nindex = index->i_Next;
+		CloseIndex(&index, 0);
+	    }
+	    ntab = tab->ta_Next;
+	    CloseTable(tab, 0);
+	}
+    }
+    return(count);
+}
+
+/*
+ * updateTableIndex() -	Update one index from a private table instance
+ */
+static int
+updateTableIndex(Table *tab, Index *index, int flags)
+{
+    RawData *rd;
+    TableI *ti;
+    ColData *colData = NULL;
+    int r;
+    int i;
+
+    rd = AllocRawData(tab, NULL, 0);
+    for (i = index->i_NCols - 1; i >= 0; --i)
+	colData = GetRawDataCol(rd, index->i_ColIds[i], DATATYPE_STRING);
+    ti = AllocPrivateTableI(rd);
+    ti->ti_Index = index;
+    ti->ti_VTable = index->i_VTable;
+
+    r = index->i_UpdateIndex(ti, tab, colData, flags);
+
+    ti->ti_Index = NULL;
+    LLFreeTableI(&ti);
+    return(r);
+}
@@ -17,6 +17,7 @@
 #define TOK_OBRACKET	'['
 #define TOK_CBRACKET	']'
 #define TOK_STAR	'*'
+#define TOK_QUESTION	'?'	/* query parameter */
 
 #define TOK_EQ		'='
 #define TOK_LT		'<'
@@ -39,6 +40,8 @@
 #define TOK_DROP	(TOKF_ID+0x006)
 #define TOK_COUNT	(TOKF_ID+0x007)
 #define TOK_CLONE	(TOKF_ID+0x008)
+#define TOK_ANALYZE	(TOKF_ID+0x009)
+#define TOK_EXPLAIN	(TOKF_ID+0x00a)
 
 #define TOK_INTO	(TOKF_ID+0x100)
 #define TOK_FROM	(TOKF_ID+0x101)
@@ -75,6 +78,7 @@
 #define TOK_UNIQUE	(TOKF_ID+0x120)
 #define TOK_SAME	(TOKF_ID+0x121)
 #define TOK_DEFAULT	(TOKF_ID+0x122)
+#define TOK_GROUP	(TOKF_ID+0x123)
 
 #define TOK_SOF		(TOKF_MISC+0x000)
 #define TOK_INT		(TOKF_MISC+0x001)
@@ -104,6 +108,8 @@ typedef struct SqlKey {
 	{ "drop",	TOK_DROP }, \
 	{ "count",	TOK_COUNT }, \
 	{ "clone",	TOK_CLONE }, \
+	{ "analyze",	TOK_ANALYZE }, \
+	{ "explain",	TOK_EXPLAIN }, \
 	{ "into",	TOK_INTO }, \
 	{ "from",	TOK_FROM }, \
 	{ "where",	TOK_WHERE }, \
@@ -124,6 +130,7 @@ typedef struct SqlKey {
 	{ "null", 	TOK_NULL }, \
 	{ "order",	TOK_ORDER }, \
 	{ "by",		TOK_BY }, \
+	{ "group",	TOK_GROUP }, \
 	{ "desc",	TOK_DESC }, \
 	{ "limit",	TOK_LIMIT }, \
 	{ "load",	TOK_LOAD }, \
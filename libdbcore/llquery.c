@@ -30,6 +30,7 @@ Prototype int LLBootstrapSchema(DataBase *db, SchemaI *tsi);
 Prototype int LLBootstrapTable(DataBase *db, SchemaI *si, TableI *tti);
 Prototype int LLBootstrapColumn(DataBase *db, TableI *ti, col_t colId, ColI *tci);
 Prototype int LLTermSysQuery(Query *q);
+Prototype int LLGetTableStats(DataBase *db, TableI *ti, void (*callback)(void *data, RawData *rd), void *data);
 Prototype const char *ColFlagsToString(int flags);
 
 typedef struct SchemaIManage {
@@ -242,6 +243,39 @@ LLSystemVId(DataBase *db, const char *fileName, int fileLen, int vt)
     return(-1);
 }
 
+/*
+ * LLGetTableStats() -	Run the callback on each of a table's rows in
+ *			sys.stats (see stats.c).
+ *
+ *	Note, this and all other LL routines MUST include CID_RAW_VTID to
+ *	prevent the null-scan resolver from inserting into the list,
+ *	since we make assumptions on ColData ordering.
+ */
+
+int
+LLGetTableStats(DataBase *db, TableI *ti, void (*callback)(void *data, RawData *rd), void *data)
+{
+    /* NOTE: columns must be ordered */
+    col_t cols[] = { CID_RAW_VTID, CID_SCHEMA_NAME, CID_TABLE_NAME,
+			CID_COL_NAME, CID_COL_ID, CID_STAT_ROWS, CID_STAT_NDV,
+			CID_STAT_NULLS, CID_STAT_AVGSIZE, CID_STAT_HISTOGRAM };
+    ColData tests[] = {
+	{ NULL },
+	{ NULL, 0, ti->ti_SchemaI->si_ScmNameLen, ti->ti_SchemaI->si_ScmName },
+	{ NULL, 0, ti->ti_TabNameLen, ti->ti_TabName },
+	{ NULL },
+	{ NULL },
+	{ NULL },
+	{ NULL },
+	{ NULL },
+	{ NULL },
+	{ NULL }
+    };
+
+    return(LLSystemQuery(db, NULL, VT_SYS_STATS,
+	    cols, tests, arysize(cols), callback, data));
+}
+
 /*
  * LLGetSchemaI() 	- Obtain schema or list of schemas from system table
  *
@@ -797,6 +831,18 @@ LLGetColICallBack(void *data, RawData *rd)
 	    case 'D':
 		ci->ci_Flags |= CIF_DELETED;
 		break;
+	    case 'H':
+		ci->ci_Flags |= CIF_HASH;
+		break;
+	    case 'T':
+		ci->ci_Flags |= CIF_TRIGRAM;
+		break;
+	    case 'M':
+		ci->ci_Flags |= CIF_COMPOUND;
+		break;
+	    case 'C':
+		ci->ci_Flags |= CIF_COVER;
+		break;
 	    case 'V':
 		/* ci->ci_Flags |= CIF_DEFAULT; -- not necessary */
 		break;
@@ -840,6 +886,14 @@ ColFlagsToString(int flags)
 	CFBuf[i++] = 'N';
     if (flags & CIF_DELETED)
 	CFBuf[i++] = 'D';
+    if (flags & CIF_HASH)
+	CFBuf[i++] = 'H';
+    if (flags & CIF_TRIGRAM)
+	CFBuf[i++] = 'T';
+    if (flags & CIF_COMPOUND)
+	CFBuf[i++] = 'M';
+    if (flags & CIF_COVER)
+	CFBuf[i++] = 'C';
     CFBuf[i++] = 0;
     return(CFBuf);
 }
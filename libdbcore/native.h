@@ -16,6 +16,7 @@
 #define VT_SYS_SCHEMA		(VT_INCREMENT*1)
 #define VT_SYS_TABLE		(VT_INCREMENT*2)
 #define VT_SYS_REPGROUP		(VT_INCREMENT*3)
+#define VT_SYS_STATS		(VT_INCREMENT*4)
 
 #define VT_MIN_USER		256	/* minimum user vtable id */
 #define VT_FMT_STRING		"%04x"
@@ -49,6 +50,12 @@
 #define CID_COL_ID		0x001F
 #define CID_COL_DEFAULT		0x0020
 
+#define CID_STAT_ROWS		0x0021
+#define CID_STAT_NDV		0x0022
+#define CID_STAT_NULLS		0x0023
+#define CID_STAT_AVGSIZE	0x0024
+#define CID_STAT_HISTOGRAM	0x0025
+
 #define CID_MIN_USER		1024	/* minimum user column id */
 #define COL_FMT_STRING		"%04x"
 
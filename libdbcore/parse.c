@@ -10,6 +10,7 @@
  */
 
 #include "defs.h"
+#include "aggregate.h"
 
 Export int ExecuteSql(Query *qhold, const char *ctl, ...);
 Export int ParseSql(token_t *t, Query *q, int type);
@@ -21,6 +22,8 @@ int ParseSqlUpdate(token_t *t, Query *q, int type);
 int ParseSqlCreate(token_t *t, Query *q, int type);
 int ParseSqlDrop(token_t *t, Query *q, int type);
 int ParseSqlAlter(token_t *t, Query *q, int type);
+int ParseSqlAnalyze(token_t *t, Query *q, int type);
+int ParseSqlExplain(token_t *t, Query *q, int type);
 int ParseSqlAlterTable(token_t *t, Query *q, int type);
 int ParseSqlAlterTableAddColumn(token_t *t, Query *q, TableI *ti, int type);
 int ParseSqlAlterTableAlterColumn(token_t *t, Query *q, TableI *ti, int type);
@@ -33,9 +36,12 @@ int ParseSqlDropSchema(token_t *t, Query *q, int type);
 
 int ParseSqlTable(token_t *t, Query *q, int type);
 int ParseSqlCol(token_t *t, Query *q, int flags, int type);
+int ParseSqlSelCol(token_t *t, Query *q, int flags, int type);
+int ParseSqlColGroup(token_t *t, Query *q, int type);
 int ParseSqlColAssignment(token_t *t, Query *q, int type);
 int ParseSqlColOrder(token_t *t, Query *q, int type);
 int ParseSqlData(token_t *t, Query *q, ColData **pcd, int type);
+int ParseSqlColData(token_t *t, Query *q, ColI *ci, int type);
 int ParseSqlExp(token_t *t, Query *q, int type);
 int ParseSqlExpVal(token_t *t, Query *q, ColI **pci, ColData **pcd, int type);
 int ParseSqlColType(token_t *t, Query *q, int type, const char *scmName, const char *tabName, col_t cid);
@@ -125,6 +131,12 @@ ParseSql(token_t *t, Query *q, int type)
     case TOK_ALTER:
 	type = ParseSqlAlter(t, q, SqlToken(t));
 	break;
+    case TOK_ANALYZE:
+	type = ParseSqlAnalyze(t, q, SqlToken(t));
+	break;
+    case TOK_EXPLAIN:
+	type = ParseSqlExplain(t, q, SqlToken(t));
+	break;
     default:
 	type = SqlError(t, DBTOKTOERR(DBERR_UNRECOGNIZED_KEYWORD));
 	break;
@@ -174,7 +186,7 @@ ParseSqlInsert(token_t *t, Query *q, int type)
     type = SqlSkip(t, TOK_VALUES);
     type = SqlSkip(t, TOK_OPAREN);
     while (ci) {
-	type = ParseSqlData(t, q, &ci->ci_Const ,type);
+	type = ParseSqlColData(t, q, ci, type);
 	ci = ci->ci_QNext;
 	if (type != TOK_COMMA)
 	    break;
@@ -221,6 +233,8 @@ ParseSqlDelete(token_t *t, Query *q, int type)
     }
     if (q->q_TableIQBase == NULL)
 	type = SqlError(t, DBTOKTOERR(DBERR_TABLE_REQUIRED));
+    if ((type & TOKF_ERROR) == 0)
+	HLPlanQuery(q);
     return(type);
 }
 
@@ -261,9 +275,9 @@ ParseSqlSelect(token_t *t, Query *q, int type)
 	 * Skip columns to get to tables so we can parse the tables first,
 	 * then redo the columns.
 	 */
-	type = ParseSqlCol(t, NULL, CIF_WILD|CIF_ORDER|CIF_SPECIAL, type);
+	type = ParseSqlSelCol(t, NULL, CIF_WILD|CIF_ORDER|CIF_SPECIAL, type);
 	while (type == TOK_COMMA) {
-	    type = ParseSqlCol(t, NULL, CIF_WILD|CIF_ORDER|CIF_SPECIAL, SqlToken(t));
+	    type = ParseSqlSelCol(t, NULL, CIF_WILD|CIF_ORDER|CIF_SPECIAL, SqlToken(t));
 	}
     }
 
@@ -280,9 +294,9 @@ ParseSqlSelect(token_t *t, Query *q, int type)
      * Go back and parse the selection columns
      */
     if (q->q_TermOp == QOP_SELECT) {
-	rtype = ParseSqlCol(&redo, q, CIF_ORDER|CIF_WILD|CIF_SPECIAL, rtype);
+	rtype = ParseSqlSelCol(&redo, q, CIF_ORDER|CIF_WILD|CIF_SPECIAL, rtype);
 	while (rtype == TOK_COMMA) {
-	    rtype = ParseSqlCol(&redo, q, CIF_ORDER|CIF_WILD|CIF_SPECIAL, SqlToken(&redo));
+	    rtype = ParseSqlSelCol(&redo, q, CIF_ORDER|CIF_WILD|CIF_SPECIAL, SqlToken(&redo));
 	}
 	if (rtype & TOKF_ERROR) {
 	    type = rtype;
@@ -298,6 +312,20 @@ ParseSqlSelect(token_t *t, Query *q, int type)
 	type = ParseSqlExp(t, q, type);
     }
 
+    /*
+     * Parse optional GROUP BY clause
+     */
+    if (q->q_TermOp == QOP_SELECT && type == TOK_GROUP) {
+	type = SqlSkip(t, TOK_GROUP);
+	type = SqlSkip(t, TOK_BY);
+	for (;;) {
+	    type = ParseSqlColGroup(t, q, type);
+	    if (type != TOK_COMMA)
+		break;
+	    type = SqlSkip(t, TOK_COMMA);
+	}
+    }
+
     /*
      * Parse optional ORDER BY clause
      */
@@ -340,12 +368,21 @@ ParseSqlSelect(token_t *t, Query *q, int type)
 	q->q_Flags |= QF_WITH_LIMIT|QF_CLIENT_LIMIT;
     }
 
+    /*
+     * Only GROUP BY columns may be returned (or sorted on) next to
+     * aggregates.
+     */
+    if (q->q_Agg && (type & TOKF_ERROR) == 0 && CheckAggregate(q) < 0)
+	type = SqlError(t, DBTOKTOERR(DBERR_NOT_GROUPED));
+
     /*
      * Cleanup NULL scans, finish up
      */
     HLResolveNullScans(q);
     if (q->q_TableIQBase == NULL)
 	type = SqlError(t, DBTOKTOERR(DBERR_TABLE_REQUIRED));
+    if ((type & TOKF_ERROR) == 0)
+	HLPlanQuery(q);
     return(type);
 }
 
@@ -406,6 +443,8 @@ ParseSqlUpdate(token_t *t, Query *q, int type)
 
     if (q->q_TableIQBase == NULL)
 	type = SqlError(t, DBTOKTOERR(DBERR_TABLE_REQUIRED));
+    if ((type & TOKF_ERROR) == 0)
+	HLPlanQuery(q);
 
     return(type);
 }
@@ -987,6 +1026,79 @@ ParseSqlDropTable(token_t *t, Query *q, int type)
     return(type);
 }
 
+/*
+ * ANALYZE [schema.]tablename { ',' [schema.]tablename }
+ *
+ *	Gather planner statistics for the tables and store them in
+ *	sys.stats, see stats.c.
+ */
+
+int
+ParseSqlAnalyze(token_t *t, Query *q, int type)
+{
+    TableI *ti;
+    int error = 0;
+
+    type = ParseSqlTable(t, q, type);
+    while (type == TOK_COMMA)
+	type = ParseSqlTable(t, q, SqlToken(t));
+    if (type & TOKF_ERROR)
+	return(type);
+    if (q->q_TableIQBase == NULL)
+	return(SqlError(t, DBTOKTOERR(DBERR_TABLE_NOT_FOUND)));
+
+    if (PushQuery(q) < 0)
+	return(SqlError(t, DBTOKTOERR(DBERR_CANT_PUSH)));
+
+    for (ti = q->q_TableIQBase; ti && error >= 0; ti = ti->ti_Next)
+	error = AnalyzeTable(q, ti);
+
+    if (error < 0) {
+	PopQuery(q, 0);
+	type = SqlError(t, DBTOKTOERR(DBERR_MACRO_SQL));
+    } else if (PopQuery(q, 1) < 0) {
+	type = SqlError(t, DBTOKTOERR(DBERR_MACRO_SQL));
+    } else {
+	dbinfo2("Committed\n");
+    }
+    return(type);
+}
+
+/*
+ * EXPLAIN [ANALYZE] { SELECT | COUNT | HISTORY | DELETE | UPDATE | CLONE } ...
+ *
+ *	Parse the query normally and flag it.  The query is not run by
+ *	the parser, ExplainQuery() describes it (and runs it for ANALYZE).
+ */
+
+int
+ParseSqlExplain(token_t *t, Query *q, int type)
+{
+    q->q_Flags |= QF_EXPLAIN;
+    if (type == TOK_ANALYZE) {
+	q->q_Flags |= QF_EXPLAIN_ANALYZE;
+	type = SqlToken(t);
+    }
+    switch(type) {
+    case TOK_DELETE:
+	type = ParseSqlDelete(t, q, SqlToken(t));
+	break;
+    case TOK_SELECT:
+    case TOK_COUNT:
+    case TOK_HISTORY:
+	type = ParseSqlSelect(t, q, type);
+	break;
+    case TOK_UPDATE:
+    case TOK_CLONE:
+	type = ParseSqlUpdate(t, q, type);
+	break;
+    default:
+	type = SqlError(t, DBTOKTOERR(DBERR_SYNTAX_ERROR));
+	break;
+    }
+    return(type);
+}
+
 /************************************************************************
  *			PARSER HELPER ROUTINES				*
  ************************************************************************
@@ -1059,6 +1171,69 @@ ParseSqlCol(token_t *t, Query *q, int flags, int type)
     return(type);
 }
 
+/*
+ * ParseSqlSelCol() - parse a selection column or aggregate
+ *
+ *	COUNT(*) | { COUNT | SUM | MIN | MAX | AVG } '(' column ')' | column
+ *
+ *	If q is NULL, we do a dummy parsing of the selector, else we
+ *	do a real one.  See aggregate.c.
+ */
+
+int
+ParseSqlSelCol(token_t *t, Query *q, int flags, int type)
+{
+    token_t save = *t;
+    int func = 0;
+
+    if (type == TOK_COUNT)
+	func = AGG_COUNT;
+    else if (type == TOK_ID)
+	func = AggregateLookup(t->t_Data, t->t_Len);
+    if (func == 0 || SqlToken(t) != TOK_OPAREN) {
+	*t = save;
+	return(ParseSqlCol(t, q, flags, type));
+    }
+
+    type = SqlToken(t);
+    if (type == TOK_STAR && func == AGG_COUNT) {
+	if (q)
+	    AddAggregate(q, AGG_COUNTSTAR, NULL);
+	type = SqlToken(t);
+    } else if (type & TOKF_ID) {
+	ColI *ci = NULL;
+
+	if (q) {
+	    ci = HLGetColI(q, t->t_Data, t->t_Len, CIF_SPECIAL);
+	    if (ci == NULL)
+		return(SqlError(t, DBTOKTOERR(DBERR_COLUMN_NOT_FOUND)));
+	    AddAggregate(q, func, ci);
+	}
+	type = SqlToken(t);
+    } else {
+	return(SqlError(t, DBTOKTOERR(DBERR_EXPECTED_COLUMN)));
+    }
+    return(SqlSkip(t, TOK_CPAREN));
+}
+
+/*
+ * ParseSqlColGroup() - parse a GROUP BY column
+ */
+
+int
+ParseSqlColGroup(token_t *t, Query *q, int type)
+{
+    ColI *ci;
+
+    if ((type & TOKF_ID) == 0)
+	return(SqlError(t, DBTOKTOERR(DBERR_EXPECTED_COLUMN)));
+    if ((ci = HLGetColI(q, t->t_Data, t->t_Len, CIF_SPECIAL)) == NULL)
+	return(SqlError(t, DBTOKTOERR(DBERR_COLUMN_NOT_FOUND)));
+    if (AddAggregateGroup(q, ci) < 0)
+	return(SqlError(t, DBTOKTOERR(DBERR_DUPLICATE_COLUMN)));
+    return(SqlToken(t));
+}
+
 /*
  * Parse a data object, set type.  For the moment we parse to generic
  * data (i.e. string, integer, etc... all converted to strings).
@@ -1077,6 +1252,10 @@ ParseSqlData(token_t *t, Query *q, ColData **pcd, int type)
 	*pcd = GetConst(q, NULL, 0);
 	type = SqlToken(t);
 	break;
+    case TOK_QUESTION:
+	*pcd = GetParam(q);
+	type = SqlToken(t);
+	break;
     default:
 	type = SqlError(t, DBTOKTOERR(DBERR_EXPECTED_DATA));
 	break;
@@ -1084,6 +1263,24 @@ ParseSqlData(token_t *t, Query *q, ColData **pcd, int type)
     return(type);
 }
 
+/*
+ * ParseSqlColData() -	parse the data stored into a column
+ *
+ *	The constant is converted to the column's data type.
+ */
+
+int
+ParseSqlColData(token_t *t, Query *q, ColI *ci, int type)
+{
+    type = ParseSqlData(t, q, &ci->ci_Const, type);
+    if ((type & TOKF_ERROR) == 0 &&
+	ConvertConst(q, &ci->ci_Const, ci->ci_DataType) < 0
+    ) {
+	type = SqlError(t, DBTOKTOERR(DBERR_BAD_VALUE));
+    }
+    return(type);
+}
+
 /*
  * ParseSqlColAssign() -	parse col = 'data'
  *
@@ -1105,7 +1302,7 @@ ParseSqlColAssignment(token_t *t, Query *q, int type)
 	    if (ci->ci_Const != NULL)
 		type = SqlError(t, DBTOKTOERR(DBERR_DUPLICATE_COLUMN));
 	    else
-		type = ParseSqlData(t, q, &ci->ci_Const, type);
+		type = ParseSqlColData(t, q, ci, type);
 	}
     } else {
 	type = SqlError(t, DBTOKTOERR(DBERR_EXPECTED_COLUMN));
@@ -1223,9 +1420,11 @@ ParseSqlExp(token_t *t, Query *q, int type)
 	 * Optimize cooked column compares against timestamps for the
 	 * CID_COOK_TIMESTAMP column, because the btree only caches the
 	 * first 8 characters and the timestamp is 16 characters in 
-	 * ascii-hex.
+	 * ascii-hex.  A parameter's value is not known yet, it is compared
+	 * against the cooked column.
 	 */
-	if (stamp_opid >= 0 && lhs && rcd && 
+	if (stamp_opid >= 0 && lhs && rcd &&
+	    (rcd->cd_Flags & RDF_PARAM) == 0 &&
 	    (lhs->ci_ColId == CID_COOK_TIMESTAMP || 
 	     lhs->ci_ColId == CID_COOK_DATESTR)
 	) {
@@ -1234,7 +1433,8 @@ ParseSqlExp(token_t *t, Query *q, int type)
 	    rcd = GetConst(q, &ts, sizeof(ts));
 	    opid = stamp_opid;
 	    ropid = stamp_ropid;
-	} else if (stamp_opid >= 0 && rhs && lcd && 
+	} else if (stamp_opid >= 0 && rhs && lcd &&
+	    (lcd->cd_Flags & RDF_PARAM) == 0 &&
 	    (rhs->ci_ColId == CID_COOK_TIMESTAMP ||
 	     rhs->ci_ColId == CID_COOK_DATESTR)
 	) {
@@ -1245,6 +1445,32 @@ ParseSqlExp(token_t *t, Query *q, int type)
 	    ropid = stamp_ropid;
 	}
 
+	/*
+	 * Compare in the column's data type.  The binary types cannot be
+	 * LIKE'd and only join against columns of the same type.
+	 */
+	if (lhs && rhs) {
+	    if (lhs->ci_DataType != rhs->ci_DataType &&
+		(DATATYPE_BINARY(lhs->ci_DataType) ||
+		 DATATYPE_BINARY(rhs->ci_DataType))
+	    ) {
+		type = SqlError(t, DBTOKTOERR(DBERR_TYPE_OPERATOR));
+		break;
+	    }
+	} else {
+	    ColI *ci = lhs ? lhs : rhs;
+	    ColData **pcd = lhs ? &rcd : &lcd;
+
+	    if (DATATYPE_BINARY(ci->ci_DataType) && opid == ROP_LIKE) {
+		type = SqlError(t, DBTOKTOERR(DBERR_TYPE_OPERATOR));
+		break;
+	    }
+	    if (ConvertConst(q, pcd, ci->ci_DataType) < 0) {
+		type = SqlError(t, DBTOKTOERR(DBERR_BAD_VALUE));
+		break;
+	    }
+	}
+
 	if (lhs && rhs) {
 	    /*
 	     * For a join either scan the right hand table looking for matches
@@ -1307,7 +1533,9 @@ ParseSqlExpVal(token_t *t, Query *q, ColI **pci, ColData **pcd, int type)
  *
  *	NAME TYPE
  *
- * Currently only type VARCHAR is supported
+ * TYPE is VARCHAR, INT (INTEGER, BIGINT), DOUBLE (FLOAT), DECIMAL
+ * (NUMERIC) or TIMESTAMP, see DataTypeLookup().  A DEFAULT must be a
+ * valid value of the type, it is stored as text.
  */
 int
 ParseSqlColType(token_t *t, Query *q, int type, const char *scmName, const char *tabName, col_t cid)
@@ -1317,6 +1545,7 @@ ParseSqlColType(token_t *t, Query *q, int type, const char *scmName, const char
     char *colFlags;
     char *alloc = NULL;
     ColData *def = NULL;
+    int dataType;
     int error;
 
     if ((type & TOKF_ID) == 0)
@@ -1326,7 +1555,7 @@ ParseSqlColType(token_t *t, Query *q, int type, const char *scmName, const char
     type = SqlToken(t);
 
     colType = safe_strndup_tolower(t->t_Data, t->t_Len);
-    if (DataTypeLookup(colType, t->t_Len) < 0)
+    if ((dataType = DataTypeLookup(colType, t->t_Len)) < 0)
 	type = SqlError(t, DBTOKTOERR(DBERR_UNRECOGNIZED_TYPE));
 
     type = SqlToken(t);
@@ -1363,6 +1592,18 @@ ParseSqlColType(token_t *t, Query *q, int type, const char *scmName, const char
 	    }
 	    type = SqlToken(t);
 	    type = ParseSqlData(t, q, &def, type);
+	    if (def && (def->cd_Flags & RDF_PARAM)) {
+		type = SqlError(t, DBTOKTOERR(DBERR_PARAM_ILLEGAL));
+		continue;
+	    }
+	    if (def) {
+		ColData *cd = def;	/* the default is kept as text */
+
+		if (ConvertConst(q, &cd, dataType) < 0) {
+		    type = SqlError(t, DBTOKTOERR(DBERR_BAD_VALUE));
+		    continue;
+		}
+	    }
 	    flag = 'V';
 	    break;
 	case TOK_NOT:
@@ -1379,6 +1620,38 @@ ParseSqlColType(token_t *t, Query *q, int type, const char *scmName, const char
 	    }
 	    type = SqlToken(t);
 	    break;
+	case TOK_USING:
+	    /*
+	     * USING HASH - index exact matches with a hash index.
+	     * USING TRIGRAM - index LIKE with a trigram index, text only.
+	     * USING COMPOUND - part of the table's compound btree index.
+	     * USING COVER - copied into the table's btree indexes.
+	     * 'hash', 'trigram', 'compound' and 'cover' are not keywords.
+	     */
+	    type = SqlToken(t);
+	    if ((type & TOKF_ID) && t->t_Len == 4 &&
+		strncasecmp(t->t_Data, "hash", 4) == 0
+	    ) {
+		flag = 'H';
+	    } else if ((type & TOKF_ID) && t->t_Len == 7 &&
+		strncasecmp(t->t_Data, "trigram", 7) == 0
+	    ) {
+		if (DATATYPE_BINARY(dataType)) {
+		    type = SqlError(t, DBTOKTOERR(DBERR_TYPE_OPERATOR));
+		    continue;
+		}
+		flag = 'T';
+	    } else if ((type & TOKF_ID) && t->t_Len == 8 &&
+		strncasecmp(t->t_Data, "compound", 8) == 0
+	    ) {
+		flag = 'M';
+	    } else if ((type & TOKF_ID) && t->t_Len == 5 &&
+		strncasecmp(t->t_Data, "cover", 5) == 0
+	    ) {
+		flag = 'C';
+	    }
+	    type = SqlToken(t);
+	    break;
 	default:
 	    break;
 	}
@@ -0,0 +1,577 @@
+/*
+ * LIBDBCORE/PREPARE.C	- Prepared statement cache
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	Parsed and planned queries are kept per client instance, keyed by
+ *	their SQL text, and cloned into the current transaction with the
+ *	values of their '?' parameters filled in.  See prepare.h.
+ */
+
+#include "defs.h"
+#include "aggregate.h"
+#include "prepare.h"
+
+Export Query *PrepareQuery(struct PrepCache **ppc, DataBase *db, const char *qry, int len, const ColData *params, int nparams, int *perror);
+Export void FreePrepCache(struct PrepCache **ppc);
+
+static DataBase *prepRoot(DataBase *db);
+static Query *prepParse(DataBase *db, const char *qry, int len, int *pcache, int *perror);
+static Query *prepOnce(Query *tq, int cache, const ColData *params, int nparams, int *perror);
+static void prepDetach(Query *tq);
+static Query *prepClone(Query *tq, DataBase *db, const ColData *params, int nparams, int *perror);
+static void prepFree(PrepCache *pc, PrepStmt *ps);
+static u_int32_t prepHash(const char *qry, int len);
+static void prepMapAdd(PrepMap *pm, const void *optr, void *nptr);
+static void *prepMap(PrepMap *pm, const void *optr);
+static char *prepReloc(const ColI *oci, ColI *ci, const char *optr);
+
+/*
+ * PrepareQuery() - return a query ready to run, with parameters bound
+ *
+ *	qry is len bytes of SQL text followed by a NUL.  params[] holds
+ *	the values of the query's '?' parameters, in order, a NULL
+ *	cd_Data binds SQL NULL.  The values are copied.  The returned
+ *	query belongs to the caller just like a freshly parsed one.
+ *
+ *	Returns NULL and sets *perror on failure.
+ */
+Query *
+PrepareQuery(struct PrepCache **ppc, DataBase *db, const char *qry, int len, const ColData *params, int nparams, int *perror)
+{
+    PrepCache *pc;
+    PrepStmt *ps;
+    PrepStmt **pps;
+    DataBase *root;
+    Query *tq;
+    u_int32_t hv;
+    int cache;
+    int gen;
+
+    *perror = 0;
+
+    /*
+     * Transactions which cannot see the latest meta-data (or which
+     * changed it) parse from scratch.
+     */
+    if ((root = prepRoot(db)) == NULL) {
+	if ((tq = prepParse(db, qry, len, &cache, perror)) == NULL)
+	    return(NULL);
+	return(prepOnce(tq, cache, params, nparams, perror));
+    }
+
+    if ((pc = *ppc) == NULL) {
+	pc = zalloc(sizeof(PrepCache));
+	initList(&pc->pc_List);
+	*ppc = pc;
+    }
+
+    hv = prepHash(qry, len);
+    for (ps = pc->pc_Hash[hv & PREP_HMASK]; ps; ps = ps->ps_HNext) {
+	if (ps->ps_Hv == hv && ps->ps_SqlLen == len &&
+	    bcmp(ps->ps_Sql, qry, len) == 0
+	) {
+	    break;
+	}
+    }
+    if (ps && ps->ps_MetaGen != root->db_MetaGen) {
+	prepFree(pc, ps);
+	ps = NULL;
+    }
+
+    if (ps == NULL) {
+	/*
+	 * The generation is sampled before parsing, a meta-data write
+	 * committed while we are parsing invalidates the template.
+	 */
+	gen = root->db_MetaGen;
+	if ((tq = prepParse(db, qry, len, &cache, perror)) == NULL)
+	    return(NULL);
+	if (cache == 0)
+	    return(prepOnce(tq, cache, params, nparams, perror));
+	prepDetach(tq);
+
+	ps = zalloc(sizeof(PrepStmt));
+	ps->ps_Hv = hv;
+	ps->ps_MetaGen = gen;
+	ps->ps_SqlLen = len;
+	ps->ps_Sql = safe_strndup(qry, len);
+	ps->ps_Query = tq;
+	pps = &pc->pc_Hash[hv & PREP_HMASK];
+	ps->ps_HNext = *pps;
+	*pps = ps;
+	addHead(&pc->pc_List, &ps->ps_Node);
+	++pc->pc_Count;
+	while (pc->pc_Count > PREP_MAXSTMTS)
+	    prepFree(pc, getTail(&pc->pc_List));
+    } else {
+	removeNode(&ps->ps_Node);
+	addHead(&pc->pc_List, &ps->ps_Node);
+    }
+    return(prepClone(ps->ps_Query, db, params, nparams, perror));
+}
+
+/*
+ * FreePrepCache() - throw away an instance's prepared statements
+ */
+void
+FreePrepCache(struct PrepCache **ppc)
+{
+    PrepCache *pc;
+    PrepStmt *ps;
+
+    if ((pc = *ppc) == NULL)
+	return;
+    *ppc = NULL;
+    while ((ps = getHead(&pc->pc_List)) != NULL)
+	prepFree(pc, ps);
+    zfree(pc, sizeof(PrepCache));
+}
+
+/*
+ * prepRoot() - return the root database if db may use the cache
+ *
+ *	The cache reflects the meta-data as of the latest write to the
+ *	root.  The transaction must not have changed meta-data itself and
+ *	its snapshot must include that write.
+ */
+static DataBase *
+prepRoot(DataBase *db)
+{
+    DataBase *top;
+
+    if (db->db_PushType == DBPUSH_ROOT)
+	return(NULL);
+    for (top = db; ; top = top->db_Parent) {
+	if (top->db_Flags & DBF_METACHANGE)
+	    return(NULL);
+	if (top->db_Parent->db_PushType == DBPUSH_ROOT)
+	    break;
+    }
+    if (top->db_FreezeTs <= top->db_Parent->db_MetaTs)
+	return(NULL);
+    return(top->db_Parent);
+}
+
+/*
+ * prepParse() - parse a query in the current transaction
+ *
+ *	*pcache is set if the query is a kind we keep templates of.  The
+ *	decision is made on the leading keyword since the DDL parsers do
+ *	not set q_TermOp.
+ */
+static Query *
+prepParse(DataBase *db, const char *qry, int len, int *pcache, int *perror)
+{
+    Query *q = GetQuery(db);
+    token_t t;
+    int type;
+
+    type = SqlInit(&t, qry, len + 1);
+    switch(type) {
+    case TOK_SELECT:
+    case TOK_COUNT:
+    case TOK_HISTORY:
+    case TOK_INSERT:
+    case TOK_DELETE:
+    case TOK_UPDATE:
+    case TOK_CLONE:
+    case TOK_EXPLAIN:
+	*pcache = 1;
+	break;
+    default:
+	*pcache = 0;
+	break;
+    }
+    type = ParseSql(&t, q, type);
+    if (type & TOKF_ERROR) {
+	*perror = -(int)(type & TOKF_ERRMASK);
+	FreeQuery(q);
+	return(NULL);
+    }
+    q->q_QryCopy = safe_strndup(qry, len);
+    return(q);
+}
+
+/*
+ * prepOnce() - bind the parameters of a query which is not kept
+ *
+ *	Anything but DML is run as parsed and may not have parameters.
+ */
+static Query *
+prepOnce(Query *tq, int cache, const ColData *params, int nparams, int *perror)
+{
+    Query *q;
+
+    if (cache == 0) {
+	if (tq->q_NParams) {
+	    *perror = DBERR_PARAM_ILLEGAL;
+	    FreeQuery(tq);
+	    return(NULL);
+	}
+	if (nparams) {
+	    *perror = DBERR_PARAM_COUNT;
+	    FreeQuery(tq);
+	    return(NULL);
+	}
+	return(tq);
+    }
+    q = prepClone(tq, tq->q_Db, params, nparams, perror);
+    FreeQuery(tq);
+    return(q);
+}
+
+/*
+ * prepDetach() - turn a parsed query into a template
+ *
+ *	The tables are opened in the transaction the query was parsed in
+ *	and the schema caches live in its top level, so both have to go.
+ *	The template is never run.
+ */
+static void
+prepDetach(Query *tq)
+{
+    SchemaI *si;
+    TableI *ti;
+
+    for (ti = tq->q_TableIQBase; ti; ti = ti->ti_Next) {
+	RawData *rd = ti->ti_RData;
+
+	if (rd->rd_Map)
+	    rd->rd_Map->dm_Table->ta_RelDataMap(&rd->rd_Map, 0);
+	rd->rd_Table = NULL;
+	if (ti->ti_Table) {
+	    CloseTable(ti->ti_Table, 0);
+	    ti->ti_Table = NULL;
+	}
+	ti->ti_CacheCopy = NULL;
+    }
+    for (si = tq->q_FirstSchemaI; si; si = si->si_Next)
+	si->si_CacheCopy = NULL;
+    tq->q_Db = NULL;
+}
+
+/*
+ * prepClone() - instantiate a template in a transaction
+ *
+ *	The copy has the template's ranges in the template's order, its
+ *	tables are reopened in db and its parameters are replaced by
+ *	constants holding the values.
+ */
+static Query *
+prepClone(Query *tq, DataBase *db, const ColData *params, int nparams, int *perror)
+{
+    PrepMap pm;
+    Query *q;
+    SchemaI *osi;
+    SchemaI **psi;
+    TableI *oti;
+    TableI **pti;
+    ColData *ocd;
+    ColI *oci;
+    ColI *ci;
+    Range *or;
+    Range *r;
+    RangeArg *pnext;
+    int (**prun)(RangeArg next);
+    int i;
+
+    if (nparams != tq->q_NParams) {
+	*perror = DBERR_PARAM_COUNT;
+	return(NULL);
+    }
+    bzero(&pm, sizeof(pm));
+
+    q = GetQuery(db);
+    q->q_TermOp = tq->q_TermOp;
+    q->q_Flags = tq->q_Flags;
+    q->q_StartRow = tq->q_StartRow;
+    q->q_MaxRows = tq->q_MaxRows;
+
+    /*
+     * Constants, the parameters get their values.  A parameter tagged
+     * with a binary data type (see ConvertConst()) gets the value in
+     * that type.
+     */
+    for (ocd = tq->q_ConstDataBase; ocd; ocd = ocd->cd_Next) {
+	const ColData *src = ocd;
+	ColData bin;
+	char buf[DATATYPE_BINSIZE];
+	ColData *cd;
+
+	if (ocd->cd_Flags & RDF_PARAM) {
+	    for (i = 0; i < nparams; ++i) {
+		if (tq->q_Params[i] == ocd)
+		    break;
+	    }
+	    DBASSERT(i < nparams);
+	    src = &params[i];
+	    if (DATATYPE_BINARY(ocd->cd_DataType) && src->cd_Data) {
+		bzero(&bin, sizeof(bin));
+		bin.cd_Bytes = DataTypeFromString(ocd->cd_DataType,
+				    src->cd_Data, src->cd_Bytes, buf);
+		if (bin.cd_Bytes < 0) {
+		    *perror = DBERR_BAD_VALUE;
+		    FreeQuery(q);
+		    q = NULL;
+		    goto done;
+		}
+		bin.cd_Data = buf;
+		src = &bin;
+	    }
+	}
+	cd = GetConst(q, src->cd_Data, src->cd_Bytes);
+	cd->cd_ColId = ocd->cd_ColId;
+	cd->cd_DataType = ocd->cd_DataType;
+	cd->cd_Flags = ocd->cd_Flags & ~RDF_PARAM;
+	prepMapAdd(&pm, ocd, cd);
+    }
+
+    /*
+     * Schemas and tables, in the template's order
+     */
+    psi = &q->q_FirstSchemaI;
+    for (osi = tq->q_FirstSchemaI; osi; osi = osi->si_Next) {
+	SchemaI *si = zalloc(sizeof(SchemaI));
+
+	si->si_Query = q;
+	si->si_ScmName = safe_strdup(osi->si_ScmName);
+	si->si_ScmNameLen = osi->si_ScmNameLen;
+	si->si_DefaultPhysFile = safe_strdup(osi->si_DefaultPhysFile);
+	*psi = si;
+	psi = &si->si_Next;
+	prepMapAdd(&pm, osi, si);
+    }
+    q->q_DefSchemaI = prepMap(&pm, tq->q_DefSchemaI);
+
+    pti = &q->q_TableIQBase;
+    for (oti = tq->q_TableIQBase; oti; oti = oti->ti_Next) {
+	TableI *ti;
+	ColI **pci;
+	Table *tab;
+	int error = 0;
+
+	tab = OpenTable(db, oti->ti_TableFile, "dt0", NULL, &error);
+	if (tab == NULL) {
+	    dberror("Unable to open physical table %s\n", oti->ti_TableFile);
+	    *perror = DBERR_TABLE_NOT_FOUND;
+	    FreeQuery(q);
+	    q = NULL;
+	    goto done;
+	}
+	ti = zalloc(sizeof(TableI));
+	ti->ti_Query = q;
+	ti->ti_SchemaI = prepMap(&pm, oti->ti_SchemaI);
+	ti->ti_TabName = safe_strdup(oti->ti_TabName);
+	ti->ti_TabNameLen = oti->ti_TabNameLen;
+	ti->ti_AliasName = safe_strdup(oti->ti_AliasName);
+	ti->ti_AliasNameLen = oti->ti_AliasNameLen;
+	ti->ti_Table = tab;
+	ti->ti_RData = AllocRawData(tab, NULL, 0);
+	ti->ti_VTable = oti->ti_VTable;
+	ti->ti_ScanOneOnly = oti->ti_ScanOneOnly;
+	ti->ti_TableFile = safe_strdup(oti->ti_TableFile);
+	ti->ti_CompNCols = oti->ti_CompNCols;
+	bcopy(oti->ti_CompColIds, ti->ti_CompColIds, sizeof(ti->ti_CompColIds));
+	*pti = ti;
+	pti = &ti->ti_Next;
+	prepMapAdd(&pm, oti, ti);
+
+	for (ocd = oti->ti_RData->rd_ColBase; ocd; ocd = ocd->cd_Next) {
+	    prepMapAdd(&pm, ocd, GetRawDataCol(ti->ti_RData,
+				(col_t)ocd->cd_ColId, ocd->cd_DataType));
+	}
+
+	pci = &ti->ti_FirstColI;
+	for (oci = oti->ti_FirstColI; oci; oci = oci->ci_Next) {
+	    ci = zalloc(oci->ci_Size);
+	    bcopy(oci, ci, oci->ci_Size);
+	    ci->ci_ColName = prepReloc(oci, ci, oci->ci_ColName);
+	    ci->ci_Default = prepReloc(oci, ci, oci->ci_Default);
+	    ci->ci_Next = NULL;
+	    ci->ci_QNext = NULL;
+	    ci->ci_QSortNext = NULL;
+	    ci->ci_TableI = ti;
+	    ci->ci_Const = prepMap(&pm, oci->ci_Const);
+	    ci->ci_CData = prepMap(&pm, oci->ci_CData);
+	    *pci = ci;
+	    pci = &ci->ci_Next;
+	    prepMapAdd(&pm, oci, ci);
+	}
+    }
+
+    /*
+     * Ranges.  Allocate the chain first, r_Prev and friends may refer
+     * to ranges further down after planning.
+     */
+    pnext = &q->q_RangeArg;
+    prun = &q->q_RunRange;
+    or = (tq->q_RunRange == RunRange) ? tq->q_RangeArg.ra_RangePtr : NULL;
+    while (or) {
+	r = zalloc(sizeof(Range));
+	*r = *or;
+	r->r_DelHash = NULL;
+	pnext->ra_RangePtr = r;
+	*prun = RunRange;
+	prepMapAdd(&pm, or, r);
+	if (or->r_RunRange != RunRange) {
+	    DBASSERT(or->r_Next.ra_VoidPtr == tq);
+	    r->r_Next.ra_VoidPtr = q;
+	    break;
+	}
+	pnext = &r->r_Next;
+	prun = &r->r_RunRange;
+	or = or->r_Next.ra_RangePtr;
+    }
+    or = (tq->q_RunRange == RunRange) ? tq->q_RangeArg.ra_RangePtr : NULL;
+    while (or) {
+	r = prepMap(&pm, or);
+	r->r_Prev = prepMap(&pm, or->r_Prev);
+	r->r_PrevSame = prepMap(&pm, or->r_PrevSame);
+	r->r_NextSame = prepMap(&pm, or->r_NextSame);
+	r->r_TableI = prepMap(&pm, or->r_TableI);
+	r->r_Col = prepMap(&pm, or->r_Col);
+	r->r_Const = prepMap(&pm, or->r_Const);
+	or = (or->r_RunRange == RunRange) ? or->r_Next.ra_RangePtr : NULL;
+    }
+    for (oti = tq->q_TableIQBase; oti; oti = oti->ti_Next) {
+	TableI *ti = prepMap(&pm, oti);
+
+	ti->ti_MarkRange = prepMap(&pm, oti->ti_MarkRange);
+    }
+
+    /*
+     * Result and sort columns.  Aggregate result columns belong to the
+     * Aggregate and are rebuilt.
+     */
+    for (oci = tq->q_ColIQBase; oci; oci = oci->ci_QNext) {
+	AggFunc *af = NULL;
+
+	if (tq->q_Agg) {
+	    for (af = tq->q_Agg->ag_Funcs; af; af = af->af_Next) {
+		if (af->af_OutColI == oci)
+		    break;
+	    }
+	}
+	if (af) {
+	    AddAggregate(q, af->af_Func, prepMap(&pm, af->af_ColI));
+	    continue;
+	}
+	ci = prepMap(&pm, oci);
+	*q->q_ColIQAppend = ci;
+	q->q_ColIQAppend = &ci->ci_QNext;
+    }
+    for (oci = tq->q_ColIQSortBase; oci; oci = oci->ci_QSortNext) {
+	ci = prepMap(&pm, oci);
+	*q->q_ColIQSortAppend = ci;
+	q->q_ColIQSortAppend = &ci->ci_QSortNext;
+    }
+    q->q_OrderCount = tq->q_OrderCount;
+    q->q_IQSortCount = tq->q_IQSortCount;
+    if (tq->q_Agg) {
+	for (i = 0; i < tq->q_Agg->ag_NGroupCols; ++i)
+	    AddAggregateGroup(q, prepMap(&pm, tq->q_Agg->ag_GroupCols[i]));
+    }
+    q->q_QryCopy = safe_strdup(tq->q_QryCopy);
+
+    /*
+     * The KEY and NOT NULL checks the parser did could not see the
+     * parameters' values.
+     */
+    if (nparams) {
+	switch(q->q_TermOp) {
+	case QOP_INSERT:
+	case QOP_UPDATE:
+	case QOP_CLONE:
+	    if (HLCheckFieldRestrictions(q, 0) < 0) {
+		*perror = DBERR_KEYNULL;
+		FreeQuery(q);
+		q = NULL;
+	    }
+	    break;
+	}
+    }
+done:
+    safe_free((char **)&pm.pm_Old);
+    safe_free((char **)&pm.pm_New);
+    return(q);
+}
+
+static void
+prepFree(PrepCache *pc, PrepStmt *ps)
+{
+    PrepStmt **pps;
+
+    for (pps = &pc->pc_Hash[ps->ps_Hv & PREP_HMASK]; *pps != ps;
+	pps = &(*pps)->ps_HNext
+    ) {
+	DBASSERT(*pps != NULL);
+    }
+    *pps = ps->ps_HNext;
+    removeNode(&ps->ps_Node);
+    --pc->pc_Count;
+    FreeQuery(ps->ps_Query);
+    safe_free(&ps->ps_Sql);
+    zfree(ps, sizeof(PrepStmt));
+}
+
+static u_int32_t
+prepHash(const char *qry, int len)
+{
+    const u_int8_t *ptr = (const u_int8_t *)qry;
+    u_int32_t hv = 2166136261U;
+
+    while (len-- > 0)
+	hv = (hv ^ *ptr++) * 16777619U;
+    return(hv);
+}
+
+static void
+prepMapAdd(PrepMap *pm, const void *optr, void *nptr)
+{
+    if (pm->pm_Count == pm->pm_Size) {
+	pm->pm_Size = pm->pm_Size ? pm->pm_Size * 2 : 32;
+	pm->pm_Old = safe_realloc(pm->pm_Old, sizeof(void *) * pm->pm_Size);
+	pm->pm_New = safe_realloc(pm->pm_New, sizeof(void *) * pm->pm_Size);
+    }
+    pm->pm_Old[pm->pm_Count] = optr;
+    pm->pm_New[pm->pm_Count] = nptr;
+    ++pm->pm_Count;
+}
+
+/*
+ * prepMap() - translate a template pointer, NULL stays NULL
+ *
+ *	Every structure of the template is entered before it can be
+ *	referenced.  Queries are small, a linear search will do.
+ */
+static void *
+prepMap(PrepMap *pm, const void *optr)
+{
+    int i;
+
+    if (optr == NULL)
+	return(NULL);
+    for (i = pm->pm_Count - 1; i >= 0; --i) {
+	if (pm->pm_Old[i] == optr)
+	    return(pm->pm_New[i]);
+    }
+    DBASSERT(0);
+    return(NULL);
+}
+
+/*
+ * prepReloc() - relocate a string stored in a ColI's own allocation
+ *
+ *	Special columns point to static names, which are kept.
+ */
+static char *
+prepReloc(const ColI *oci, ColI *ci, const char *optr)
+{
+    const char *base = (const char *)oci;
+
+    if (optr >= base && optr < base + oci->ci_Size)
+	return((char *)ci + (optr - base));
+    return((char *)optr);
+}
@@ -0,0 +1,61 @@
+/*
+ * LIBDBCORE/PREPARE.H	- Prepared statements
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ * Notes on prepared statements:
+ *
+ *	A query may contain '?' in place of any constant value.  Each '?'
+ *	is parsed into a RDF_PARAM place holder (see GetParam()) and the
+ *	values are supplied when the query is run, in the order the '?'s
+ *	appear.  Values are bound as strings, NULL binds SQL NULL.
+ *
+ *	Parsing resolves schemas, tables and columns through the system
+ *	tables and plans the ranges (HLPlanQuery()).  PrepareQuery() keeps
+ *	the result of that work per client instance, keyed by the exact
+ *	SQL text.  The cached copy is a template: its tables are closed
+ *	and it is never run.  Each execution clones the template into the
+ *	current transaction, substituting the values for the place holders,
+ *	so the plan is the one chosen when the template was parsed.
+ *
+ *	A meta-data write reaching the root database (CREATE, DROP, ALTER,
+ *	ANALYZE, ...) bumps db_MetaGen, which invalidates every template
+ *	parsed under an older generation.  A transaction which changed
+ *	meta-data itself, or whose snapshot predates the latest meta-data
+ *	write, does not use the cache at all.
+ *
+ *	Only SELECT, COUNT, INSERT, DELETE, UPDATE and CLONE are cached.
+ *	The cache holds at most PREP_MAXSTMTS templates and throws out the
+ *	least recently used one.
+ */
+
+#define PREP_HSIZE	64		/* power of 2 */
+#define PREP_HMASK	(PREP_HSIZE - 1)
+#define PREP_MAXSTMTS	256
+
+typedef struct PrepStmt {
+    Node	ps_Node;	/* LRU, most recently used first */
+    struct PrepStmt *ps_HNext;	/* hash chain */
+    u_int32_t	ps_Hv;
+    int		ps_MetaGen;	/* root db_MetaGen when parsed */
+    int		ps_SqlLen;
+    char	*ps_Sql;
+    Query	*ps_Query;	/* template */
+} PrepStmt;
+
+typedef struct PrepCache {
+    List	pc_List;	/* LRU */
+    int		pc_Count;
+    PrepStmt	*pc_Hash[PREP_HSIZE];
+} PrepCache;
+
+/*
+ * Old -> new pointer translation while cloning a template
+ */
+typedef struct PrepMap {
+    int		pm_Count;
+    int		pm_Size;
+    const void	**pm_Old;
+    void	**pm_New;
+} PrepMap;
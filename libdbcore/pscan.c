@@ -0,0 +1,651 @@
+/*
+ * LIBDBCORE/PSCAN.C	- Split a large table scan across worker processes
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	DefaultIndexScanRangeOp1() hands an unindexed scan to
+ *	ParallelScanRange().  If the range can be batched and the table
+ *	is large enough, runs of blocks are evaluated by forked workers
+ *	and the database process runs their results through the
+ *	terminator as they arrive.  See pscan.h.
+ */
+
+#include "defs.h"
+#include "batch.h"
+#include "pscan.h"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <poll.h>
+
+Prototype int ParallelScanRange(Range *r, int *pcount);
+Export void SetParallelScan(int workers);
+
+static int psWorkers(void);
+static int psStart(PScan *ps, PScanWorker *pw, Range *r, BatchScan *bs);
+static void psWorker(Range *r, BatchScan *bs, int fd, dboff_t beg, dboff_t end);
+static int psCountable(Range *r, BatchScan *bs);
+static int psWrite(int fd, const void *buf, size_t bytes);
+static int psFill(PScan *ps, PScanWorker *wpw);
+static int psDeletes(PScan *ps);
+static void psSaveDeletes(PScan *ps, Range *r);
+static int psRecords(PScan *ps, Range *r, BatchScan *bs, int mode);
+static int psLocal(Range *r, BatchScan *bs, dboff_t beg, dboff_t last);
+static void psReap(PScanWorker *pw, int killMe);
+
+static int PScanWorkers = 0;		/* 0: disabled, -1: one per cpu */
+
+/*
+ * SetParallelScan() - set the number of workers a scan may be split into
+ *
+ *	0 or 1 disables parallel scans (the default), a negative number
+ *	uses one worker per cpu.
+ */
+void
+SetParallelScan(int workers)
+{
+    PScanWorkers = workers;
+}
+
+/*
+ * ParallelScanRange() - run both passes of DefaultIndexScanRangeOp1()
+ *
+ *	Returns -1 if the caller must scan the table itself, otherwise
+ *	the range has been run and its result is stored in *pcount.  The
+ *	caller restores ti_RanBeg afterwords.
+ */
+int
+ParallelScanRange(Range *r, int *pcount)
+{
+    TableI *ti = r->r_TableI;
+    RawData *rd = ti->ti_RData;
+    Table *tab = ti->ti_RanBeg.p_Tab;
+    PScanWorker *pws;
+    PScan *ps;
+    BatchScan *bs;
+    dboff_t beg;
+    dboff_t end;
+    dboff_t ro;
+    int nblocks;
+    int nw;
+    int error;
+    char mode;
+    int i;
+    int j;
+
+    if (ti->ti_ScanOneOnly != 0 || ti->ti_RanBeg.p_Ro <= 0)
+	return(-1);
+    if ((nw = psWorkers()) < 2)
+	return(-1);
+
+    /*
+     * Count the blocks in the range and split them into runs of at
+     * least PS_MINBLOCKS.
+     */
+    beg = ti->ti_RanBeg.p_Ro;
+    end = ti->ti_RanEnd.p_Ro;
+    nblocks = 0;
+    for (
+	ro = beg & ~(dboff_t)(tab->ta_Meta->tf_BlockSize - 1);
+	ro < end;
+	ro = tab->ta_NextBlock(tab, NULL, ro)
+    ) {
+	++nblocks;
+    }
+    if (nw > nblocks / PS_MINBLOCKS)
+	nw = nblocks / PS_MINBLOCKS;
+    if (nw < 2)
+	return(-1);
+    if ((bs = BatchScanOpen(r)) == NULL)
+	return(-1);
+
+    ps = zalloc(sizeof(PScan));
+    ps->ps_NW = nw;
+    pws = ps->ps_Workers;
+    pws[0].pw_Beg = beg;
+    pws[nw-1].pw_End = end;
+    ro = beg & ~(dboff_t)(tab->ta_Meta->tf_BlockSize - 1);
+    for (i = 0, j = 1; j < nw; ++i) {
+	if (i == (int)((int64_t)nblocks * j / nw)) {
+	    pws[j-1].pw_End = ro;
+	    pws[j].pw_Beg = ro;
+	    ++j;
+	}
+	ro = tab->ta_NextBlock(tab, NULL, ro);
+    }
+
+    /*
+     * Start the workers and wait for their deletions.  Until the
+     * deletions are saved the scan can still be left to the caller.
+     */
+    for (i = 0; i < nw; ++i)
+	pws[i].pw_Fd = -1;
+    error = 0;
+    for (i = 0; i < nw && error == 0; ++i)
+	error = psStart(ps, &pws[i], r, bs);
+    if (error == 0)
+	error = psDeletes(ps);
+
+    if (error == 0) {
+	psSaveDeletes(ps, r);
+	if (r->r_DelHash->dh_Count)
+	    mode = PSM_ALL;
+	else if (psCountable(r, bs))
+	    mode = PSM_COUNT;
+	else
+	    mode = PSM_SEL;
+	for (i = 0; i < nw; ++i)
+	    (void)write(pws[i].pw_Fd, &mode, 1);
+	*pcount = psRecords(ps, r, bs, mode);
+	ti->ti_DebugScanCount += ps->ps_Scanned;
+	if (rd->rd_Map)
+	    rd->rd_Map->dm_Table->ta_RelDataMap(&rd->rd_Map, 0);
+    }
+
+    for (i = 0; i < nw; ++i) {
+	psReap(&pws[i], 1);
+	safe_free(&pws[i].pw_Buf);
+    }
+    if (ps->ps_Dels)
+	free(ps->ps_Dels);
+    zfree(ps, sizeof(PScan));
+    BatchScanClose(bs);
+    return(error);
+}
+
+/*
+ * psWorkers() - number of workers a scan may use
+ */
+static int
+psWorkers(void)
+{
+    if (PScanWorkers < 0) {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	PScanWorkers = (n > 0) ? (int)n : 1;
+    }
+    if (PScanWorkers > PS_MAXWORKERS)
+	return(PS_MAXWORKERS);
+    return(PScanWorkers);
+}
+
+/*
+ * psCountable() - may the workers count the records themselves
+ *
+ *	The terminator must be the plain COUNT of TermRange(), which just
+ *	counts each record unless a LIMIT applies.
+ */
+static int
+psCountable(Range *r, BatchScan *bs)
+{
+    Query *q = r->r_TableI->ti_Query;
+
+    if (q == NULL || q->q_TermOp != QOP_COUNT)
+	return(0);
+    if (bs->bs_Last->r_RunRange != TermRange)
+	return(0);
+    if ((q->q_Flags & (QF_WITH_LIMIT|QF_WITH_ORDER)) == QF_WITH_LIMIT)
+	return(0);
+    return(1);
+}
+
+/*
+ * psStart() - fork a worker for pw's run of blocks
+ */
+static int
+psStart(PScan *ps, PScanWorker *pw, Range *r, BatchScan *bs)
+{
+    int fds[2];
+    int i;
+
+    if (socketpair(PF_LOCAL, SOCK_STREAM, 0, fds) < 0)
+	return(-1);
+    if ((pw->pw_Pid = t_fork()) == 0) {
+	close(fds[0]);
+	for (i = 0; i < ps->ps_NW; ++i) {
+	    if (ps->ps_Workers[i].pw_Fd >= 0)
+		close(ps->ps_Workers[i].pw_Fd);
+	}
+	psWorker(r, bs, fds[1], pw->pw_Beg, pw->pw_End);
+	/* not reached */
+    }
+    close(fds[1]);
+    if (pw->pw_Pid < 0) {
+	pw->pw_Pid = 0;
+	close(fds[0]);
+	return(-1);
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    pw->pw_Fd = fds[0];
+    pw->pw_Buf = safe_malloc(PS_BUFBYTES);
+    return(0);
+}
+
+/*
+ * psWorker() - scan [beg, end) and write the entries to fd, then exit
+ *
+ *	This runs in the child.  The scheduler's interval timer is not
+ *	inherited, the quantums are maxed so the scan never switches to
+ *	another task.  The table instance is our own copy, so the range
+ *	is simply narrowed to the run.  Task stacks are small, the entries
+ *	are buffered on the heap.
+ *
+ *	For PSM_COUNT the commit test is made here, on our copy of the
+ *	database state, and the records the terminator would have counted
+ *	are counted instead of sent, see BatchRunRecord().
+ */
+static void
+psWorker(Range *r, BatchScan *bs, int fd, dboff_t beg, dboff_t end)
+{
+    TableI *ti = r->r_TableI;
+    DataMap *dm = NULL;
+    dboff_t *buf;
+    int64_t scanned = 0;
+    int64_t counted = 0;
+    char mode = 0;
+    int pass;
+    int n;
+    int i;
+
+    TaskQuantum = 0x7FFFFFFF;
+    IOQuantum = 0x7FFFFFFF;
+
+    ti->ti_RanEnd.p_Ro = end;
+    ti->ti_Append = end;
+    buf = safe_malloc((PS_BUFENTS + PS_TRAILERENTS) * sizeof(dboff_t));
+    n = 0;
+
+    /*
+     * The first pass sends the deletions, the second what the mode
+     * the database process sends back asks for.
+     */
+    for (pass = 0; pass < 2; ++pass) {
+	scanned = ti->ti_DebugScanCount;
+	ti->ti_RanBeg.p_Ro = beg;
+	SelectBegTableRec(ti, 0);
+	while (ti->ti_RanBeg.p_Ro > 0) {
+	    BatchScanNext(bs, r, &dm);
+	    for (i = 0; i < bs->bs_NRecs; ++i) {
+		const RecHead *rh = bs->bs_Rh[i];
+		dboff_t e;
+
+		if (BATCH_TEST(bs->bs_Pass, i) == 0)
+		    continue;
+		e = bs->bs_Ro[i] << PS_SHIFT;
+		if (BATCH_TEST(bs->bs_Sel, i))
+		    e |= PS_SEL;
+		if (rh->rh_Flags & RHF_DELETE)
+		    e |= PS_DELETE;
+
+		if (pass == 0) {
+		    if ((e & PS_DELETE) == 0)
+			continue;
+		} else if (mode != PSM_ALL) {
+		    if ((e & PS_SEL) == 0)
+			continue;
+		    if (mode == PSM_COUNT) {
+			ti->ti_RData->rd_Rh = rh;
+			if (RecordIsValidForCommitTestOnly(ti) >= 0) {
+			    if ((e & PS_DELETE) == 0)
+				++counted;
+			    continue;
+			}
+		    }
+		}
+		buf[n++] = e;
+		if (n == PS_BUFENTS) {
+		    if (psWrite(fd, buf, n * sizeof(dboff_t)) < 0)
+			_exit(1);
+		    n = 0;
+		}
+	    }
+	}
+	if (pass == 0) {
+	    buf[n++] = PS_DELEND;
+	    if (psWrite(fd, buf, n * sizeof(dboff_t)) < 0)
+		_exit(1);
+	    n = 0;
+	    for (;;) {
+		ssize_t k = read(fd, &mode, 1);
+
+		if (k == 1)
+		    break;
+		if (k < 0 && errno == EINTR)
+		    continue;
+		_exit(1);
+	    }
+	}
+    }
+    buf[n++] = PS_TRAILER;
+    buf[n++] = ti->ti_DebugScanCount - scanned;
+    buf[n++] = counted;
+    if (psWrite(fd, buf, n * sizeof(dboff_t)) < 0)
+	_exit(1);
+    _exit(0);
+}
+
+static int
+psWrite(int fd, const void *buf, size_t bytes)
+{
+    while (bytes) {
+	ssize_t n = write(fd, buf, bytes);
+
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return(-1);
+	}
+	buf = (const char *)buf + n;
+	bytes -= n;
+    }
+    return(0);
+}
+
+/*
+ * psFill() - read whatever the workers have sent into their buffers
+ *
+ *	The descriptors are non-blocking.  A worker whose buffer is full
+ *	is left alone.  If nothing could be read we wait in poll() for a
+ *	short while, letting the other tasks run if nothing turns up.
+ *
+ *	Returns -1 if wpw's pipe is closed and its buffer cannot be added
+ *	to, else 0.
+ */
+static int
+psFill(PScan *ps, PScanWorker *wpw)
+{
+    struct pollfd pfds[PS_MAXWORKERS];
+    int progress = 0;
+    int live = 0;
+    int i;
+
+    for (i = 0; i < ps->ps_NW; ++i) {
+	PScanWorker *pw = &ps->ps_Workers[i];
+	ssize_t n;
+
+	if (pw->pw_Fd < 0)
+	    continue;
+	if (pw->pw_Off) {
+	    bcopy(pw->pw_Buf + pw->pw_Off, pw->pw_Buf,
+		  pw->pw_Bytes - pw->pw_Off);
+	    pw->pw_Bytes -= pw->pw_Off;
+	    pw->pw_Off = 0;
+	}
+	if (pw->pw_Bytes == PS_BUFBYTES)
+	    continue;
+	n = read(pw->pw_Fd, pw->pw_Buf + pw->pw_Bytes,
+		 PS_BUFBYTES - pw->pw_Bytes);
+	if (n > 0) {
+	    pw->pw_Bytes += n;
+	    progress = 1;
+	} else if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+	    pfds[live].fd = pw->pw_Fd;
+	    pfds[live].events = POLLIN;
+	    pfds[live].revents = 0;
+	    ++live;
+	} else {
+	    close(pw->pw_Fd);
+	    pw->pw_Fd = -1;
+	    progress = 1;
+	}
+    }
+    if (wpw && wpw->pw_Fd < 0)
+	return(-1);
+    if (progress)
+	taskQuantum();
+    else if (live && poll(pfds, live, PS_POLLMS) == 0)
+	taskGiveup();
+    return(0);
+}
+
+/*
+ * psDeletes() - collect the first pass of every worker
+ *
+ *	Returns -1 if a worker fails before it has sent PS_DELEND.
+ */
+static int
+psDeletes(PScan *ps)
+{
+    int i;
+
+    for (;;) {
+	int waiting = 0;
+
+	for (i = 0; i < ps->ps_NW; ++i) {
+	    PScanWorker *pw = &ps->ps_Workers[i];
+
+	    while (pw->pw_State == PWS_DELETES &&
+		   pw->pw_Bytes - pw->pw_Off >= (int)sizeof(dboff_t)) {
+		dboff_t e;
+
+		bcopy(pw->pw_Buf + pw->pw_Off, &e, sizeof(e));
+		pw->pw_Off += sizeof(e);
+		if (e == PS_DELEND) {
+		    pw->pw_State = PWS_RECORDS;
+		    break;
+		}
+		if (ps->ps_NDels == ps->ps_MaxDels) {
+		    ps->ps_MaxDels = ps->ps_MaxDels ?
+				     ps->ps_MaxDels * 2 : PS_BUFENTS;
+		    ps->ps_Dels = safe_realloc(ps->ps_Dels,
+				     ps->ps_MaxDels * sizeof(dboff_t));
+		}
+		ps->ps_Dels[ps->ps_NDels++] = e;
+	    }
+	    if (pw->pw_State == PWS_DELETES) {
+		if (pw->pw_Fd < 0)
+		    return(-1);
+		waiting = 1;
+	    }
+	}
+	if (waiting == 0)
+	    break;
+	psFill(ps, NULL);
+    }
+    return(0);
+}
+
+/*
+ * psSaveDeletes() - the deletion pass of DefaultIndexScanRangeOp1()
+ *
+ *	The workers have already dropped the records not satisfying r.
+ *	The delete hash does not care about the order deletions are
+ *	saved in.
+ */
+static void
+psSaveDeletes(PScan *ps, Range *r)
+{
+    TableI *ti = r->r_TableI;
+    RawData *rd = ti->ti_RData;
+    int i;
+
+    for (i = 0; i < ps->ps_NDels; ++i) {
+	dboff_t e = ps->ps_Dels[i];
+
+	/*
+	 * cooperative multitasking
+	 */
+	taskQuantum();
+
+	ti->ti_RanBeg.p_Ro = e >> PS_SHIFT;
+	ReadDataRecord(rd, &ti->ti_RanBeg, 0);
+
+	/*
+	 * Check for commit conflict, see DefaultIndexScanRangeOp1().
+	 */
+	if (RecordIsValidForCommitTestOnly(ti) < 0) {
+	    if (e & PS_SEL)
+		RecordIsValidForCommit(ti);
+	    continue;
+	}
+	DBASSERT(r->r_DelHash != NULL);
+	SaveDelHash(r->r_DelHash, &ti->ti_RanBeg, rd->rd_Rh);
+    }
+}
+
+/*
+ * psRecords() - run the second pass entries in table order
+ *
+ *	This is the record pass of DefaultIndexScanRangeOp1() for the
+ *	entries mode has the workers send (see pscan.h), with PSM_COUNT
+ *	the workers' counts are added in as the terminator would have.
+ *	The workers are reaped as they finish.  If the terminator stops
+ *	the scan the remaining workers are killed by our caller.
+ */
+static int
+psRecords(PScan *ps, Range *r, BatchScan *bs, int mode)
+{
+    TableI *ti = r->r_TableI;
+    RawData *rd = ti->ti_RData;
+    Query *q = ti->ti_Query;
+    int count = 0;
+    int rv = 0;
+    int i;
+
+    for (i = 0; i < ps->ps_NW && rv >= 0; ++i) {
+	PScanWorker *pw = &ps->ps_Workers[i];
+
+	while (pw->pw_State == PWS_RECORDS) {
+	    int avail = pw->pw_Bytes - pw->pw_Off;
+	    dboff_t e = 0;
+
+	    /*
+	     * Wait for a whole entry, or a whole trailer.
+	     */
+	    if (avail >= (int)sizeof(e))
+		bcopy(pw->pw_Buf + pw->pw_Off, &e, sizeof(e));
+	    if (avail < (int)sizeof(e) ||
+		(e == PS_TRAILER &&
+		 avail < (int)(PS_TRAILERENTS * sizeof(e)))
+	    ) {
+		if (psFill(ps, pw) < 0)
+		    break;
+		continue;
+	    }
+	    pw->pw_Off += sizeof(e);
+	    if (e == PS_TRAILER) {
+		bcopy(pw->pw_Buf + pw->pw_Off, &e, sizeof(e));
+		pw->pw_Off += sizeof(e);
+		ps->ps_Scanned += e;
+		bcopy(pw->pw_Buf + pw->pw_Off, &e, sizeof(e));
+		pw->pw_Off += sizeof(e);
+		if (mode == PSM_COUNT) {
+		    count += (int)e;
+		    q->q_CountRows += (int)e;
+		}
+		pw->pw_State = PWS_DONE;
+		break;
+	    }
+	    ti->ti_RanBeg.p_Ro = e >> PS_SHIFT;
+	    ReadDataRecord(rd, &ti->ti_RanBeg, 0);
+	    if (mode != PSM_COUNT)
+		pw->pw_Last = ti->ti_RanBeg.p_Ro;
+	    rv = BatchRunRecord(bs, r, (e & PS_SEL) != 0);
+	    if (rv < 0)
+		break;
+	    count += rv;
+	}
+	if (rv < 0)
+	    break;
+	if (pw->pw_State == PWS_DONE) {
+	    psReap(pw, 0);
+	    continue;
+	}
+
+	/*
+	 * The worker failed part way through its second pass, stop the
+	 * rest and finish the scan here.  With PSM_COUNT nothing of the
+	 * worker's run has been counted, the commit failures it sent are
+	 * simply checked again.
+	 */
+	dbwarning("Parallel scan worker %d failed, continuing locally\n",
+	    (int)pw->pw_Pid);
+	for (; i < ps->ps_NW; ++i)
+	    psReap(&ps->ps_Workers[i], 1);
+	rv = psLocal(r, bs, (pw->pw_Last ? pw->pw_Last : pw->pw_Beg),
+		     pw->pw_Last);
+	if (rv >= 0)
+	    count += rv;
+	break;
+    }
+    if (rv < 0)
+	count = rv;
+    return(count);
+}
+
+/*
+ * psLocal() - run the record pass from beg to the end of the range
+ *
+ *	Records at or before last have already been run.  This follows
+ *	BatchScanRange().
+ */
+static int
+psLocal(Range *r, BatchScan *bs, dboff_t beg, dboff_t last)
+{
+    TableI *ti = r->r_TableI;
+    RawData *rd = ti->ti_RData;
+    DataMap *dm = NULL;
+    int count = 0;
+    int rv = 0;
+
+    ti->ti_RanBeg.p_Ro = beg;
+    SelectBegTableRec(ti, 0);
+
+    while (ti->ti_RanBeg.p_Ro > 0) {
+	dbpos_t next;
+	int i;
+
+	/*
+	 * cooperative multitasking
+	 */
+	taskQuantum();
+
+	BatchScanNext(bs, r, &dm);
+	next = ti->ti_RanBeg;
+
+	for (i = 0; i < bs->bs_NRecs; ++i) {
+	    if (BATCH_TEST(bs->bs_Pass, i) == 0 || bs->bs_Ro[i] <= last)
+		continue;
+	    ti->ti_RanBeg.p_Ro = bs->bs_Ro[i];
+	    rd->rd_Rh = bs->bs_Rh[i];
+	    rv = BatchRunRecord(bs, r, BATCH_TEST(bs->bs_Sel, i) != 0);
+	    if (rv < 0)
+		break;
+	    count += rv;
+	}
+
+	ti->ti_RanBeg = next;
+	if (rv < 0) {
+	    count = rv;
+	    break;
+	}
+    }
+    if (dm)
+	dm->dm_Table->ta_RelDataMap(&dm, 0);
+    return(count);
+}
+
+/*
+ * psReap() - close a worker's pipe and wait for it, killing it first
+ *	      if killMe is set
+ */
+static void
+psReap(PScanWorker *pw, int killMe)
+{
+    int status;
+
+    if (pw->pw_Fd >= 0) {
+	close(pw->pw_Fd);
+	pw->pw_Fd = -1;
+    }
+    if (pw->pw_Pid <= 0)
+	return;
+    if (killMe)
+	kill(pw->pw_Pid, SIGKILL);
+    while (waitpid(pw->pw_Pid, &status, 0) < 0) {
+	if (errno != EINTR)
+	    break;
+    }
+    pw->pw_Pid = 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * LIBDBCORE/PSCAN.H	- Parallel scan of a large table
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ * Notes on parallel scans:
+ *
+ *	When a range qualifies for a batched scan (see batch.h) and the
+ *	unindexed part of the table spans at least PS_MINBLOCKS blocks
+ *	per worker, DefaultIndexScanRangeOp1() hands the whole scan to
+ *	ParallelScanRange().  The blocks are split into contiguous runs,
+ *	walking them with ta_FirstBlock()/ta_NextBlock() style offsets,
+ *	and each run is given to a forked worker process.  The workers
+ *	share the table files (and a copy-on-write image of memory
+ *	tables) with the database process.
+ *
+ *	Parallel scans are off unless drd_database is given -p (see
+ *	SetParallelScan()).
+ *
+ *	A worker makes the same two passes over its run as the serial
+ *	scan, talking to the database process over a socket pair.  The
+ *	first pass writes an entry for each deletion record satisfying
+ *	the first range, followed by PS_DELEND.  The worker then waits
+ *	for a PSM_* byte telling it what the second pass should send, in
+ *	table order, before a trailer.
+ *
+ *	The database process saves the deletions in the delete hash once
+ *	every worker has sent PS_DELEND.  Until then nothing has been
+ *	done that the normal scan would repeat, so if a worker cannot be
+ *	started or fails the workers are killed and the table is scanned
+ *	normally.  The deletion entries are held until then, which costs
+ *	less than the delete hash they end up in.
+ *
+ *	With no deletions pending in the delete hash a record can only
+ *	reach the terminator if it satisfies every range, so the second
+ *	pass sends just those (PSM_SEL).  A record and its deletion hold
+ *	the same column data, so one satisfies the ranges exactly when
+ *	the other does.  For a plain COUNT the workers count the records
+ *	themselves and send only the ones failing the commit test
+ *	(PSM_COUNT), the counts arrive in the trailers.  Otherwise every
+ *	record satisfying the first range is sent so the deletions can be
+ *	matched up (PSM_ALL).
+ *
+ *	The second pass entries are run through the deletion and commit
+ *	checks and the terminator as they arrive, one worker's run after
+ *	another.  Each worker has a PS_BUFBYTES buffer, a worker
+ *	whose buffer is full blocks in write() until its entries are
+ *	used.  If the terminator stops the scan (a LIMIT, or an error)
+ *	the remaining workers are killed.  A worker failing at this point
+ *	is killed along with the later ones and the database process
+ *	scans the rest of the range itself, starting after the last
+ *	record run.
+ */
+
+#define PS_MAXWORKERS		16
+#define PS_MINBLOCKS		16		/* blocks per worker */
+#define PS_BUFENTS		4096		/* entries per write */
+#define PS_BUFBYTES		(256 * 1024)	/* entries held per worker */
+#define PS_POLLMS		10
+
+/*
+ * An entry is the record offset shifted left by PS_SHIFT plus flags.
+ * PS_DELEND ends the deletions, the trailer is PS_TRAILER followed by
+ * the number of records scanned by the second pass and, for PSM_COUNT,
+ * the number of records counted.
+ */
+#define PS_SEL			0x1		/* satisfies every range */
+#define PS_DELETE		0x2		/* deletion record */
+#define PS_SHIFT		2
+#define PS_TRAILER		((dboff_t)-1)
+#define PS_DELEND		((dboff_t)-2)
+#define PS_TRAILERENTS		3
+
+#define PSM_ALL			'A'		/* satisfying r */
+#define PSM_SEL			'S'		/* satisfying every range */
+#define PSM_COUNT		'C'		/* count, send commit failures */
+
+#define PWS_DELETES		0		/* receiving deletions */
+#define PWS_RECORDS		1		/* receiving records */
+#define PWS_DONE		2		/* trailer received */
+
+typedef struct PScanWorker {
+    pid_t	pw_Pid;		/* worker, or 0 once reaped */
+    int		pw_Fd;		/* our side of the socket pair, or -1 */
+    int		pw_State;	/* PWS_* */
+    dboff_t	pw_Beg;		/* first record or block */
+    dboff_t	pw_End;		/* end of run */
+    dboff_t	pw_Last;	/* last record run (not PSM_COUNT), or 0 */
+    char	*pw_Buf;	/* entries received, PS_BUFBYTES */
+    int		pw_Off;		/* first unused byte */
+    int		pw_Bytes;	/* end of received bytes */
+} PScanWorker;
+
+typedef struct PScan {
+    PScanWorker	ps_Workers[PS_MAXWORKERS];
+    int		ps_NW;
+    dboff_t	*ps_Dels;	/* deletion entries */
+    int		ps_NDels;
+    int		ps_MaxDels;
+    int64_t	ps_Scanned;	/* from the trailers */
+} PScan;
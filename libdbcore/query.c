@@ -24,6 +24,8 @@ Prototype int PopQuery(Query *q, int commitMe);
 Prototype ColData *GetConst(Query *q, const void *data, int bytes);
 Prototype ColData *GetConstUnEscape(Query *q, const void *data, int bytes);
 Prototype ColData *DupConst(Query *q, const ColData *cd);
+Prototype ColData *GetParam(Query *q);
+Prototype int ConvertConst(Query *q, ColData **pcd, int dataType);
 Prototype TableI *GetTableIQuick(Query *q, Table *tab, vtable_t vid, col_t *cols, int count);
 Prototype RawData *AllocRawData(Table *tab, col_t *cols, int count);
 Prototype ColData *GetRawDataCol(RawData *rd, col_t colId, int dataType);
@@ -133,6 +135,7 @@ ResetQuery(Query *q)
      * columns underlying tables).
      */
 
+    FreeAggregate(q);
     LLFreeTableI(&q->q_TableIQBase);
     LLFreeSchemaI(&q->q_FirstSchemaI);
     q->q_DefSchemaI = NULL;
@@ -163,6 +166,12 @@ ResetQuery(Query *q)
 	}
     }
 
+    if (q->q_Params) {
+	free(q->q_Params);
+	q->q_Params = NULL;
+    }
+    q->q_NParams = 0;
+
     FreeResultBuffer(q);
     q->q_Error = 0;
     q->q_Flags = 0;
@@ -362,6 +371,60 @@ DupConst(Query *q, const ColData *ocd)
     return(cd);
 }
 
+/*
+ * GetParam() -	Create the place holder for a '?' query parameter
+ *
+ *	The place holder is a NULL constant flagged RDF_PARAM.  Parameters
+ *	are numbered in the order they are parsed, the values are supplied
+ *	when a prepared query is instantiated (see prepare.c).
+ */
+
+ColData *
+GetParam(Query *q)
+{
+    ColData *cd = GetConst(q, NULL, 0);
+
+    cd->cd_Flags |= RDF_PARAM;
+    q->q_Params = safe_realloc(q->q_Params,
+			sizeof(ColData *) * (q->q_NParams + 1));
+    q->q_Params[q->q_NParams++] = cd;
+    return(cd);
+}
+
+/*
+ * ConvertConst() - Convert a constant to the data type of the column
+ *		    it is stored into or compared against.
+ *
+ *	Constants are parsed as text.  Binary data types get a new constant
+ *	holding the value in binary, the original is left on the constant
+ *	list.  NULL stays NULL and a parameter is only tagged with the type,
+ *	its value is converted when it is bound.  Returns DBERR_BAD_VALUE if
+ *	the text is not a valid value of the type.
+ */
+
+int
+ConvertConst(Query *q, ColData **pcd, int dataType)
+{
+    ColData *cd = *pcd;
+    char buf[DATATYPE_BINSIZE];
+    int n;
+
+    if (!DATATYPE_BINARY(dataType) || cd->cd_DataType == dataType)
+	return(0);
+    if (cd->cd_Flags & RDF_PARAM) {
+	cd->cd_DataType = dataType;
+	return(0);
+    }
+    if (cd->cd_Data == NULL)
+	return(0);
+    if ((n = DataTypeFromString(dataType, cd->cd_Data, cd->cd_Bytes, buf)) < 0)
+	return(DBERR_BAD_VALUE);
+    cd = GetConst(q, buf, n);
+    cd->cd_DataType = dataType;
+    *pcd = cd;
+    return(0);
+}
+
 /*
  * GetTableIQuick() - create a quick tableI structure for a table
  *
@@ -486,6 +549,8 @@ FreeRawData(RawData *rd)
 	    pcd = &cd->cd_Next;
 	}
     }
+    if (rd->rd_CoverBuf)
+	zfree(rd->rd_CoverBuf, RD_COVERSIZE);
     zfree(rd, rd->rd_AllocSize);
 }
 
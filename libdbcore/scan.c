@@ -23,6 +23,7 @@ Prototype int OpLtEqStampMatch(const ColData *d1, const ColData *d2);
 
 Prototype int TermRange(RangeArg ra);
 
+static int TermRangeSelect(Query *q);
 static int TermRangeCounter(Query *q);
 static int TermRangeInsert(Query *q);
 static int TermRangeDelete(Query *q);
@@ -46,6 +47,15 @@ RunQuery(Query *q)
 	ti->ti_Rewind = ti->ti_Table->ta_Append;
     }
     r = q->q_RunRange(q->q_RangeArg);
+    for (ti = q->q_TableIQBase; ti; ti = ti->ti_Next)
+	FreeHashJoin(ti);
+
+    /*
+     * Aggregating selections only return their groups once every
+     * record has been seen.
+     */
+    if (q->q_Agg && q->q_TermOp == QOP_SELECT)
+	r = EmitAggregates(q, r, TermRangeSelect);
 
     /*
      * A negative return value can occur for a number of reasons but it is
@@ -80,18 +90,9 @@ TermRange(RangeArg ra)
 
     switch(q->q_TermOp) {
     case QOP_SELECT:
-	if ((q->q_Flags & (QF_WITH_LIMIT|QF_WITH_ORDER)) == QF_WITH_LIMIT) {
-	    if (q->q_CountRows < q->q_StartRow) {
-		++q->q_CountRows;
-		return(0);
-	    }
-	    if (q->q_CountRows >= q->q_MaxRows + q->q_StartRow)
-		return(DBERR_LIMIT_ABORT);
-	}
-	++q->q_CountRows;
-	if (q->q_TermFunc)
-	    return(q->q_TermFunc(q));
-	return(TermRangeCounter(q));
+	if (q->q_Agg)
+	    return(TermRangeAggregate(q));
+	return(TermRangeSelect(q));
     case QOP_COUNT:
 	if ((q->q_Flags & (QF_WITH_LIMIT|QF_WITH_ORDER)) == QF_WITH_LIMIT) {
 	    if (q->q_CountRows < q->q_StartRow) {
@@ -154,10 +155,16 @@ RunRange(RangeArg a)
      * prime the range.
      *
      * Additional indexed restrictions may be emplaced on the table instance
-     * only for expressions operating on the same column.  This is handled
-     * through the i_UpdateTableRange() call.
+     * only for expressions operating on the same column, or on the other
+     * columns of a compound index.  This is handled through the
+     * i_UpdateTableRange() call.
+     *
+     * The inner side of an equality join may instead be answered from
+     * a hash of the table built on the fly, see HashJoinRange().
      */
-    if (r->r_PrevSame == NULL) {
+    if (r->r_PrevSame == NULL && HashJoinRange(r, &count) == 0) {
+	/* answered from the join hash */
+    } else if (r->r_PrevSame == NULL) {
 	DelHash delHash;
 	int rv;
 
@@ -284,6 +291,26 @@ TermRangeCounter(Query *q)
     }
 }
 
+/*
+ * TermRangeSelect() - return a selected record (or aggregated group)
+ */
+static int
+TermRangeSelect(Query *q)
+{
+    if ((q->q_Flags & (QF_WITH_LIMIT|QF_WITH_ORDER)) == QF_WITH_LIMIT) {
+	if (q->q_CountRows < q->q_StartRow) {
+	    ++q->q_CountRows;
+	    return(0);
+	}
+	if (q->q_CountRows >= q->q_MaxRows + q->q_StartRow)
+	    return(DBERR_LIMIT_ABORT);
+    }
+    ++q->q_CountRows;
+    if (q->q_TermFunc)
+	return(q->q_TermFunc(q));
+    return(TermRangeCounter(q));
+}
+
 static int
 TermRangeInsert(Query *q)
 {
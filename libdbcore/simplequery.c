@@ -109,8 +109,14 @@ SSTermRange(Query *q)
     for (ci = q->q_ColIQBase; ci; ci = ci->ci_QNext) {
 	ColData *ccd;
 
-	if ((ccd = ci->ci_CData) && ccd->cd_Data)
-	    rows[cols] = safe_strndup(ccd->cd_Data, ccd->cd_Bytes);
+	if ((ccd = ci->ci_CData) && ccd->cd_Data) {
+	    char buf[DATATYPE_FMTSIZE];
+
+	    if (DataTypeToString(ci->ci_DataType, ccd, buf) >= 0)
+		rows[cols] = safe_strdup(buf);
+	    else
+		rows[cols] = safe_strndup(ccd->cd_Data, ccd->cd_Bytes);
+	}
 	++cols;
     }
     return(1);
@@ -0,0 +1,606 @@
+/*
+ * LIBDBCORE/STATS.C	- Gather and cache planner statistics
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	AnalyzeTable() implements the ANALYZE command, GetTableStats()
+ *	hands the statistics of a table instance to the query planner.
+ *	See stats.h.
+ */
+
+#include "defs.h"
+#include "stats.h"
+
+Prototype int AnalyzeTable(Query *q, TableI *ti);
+Prototype struct TableStats *GetTableStats(TableI *ti);
+Prototype void StatsCommitRecord(Table *tab, const RecHead *rh);
+Prototype void FreeTableStats(Table *tab);
+
+static int statsTermRange(Query *q);
+static void statsInitCollect(StatsCollect *sc, Query *q);
+static void statsAddValue(StatsCollect *sc, ColCollect *cc, const ColData *cd);
+static void statsDoneCollect(StatsCollect *sc);
+static TableStats *statsBuild(StatsCollect *sc, vtable_t vt);
+static int statsStore(Query *q, TableI *ti, StatsCollect *sc, TableStats *ts);
+static void statsInstall(TableI *ti, TableStats *ts);
+static void statsFree(TableStats *ts);
+static void statsLoadCallBack(void *data, RawData *rd);
+static int64_t statsNumber(const ColData *cd, int base);
+static void statsParseBounds(ColStats *cs, const ColData *cd);
+static void statsFormatBounds(const ColStats *cs, char *buf);
+static int statsHexDigit(int c);
+static int64_t statsEstimate(const ColCollect *cc);
+static int statsKeyCmp(const void *k1, const void *k2);
+static u_int64_t statsHash(const ColData *cd);
+static Table *statsRootTable(Table *tab);
+
+/*
+ * AnalyzeTable() - gather statistics for a table and store them
+ *
+ *	Every visible record of the table instance is read with a
+ *	SELECT * at the holder query's transaction level.  The table's
+ *	rows in sys.stats are replaced and the cached statistics on the
+ *	root table are updated.  Returns a negative error code on failure.
+ */
+int
+AnalyzeTable(Query *q, TableI *ti)
+{
+    StatsCollect sc;
+    TableStats *ts;
+    Query *sq;
+    char *qry = NULL;
+    token_t t;
+    int error;
+    int type;
+
+    bzero(&sc, sizeof(sc));
+    sc.sc_Rand = 0x5DEECE66DULL;
+
+    safe_asprintf(&qry, "SELECT * FROM %s.%s",
+	ti->ti_SchemaI->si_ScmName, ti->ti_TabName);
+    sq = GetQuery(q->q_Db);
+    type = ParseSql(&t, sq, SqlInit(&t, qry, strlen(qry) + 1));
+    free(qry);
+    if (type & TOKF_ERROR) {
+	FreeQuery(sq);
+	return(-(int)(type & TOKF_ERRMASK));
+    }
+    sq->q_TermFunc = statsTermRange;
+    sq->q_TermInfo = &sc;
+
+    /*
+     * The column names of the stored rows come from the scan query,
+     * so store before releasing it.
+     */
+    if ((error = RunQuery(sq)) >= 0) {
+	ts = statsBuild(&sc, ti->ti_VTable);
+	if ((error = statsStore(q, ti, &sc, ts)) < 0)
+	    statsFree(ts);
+	else
+	    statsInstall(ti, ts);
+    }
+    RelQuery(sq);
+    statsDoneCollect(&sc);
+    return(error);
+}
+
+/*
+ * GetTableStats() - return the statistics of a table instance
+ *
+ *	Returns NULL if the table has not been analyzed.  The first
+ *	lookup of a vtable loads its rows from sys.stats, the result
+ *	(including a negative one) is cached on the root table.
+ */
+TableStats *
+GetTableStats(TableI *ti)
+{
+    TableStats *ts;
+    Table *tab;
+
+    if (ti->ti_Table == NULL)
+	return(NULL);
+    tab = statsRootTable(ti->ti_Table);
+    for (ts = tab->ta_Stats; ts; ts = ts->ts_Next) {
+	if (ts->ts_VTable == ti->ti_VTable)
+	    break;
+    }
+    if (ts == NULL) {
+	ts = zalloc(sizeof(TableStats));
+	ts->ts_VTable = ti->ti_VTable;
+	LLGetTableStats(ti->ti_Table->ta_Db, ti, statsLoadCallBack, ts);
+	ts->ts_Next = tab->ta_Stats;
+	tab->ta_Stats = ts;
+    }
+    if ((ts->ts_Flags & TSF_ANALYZED) == 0)
+	return(NULL);
+    return(ts);
+}
+
+/*
+ * StatsCommitRecord() - account for a record committed to a root table
+ *
+ *	Called by Commit2() for each record it writes.  An update is a
+ *	deletion followed by an insertion and nets out to no change.
+ */
+void
+StatsCommitRecord(Table *tab, const RecHead *rh)
+{
+    TableStats *ts;
+
+    for (ts = tab->ta_Stats; ts; ts = ts->ts_Next) {
+	if (ts->ts_VTable == rh->rh_VTableId)
+	    break;
+    }
+    if (ts == NULL || (ts->ts_Flags & TSF_ANALYZED) == 0)
+	return;
+    if (rh->rh_Flags & RHF_DELETE) {
+	if (ts->ts_Rows > 0)
+	    --ts->ts_Rows;
+    } else if (rh->rh_Flags & (RHF_INSERT|RHF_UPDATE)) {
+	++ts->ts_Rows;
+    }
+}
+
+/*
+ * FreeTableStats() - release the cached statistics of a table
+ */
+void
+FreeTableStats(Table *tab)
+{
+    TableStats *ts;
+
+    while ((ts = tab->ta_Stats) != NULL) {
+	tab->ta_Stats = ts->ts_Next;
+	statsFree(ts);
+    }
+}
+
+/*
+ * statsTermRange() - terminator for the ANALYZE scan, one record
+ */
+static int
+statsTermRange(Query *q)
+{
+    StatsCollect *sc = q->q_TermInfo;
+    const RawData *rd = q->q_TableIQBase->ti_RData;
+    int i;
+
+    if (sc->sc_Cols == NULL)
+	statsInitCollect(sc, q);
+    ++sc->sc_Rows;
+    if (rd->rd_Rh)
+	sc->sc_Bytes += rd->rd_Rh->rh_Size;
+    for (i = 0; i < sc->sc_NCols; ++i) {
+	ColCollect *cc = &sc->sc_Cols[i];
+
+	statsAddValue(sc, cc, cc->cc_ColI->ci_CData);
+    }
+    return(1);
+}
+
+static void
+statsInitCollect(StatsCollect *sc, Query *q)
+{
+    ColI *ci;
+    int i;
+
+    for (ci = q->q_ColIQBase; ci; ci = ci->ci_QNext)
+	++sc->sc_NCols;
+    sc->sc_Cols = zalloc(sizeof(ColCollect) * (sc->sc_NCols + 1));
+    for (i = 0, ci = q->q_ColIQBase; ci; ci = ci->ci_QNext, ++i) {
+	ColCollect *cc = &sc->sc_Cols[i];
+
+	cc->cc_ColI = ci;
+	cc->cc_Set = zalloc(sizeof(u_int64_t) * STATS_EXACT * 2);
+	cc->cc_Sample = safe_malloc(sizeof(StatsKey) * STATS_SAMPLE);
+    }
+}
+
+/*
+ * statsAddValue() - add a column value to the distinct count sketches
+ *		     and the histogram sample
+ */
+static void
+statsAddValue(StatsCollect *sc, ColCollect *cc, const ColData *cd)
+{
+    u_int64_t hv;
+    u_int64_t w;
+    int64_t j;
+    int rho;
+
+    if (cd == NULL || cd->cd_Data == NULL) {
+	++cc->cc_Nulls;
+	return;
+    }
+    ++cc->cc_Seen;
+    cc->cc_Bytes += cd->cd_Bytes;
+    hv = statsHash(cd);
+
+    /*
+     * HyperLogLog register: position of the first one bit below the
+     * register index bits.
+     */
+    w = hv << STATS_HLLBITS;
+    for (rho = 1; rho <= 64 - STATS_HLLBITS; ++rho) {
+	if (w & ((u_int64_t)1 << 63))
+	    break;
+	w <<= 1;
+    }
+    j = hv >> (64 - STATS_HLLBITS);
+    if (cc->cc_Regs[j] < rho)
+	cc->cc_Regs[j] = rho;
+
+    /*
+     * Exact distinct count (of hashes) until the set fills up
+     */
+    if (cc->cc_Exact >= 0) {
+	int mask = STATS_EXACT * 2 - 1;
+	int i;
+
+	if (hv == 0)
+	    hv = 1;
+	for (i = hv & mask; cc->cc_Set[i] != 0; i = (i + 1) & mask) {
+	    if (cc->cc_Set[i] == hv)
+		break;
+	}
+	if (cc->cc_Set[i] == 0) {
+	    if (cc->cc_Exact == STATS_EXACT) {
+		cc->cc_Exact = -1;
+		zfree(cc->cc_Set, sizeof(u_int64_t) * STATS_EXACT * 2);
+		cc->cc_Set = NULL;
+	    } else {
+		cc->cc_Set[i] = hv;
+		++cc->cc_Exact;
+	    }
+	}
+    }
+
+    /*
+     * Reservoir sample for the histogram
+     */
+    if (cc->cc_NSample < STATS_SAMPLE) {
+	j = cc->cc_NSample++;
+    } else {
+	sc->sc_Rand = sc->sc_Rand * 6364136223846793005ULL +
+		    1442695040888963407ULL;
+	j = (sc->sc_Rand >> 11) % (u_int64_t)cc->cc_Seen;
+	if (j >= STATS_SAMPLE)
+	    return;
+    }
+    cc->cc_Sample[j].sk_Bytes = (cd->cd_Bytes < STATS_KEYSIZE) ?
+				    cd->cd_Bytes : STATS_KEYSIZE;
+    bcopy(cd->cd_Data, cc->cc_Sample[j].sk_Data, cc->cc_Sample[j].sk_Bytes);
+}
+
+static void
+statsDoneCollect(StatsCollect *sc)
+{
+    int i;
+
+    for (i = 0; i < sc->sc_NCols; ++i) {
+	ColCollect *cc = &sc->sc_Cols[i];
+
+	if (cc->cc_Set)
+	    zfree(cc->cc_Set, sizeof(u_int64_t) * STATS_EXACT * 2);
+	safe_free((char **)&cc->cc_Sample);
+    }
+    if (sc->sc_Cols)
+	zfree(sc->sc_Cols, sizeof(ColCollect) * (sc->sc_NCols + 1));
+    sc->sc_Cols = NULL;
+    sc->sc_NCols = 0;
+}
+
+/*
+ * statsBuild() - turn the collection state into a TableStats
+ *
+ *	The histogram bounds are the minimum, maximum and equally spaced
+ *	quantiles of the sorted sample.
+ */
+static TableStats *
+statsBuild(StatsCollect *sc, vtable_t vt)
+{
+    TableStats *ts = zalloc(sizeof(TableStats));
+    int i;
+
+    ts->ts_VTable = vt;
+    ts->ts_Flags = TSF_ANALYZED;
+    ts->ts_Rows = sc->sc_Rows;
+    if (sc->sc_Rows)
+	ts->ts_AvgSize = sc->sc_Bytes / sc->sc_Rows;
+    ts->ts_NCols = sc->sc_NCols;
+    if (sc->sc_NCols)
+	ts->ts_Cols = safe_malloc(sizeof(ColStats) * sc->sc_NCols);
+
+    for (i = 0; i < sc->sc_NCols; ++i) {
+	ColCollect *cc = &sc->sc_Cols[i];
+	ColStats *cs = &ts->ts_Cols[i];
+	int n = cc->cc_NSample;
+	int j;
+
+	bzero(cs, sizeof(ColStats));
+	cs->cs_ColId = cc->cc_ColI->ci_ColId;
+	cs->cs_Nulls = cc->cc_Nulls;
+	if (cc->cc_Seen)
+	    cs->cs_AvgSize = cc->cc_Bytes / cc->cc_Seen;
+	if (cc->cc_Exact >= 0)
+	    cs->cs_NDV = cc->cc_Exact;
+	else
+	    cs->cs_NDV = statsEstimate(cc);
+
+	if (n == 0)
+	    continue;
+	qsort(cc->cc_Sample, n, sizeof(StatsKey), statsKeyCmp);
+	cs->cs_NBounds = STATS_BUCKETS + 1;
+	for (j = 0; j <= STATS_BUCKETS; ++j)
+	    cs->cs_Bounds[j] = cc->cc_Sample[j * (n - 1) / STATS_BUCKETS];
+    }
+    return(ts);
+}
+
+/*
+ * statsStore() - replace the table's rows in sys.stats
+ */
+static int
+statsStore(Query *q, TableI *ti, StatsCollect *sc, TableStats *ts)
+{
+    const char *scmName = ti->ti_SchemaI->si_ScmName;
+    char buf[(STATS_BUCKETS + 1) * (STATS_KEYSIZE * 2 + 1) + 8];
+    int error;
+    int i;
+
+    ExecuteSql(
+	q,
+	"DELETE FROM sys.stats WHERE SchemaName = '%s' AND TableName = '%s'",
+	scmName,
+	ti->ti_TabName
+    );
+    error = ExecuteSql(
+	q,
+	"INSERT INTO sys.stats ( SchemaName, TableName, ColName, ColId,"
+	" StatRows, StatAvgSize ) VALUES ( '%s', '%s', '" STATS_TABLEROW "',"
+	" '" COL_FMT_STRING "', '%qd', '%d' )",
+	scmName,
+	ti->ti_TabName,
+	0,
+	ts->ts_Rows,
+	ts->ts_AvgSize
+    );
+    for (i = 0; error >= 0 && i < ts->ts_NCols; ++i) {
+	ColStats *cs = &ts->ts_Cols[i];
+
+	buf[0] = 0;
+	if (cs->cs_NBounds)
+	    statsFormatBounds(cs, buf);
+	error = ExecuteSql(
+	    q,
+	    "INSERT INTO sys.stats ( SchemaName, TableName, ColName, ColId,"
+	    " StatNDV, StatNulls, StatAvgSize%s ) VALUES ( '%s', '%s', '%s',"
+	    " '" COL_FMT_STRING "', '%qd', '%qd', '%d'%s%s%s )",
+	    (buf[0] ? ", StatHistogram" : ""),
+	    scmName,
+	    ti->ti_TabName,
+	    sc->sc_Cols[i].cc_ColI->ci_ColName,
+	    cs->cs_ColId,
+	    cs->cs_NDV,
+	    cs->cs_Nulls,
+	    cs->cs_AvgSize,
+	    (buf[0] ? ", '" : ""),
+	    buf,
+	    (buf[0] ? "'" : "")
+	);
+    }
+    return(error);
+}
+
+/*
+ * statsInstall() - replace the cached statistics of the table's vtable
+ */
+static void
+statsInstall(TableI *ti, TableStats *ts)
+{
+    Table *tab = statsRootTable(ti->ti_Table);
+    TableStats **pts;
+    TableStats *scan;
+
+    for (pts = &tab->ta_Stats; (scan = *pts) != NULL; pts = &scan->ts_Next) {
+	if (scan->ts_VTable == ts->ts_VTable) {
+	    *pts = scan->ts_Next;
+	    statsFree(scan);
+	    break;
+	}
+    }
+    ts->ts_Next = tab->ta_Stats;
+    tab->ta_Stats = ts;
+}
+
+static void
+statsFree(TableStats *ts)
+{
+    safe_free((char **)&ts->ts_Cols);
+    zfree(ts, sizeof(TableStats));
+}
+
+/*
+ * statsLoadCallBack() - load one sys.stats row (see LLGetTableStats())
+ *
+ *	vtid, schema, table, colname, colid, rows, ndv, nulls, avgsize,
+ *	histogram
+ */
+static void
+statsLoadCallBack(void *data, RawData *rd)
+{
+    TableStats *ts = data;
+    ColData *cd = rd->rd_ColBase;
+    ColStats *cs;
+
+    cd = cd->cd_Next;	/* skip vtid */
+    cd = cd->cd_Next;	/* skip schema */
+    cd = cd->cd_Next;	/* skip table */
+
+    if (cd->cd_Bytes == sizeof(STATS_TABLEROW) - 1 &&
+	bcmp(cd->cd_Data, STATS_TABLEROW, cd->cd_Bytes) == 0
+    ) {
+	cd = cd->cd_Next->cd_Next;		/* rows */
+	ts->ts_Rows = statsNumber(cd, 10);
+	cd = cd->cd_Next->cd_Next->cd_Next;	/* avgsize */
+	ts->ts_AvgSize = statsNumber(cd, 10);
+	ts->ts_Flags |= TSF_ANALYZED;
+	return;
+    }
+    ts->ts_Cols = safe_realloc(ts->ts_Cols,
+			sizeof(ColStats) * (ts->ts_NCols + 1));
+    cs = &ts->ts_Cols[ts->ts_NCols++];
+    bzero(cs, sizeof(ColStats));
+
+    cd = cd->cd_Next;	/* colid */
+    cs->cs_ColId = statsNumber(cd, 16);
+    cd = cd->cd_Next;	/* rows (unused) */
+    cd = cd->cd_Next;
+    cs->cs_NDV = statsNumber(cd, 10);
+    cd = cd->cd_Next;
+    cs->cs_Nulls = statsNumber(cd, 10);
+    cd = cd->cd_Next;
+    cs->cs_AvgSize = statsNumber(cd, 10);
+    cd = cd->cd_Next;
+    statsParseBounds(cs, cd);
+}
+
+static int64_t
+statsNumber(const ColData *cd, int base)
+{
+    char buf[32];
+
+    if (cd->cd_Data == NULL || cd->cd_Bytes >= sizeof(buf))
+	return(0);
+    bcopy(cd->cd_Data, buf, cd->cd_Bytes);
+    buf[cd->cd_Bytes] = 0;
+    return(strtoll(buf, NULL, base));
+}
+
+/*
+ * statsParseBounds() - decode the comma separated hex histogram bounds
+ */
+static void
+statsParseBounds(ColStats *cs, const ColData *cd)
+{
+    const char *ptr = cd->cd_Data;
+    StatsKey *sk;
+    int i;
+
+    if (ptr == NULL || cd->cd_Bytes == 0)
+	return;
+    sk = &cs->cs_Bounds[0];
+    cs->cs_NBounds = 1;
+    for (i = 0; i < cd->cd_Bytes; ++i) {
+	int c = ptr[i];
+
+	if (c == ',') {
+	    if (cs->cs_NBounds == STATS_BUCKETS + 1)
+		break;
+	    sk = &cs->cs_Bounds[cs->cs_NBounds++];
+	    continue;
+	}
+	if (i + 1 >= cd->cd_Bytes || sk->sk_Bytes == STATS_KEYSIZE)
+	    break;
+	c = (statsHexDigit(c) << 4) | statsHexDigit(ptr[i + 1]);
+	sk->sk_Data[sk->sk_Bytes++] = c;
+	++i;
+    }
+}
+
+static int
+statsHexDigit(int c)
+{
+    if (c >= '0' && c <= '9')
+	return(c - '0');
+    if (c >= 'a' && c <= 'f')
+	return(c - 'a' + 10);
+    if (c >= 'A' && c <= 'F')
+	return(c - 'A' + 10);
+    return(0);
+}
+
+static void
+statsFormatBounds(const ColStats *cs, char *buf)
+{
+    int i;
+    int j;
+
+    for (i = 0; i < cs->cs_NBounds; ++i) {
+	const StatsKey *sk = &cs->cs_Bounds[i];
+
+	if (i)
+	    *buf++ = ',';
+	for (j = 0; j < sk->sk_Bytes; ++j) {
+	    sprintf(buf, "%02x", (u_int8_t)sk->sk_Data[j]);
+	    buf += 2;
+	}
+    }
+    *buf = 0;
+}
+
+/*
+ * statsEstimate() - HyperLogLog estimate of the distinct values
+ *
+ *	Only used once more than STATS_EXACT distinct values have been
+ *	seen, well above the range where the raw estimate needs a small
+ *	cardinality correction.
+ */
+static int64_t
+statsEstimate(const ColCollect *cc)
+{
+    double m = STATS_HLLREGS;
+    double sum = 0.0;
+    double e;
+    int i;
+
+    for (i = 0; i < STATS_HLLREGS; ++i)
+	sum += 1.0 / (double)((u_int64_t)1 << cc->cc_Regs[i]);
+    e = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    if (e > (double)cc->cc_Seen)
+	return(cc->cc_Seen);
+    return((int64_t)e);
+}
+
+static int
+statsKeyCmp(const void *k1, const void *k2)
+{
+    const StatsKey *sk1 = k1;
+    const StatsKey *sk2 = k2;
+    int r;
+
+    r = memcmp(sk1->sk_Data, sk2->sk_Data,
+	    (sk1->sk_Bytes < sk2->sk_Bytes) ? sk1->sk_Bytes : sk2->sk_Bytes);
+    if (r == 0)
+	r = sk1->sk_Bytes - sk2->sk_Bytes;
+    return(r);
+}
+
+/*
+ * statsHash() - 64 bit hash of a column value (FNV-1a and a final mix)
+ */
+static u_int64_t
+statsHash(const ColData *cd)
+{
+    const u_int8_t *ptr = (const u_int8_t *)cd->cd_Data;
+    u_int64_t hv = 0xcbf29ce484222325ULL;
+    int bytes;
+
+    for (bytes = cd->cd_Bytes; bytes > 0; --bytes)
+	hv = (hv ^ *ptr++) * 0x100000001b3ULL;
+    hv ^= hv >> 33;
+    hv *= 0xff51afd7ed558ccdULL;
+    hv ^= hv >> 33;
+    hv *= 0xc4ceb9fe1a85ec53ULL;
+    hv ^= hv >> 33;
+    return(hv);
+}
+
+static Table *
+statsRootTable(Table *tab)
+{
+    while (tab->ta_Parent)
+	tab = tab->ta_Parent;
+    return(tab);
+}
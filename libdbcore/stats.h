@@ -0,0 +1,85 @@
+/*
+ * LIBDBCORE/STATS.H	- Planner statistics (ANALYZE)
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ * Notes on table statistics:
+ *
+ *	ANALYZE [schema.]table reads every visible record of the table and
+ *	stores one row per column plus one table row (ColName '*') in
+ *	sys.stats.  The table row holds the live record count and the
+ *	average record size.  A column row holds the number of distinct
+ *	values, the number of records missing the column, the average
+ *	value size and an equi-depth histogram.
+ *
+ *	Distinct values are counted exactly until STATS_EXACT of them have
+ *	been seen, after which a HyperLogLog sketch of 2^STATS_HLLBITS
+ *	registers provides the estimate.  The histogram is built from a
+ *	reservoir sample of STATS_SAMPLE values and stored as
+ *	STATS_BUCKETS + 1 comma separated bounds, each the hex encoding
+ *	of at most STATS_KEYSIZE leading bytes of the value.
+ *
+ *	The statistics of a vtable are cached on its root Table by
+ *	GetTableStats().  Commit2() keeps the cached record count current
+ *	as records are committed, the sys.stats rows themselves are only
+ *	rewritten by ANALYZE.
+ */
+
+#define STATS_EXACT		4096		/* exact distinct count limit */
+#define STATS_HLLBITS		10
+#define STATS_HLLREGS		(1 << STATS_HLLBITS)
+#define STATS_SAMPLE		1024		/* histogram sample size */
+#define STATS_BUCKETS		8
+#define STATS_KEYSIZE		16		/* bytes of a bound kept */
+
+#define STATS_TABLEROW		"*"		/* ColName of the table row */
+
+typedef struct StatsKey {
+    int		sk_Bytes;
+    char	sk_Data[STATS_KEYSIZE];
+} StatsKey;
+
+typedef struct ColStats {
+    col_t	cs_ColId;
+    int		cs_AvgSize;	/* average bytes of a non-null value */
+    int64_t	cs_NDV;		/* distinct non-null values */
+    int64_t	cs_Nulls;	/* records without the column */
+    int		cs_NBounds;	/* histogram bounds, 0 if none */
+    StatsKey	cs_Bounds[STATS_BUCKETS + 1];
+} ColStats;
+
+typedef struct TableStats {
+    struct TableStats *ts_Next;	/* list on root Table (ta_Stats) */
+    vtable_t	ts_VTable;
+    int		ts_Flags;	/* TSF_* */
+    int64_t	ts_Rows;	/* live records */
+    int		ts_AvgSize;	/* average record size */
+    int		ts_NCols;
+    ColStats	*ts_Cols;
+} TableStats;
+
+#define TSF_ANALYZED	0x0001	/* else the table was never analyzed */
+
+/*
+ * ANALYZE collection state, one ColCollect per column of the table
+ */
+typedef struct ColCollect {
+    ColI	*cc_ColI;
+    int64_t	cc_Nulls;
+    int64_t	cc_Seen;	/* non-null values */
+    int64_t	cc_Bytes;	/* total bytes of non-null values */
+    int		cc_Exact;	/* distinct values in cc_Set, -1 overflowed */
+    u_int64_t	*cc_Set;	/* open addressed, STATS_EXACT * 2 slots */
+    int		cc_NSample;
+    StatsKey	*cc_Sample;
+    u_int8_t	cc_Regs[STATS_HLLREGS];
+} ColCollect;
+
+typedef struct StatsCollect {
+    int64_t	sc_Rows;
+    int64_t	sc_Bytes;	/* total record bytes */
+    u_int64_t	sc_Rand;	/* reservoir sampling */
+    int		sc_NCols;
+    ColCollect	*sc_Cols;
+} StatsCollect;
@@ -234,6 +234,8 @@ RawScanDelete(void *data, RawData *rd)
 	if (srh->rh_VTableId == rh->rh_VTableId &&
 	    srh->rh_Size == rh->rh_Size &&
 	    srh->rh_NCols == rh->rh_NCols &&
+	    srh->rh_Hv == rh->rh_Hv &&
+	    RecHash64(srh) == RecHash64(rh) &&
 	    bcmp(&srh->rh_Cols[0], &rh->rh_Cols[0], sizeof(ColHead)) == 0 &&
 	    bcmp(srh + 1, rh + 1, rh->rh_Size - sizeof(RecHead)) == 0
 	) {
@@ -0,0 +1,846 @@
+/*
+ * LIBDBCORE/TRGM.C	- Implement trigram indexing for LIKE
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	A trigram index produces candidate records for LIKE patterns which
+ *	a btree cannot narrow, such as '%smith'.  It is selected per column
+ *	(see CIF_TRIGRAM and GetIndexOpClass()) and only ever primed by a
+ *	LIKE against a constant.  See trgm.h for the file layout.
+ */
+
+#include "defs.h"
+#include "btree.h"
+#include "trgm.h"
+
+Prototype void OpenTrgmIndex(Index *index);
+
+/*
+ * TrgmSet - distinct trigrams of a value or pattern
+ */
+typedef struct TrgmSet {
+    u_int32_t	*ts_Ary;
+    int		ts_Count;
+    int		ts_Size;
+} TrgmSet;
+
+static void CloseTrgmIndex(Index *index);
+static void TrgmSetTableRange(TableI *ti, Table *tab, const ColData *colData, Range *r, int flags);
+static int TrgmUpdateIndex(TableI *ti, Table *tab, const ColData *colData, int flags);
+static void TrgmUpdateTableRange(TableI *ti, Range *r);
+static void TrgmNextTableRec(TableI *ti);
+static void TrgmPrevTableRec(TableI *ti);
+static int trgmMatch(TableI *ti, const TrgmElm *te);
+static void trgmAdd(TrgmSet *ts, const char *data, int bytes, int pad);
+static void trgmPattern(TrgmSet *ts, const char *data, int bytes);
+static void trgmUnique(TrgmSet *ts);
+static int trgmSortCmp(const void *v1, const void *v2);
+static u_int32_t trgmHash(u_int32_t trgm);
+static u_int32_t trgmSig(const TrgmSet *ts);
+static dboff_t trgmGetBucket(Index *index, IndexMap **pim, int bucket);
+static void trgmSetBucket(Index *index, int bucket, dboff_t pgro, dboff_t *appro);
+static void trgmInsert(Index *index, const TrgmElm *te, dboff_t *appro);
+static dboff_t trgmAppend(Index *index, const void *data, int bytes, dboff_t *appro);
+static const TrgmPage *trgmRead(Index *index, IndexMap **pim, dboff_t ro, int *elm);
+
+#define trgmBucket(trgm)	(trgmHash(trgm) & (TG_NBUCKETS - 1))
+
+/*
+ * OpenTrgmIndex() -	Open a trigram index file, creating it if necessary
+ *
+ *	Validation follows OpenBTreeIndex().  Temporary tables get a private
+ *	index file which is unlinked as soon as it has been created.
+ */
+
+void
+OpenTrgmIndex(Index *index)
+{
+    Table *tab = index->i_Table;
+    TrgmHead *tg;
+    char *p1;
+    int error = 0;
+    int tempOpt = 0;
+
+    DBASSERT(index->i_NCols == 1);
+    initList(&index->i_BTreeCacheList);
+
+    safe_asprintf(&p1, tab->ta_Name, 0);
+    safe_asprintf(&index->i_FilePath, "%s/%s.vt%04x.i%04x.o%02x",
+	tab->ta_Db->db_DirPath,
+	p1,
+	index->i_VTable,
+	index->i_ColId,
+	index->i_OpClass
+    );
+    safe_free(&p1);
+
+    if (tab->ta_Db->db_PushType != DBPUSH_ROOT) {
+	safe_replacef(
+	    &index->i_FilePath,
+	    "%s.%d.tmp",
+	    index->i_FilePath,
+	    (int)tab->ta_Db->db_Pid
+	);
+	tempOpt = 1;
+    }
+
+    tg = zalloc(sizeof(TrgmHead));
+
+    while (error == 0) {
+	int deleteMe = 0;
+	struct stat st;
+
+	if (tempOpt) {
+	    index->i_Fd = open(index->i_FilePath, O_RDWR|O_CREAT|O_TRUNC, 0660);
+	    if (index->i_Fd < 0) {
+		error = -1;
+		break;
+	    }
+	    remove(index->i_FilePath);
+	} else {
+	    index->i_Fd = open(index->i_FilePath, O_RDWR|O_CREAT, 0660);
+	    if (index->i_Fd < 0) {
+		error = -1;
+		break;
+	    }
+
+	    /*
+	     * Fasttrack validation
+	     */
+	    if (read(index->i_Fd, tg, sizeof(*tg)) == sizeof(*tg)) {
+		if (tg->tg_Magic == TG_MAGIC &&
+		    tg->tg_Version == TG_VERSION &&
+		    tg->tg_Generation == tab->ta_Meta->tf_Generation
+		) {
+		    break;
+		}
+	    }
+
+	    /*
+	     * Get exclusive lock, try to validate again.  If we cannot
+	     * validate we may have to delete/recreate the index file.
+	     */
+	    hflock_ex(index->i_Fd, 0);
+	    lseek(index->i_Fd, 0L, 0);
+	    if (read(index->i_Fd, tg, sizeof(*tg)) == sizeof(*tg)) {
+		if (tg->tg_Magic == TG_MAGIC &&
+		    tg->tg_Version == TG_VERSION &&
+		    tg->tg_Generation == tab->ta_Meta->tf_Generation
+		) {
+		    hflock_un(index->i_Fd, 0);
+		    break;
+		}
+		deleteMe = 1;
+	    }
+
+	    if (fstat(index->i_Fd, &st) < 0) {
+		hflock_un(index->i_Fd, 0);
+		error = -1;
+		break;
+	    }
+
+	    /*
+	     * If the file was unlinked while we were obtaining the lock
+	     * we have to try again.
+	     */
+	    if (st.st_nlink == 0) {
+		hflock_un(index->i_Fd, 0);
+		close(index->i_Fd);
+		continue;
+	    }
+	}
+
+	/*
+	 * File is unusable, we have to delete it and reaquire/recreate
+	 */
+	if (deleteMe) {
+	    remove(index->i_FilePath);
+	    hflock_un(index->i_Fd, 0);
+	    close(index->i_Fd);
+	    index->i_Fd = -1;
+	    continue;
+	}
+
+	/*
+	 * Creating new index file, setup the header.  The bucket directory
+	 * is allocated on the fly.
+	 */
+	bzero(tg, sizeof(*tg));
+	tg->tg_Magic = TG_MAGIC;
+	tg->tg_Version = 0;			/* operation in progress */
+	tg->tg_HeadSize = sizeof(TrgmHead);
+	tg->tg_Append = ALIGN128(sizeof(TrgmHead));
+	tg->tg_ExtAppend = (sizeof(TrgmHead) + BT_CACHEMASK) & ~BT_CACHEMASK;
+	tg->tg_TabAppend = tab->ta_FirstBlock(tab);
+	tg->tg_Generation = tab->ta_Meta->tf_Generation;
+	if (tempOpt)
+	    tg->tg_Flags |= TGF_TEMP;
+
+	ftruncate(index->i_Fd, tg->tg_ExtAppend);
+	lseek(index->i_Fd, 0, 0);
+	if (write(index->i_Fd, tg, sizeof(*tg)) != sizeof(*tg)) {
+	    error = -1;
+	    ftruncate(index->i_Fd, 0);
+	    if (tempOpt == 0)
+		hflock_un(index->i_Fd, 0);
+	    break;
+	}
+
+	/*
+	 * Lock-in changes prior to validating, then update the version
+	 * and flags, validating the index file.  A temporary index is
+	 * never synchronized.
+	 */
+	if (tempOpt == 0)
+	    fsync(index->i_Fd);
+	tg->tg_Version = TG_VERSION;
+	if (tempOpt == 0)
+	    tg->tg_Flags |= TGF_SYNCED;
+	lseek(index->i_Fd, offsetof(TrgmHead, tg_Head), 0);
+	if (write(index->i_Fd, &tg->tg_Head, sizeof(tg->tg_Head)) != sizeof(tg->tg_Head)) {
+	    error = -1;
+	    ftruncate(index->i_Fd, 0);
+	}
+	if (tempOpt == 0)
+	    hflock_un(index->i_Fd, 0);
+	break;
+    }
+    zfree(tg, sizeof(TrgmHead));
+
+    /*
+     * Map the header
+     */
+    if (error == 0) {
+	index->i_TrgmHead = mmap(
+			    NULL,
+			    sizeof(TrgmHead),
+			    PROT_READ,
+			    MAP_SHARED,
+			    index->i_Fd,
+			    0
+			);
+	if (index->i_TrgmHead == MAP_FAILED) {
+	    index->i_TrgmHead = NULL;
+	    error = -1;
+	}
+    }
+
+    /*
+     * Bucket chains are kept in table order and can be scanned in
+     * reverse, so we can use DefaultIndexScanRangeOp2().
+     */
+    if (error == 0) {
+	index->i_ScanRangeOp = DefaultIndexScanRangeOp2;
+	index->i_SetTableRange = TrgmSetTableRange;
+	index->i_UpdateIndex = TrgmUpdateIndex;
+	index->i_UpdateTableRange = TrgmUpdateTableRange;
+	index->i_NextTableRec = TrgmNextTableRec;
+	index->i_PrevTableRec = TrgmPrevTableRec;
+	index->i_Close = CloseTrgmIndex;
+	index->i_PosCache.p_IRo = (dboff_t)-1;
+    } else {
+	CloseTrgmIndex(index);
+    }
+}
+
+static void
+CloseTrgmIndex(Index *index)
+{
+    IndexMap *im;
+    const TrgmHead *tg;
+
+    while ((im = getHead(&index->i_BTreeCacheList)) != NULL) {
+	DBASSERT(im->im_Refs == 0);
+	im->im_Refs = 1;
+	btreeRelIndexMap(&im, 1);
+    }
+    if ((tg = index->i_TrgmHead) != NULL) {
+	if ((tg->tg_Flags & TGF_TEMP) == 0) {
+	    t_flock_ex(&index->i_FLock);
+	    btreeSynchronize(index);
+	    t_flock_un(&index->i_FLock);
+	}
+	munmap((void *)tg, sizeof(TrgmHead));
+	index->i_TrgmHead = NULL;
+    }
+    if (index->i_Fd >= 0) {
+	close(index->i_Fd);
+	index->i_Fd = -1;
+    }
+    safe_free(&index->i_FilePath);
+}
+
+/*
+ * TrgmSetTableRange()	- update index if necessary and set indexed range
+ *
+ *	Same as HashSetTableRange().
+ */
+
+static void
+TrgmSetTableRange(TableI *ti, Table *tab, const ColData *colData, Range *r, int flags)
+{
+    Index *index = ti->ti_Index;
+    const TrgmHead *tg = index->i_TrgmHead;
+
+    DBASSERT(ti->ti_ScanOneOnly <= 0);
+
+    if (flags & TABRAN_INIT) {
+	if ((flags & TABRAN_SYNCIDX) && (tg->tg_TabAppend != tab->ta_Append))
+	    TrgmUpdateIndex(ti, tab, colData, 0);
+	else if (tg->tg_TabAppend + tab->ta_IndexSlop < tab->ta_Append)
+	    TrgmUpdateIndex(ti, tab, colData, 0);
+	ti->ti_Append = tab->ta_Append;
+	ti->ti_IndexAppend = tg->tg_TabAppend;
+    }
+    if (flags & TABRAN_SLOP) {
+	DefaultSetTableRange(ti, tab, colData, r, flags & TABRAN_SLOP);
+	return;
+    }
+
+    ti->ti_RanBeg.p_Tab = tab;
+    ti->ti_RanEnd.p_Tab = tab;
+    ti->ti_ScanRangeOp = index->i_ScanRangeOp;
+
+    TrgmUpdateTableRange(ti, r);
+    SelectBegTableRec(ti, 0); 	/* to check degenerate EOF only */
+}
+
+/*
+ * TrgmUpdateIndex() -	Update index file by adding new records from the table
+ *
+ *	Same as HashUpdateIndex(), except that each record is entered
+ *	under all of its trigrams.
+ */
+
+static int
+TrgmUpdateIndex(TableI *ti, Table *tab, const ColData *colData, int flags)
+{
+    Index *index = ti->ti_Index;
+    const TrgmHead *tg = index->i_TrgmHead;
+    int tempOpt = (tg->tg_Flags & TGF_TEMP);
+    TrgmSet ts;
+    dboff_t appro;
+    int64_t count;
+    int oflags;
+
+    if (tempOpt == 0)
+	t_flock_ex(&index->i_FLock);
+    if (tg->tg_TabAppend >= tab->ta_Append) {
+	if (tempOpt == 0) {
+	    if ((flags & IUF_NOSYNC) == 0)
+		btreeSynchronize(index);
+	    t_flock_un(&index->i_FLock);
+	}
+	return(0);
+    }
+    if (tempOpt == 0)
+	btreeUnSynchronize(index);
+
+    /*
+     * Temporarily remove the index reference so we can scan the physical
+     * table sequentially.  Locate the first record to scan.
+     */
+    oflags = ti->ti_Flags;
+    ti->ti_Index = NULL;
+    ti->ti_Flags = TABRAN_SLOP;
+    DefaultSetTableRange(ti, tab, colData, NULL, TABRAN_SLOP|TABRAN_INIT);
+
+    bzero(&ts, sizeof(ts));
+    appro = tg->tg_Append;
+    count = tg->tg_Count;
+    if (tg->tg_TabAppend != 0) {
+	ti->ti_RanBeg.p_Ro = tg->tg_TabAppend;
+	SelectBegTableRec(ti, 0);
+    }
+
+    while (ti->ti_RanBeg.p_Ro > 0) {
+	const RecHead *rh;
+
+	ReadDataRecord(ti->ti_RData, &ti->ti_RanBeg, RDF_READ|RDF_ZERO);
+	rh = ti->ti_RData->rd_Rh;
+
+	if (index->i_VTable == 0 || index->i_VTable == rh->rh_VTableId) {
+	    TrgmElm te;
+	    int i;
+
+	    ts.ts_Count = 0;
+	    trgmAdd(&ts, colData->cd_Data, colData->cd_Bytes, 1);
+	    trgmUnique(&ts);
+
+	    te.te_Ro = ti->ti_RanBeg.p_Ro;
+	    te.te_Sig = trgmSig(&ts);
+	    for (i = 0; i < ts.ts_Count; ++i) {
+		te.te_Trgm = ts.ts_Ary[i];
+		trgmInsert(index, &te, &appro);
+	    }
+	    te.te_Trgm = TG_ALL;
+	    trgmInsert(index, &te, &appro);
+	    count += ts.ts_Count + 1;
+	}
+	taskQuantum();
+	SelectNextTableRec(ti, 0);
+    }
+    ti->ti_Index = index;
+    ti->ti_Flags = oflags;
+    if (ts.ts_Ary)
+	free(ts.ts_Ary);
+    btreeIndexWrite(
+	index,
+	offsetof(TrgmHead, tg_Count),
+	&count,
+	sizeof(int64_t)
+    );
+    btreeIndexWrite(
+	index,
+	offsetof(TrgmHead, tg_Append),
+	&appro,
+	sizeof(dboff_t)
+    );
+    btreeIndexWrite(
+	index,
+	offsetof(TrgmHead, tg_TabAppend),
+	&ti->ti_RanEnd.p_Ro,
+	sizeof(dboff_t)
+    );
+    if (tempOpt == 0) {
+	if ((flags & IUF_NOSYNC) == 0)
+	    btreeSynchronize(index);
+	t_flock_un(&index->i_FLock);
+    }
+    return(1);
+}
+
+/*
+ * TrgmUpdateTableRange() - restrict the range to a pattern's candidates
+ *
+ *	GetIndexOpClass() only hands out ROP_TRGM_LIKE for LIKE against a
+ *	constant, so the range priming the table instance always provides
+ *	the pattern.  Of the pattern's trigrams the one with the smallest
+ *	bucket drives the scan (ti_HashKey) and the rest make up the
+ *	signature every candidate must contain (ti_TrgmSig).  The range is
+ *	set to the oldest and newest candidates in the driving bucket and
+ *	the scan skips any other elements in between.
+ */
+
+static void
+TrgmUpdateTableRange(TableI *ti, Range *r)
+{
+    Index *index = ti->ti_Index;
+    IndexMap *im = NULL;
+    TrgmSet ts;
+    int64_t best = -1;
+    dboff_t pgro;
+    int i;
+
+    DBASSERT(ti->ti_ScanOneOnly <= 0);
+    DBASSERT(r != NULL && (r->r_Type & ROPF_CONST));
+    DBASSERT((col_t)r->r_Col->cd_ColId == index->i_ColId);
+    DBASSERT(r->r_OpClass == index->i_OpClass);
+
+    bzero(&ts, sizeof(ts));
+    trgmPattern(&ts, r->r_Const->cd_Data, r->r_Const->cd_Bytes);
+    trgmUnique(&ts);
+
+    ti->ti_HashKey = TG_ALL;
+    ti->ti_TrgmSig = trgmSig(&ts);
+    for (i = 0; i < ts.ts_Count; ++i) {
+	int64_t n = 0;
+
+	pgro = trgmGetBucket(index, &im, trgmBucket(ts.ts_Ary[i]));
+	if (pgro) {
+	    const TrgmPage *tp;
+
+	    tp = btreeGetIndexMap(index, &im, pgro, sizeof(TrgmPage));
+	    n = tp->tp_Total + tp->tp_Count;
+	}
+	if (best < 0 || n < best) {
+	    best = n;
+	    ti->ti_HashKey = ts.ts_Ary[i];
+	}
+    }
+    if (ts.ts_Ary)
+	free(ts.ts_Ary);
+
+    ti->ti_RanBeg.p_Ro = -1;
+    ti->ti_RanEnd.p_Ro = -1;
+
+    pgro = trgmGetBucket(index, &im, trgmBucket(ti->ti_HashKey));
+    while (pgro) {
+	const TrgmPage *tp;
+
+	tp = btreeGetIndexMap(index, &im, pgro, sizeof(TrgmPage));
+	for (i = tp->tp_Count - 1; i >= 0; --i) {
+	    const TrgmElm *te = &tp->tp_Elms[i];
+
+	    if (trgmMatch(ti, te) == 0)
+		continue;
+	    if (ti->ti_RanEnd.p_Ro < 0) {
+		ti->ti_RanEnd.p_Ro = te->te_Ro;
+		ti->ti_RanEnd.p_IRo = pgro + i;
+	    }
+	    ti->ti_RanBeg.p_Ro = te->te_Ro;
+	    ti->ti_RanBeg.p_IRo = pgro + i;
+	}
+	pgro = tp->tp_Older;
+    }
+    btreeRelIndexMap(&im, 0);
+}
+
+/*
+ * TrgmNextTableRec()
+ * TrgmPrevTableRec()
+ *
+ *	Step through the bucket chain, skipping elements which are not
+ *	candidates.  Same as HashNextTableRec() and HashPrevTableRec().
+ */
+
+static void
+TrgmNextTableRec(TableI *ti)
+{
+    Index *index = ti->ti_Index;
+    IndexMap *im = NULL;
+
+    for (;;) {
+	const TrgmPage *tp;
+	const TrgmElm *te;
+	dboff_t pgro;
+	int elm;
+
+	if (ti->ti_RanBeg.p_Ro == ti->ti_RanEnd.p_Ro) {
+	    ti->ti_RanBeg.p_Ro = -1;
+	    break;
+	}
+	tp = trgmRead(index, &im, ti->ti_RanBeg.p_IRo, &elm);
+	pgro = ti->ti_RanBeg.p_IRo & ~(dboff_t)TG_PAGEMASK;
+	if (++elm == tp->tp_Count) {
+	    if ((pgro = tp->tp_Newer) == 0) {
+		ti->ti_RanBeg.p_Ro = -1;
+		break;
+	    }
+	    tp = trgmRead(index, &im, pgro, &elm);
+	}
+	te = &tp->tp_Elms[elm];
+	ti->ti_RanBeg.p_IRo = pgro + elm;
+	ti->ti_RanBeg.p_Ro = te->te_Ro;
+	if (trgmMatch(ti, te))
+	    break;
+    }
+    btreeRelIndexMap(&im, 0);
+}
+
+static void
+TrgmPrevTableRec(TableI *ti)
+{
+    Index *index = ti->ti_Index;
+    IndexMap *im = NULL;
+
+    for (;;) {
+	const TrgmPage *tp;
+	const TrgmElm *te;
+	dboff_t pgro;
+	int elm;
+
+	if (ti->ti_RanEnd.p_Ro == ti->ti_RanBeg.p_Ro) {
+	    ti->ti_RanEnd.p_Ro = -1;
+	    break;
+	}
+	tp = trgmRead(index, &im, ti->ti_RanEnd.p_IRo, &elm);
+	pgro = ti->ti_RanEnd.p_IRo & ~(dboff_t)TG_PAGEMASK;
+	if (--elm < 0) {
+	    if ((pgro = tp->tp_Older) == 0) {
+		ti->ti_RanEnd.p_Ro = -1;
+		break;
+	    }
+	    tp = trgmRead(index, &im, pgro, &elm);
+	    elm = tp->tp_Count - 1;
+	    DBASSERT(elm >= 0);
+	}
+	te = &tp->tp_Elms[elm];
+	ti->ti_RanEnd.p_IRo = pgro + elm;
+	ti->ti_RanEnd.p_Ro = te->te_Ro;
+	if (trgmMatch(ti, te))
+	    break;
+    }
+    btreeRelIndexMap(&im, 0);
+}
+
+/*
+ * trgmMatch() -	is the element a candidate for the current scan
+ */
+static int
+trgmMatch(TableI *ti, const TrgmElm *te)
+{
+    return(te->te_Trgm == ti->ti_HashKey &&
+	(te->te_Sig & ti->ti_TrgmSig) == ti->ti_TrgmSig &&
+	te->te_Ro < ti->ti_IndexAppend);
+}
+
+/*
+ * trgmAdd() -	add the trigrams of data to the set
+ *
+ *	If pad is set the data is padded in front with two TG_PAD bytes.
+ *	Case is folded the same way the LIKE operator folds it.
+ */
+static void
+trgmAdd(TrgmSet *ts, const char *data, int bytes, int pad)
+{
+    u_int32_t trgm = 0;
+    int n = 0;
+    int i;
+
+    if (pad) {
+	trgm = (TG_PAD << 8) | TG_PAD;
+	n = 2;
+    }
+    for (i = 0; i < bytes; ++i) {
+	trgm = ((trgm << 8) | (u_int8_t)tolower(data[i])) & 0x00FFFFFF;
+	if (++n < 3)
+	    continue;
+	if (ts->ts_Count == ts->ts_Size) {
+	    ts->ts_Size = (ts->ts_Size) ? ts->ts_Size * 2 : 64;
+	    ts->ts_Ary = safe_realloc(ts->ts_Ary,
+				ts->ts_Size * sizeof(u_int32_t));
+	}
+	ts->ts_Ary[ts->ts_Count++] = trgm;
+    }
+}
+
+/*
+ * trgmPattern() -	add the trigrams every match of a LIKE pattern has
+ *
+ *	The part of the pattern up to the first '%' is anchored at the
+ *	start of the value and padded like the value is, the parts between
+ *	and after '%'s may appear anywhere.
+ */
+static void
+trgmPattern(TrgmSet *ts, const char *data, int bytes)
+{
+    int pad = 1;
+
+    for (;;) {
+	const char *wc = NULL;
+	int n = bytes;
+
+	if (bytes > 0 && (wc = memchr(data, '%', bytes)) != NULL)
+	    n = wc - data;
+	trgmAdd(ts, data, n, pad);
+	if (wc == NULL)
+	    break;
+	pad = 0;
+	data += n + 1;
+	bytes -= n + 1;
+    }
+}
+
+/*
+ * trgmUnique() -	sort the set and remove duplicates
+ */
+static void
+trgmUnique(TrgmSet *ts)
+{
+    int i;
+    int j;
+
+    if (ts->ts_Count < 2)
+	return;
+    qsort(ts->ts_Ary, ts->ts_Count, sizeof(u_int32_t), trgmSortCmp);
+    for (i = j = 1; i < ts->ts_Count; ++i) {
+	if (ts->ts_Ary[i] != ts->ts_Ary[j-1])
+	    ts->ts_Ary[j++] = ts->ts_Ary[i];
+    }
+    ts->ts_Count = j;
+}
+
+static int
+trgmSortCmp(const void *v1, const void *v2)
+{
+    u_int32_t t1 = *(const u_int32_t *)v1;
+    u_int32_t t2 = *(const u_int32_t *)v2;
+
+    if (t1 < t2)
+	return(-1);
+    if (t1 > t2)
+	return(1);
+    return(0);
+}
+
+/*
+ * trgmHash() -	mix a trigram.  The low bits select the bucket and the
+ *		top five bits the signature bit.
+ */
+static u_int32_t
+trgmHash(u_int32_t trgm)
+{
+    trgm ^= trgm >> 15;
+    trgm *= 0x2C1B3C6DU;
+    trgm ^= trgm >> 12;
+    trgm *= 0x297A2D39U;
+    trgm ^= trgm >> 15;
+    return(trgm);
+}
+
+static u_int32_t
+trgmSig(const TrgmSet *ts)
+{
+    u_int32_t sig = 0;
+    int i;
+
+    for (i = 0; i < ts->ts_Count; ++i)
+	sig |= 1U << (trgmHash(ts->ts_Ary[i]) >> 27);
+    return(sig);
+}
+
+/*
+ * trgmGetBucket() -	return the newest page in a bucket, or 0 if empty
+ */
+static dboff_t
+trgmGetBucket(Index *index, IndexMap **pim, int bucket)
+{
+    const TrgmHead *tg = index->i_TrgmHead;
+    dboff_t segro;
+
+    if ((segro = tg->tg_Segs[bucket / TG_SEGBUCKETS]) == 0)
+	return(0);
+    segro += (bucket % TG_SEGBUCKETS) * sizeof(dboff_t);
+    return(*(const dboff_t *)btreeGetIndexMap(index, pim, segro, sizeof(dboff_t)));
+}
+
+/*
+ * trgmSetBucket() -	set the newest page in a bucket
+ *
+ *	Directory segments are allocated as needed.
+ */
+static void
+trgmSetBucket(Index *index, int bucket, dboff_t pgro, dboff_t *appro)
+{
+    const TrgmHead *tg = index->i_TrgmHead;
+    int seg = bucket / TG_SEGBUCKETS;
+    dboff_t segro;
+
+    if ((segro = tg->tg_Segs[seg]) == 0) {
+	segro = trgmAppend(index, NULL, TG_SEGBUCKETS * sizeof(dboff_t), appro);
+	btreeIndexWrite(
+	    index,
+	    offsetof(TrgmHead, tg_Segs[seg]),
+	    &segro,
+	    sizeof(dboff_t)
+	);
+    }
+    btreeIndexWrite(
+	index,
+	segro + (bucket % TG_SEGBUCKETS) * sizeof(dboff_t),
+	&pgro,
+	sizeof(dboff_t)
+    );
+}
+
+/*
+ * trgmInsert() -	append an element to its trigram's bucket
+ *
+ *	Same as hashInsert().
+ */
+static void
+trgmInsert(Index *index, const TrgmElm *te, dboff_t *appro)
+{
+    IndexMap *im = NULL;
+    const TrgmPage *tp = NULL;
+    int bucket = trgmBucket(te->te_Trgm);
+    dboff_t pgro;
+
+    if ((pgro = trgmGetBucket(index, &im, bucket)) != 0)
+	tp = btreeGetIndexMap(index, &im, pgro, sizeof(TrgmPage));
+
+    if (tp && tp->tp_Count < TG_MAXELM) {
+	int16_t count = tp->tp_Count + 1;
+
+	btreeIndexWrite(
+	    index,
+	    pgro + offsetof(TrgmPage, tp_Elms[tp->tp_Count]),
+	    (void *)te,
+	    sizeof(TrgmElm)
+	);
+	btreeIndexWrite(
+	    index,
+	    pgro + offsetof(TrgmPage, tp_Count),
+	    &count,
+	    sizeof(count)
+	);
+    } else {
+	TrgmPage np;
+	dboff_t npgro;
+
+	bzero(&np, sizeof(np));
+	np.tp_Older = pgro;
+	if (tp)
+	    np.tp_Total = tp->tp_Total + tp->tp_Count;
+	np.tp_Bucket = bucket;
+	np.tp_Count = 1;
+	np.tp_Elms[0] = *te;
+	npgro = trgmAppend(index, &np, sizeof(np), appro);
+	if (pgro) {
+	    btreeIndexWrite(
+		index,
+		pgro + offsetof(TrgmPage, tp_Newer),
+		&npgro,
+		sizeof(dboff_t)
+	    );
+	}
+	trgmSetBucket(index, bucket, npgro, appro);
+    }
+    btreeRelIndexMap(&im, 0);
+}
+
+/*
+ * trgmAppend() -	append data to the index file
+ *
+ *	Same as hashAppend().  If data is NULL the space is zero'd.
+ */
+static dboff_t
+trgmAppend(Index *index, const void *data, int bytes, dboff_t *appro)
+{
+    static char *ZBuf;
+    const TrgmHead *tg = index->i_TrgmHead;
+    dboff_t ro;
+
+    DBASSERT(bytes <= 8192);
+    if (ZBuf == NULL)
+	ZBuf = zalloc(8192);
+
+    ro = (*appro + TG_PAGEMASK) & ~(dboff_t)TG_PAGEMASK;	/* align */
+    if ((ro ^ (ro + (bytes - 1))) & ~(dboff_t)BT_CACHEMASK)
+	ro = (ro + BT_CACHEMASK) & ~(dboff_t)BT_CACHEMASK;
+
+    if (ro + bytes > tg->tg_ExtAppend) {
+	dboff_t curapp = ro;
+	dboff_t extapp = tg->tg_ExtAppend + BT_CACHESIZE;
+
+	while (curapp < extapp) {
+	    int n = (extapp - curapp > 8192) ? 8192 : extapp - curapp;
+	    btreeIndexWrite(index, curapp, ZBuf, n);
+	    curapp += n;
+	}
+	btreeIndexWrite(
+	    index,
+	    offsetof(TrgmHead, tg_ExtAppend),
+	    &extapp,
+	    sizeof(dboff_t)
+	);
+    }
+    btreeIndexWrite(index, ro, (data ? (void *)data : ZBuf), bytes);
+    *appro = ro + bytes;
+    return(ro);
+}
+
+/*
+ * trgmRead() -	map the page containing index offset ro
+ *
+ *	As with the btree, ro is the page offset plus the element index.
+ */
+static const TrgmPage *
+trgmRead(Index *index, IndexMap **pim, dboff_t ro, int *elm)
+{
+    *elm = (int)ro & TG_PAGEMASK;
+    ro &= ~(dboff_t)TG_PAGEMASK;
+    return(btreeGetIndexMap(index, pim, ro, sizeof(TrgmPage)));
+}
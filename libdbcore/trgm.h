@@ -0,0 +1,80 @@
+/*
+ * LIBDBCORE/TRGM.H	- Trigram index format
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ * Notes on the trigram index:
+ *
+ *	The trigram index serves LIKE against a constant (ROP_TRGM_LIKE),
+ *	including patterns with a leading '%'.  A record is entered once
+ *	for each distinct trigram (three consecutive case-folded bytes) of
+ *	its column value, and once more under TG_ALL.  The value is padded
+ *	in front with two TG_PAD bytes so short values and short anchored
+ *	patterns still produce trigrams.
+ *
+ *	Each element also carries a signature of all of its record's
+ *	trigrams, one bit per trigram.  A lookup walks the elements of the
+ *	pattern's least common trigram and skips those whose signature
+ *	lacks any of the pattern's other trigrams, which approximates
+ *	intersecting the lists.  A pattern without trigrams walks TG_ALL.
+ *	The result is a superset of the matching records; the LIKE
+ *	operator is always rechecked against the record.
+ *
+ *	Trigrams are hashed into TG_NBUCKETS buckets which never split.
+ *	As with the hash index (see hash.h) each bucket is a doubly linked
+ *	chain of append-only pages, newest first, with elements in table
+ *	order, so scans can run backwards.  A bucket may hold several
+ *	trigrams, the scan skips the ones it is not interested in.
+ *	tp_Total counts the elements in older pages, so the newest page
+ *	gives the size of the bucket.
+ *
+ *	Index file mappings, writes, and synchronization go through the
+ *	btree support routines, so TGF_SYNCED must match BTF_SYNCED.
+ */
+
+#define TG_MAXELM		64		/* elements per page */
+#define TG_PAGEMASK		(TG_MAXELM - 1)	/* used to align pages */
+#define TG_SEGBUCKETS		1024		/* buckets per dir segment */
+#define TG_MAXSEGS		16
+#define TG_NBUCKETS		(TG_SEGBUCKETS * TG_MAXSEGS)
+
+#define TG_PAD			0		/* front padding byte */
+#define TG_ALL			0xFF000000	/* every record, not a trigram */
+
+typedef struct TrgmElm {
+    dboff_t	te_Ro;		/* offset of record in phys table */
+    u_int32_t	te_Trgm;	/* trigram, or TG_ALL */
+    u_int32_t	te_Sig;		/* signature of the record's trigrams */
+} TrgmElm;
+
+typedef struct TrgmPage {
+    dboff_t	tp_Older;	/* next older page in bucket, or 0 */
+    dboff_t	tp_Newer;	/* next newer page in bucket, or 0 */
+    int64_t	tp_Total;	/* elements in older pages */
+    int32_t	tp_Bucket;
+    int16_t	tp_Count;
+    u_int16_t	tp_Flags;
+    TrgmElm	tp_Elms[TG_MAXELM];
+} TrgmPage;
+
+typedef struct TrgmHead {
+    IndexHead	tg_Head;
+    dboff_t	tg_TabAppend;	/* we are indexed up to this point */
+    dboff_t	tg_Append;	/* append point for new pages */
+    dboff_t	tg_ExtAppend;	/* append point for file extension */
+    dbstamp_t	tg_Generation;	/* generation number */
+    int64_t	tg_Count;	/* number of elements */
+    dboff_t	tg_Segs[TG_MAXSEGS];	/* directory segments */
+} TrgmHead;
+
+#define tg_Flags	tg_Head.ih_Flags
+#define tg_Magic	tg_Head.ih_Magic
+#define tg_Version	tg_Head.ih_Version
+#define tg_HeadSize	tg_Head.ih_HeadSize
+
+#define TGF_SYNCED	0x00000001	/* trigram file is intact (BTF_SYNCED) */
+#define TGF_TEMP	0x00000004	/* private file (unlike BTF_TEMP, on disk) */
+
+#define TG_MAGIC	0x5447A1E5
+#define TG_VERSION	1
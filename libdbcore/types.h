@@ -13,5 +13,6 @@ typedef u_int8_t	rhmagic_t;
 typedef u_int8_t	rhflags_t;
 typedef u_int16_t	vtable_t;
 typedef u_int16_t	rhhash_t;
+typedef u_int64_t	rhhash64_t;
 typedef u_int32_t	rhuser_t;
 
@@ -0,0 +1,500 @@
+/*
+ * LIBDBCORE/ZONEMAP.C	- Per-block summaries used to skip table blocks
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	A block is summarized by WriteDataRecord() when the table append
+ *	point moves past it, and sequential scans (see SelectBegTableRec()
+ *	and SelectNextTableRec()) ask ZoneMapSkipBlock() whether the block
+ *	can hold anything the scan is looking for before mapping it.  See
+ *	zonemap.h for the file layout.
+ */
+
+#include "defs.h"
+#include "zonemap.h"
+
+Prototype void OpenZoneMap(Table *tab);
+Prototype void CloseZoneMap(Table *tab);
+Prototype void ZoneMapCloseBlock(Table *tab, dboff_t blkRo);
+Prototype void ZoneMapOpenBlock(Table *tab, dboff_t ro);
+Prototype int ZoneMapSkipBlock(TableI *ti, Table *tab, dboff_t blkRo, dboff_t limit);
+
+static int zoneHeadValid(Table *tab, const ZoneHead *zh);
+static void zoneRemap(ZoneMap *zm);
+static off_t zoneOffset(Table *tab, dboff_t blkRo);
+static const ZoneEntry *zoneEntry(Table *tab, dboff_t blkRo, int remap);
+static int zoneAddColId(ZoneEntry *ze, int ncols, col_t colId);
+static void zoneNoteCol(ColData *minCd, ColData *maxCd, int *seen, const ColData *cd);
+static int zoneExcludes(TableI *ti, const ZoneEntry *ze, Range *r);
+
+static ColData ZoneEmptyCol = { NULL, 0, 0, "", 0, DATATYPE_STRING };
+
+/*
+ * OpenZoneMap() -	open the zone map file for a physical table
+ *
+ *	Called once the table's meta data has been validated.  The file
+ *	is (re)initialized if it does not match the table.  Zone maps are
+ *	optional, if we cannot open the file the table simply has none.
+ */
+void
+OpenZoneMap(Table *tab)
+{
+    ZoneMap *zm;
+    ZoneHead zh;
+    int fd;
+
+    if (tab->ta_ZoneMap != NULL)
+	return;
+
+    zm = zalloc(sizeof(ZoneMap));
+    safe_asprintf(&zm->zm_FilePath, "%s/%s.zm0",
+	tab->ta_Db->db_DirPath, tab->ta_Name);
+    if ((fd = open(zm->zm_FilePath, O_RDWR|O_CREAT, 0660)) < 0) {
+	safe_free(&zm->zm_FilePath);
+	zfree(zm, sizeof(ZoneMap));
+	return;
+    }
+    zm->zm_Fd = fd;
+    zm->zm_Base = NULL;
+
+    /*
+     * Fasttrack validation, then validate again under an exclusive lock
+     * and reset the file if it belongs to some other incarnation of the
+     * table.
+     */
+    bzero(&zh, sizeof(zh));
+    if (read(fd, &zh, sizeof(zh)) != sizeof(zh) || !zoneHeadValid(tab, &zh)) {
+	hflock_ex(fd, 0);
+	lseek(fd, 0L, 0);
+	bzero(&zh, sizeof(zh));
+	if (read(fd, &zh, sizeof(zh)) != sizeof(zh) ||
+	    !zoneHeadValid(tab, &zh)
+	) {
+	    char *buf = zalloc(ZH_HEADSIZE);
+
+	    zh.zh_Magic = ZH_MAGIC;
+	    zh.zh_Version = ZH_VERSION;
+	    zh.zh_HeadSize = ZH_HEADSIZE;
+	    zh.zh_EntrySize = sizeof(ZoneEntry);
+	    zh.zh_BlockSize = tab->ta_Meta->tf_BlockSize;
+	    zh.zh_Unused01 = 0;
+	    zh.zh_DataOff = tab->ta_Meta->tf_DataOff;
+	    zh.zh_Generation = tab->ta_Meta->tf_Generation;
+	    bcopy(&zh, buf, sizeof(zh));
+
+	    ftruncate(fd, 0);
+	    lseek(fd, 0L, 0);
+	    if (write(fd, buf, ZH_HEADSIZE) != ZH_HEADSIZE)
+		ftruncate(fd, 0);
+	    zfree(buf, ZH_HEADSIZE);
+	}
+	hflock_un(fd, 0);
+    }
+    zoneRemap(zm);
+    tab->ta_ZoneMap = zm;
+}
+
+void
+CloseZoneMap(Table *tab)
+{
+    ZoneMap *zm;
+
+    if ((zm = tab->ta_ZoneMap) != NULL) {
+	tab->ta_ZoneMap = NULL;
+	if (zm->zm_Base != NULL)
+	    munmap((void *)zm->zm_Base, zm->zm_MapSize);
+	close(zm->zm_Fd);
+	safe_free(&zm->zm_FilePath);
+	zfree(zm, sizeof(ZoneMap));
+    }
+}
+
+/*
+ * ZoneMapCloseBlock() - summarize a block which will not change again
+ *
+ *	The entry is written with ZEF_VALID clear and then validated, so
+ *	a concurrent reader never uses a partially written entry.
+ */
+void
+ZoneMapCloseBlock(Table *tab, dboff_t blkRo)
+{
+    ZoneMap *zm;
+    ZoneEntry ze;
+    ColData minCd[ZM_MAXCOLS];
+    ColData maxCd[ZM_MAXCOLS];
+    int seen[ZM_MAXCOLS];
+    const char *base;
+    const RecHead *rh;
+    DataMap *dm = NULL;
+    dbpos_t pos;
+    off_t off;
+    int blockSize;
+    int ncols;
+    int boff;
+    int i;
+    int j;
+
+    if ((zm = tab->ta_ZoneMap) == NULL)
+	return;
+    if ((off = zoneOffset(tab, blkRo)) < 0)
+	return;
+
+    blockSize = tab->ta_Meta->tf_BlockSize;
+    pos.p_Tab = tab;
+    pos.p_Ro = blkRo;
+    base = tab->ta_GetDataMap(&pos, &dm, blockSize);
+    DBASSERT(((const BlockHead *)base)->bh_Magic == BH_MAGIC);
+
+    bzero(&ze, sizeof(ze));
+    ze.ze_MinStamp = DBSTAMP_MAX;
+    ze.ze_MaxStamp = 0;
+
+    /*
+     * Pass 1 - record count, timestamps, and pick the columns to
+     * summarize.
+     */
+    ncols = 0;
+    for (boff = sizeof(BlockHead); boff < blockSize; boff += rh->rh_Size) {
+	rh = (const RecHead *)(base + boff);
+	if (!RH_ISRECORD(rh))
+	    break;
+	++ze.ze_Count;
+	if (ze.ze_MinStamp > rh->rh_Stamp)
+	    ze.ze_MinStamp = rh->rh_Stamp;
+	if (ze.ze_MaxStamp < rh->rh_Stamp)
+	    ze.ze_MaxStamp = rh->rh_Stamp;
+	for (i = 0; i < rh->rh_NCols; ++i)
+	    ncols = zoneAddColId(&ze, ncols, rh->rh_Cols[i].ch_ColId);
+    }
+
+    /*
+     * Pass 2 - column ranges.  Both the record's columns and ze_Cols[]
+     * are sorted by column id.
+     */
+    bzero(seen, sizeof(seen));
+    for (boff = sizeof(BlockHead); ncols && boff < blockSize; boff += rh->rh_Size) {
+	int offset;
+
+	rh = (const RecHead *)(base + boff);
+	if (!RH_ISRECORD(rh))
+	    break;
+	offset = offsetof(RecHead, rh_Cols[rh->rh_NCols]);
+	j = 0;
+	for (i = 0; i < rh->rh_NCols && j < ncols; ++i) {
+	    const ColHead *ch = &rh->rh_Cols[i];
+	    ColData cd;
+	    int bytes;
+
+	    if (ch->ch_Bytes < BSIZE_EXT_BASE) {
+		bytes = ch->ch_Bytes;
+	    } else {
+		bytes = *(int32_t *)((char *)rh + offset);
+		offset += 4;
+	    }
+	    while (j < ncols && ze.ze_Cols[j].zc_ColId < ch->ch_ColId) {
+		zoneNoteCol(&minCd[j], &maxCd[j], &seen[j], &ZoneEmptyCol);
+		++j;
+	    }
+	    if (j < ncols && ze.ze_Cols[j].zc_ColId == ch->ch_ColId) {
+		bzero(&cd, sizeof(cd));
+		cd.cd_Data = (const char *)rh + offset;
+		cd.cd_Bytes = bytes;
+		zoneNoteCol(&minCd[j], &maxCd[j], &seen[j], &cd);
+		++j;
+	    }
+	    offset += ALIGN4(bytes);
+	}
+	while (j < ncols) {
+	    zoneNoteCol(&minCd[j], &maxCd[j], &seen[j], &ZoneEmptyCol);
+	    ++j;
+	}
+    }
+
+    /*
+     * Copy out the bounds while the block is still mapped.
+     */
+    for (j = 0; j < ncols; ++j) {
+	ZoneCol *zc = &ze.ze_Cols[j];
+	int bytes;
+
+	bytes = minCd[j].cd_Bytes;
+	if (bytes > ZM_KEYSIZE)
+	    bytes = ZM_KEYSIZE;
+	zc->zc_MinLen = bytes;
+	bcopy(minCd[j].cd_Data, zc->zc_Min, bytes);
+	if (maxCd[j].cd_Bytes > ZM_KEYSIZE) {
+	    zc->zc_MaxLen = ZC_NOMAX;
+	} else {
+	    zc->zc_MaxLen = maxCd[j].cd_Bytes;
+	    bcopy(maxCd[j].cd_Data, zc->zc_Max, maxCd[j].cd_Bytes);
+	}
+    }
+    dm->dm_Table->ta_RelDataMap(&dm, 0);
+
+    lseek(zm->zm_Fd, off, 0);
+    if (write(zm->zm_Fd, &ze, sizeof(ze)) == sizeof(ze)) {
+	ze.ze_Flags = ZEF_VALID;
+	lseek(zm->zm_Fd, off, 0);
+	write(zm->zm_Fd, &ze.ze_Flags, sizeof(ze.ze_Flags));
+    }
+}
+
+/*
+ * ZoneMapOpenBlock() -	a record is being appended at ro
+ *
+ *	Normally the block is still open and has no summary.  After a
+ *	crash the append point can be backed up into a block which had
+ *	already been summarized, in which case the summary is thrown away.
+ *	Only entries already mapped need to be checked since those are the
+ *	only ones that can predate the append point.
+ */
+void
+ZoneMapOpenBlock(Table *tab, dboff_t ro)
+{
+    const ZoneEntry *ze;
+    dboff_t blkRo;
+
+    if (tab->ta_ZoneMap == NULL)
+	return;
+    blkRo = ro & ~(dboff_t)(tab->ta_Meta->tf_BlockSize - 1);
+    if ((ze = zoneEntry(tab, blkRo, 0)) != NULL && (ze->ze_Flags & ZEF_VALID)) {
+	int32_t flags = 0;
+
+	lseek(tab->ta_ZoneMap->zm_Fd, zoneOffset(tab, blkRo), 0);
+	write(tab->ta_ZoneMap->zm_Fd, &flags, sizeof(flags));
+    }
+}
+
+/*
+ * ZoneMapSkipBlock() -	return 1 if a sequential scan may skip the block
+ *
+ *	The scan must not be carried past limit, so the block is only
+ *	skipped if it lies entirely below it.  ti_ZoneRange is the range
+ *	being scanned (see DefaultIndexScanRangeOp1()).  For a scan which
+ *	returns every record (ti_ScanOneOnly < 0, no delete tracking) the
+ *	remaining ranges on the table instance can be used as well.
+ */
+int
+ZoneMapSkipBlock(TableI *ti, Table *tab, dboff_t blkRo, dboff_t limit)
+{
+    const ZoneEntry *ze;
+    Range *r;
+
+    if (tab->ta_ZoneMap == NULL)
+	return(0);
+    if (blkRo + tab->ta_Meta->tf_BlockSize > limit)
+	return(0);
+    if ((ze = zoneEntry(tab, blkRo, 1)) == NULL ||
+	(ze->ze_Flags & ZEF_VALID) == 0
+    ) {
+	return(0);
+    }
+    for (r = ti->ti_ZoneRange; r; r = r->r_NextSame) {
+	if (zoneExcludes(ti, ze, r))
+	    return(1);
+	if (ti->ti_ScanOneOnly >= 0)
+	    break;
+    }
+    return(0);
+}
+
+static int
+zoneHeadValid(Table *tab, const ZoneHead *zh)
+{
+    const TableFile *tf = tab->ta_Meta;
+
+    return(zh->zh_Magic == ZH_MAGIC &&
+	zh->zh_Version == ZH_VERSION &&
+	zh->zh_HeadSize == ZH_HEADSIZE &&
+	zh->zh_EntrySize == sizeof(ZoneEntry) &&
+	zh->zh_BlockSize == tf->tf_BlockSize &&
+	zh->zh_DataOff == tf->tf_DataOff &&
+	zh->zh_Generation == tf->tf_Generation);
+}
+
+/*
+ * zoneRemap() - map the zone map file if it has grown
+ */
+static void
+zoneRemap(ZoneMap *zm)
+{
+    struct stat st;
+
+    if (fstat(zm->zm_Fd, &st) < 0 || st.st_size <= zm->zm_MapSize)
+	return;
+    if (zm->zm_Base != NULL)
+	munmap((void *)zm->zm_Base, zm->zm_MapSize);
+    zm->zm_Base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, zm->zm_Fd, 0);
+    if (zm->zm_Base == MAP_FAILED) {
+	zm->zm_Base = NULL;
+	zm->zm_MapSize = 0;
+    } else {
+	zm->zm_MapSize = st.st_size;
+    }
+}
+
+static off_t
+zoneOffset(Table *tab, dboff_t blkRo)
+{
+    const TableFile *tf = tab->ta_Meta;
+
+    if (blkRo < tf->tf_DataOff)
+	return(-1);
+    return(ZH_HEADSIZE +
+	(off_t)((blkRo - tf->tf_DataOff) / tf->tf_BlockSize) *
+	sizeof(ZoneEntry));
+}
+
+static const ZoneEntry *
+zoneEntry(Table *tab, dboff_t blkRo, int remap)
+{
+    ZoneMap *zm = tab->ta_ZoneMap;
+    off_t off;
+
+    if ((off = zoneOffset(tab, blkRo)) < 0)
+	return(NULL);
+    if (off + (off_t)sizeof(ZoneEntry) > zm->zm_MapSize) {
+	if (remap == 0)
+	    return(NULL);
+	zoneRemap(zm);
+	if (off + (off_t)sizeof(ZoneEntry) > zm->zm_MapSize)
+	    return(NULL);
+    }
+    return((const ZoneEntry *)(zm->zm_Base + off));
+}
+
+/*
+ * zoneAddColId() - track the ZM_MAXCOLS lowest column ids in the block
+ *
+ *	ze_Cols[] is kept sorted.  Special columns are not stored in the
+ *	record body and are ignored.  Returns the new number of columns.
+ */
+static int
+zoneAddColId(ZoneEntry *ze, int ncols, col_t colId)
+{
+    int i;
+
+    if (colId < CID_RAW_LIMIT)
+	return(ncols);
+    for (i = 0; i < ncols; ++i) {
+	if (ze->ze_Cols[i].zc_ColId == colId)
+	    return(ncols);
+	if (ze->ze_Cols[i].zc_ColId > colId)
+	    break;
+    }
+    if (i == ZM_MAXCOLS)
+	return(ncols);
+    if (ncols == ZM_MAXCOLS)
+	--ncols;
+    bcopy(&ze->ze_Cols[i], &ze->ze_Cols[i+1], (ncols - i) * sizeof(ZoneCol));
+    ze->ze_Cols[i].zc_ColId = colId;
+    return(ncols + 1);
+}
+
+static void
+zoneNoteCol(ColData *minCd, ColData *maxCd, int *seen, const ColData *cd)
+{
+    dataop_func_t ltFunc = DataTypeFuncAry[DATATYPE_STRING][DATAOP_LT];
+
+    if (*seen == 0) {
+	*minCd = *cd;
+	*maxCd = *cd;
+	*seen = 1;
+	return;
+    }
+    if (ltFunc(cd, minCd) > 0)
+	*minCd = *cd;
+    if (ltFunc(maxCd, cd) > 0)
+	*maxCd = *cd;
+}
+
+/*
+ * zoneExcludes() -	return 1 if no record in the block can satisfy r
+ *
+ *	Only constant ranges which the indexes would also be allowed to
+ *	optimize are considered (see RF_FORCESAVE in HLAddClause()), so
+ *	skipping the block cannot upset delete tracking.
+ */
+static int
+zoneExcludes(TableI *ti, const ZoneEntry *ze, Range *r)
+{
+    dataop_func_t *opary;
+    const ZoneCol *zc;
+    ColData minCd;
+    ColData maxCd;
+    int i;
+
+    if (r->r_Type != ROP_CONST)
+	return(0);
+    if ((r->r_Flags & RF_FORCESAVE) && ti->ti_ScanOneOnly >= 0)
+	return(0);
+    if (ze->ze_Count == 0)
+	return(1);
+
+    bzero(&minCd, sizeof(minCd));
+    bzero(&maxCd, sizeof(maxCd));
+
+    switch(r->r_OpId) {
+    case ROP_STAMP_LT:
+    case ROP_STAMP_LTEQ:
+	minCd.cd_Data = (const char *)&ze->ze_MinStamp;
+	minCd.cd_Bytes = sizeof(dbstamp_t);
+	return(r->r_OpFunc(&minCd, r->r_Const) < 0);
+    case ROP_STAMP_GT:
+    case ROP_STAMP_GTEQ:
+	maxCd.cd_Data = (const char *)&ze->ze_MaxStamp;
+	maxCd.cd_Bytes = sizeof(dbstamp_t);
+	return(r->r_OpFunc(&maxCd, r->r_Const) < 0);
+    case ROP_EQEQ:
+    case ROP_LT:
+    case ROP_LTEQ:
+    case ROP_GT:
+    case ROP_GTEQ:
+	break;
+    default:
+	return(0);
+    }
+
+    /*
+     * Column ranges, only string ordering is understood
+     */
+    if (r->r_Col->cd_DataType != DATATYPE_STRING)
+	return(0);
+    for (i = 0; i < ZM_MAXCOLS; ++i) {
+	zc = &ze->ze_Cols[i];
+	if (zc->zc_ColId == 0)
+	    return(0);
+	if (zc->zc_ColId == (col_t)r->r_Col->cd_ColId)
+	    break;
+    }
+    if (i == ZM_MAXCOLS)
+	return(0);
+
+    opary = DataTypeFuncAry[DATATYPE_STRING];
+    minCd.cd_Data = zc->zc_Min;
+    minCd.cd_Bytes = zc->zc_MinLen;
+    maxCd.cd_Data = zc->zc_Max;
+    maxCd.cd_Bytes = (zc->zc_MaxLen == ZC_NOMAX) ? 0 : zc->zc_MaxLen;
+
+    switch(r->r_OpId) {
+    case ROP_LT:
+    case ROP_LTEQ:
+	return(r->r_OpFunc(&minCd, r->r_Const) < 0);
+    case ROP_GT:
+    case ROP_GTEQ:
+	if (zc->zc_MaxLen == ZC_NOMAX)
+	    return(0);
+	return(r->r_OpFunc(&maxCd, r->r_Const) < 0);
+    case ROP_EQEQ:
+	if (opary[DATAOP_GT](&minCd, r->r_Const) > 0)
+	    return(1);
+	if (zc->zc_MaxLen != ZC_NOMAX &&
+	    opary[DATAOP_LT](&maxCd, r->r_Const) > 0
+	) {
+	    return(1);
+	}
+	break;
+    }
+    return(0);
+}
@@ -0,0 +1,77 @@
+/*
+ * LIBDBCORE/ZONEMAP.H	- Per-block summaries of a physical table
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ * Notes on zone maps:
+ *
+ *	Data blocks are append-only and never change once they have been
+ *	closed out (see WriteDataRecord()).  When a block is closed out we
+ *	summarize it: the number of records, the range of rh_Stamp values,
+ *	and the range of values of up to ZM_MAXCOLS columns (the lowest
+ *	numbered columns found in the block).  A sequential scan consults
+ *	the summary before mapping a block and skips blocks which cannot
+ *	contain a record matching the range being scanned, see
+ *	ZoneMapSkipBlock().
+ *
+ *	The summaries live in a sidecar file, <table>.zm0, as an array of
+ *	ZoneEntry's indexed by block number.  The file is only a hint.  An
+ *	entry is not used unless ZEF_VALID is set and the whole file is
+ *	reset when the table's generation changes, so it may be removed at
+ *	any time.
+ *
+ *	Column values are compared as strings.  A minimum longer than
+ *	ZM_KEYSIZE is stored truncated, which still bounds the column from
+ *	below.  A maximum longer than ZM_KEYSIZE cannot be bounded and is
+ *	flagged ZC_NOMAX.  Records which do not have the column compare as
+ *	the empty string.
+ */
+
+#define ZM_MAXCOLS		4		/* columns summarized per block */
+#define ZM_KEYSIZE		16		/* bytes of min/max kept */
+
+typedef struct ZoneCol {
+    col_t	zc_ColId;	/* column id, 0 if unused */
+    u_int8_t	zc_MinLen;	/* bytes in zc_Min (may be truncated) */
+    u_int8_t	zc_MaxLen;	/* bytes in zc_Max or ZC_NOMAX */
+    char	zc_Min[ZM_KEYSIZE];
+    char	zc_Max[ZM_KEYSIZE];
+} ZoneCol;
+
+#define ZC_NOMAX	((u_int8_t)0xFF)
+
+typedef struct ZoneEntry {
+    int32_t	ze_Flags;	/* ZEF_* */
+    int32_t	ze_Count;	/* number of records in block */
+    dbstamp_t	ze_MinStamp;
+    dbstamp_t	ze_MaxStamp;
+    ZoneCol	ze_Cols[ZM_MAXCOLS];
+} ZoneEntry;
+
+#define ZEF_VALID	0x0001
+
+typedef struct ZoneHead {
+    int32_t	zh_Magic;
+    int32_t	zh_Version;
+    int32_t	zh_HeadSize;	/* offset of first ZoneEntry */
+    int32_t	zh_EntrySize;	/* sizeof(ZoneEntry) */
+    int32_t	zh_BlockSize;	/* table block size */
+    int32_t	zh_Unused01;
+    dboff_t	zh_DataOff;	/* table offset of block 0 */
+    dbstamp_t	zh_Generation;	/* must match tf_Generation */
+} ZoneHead;
+
+#define ZH_MAGIC	0x5A4D4150
+#define ZH_VERSION	1
+#define ZH_HEADSIZE	512
+
+/*
+ * ZoneMap - in-memory reference to a table's zone map file
+ */
+typedef struct ZoneMap {
+    int		zm_Fd;
+    const char	*zm_Base;	/* read-only mapping of the file */
+    off_t	zm_MapSize;
+    char	*zm_FilePath;
+} ZoneMap;
@@ -4,8 +4,8 @@
  * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
  * file at the base of the distribution tree.
  *
- *	Implements string operators, validation, encoding, and decoding
- *	functions.
+ *	Implements the data type registry and conversion between the
+ *	data types and their text form.
  *
  * $Backplane: rdbms/libdbtypes/datatype.c,v 1.2 2002/08/20 22:05:53 dillon Exp $
  */
@@ -13,12 +13,17 @@
 #include "defs.h"
 
 Export int DataTypeLookup(const char *ptr, int bytes);
+Export int DataTypeFromString(int dataType, const char *ptr, int bytes, char *buf);
+Export int DataTypeToString(int dataType, const ColData *cd, char *buf);
 Export dataop_func_t *DataTypeFuncAry[DATATYPE_ARRAY_SIZE];
 
 dataop_func_t *DataTypeFuncAry[DATATYPE_ARRAY_SIZE] = { 
 	DataTypeUnknownFuncAry,		/* DATATYPE_UNKNOWN	*/
 	DataTypeStringFuncAry,		/* DATATYPE_STRING	*/
-	DataTypeUnknownFuncAry		/* DATATYPE_INT		*/
+	DataTypeBinaryFuncAry,		/* DATATYPE_INT		*/
+	DataTypeBinaryFuncAry,		/* DATATYPE_DOUBLE	*/
+	DataTypeBinaryFuncAry,		/* DATATYPE_DECIMAL	*/
+	DataTypeBinaryFuncAry		/* DATATYPE_TIMESTAMP	*/
 };
 
 int
@@ -26,6 +31,74 @@ DataTypeLookup(const char *ptr, int bytes)
 {
     if (bytes == 7 && strncmp(ptr, "varchar", 7) == 0)
 	return(DATATYPE_STRING);
+    if ((bytes == 3 && strncmp(ptr, "int", 3) == 0) ||
+	(bytes == 7 && strncmp(ptr, "integer", 7) == 0) ||
+	(bytes == 6 && strncmp(ptr, "bigint", 6) == 0)
+    ) {
+	return(DATATYPE_INT);
+    }
+    if ((bytes == 6 && strncmp(ptr, "double", 6) == 0) ||
+	(bytes == 5 && strncmp(ptr, "float", 5) == 0)
+    ) {
+	return(DATATYPE_DOUBLE);
+    }
+    if ((bytes == 7 && strncmp(ptr, "decimal", 7) == 0) ||
+	(bytes == 7 && strncmp(ptr, "numeric", 7) == 0)
+    ) {
+	return(DATATYPE_DECIMAL);
+    }
+    if (bytes == 9 && strncmp(ptr, "timestamp", 9) == 0)
+	return(DATATYPE_TIMESTAMP);
     return(-1);
 }
 
+/*
+ * DataTypeFromString() - convert a value in text form to a data type
+ *
+ *	The result is stored in buf, which must hold DATATYPE_BINSIZE
+ *	bytes.  Returns the number of bytes stored, 0 if the type is
+ *	stored as text (buf is not used), or -1 if the text is not a
+ *	valid value of the type.
+ */
+int
+DataTypeFromString(int dataType, const char *ptr, int bytes, char *buf)
+{
+    switch(dataType) {
+    case DATATYPE_INT:
+	return(IntFromString(ptr, bytes, buf));
+    case DATATYPE_DOUBLE:
+	return(DoubleFromString(ptr, bytes, buf));
+    case DATATYPE_DECIMAL:
+	return(DecimalFromString(ptr, bytes, buf));
+    case DATATYPE_TIMESTAMP:
+	return(TimestampFromString(ptr, bytes, buf));
+    }
+    return(0);
+}
+
+/*
+ * DataTypeToString() - convert a value to text form
+ *
+ *	The text is stored 0-terminated in buf, which must hold
+ *	DATATYPE_FMTSIZE bytes.  Returns its length, or -1 if the value
+ *	is already text (or NULL, or not a valid binary value) and should
+ *	be used as is.
+ */
+int
+DataTypeToString(int dataType, const ColData *cd, char *buf)
+{
+    if (cd->cd_Data == NULL || cd->cd_Bytes != DATATYPE_BINSIZE)
+	return(-1);
+
+    switch(dataType) {
+    case DATATYPE_INT:
+	return(IntToString(cd->cd_Data, buf));
+    case DATATYPE_DOUBLE:
+	return(DoubleToString(cd->cd_Data, buf));
+    case DATATYPE_DECIMAL:
+	return(DecimalToString(cd->cd_Data, buf));
+    case DATATYPE_TIMESTAMP:
+	return(TimestampToString(cd->cd_Data, buf));
+    }
+    return(-1);
+}
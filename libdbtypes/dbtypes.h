@@ -27,7 +27,7 @@ typedef struct ColData {
     int		cd_ColId;		/* column identifier */
     int		cd_Bytes;		/* data len (terminator not included)*/
     const char	*cd_Data;		/* pointer to data */
-    int		cd_Flags;		/* RDF_ALLOC only */
+    int		cd_Flags;		/* RDF_ALLOC, RDF_PARAM */
     int		cd_DataType;
 } ColData;
 
@@ -35,13 +35,37 @@ typedef int (*dataop_func_t)(const ColData *lhs, const ColData *rhs);
 
 /*
  * Fixed datatypes
+ *
+ *	DATATYPE_STRING (varchar) data is stored as is.  The other types
+ *	are stored in binary, DATATYPE_BINSIZE bytes encoded most significant
+ *	byte first such that the values sort the same way their encodings
+ *	do as unsigned byte strings (memcmp()).  Btree keys, ORDER BY and
+ *	byte equality therefore work on the stored data directly.
+ *
+ *	DATATYPE_INT		int64, sign bit inverted
+ *	DATATYPE_DOUBLE		IEEE double, sign bit inverted if positive,
+ *				every bit inverted if negative
+ *	DATATYPE_DECIMAL	int64 in units of 1/DATATYPE_DECUNIT
+ *	DATATYPE_TIMESTAMP	int64 microseconds since 1970-01-01 UTC
+ *
+ *	Values are converted from and to text at the client boundary only,
+ *	see DataTypeFromString() and DataTypeToString().
  */
 
 #define DATATYPE_UNKNOWN	0
 #define DATATYPE_STRING		1
 #define DATATYPE_INT		2
+#define DATATYPE_DOUBLE		3
+#define DATATYPE_DECIMAL	4
+#define DATATYPE_TIMESTAMP	5
+
+#define DATATYPE_ARRAY_SIZE	6
 
-#define DATATYPE_ARRAY_SIZE	3
+#define DATATYPE_BINARY(type)	((type) > DATATYPE_STRING)
+#define DATATYPE_BINSIZE	8
+#define DATATYPE_FMTSIZE	32	/* formatted binary value incl NUL */
+#define DATATYPE_DECSCALE	4	/* DECIMAL digits after the point */
+#define DATATYPE_DECUNIT	10000
 
 /*
  * Operators
@@ -42,11 +42,9 @@ int
 OpExactMatch(const ColData *d1, const ColData *d2)
 {
     int s = (d1->cd_Bytes < d2->cd_Bytes) ? d1->cd_Bytes : d2->cd_Bytes;
-    int i;
+    int i = StrFirstDiff(d1->cd_Data, d2->cd_Data, s);
 
-    for (i = 0; i < s; ++i) {
-	if (d1->cd_Data[i] == d2->cd_Data[i])
-	    continue;
+    if (i < s) {
 	if (d1->cd_Data[i] < d2->cd_Data[i])
 	    return(-1);		/* FALSE region #1 (d1 smaller) */
 	return(-2);		/* FALSE region #2 (d1 larger) */
@@ -63,11 +61,9 @@ int
 OpExactNoMatch(const ColData *d1, const ColData *d2)
 {
     int s = (d1->cd_Bytes < d2->cd_Bytes) ? d1->cd_Bytes : d2->cd_Bytes;
-    int i;
+    int i = StrFirstDiff(d1->cd_Data, d2->cd_Data, s);
 
-    for (i = 0; i < s; ++i) {
-	if (d1->cd_Data[i] == d2->cd_Data[i])
-	    continue;
+    if (i < s) {
 	if (d1->cd_Data[i] < d2->cd_Data[i])
 	    return(1);		/* TRUE region #1 (d1 smaller) */
 	return(2);		/* TRUE region #2 (d1 larger) */
@@ -0,0 +1,483 @@
+/*
+ * LIBDBTYPES/NUMERIC.C
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	Implements the binary (int, double, decimal, timestamp) operators,
+ *	encoding, and decoding functions.  See dbtypes.h for the encodings.
+ *
+ *	Since every binary type sorts the same way its encoding does, the
+ *	types share one operator table.  Equality is byte equality, which
+ *	uses the same primitives as strings so hash joins and bloom
+ *	filters recognize it.  LIKE is not supported (the parser rejects
+ *	it).
+ */
+
+#include "defs.h"
+#include <math.h>
+
+Export void Int64ToBin(int64_t v, char *buf);
+Export int64_t BinToInt64(const char *buf);
+Export void DoubleToBin(double d, char *buf);
+Export double BinToDouble(const char *buf);
+
+Prototype int IntFromString(const char *ptr, int bytes, char *buf);
+Prototype int IntToString(const char *data, char *buf);
+Prototype int DoubleFromString(const char *ptr, int bytes, char *buf);
+Prototype int DoubleToString(const char *data, char *buf);
+Prototype int DecimalFromString(const char *ptr, int bytes, char *buf);
+Prototype int DecimalToString(const char *data, char *buf);
+Prototype int TimestampFromString(const char *ptr, int bytes, char *buf);
+Prototype int TimestampToString(const char *data, char *buf);
+
+static int OpLtBinMatch(const ColData *d1, const ColData *d2);
+static int OpLtEqBinMatch(const ColData *d1, const ColData *d2);
+static int OpGtBinMatch(const ColData *d1, const ColData *d2);
+static int OpGtEqBinMatch(const ColData *d1, const ColData *d2);
+
+static int binCompare(const ColData *d1, const ColData *d2);
+static u_int64_t binGet(const char *buf);
+static void binPut(char *buf, u_int64_t v);
+static int numCopy(const char *ptr, int bytes, char *tmp, int size);
+static int numDigits(const char **pp, int max, int *pv);
+static int64_t daysFromCivil(int y, int m, int d);
+static void civilFromDays(int64_t z, int *py, int *pm, int *pd);
+
+#define BIN_SIGN	((u_int64_t)1 << 63)
+#define BIN_INT64_MAX	((int64_t)(BIN_SIGN - 1))
+#define USECS_PER_DAY	((int64_t)86400 * 1000000)
+
+Prototype dataop_func_t DataTypeBinaryFuncAry[];
+
+dataop_func_t DataTypeBinaryFuncAry[] = {
+	OpUnknown,		/* DATATYPE_UNKNOWN	*/
+	OpUnknown,		/* DATATYPE_LIKE	*/
+	OpUnknown,		/* DATATYPE_RLIKE	*/
+	OpExactMatch,		/* DATATYPE_SAME	*/
+	OpExactNoMatch,		/* DATATYPE_RSAME	*/
+	OpExactMatch,		/* DATATYPE_EQEQ	*/
+	OpExactNoMatch,		/* DATATYPE_NOTEQ	*/
+	OpLtBinMatch,		/* DATATYPE_LT		*/
+	OpLtEqBinMatch,		/* DATATYPE_LTEQ	*/
+	OpGtBinMatch,		/* DATATYPE_GT 		*/
+	OpGtEqBinMatch		/* DATATYPE_GTEQ	*/
+};
+
+static int
+OpLtBinMatch(const ColData *d1, const ColData *d2)
+{
+    return((binCompare(d1, d2) < 0) ? 1 : -1);
+}
+
+static int
+OpLtEqBinMatch(const ColData *d1, const ColData *d2)
+{
+    return((binCompare(d1, d2) <= 0) ? 1 : -1);
+}
+
+static int
+OpGtBinMatch(const ColData *d1, const ColData *d2)
+{
+    return((binCompare(d1, d2) > 0) ? 1 : -1);
+}
+
+static int
+OpGtEqBinMatch(const ColData *d1, const ColData *d2)
+{
+    return((binCompare(d1, d2) >= 0) ? 1 : -1);
+}
+
+/*
+ * binCompare() - compare two encoded values
+ *
+ *	Anything which is not a full sized value (NULL in particular)
+ *	is compared as an unsigned byte string.
+ */
+static int
+binCompare(const ColData *d1, const ColData *d2)
+{
+    int s;
+    int r;
+
+    if (d1->cd_Bytes == DATATYPE_BINSIZE && d2->cd_Bytes == DATATYPE_BINSIZE) {
+	u_int64_t v1 = binGet(d1->cd_Data);
+	u_int64_t v2 = binGet(d2->cd_Data);
+
+	if (v1 < v2)
+	    return(-1);
+	return(v1 > v2);
+    }
+    s = (d1->cd_Bytes < d2->cd_Bytes) ? d1->cd_Bytes : d2->cd_Bytes;
+    if (s && (r = memcmp(d1->cd_Data, d2->cd_Data, s)) != 0)
+	return(r);
+    return(d1->cd_Bytes - d2->cd_Bytes);
+}
+
+static u_int64_t
+binGet(const char *buf)
+{
+    const u_int8_t *p = (const u_int8_t *)buf;
+
+    return(((u_int64_t)p[0] << 56) | ((u_int64_t)p[1] << 48) |
+	   ((u_int64_t)p[2] << 40) | ((u_int64_t)p[3] << 32) |
+	   ((u_int64_t)p[4] << 24) | ((u_int64_t)p[5] << 16) |
+	   ((u_int64_t)p[6] << 8) | (u_int64_t)p[7]);
+}
+
+static void
+binPut(char *buf, u_int64_t v)
+{
+    int i;
+
+    for (i = DATATYPE_BINSIZE - 1; i >= 0; --i) {
+	buf[i] = (char)(v & 0xFF);
+	v >>= 8;
+    }
+}
+
+void
+Int64ToBin(int64_t v, char *buf)
+{
+    binPut(buf, (u_int64_t)v ^ BIN_SIGN);
+}
+
+int64_t
+BinToInt64(const char *buf)
+{
+    return((int64_t)(binGet(buf) ^ BIN_SIGN));
+}
+
+/*
+ * DoubleToBin() - encode a double.  -0.0 is stored as 0.0 so that
+ *		   equal values have equal encodings.
+ */
+void
+DoubleToBin(double d, char *buf)
+{
+    u_int64_t v;
+
+    if (d == 0.0)
+	d = 0.0;
+    bcopy(&d, &v, sizeof(v));
+    if (v & BIN_SIGN)
+	v = ~v;
+    else
+	v |= BIN_SIGN;
+    binPut(buf, v);
+}
+
+double
+BinToDouble(const char *buf)
+{
+    u_int64_t v = binGet(buf);
+    double d;
+
+    if (v & BIN_SIGN)
+	v &= ~BIN_SIGN;
+    else
+	v = ~v;
+    bcopy(&v, &d, sizeof(d));
+    return(d);
+}
+
+/*
+ * numCopy() - copy a value into a 0-terminated buffer for parsing,
+ *	       returns -1 if it is empty or does not fit.
+ */
+static int
+numCopy(const char *ptr, int bytes, char *tmp, int size)
+{
+    if (bytes <= 0 || bytes >= size)
+	return(-1);
+    bcopy(ptr, tmp, bytes);
+    tmp[bytes] = 0;
+    return(0);
+}
+
+int
+IntFromString(const char *ptr, int bytes, char *buf)
+{
+    char tmp[DATATYPE_FMTSIZE];
+    char *end;
+    int64_t v;
+
+    if (numCopy(ptr, bytes, tmp, sizeof(tmp)) < 0)
+	return(-1);
+    errno = 0;
+    v = strtoll(tmp, &end, 10);
+    if (*end != 0 || errno != 0 || isspace((unsigned char)tmp[0]))
+	return(-1);
+    Int64ToBin(v, buf);
+    return(DATATYPE_BINSIZE);
+}
+
+int
+IntToString(const char *data, char *buf)
+{
+    return(snprintf(buf, DATATYPE_FMTSIZE, "%lld",
+	(long long)BinToInt64(data)));
+}
+
+/*
+ * DoubleFromString() - NaN and infinities are not storable values.
+ */
+int
+DoubleFromString(const char *ptr, int bytes, char *buf)
+{
+    char tmp[64];
+    char *end;
+    double d;
+
+    if (numCopy(ptr, bytes, tmp, sizeof(tmp)) < 0)
+	return(-1);
+    d = strtod(tmp, &end);	/* overflow is infinite, underflow ok */
+    if (*end != 0 || isspace((unsigned char)tmp[0]) || !isfinite(d))
+	return(-1);
+    DoubleToBin(d, buf);
+    return(DATATYPE_BINSIZE);
+}
+
+/*
+ * DoubleToString() - use the fewest digits (15 to 17) which read back
+ *		      as the same value.
+ */
+int
+DoubleToString(const char *data, char *buf)
+{
+    double d = BinToDouble(data);
+    int prec;
+    int len;
+
+    for (prec = 15; ; ++prec) {
+	len = snprintf(buf, DATATYPE_FMTSIZE, "%.*g", prec, d);
+	if (prec == 17 || strtod(buf, NULL) == d)
+	    break;
+    }
+    return(len);
+}
+
+/*
+ * DecimalFromString() - [+-]digits[.digits]
+ *
+ *	Digits beyond DATATYPE_DECSCALE are rounded, half away from zero.
+ */
+int
+DecimalFromString(const char *ptr, int bytes, char *buf)
+{
+    const char *end = ptr + bytes;
+    u_int64_t v = 0;
+    int neg = 0;
+    int digits = 0;
+    int scale = 0;
+    int c;
+
+    if (ptr < end && (*ptr == '-' || *ptr == '+')) {
+	neg = (*ptr == '-');
+	++ptr;
+    }
+    while (ptr < end && isdigit((unsigned char)*ptr)) {
+	c = *ptr++ - '0';
+	if (v > ((u_int64_t)BIN_INT64_MAX / DATATYPE_DECUNIT - c) / 10)
+	    return(-1);
+	v = v * 10 + c;
+	++digits;
+    }
+    v *= DATATYPE_DECUNIT;
+    if (ptr < end && *ptr == '.') {
+	u_int64_t unit = DATATYPE_DECUNIT;
+
+	++ptr;
+	while (ptr < end && isdigit((unsigned char)*ptr)) {
+	    c = *ptr++ - '0';
+	    if (scale < DATATYPE_DECSCALE) {
+		unit /= 10;
+		v += c * unit;
+	    } else if (scale == DATATYPE_DECSCALE && c >= 5) {
+		++v;
+	    }
+	    ++scale;
+	    ++digits;
+	}
+    }
+    if (ptr != end || digits == 0 || v > (u_int64_t)BIN_INT64_MAX)
+	return(-1);
+    Int64ToBin(neg ? -(int64_t)v : (int64_t)v, buf);
+    return(DATATYPE_BINSIZE);
+}
+
+/*
+ * DecimalToString() - trailing zeros after the point are dropped
+ */
+int
+DecimalToString(const char *data, char *buf)
+{
+    int64_t v = BinToInt64(data);
+    u_int64_t u = (v < 0) ? -(u_int64_t)v : (u_int64_t)v;
+    int frac = (int)(u % DATATYPE_DECUNIT);
+    int len;
+
+    len = snprintf(buf, DATATYPE_FMTSIZE, "%s%llu",
+		(v < 0) ? "-" : "",
+		(unsigned long long)(u / DATATYPE_DECUNIT));
+    if (frac) {
+	len += snprintf(buf + len, DATATYPE_FMTSIZE - len, ".%0*d",
+		DATATYPE_DECSCALE, frac);
+	while (buf[len-1] == '0')
+	    buf[--len] = 0;
+    }
+    return(len);
+}
+
+/*
+ * TimestampFromString() - YYYY-MM-DD[{ |T}HH:MM[:SS[.ffffff]]][Z]
+ *
+ *	Timestamps are UTC.
+ */
+int
+TimestampFromString(const char *ptr, int bytes, char *buf)
+{
+    char tmp[DATATYPE_FMTSIZE];
+    const char *p = tmp;
+    int y, mo, d;
+    int h = 0;
+    int mi = 0;
+    int s = 0;
+    int usec = 0;
+    int64_t v;
+
+    if (numCopy(ptr, bytes, tmp, sizeof(tmp)) < 0)
+	return(-1);
+    if (numDigits(&p, 4, &y) != 4 || *p++ != '-' ||
+	numDigits(&p, 2, &mo) != 2 || *p++ != '-' ||
+	numDigits(&p, 2, &d) != 2
+    ) {
+	return(-1);
+    }
+    if (*p == ' ' || *p == 'T') {
+	++p;
+	if (numDigits(&p, 2, &h) != 2 || *p++ != ':' ||
+	    numDigits(&p, 2, &mi) != 2
+	) {
+	    return(-1);
+	}
+	if (*p == ':') {
+	    ++p;
+	    if (numDigits(&p, 2, &s) != 2)
+		return(-1);
+	    if (*p == '.') {
+		int n;
+
+		++p;
+		if ((n = numDigits(&p, 6, &usec)) == 0)
+		    return(-1);
+		while (n++ < 6)
+		    usec *= 10;
+	    }
+	}
+    }
+    if (*p == 'Z')
+	++p;
+    if (*p != 0)
+	return(-1);
+    if (y < 1 || mo < 1 || mo > 12 || d < 1 || h > 23 || mi > 59 || s > 59)
+	return(-1);
+    if (d > 28) {
+	int y2, mo2, d2;
+
+	civilFromDays(daysFromCivil(y, mo, d), &y2, &mo2, &d2);
+	if (mo2 != mo)
+	    return(-1);
+    }
+    v = daysFromCivil(y, mo, d) * USECS_PER_DAY +
+	((int64_t)h * 3600 + mi * 60 + s) * 1000000 + usec;
+    Int64ToBin(v, buf);
+    return(DATATYPE_BINSIZE);
+}
+
+/*
+ * TimestampToString() - YYYY-MM-DD HH:MM:SS[.ffffff]
+ */
+int
+TimestampToString(const char *data, char *buf)
+{
+    int64_t v = BinToInt64(data);
+    int64_t days;
+    int64_t t;
+    int y, mo, d;
+    int len;
+
+    days = v / USECS_PER_DAY;
+    t = v % USECS_PER_DAY;
+    if (t < 0) {
+	t += USECS_PER_DAY;
+	--days;
+    }
+    civilFromDays(days, &y, &mo, &d);
+    len = snprintf(buf, DATATYPE_FMTSIZE, "%04d-%02d-%02d %02d:%02d:%02d",
+		y, mo, d,
+		(int)(t / 3600000000LL),
+		(int)(t / 60000000 % 60),
+		(int)(t / 1000000 % 60));
+    if (t % 1000000) {
+	len += snprintf(buf + len, DATATYPE_FMTSIZE - len, ".%06d",
+		(int)(t % 1000000));
+    }
+    return(len);
+}
+
+/*
+ * numDigits() - parse up to max decimal digits, return the count
+ */
+static int
+numDigits(const char **pp, int max, int *pv)
+{
+    const char *p = *pp;
+    int n = 0;
+
+    *pv = 0;
+    while (n < max && isdigit((unsigned char)*p)) {
+	*pv = *pv * 10 + (*p++ - '0');
+	++n;
+    }
+    *pp = p;
+    return(n);
+}
+
+/*
+ * daysFromCivil() - days since 1970-01-01 of a proleptic Gregorian date
+ */
+static int64_t
+daysFromCivil(int y, int m, int d)
+{
+    int64_t era;
+    int yoe;
+    int doy;
+
+    if (m <= 2)
+	--y;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = (int)(y - era * 400);
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    return(era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468);
+}
+
+static void
+civilFromDays(int64_t z, int *py, int *pm, int *pd)
+{
+    int64_t era;
+    int doe;
+    int yoe;
+    int doy;
+    int mp;
+
+    z += 719468;
+    era = (z >= 0 ? z : z - 146096) / 146097;
+    doe = (int)(z - era * 146097);
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    *pd = doy - (153 * mp + 2) / 5 + 1;
+    *pm = mp + (mp < 10 ? 3 : -9);
+    *py = (int)(yoe + era * 400 + (*pm <= 2));
+}
@@ -5,13 +5,21 @@
  * file at the base of the distribution tree.
  *
  *	Implements string operators, validation, encoding, and decoding
- *	functions.
+ *	functions.  The byte scans are done by StrFirstDiff() and
+ *	StrFirstDiffNoCase() (see strvec.c).
+ *
+ *	LIKE is a case-insensitive prefix match.  A '%' in the pattern
+ *	matches any run of characters, so 'ab%cd' matches any value
+ *	starting with 'ab' which contains 'cd' further on, and '%cd'
+ *	matches any value containing 'cd'.
  *
  * $Backplane: rdbms/libdbtypes/string.c,v 1.3 2002/08/20 22:05:53 dillon Exp $
  */
 
 #include "defs.h"
 
+Export int LikePrefixLen(const char *data, int bytes);
+
 static int OpLikeStrMatch(const ColData *d1, const ColData *d2);
 static int OpLikeNoStrMatch(const ColData *d1, const ColData *d2);
 
@@ -23,6 +31,9 @@ static int OpGtStrMatch(const ColData *d1, const ColData *d2);
 static int OpLtEqStrMatch(const ColData *d1, const ColData *d2);
 static int OpGtEqStrMatch(const ColData *d1, const ColData *d2);
 
+static int likeWildMatch(const ColData *pat, const ColData *val);
+static int likeFind(const char *pat, int n, const char *val, int bytes);
+
 Prototype dataop_func_t DataTypeStringFuncAry[];
 
 dataop_func_t DataTypeStringFuncAry[] = {
@@ -43,11 +54,9 @@ static int
 OpLtStrMatch(const ColData *d1, const ColData *d2)
 {
     int s = (d1->cd_Bytes < d2->cd_Bytes) ? d1->cd_Bytes : d2->cd_Bytes;
-    int i;
+    int i = StrFirstDiff(d1->cd_Data, d2->cd_Data, s);
 
-    for (i = 0; i < s; ++i) {
-	if (d1->cd_Data[i] == d2->cd_Data[i])
-	    continue;
+    if (i < s) {
 	if (d1->cd_Data[i] < d2->cd_Data[i])
 	    return(1);		/* TRUE region #1 (d1 smaller) */
 	return(-1);		/* FALSE region #1 (d1 larger) */
@@ -64,11 +73,9 @@ static int
 OpGtStrMatch(const ColData *d1, const ColData *d2)
 {
     int s = (d1->cd_Bytes < d2->cd_Bytes) ? d1->cd_Bytes : d2->cd_Bytes;
-    int i;
+    int i = StrFirstDiff(d1->cd_Data, d2->cd_Data, s);
 
-    for (i = 0; i < s; ++i) {
-	if (d1->cd_Data[i] == d2->cd_Data[i])
-	    continue;
+    if (i < s) {
 	if (d1->cd_Data[i] > d2->cd_Data[i])
 	    return(1);		/* TRUE region #1 (d1 larger) */
 	return(-1);		/* FALSE region #1 (d1 smaller) */
@@ -85,11 +92,9 @@ static int
 OpLtEqStrMatch(const ColData *d1, const ColData *d2)
 {
     int s = (d1->cd_Bytes < d2->cd_Bytes) ? d1->cd_Bytes : d2->cd_Bytes;
-    int i;
+    int i = StrFirstDiff(d1->cd_Data, d2->cd_Data, s);
 
-    for (i = 0; i < s; ++i) {
-	if (d1->cd_Data[i] == d2->cd_Data[i])
-	    continue;
+    if (i < s) {
 	if (d1->cd_Data[i] < d2->cd_Data[i])
 	    return(1);		/* TRUE region #1 (d1 smaller) */
 	return(-1);		/* FALSE region #1 (d1 larger) */
@@ -106,11 +111,9 @@ static int
 OpGtEqStrMatch(const ColData *d1, const ColData *d2)
 {
     int s = (d1->cd_Bytes < d2->cd_Bytes) ? d1->cd_Bytes : d2->cd_Bytes;
-    int i;
+    int i = StrFirstDiff(d1->cd_Data, d2->cd_Data, s);
 
-    for (i = 0; i < s; ++i) {
-	if (d1->cd_Data[i] == d2->cd_Data[i])
-	    continue;
+    if (i < s) {
 	if (d1->cd_Data[i] > d2->cd_Data[i])
 	    return(1);		/* TRUE region #1 (d1 larger) */
 	return(-1);		/* FALSE region #1 (d1 smaller) */
@@ -126,14 +129,14 @@ OpGtEqStrMatch(const ColData *d1, const ColData *d2)
 static int
 OpLikeNoStrMatch(const ColData *d1, const ColData *d2)
 {
-    int i;
+    if (LikePrefixLen(d1->cd_Data, d1->cd_Bytes) != d1->cd_Bytes)
+	return(likeWildMatch(d1, d2) ? -1 : 2);
 
     if (d1->cd_Bytes > d2->cd_Bytes)	/* d1 LIKE d2, d1 too large for d2 */
 	return(1);
 
-    for (i = 0; i < d1->cd_Bytes; ++i) {
-	if (tolower(d1->cd_Data[i]) == tolower(d2->cd_Data[i]))
-	    continue;
+    if (StrFirstDiffNoCase(d1->cd_Data, d2->cd_Data, d1->cd_Bytes) <
+	d1->cd_Bytes) {
 	return(2);			/* substring mismatch */
     }
     return(-1);				/* GOOD */
@@ -142,14 +145,14 @@ OpLikeNoStrMatch(const ColData *d1, const ColData *d2)
 static int
 OpLikeStrMatch(const ColData *d2, const ColData *d1)
 {
-    int i;
+    if (LikePrefixLen(d1->cd_Data, d1->cd_Bytes) != d1->cd_Bytes)
+	return(likeWildMatch(d1, d2) ? 1 : -2);
 
     if (d1->cd_Bytes > d2->cd_Bytes)	/* d1 LIKE d2, d1 too large for d2 */
 	return(-1);
 
-    for (i = 0; i < d1->cd_Bytes; ++i) {
-	if (tolower(d1->cd_Data[i]) == tolower(d2->cd_Data[i]))
-	    continue;
+    if (StrFirstDiffNoCase(d1->cd_Data, d2->cd_Data, d1->cd_Bytes) <
+	d1->cd_Bytes) {
 	return(-2);			/* substring mismatch */
     }
     return(1);				/* GOOD */
@@ -159,13 +162,11 @@ static int
 OpSameStrMatch(const ColData *d1, const ColData *d2)
 {
     int s = (d1->cd_Bytes < d2->cd_Bytes) ? d1->cd_Bytes : d2->cd_Bytes;
-    int i;
+    int i = StrFirstDiffNoCase(d1->cd_Data, d2->cd_Data, s);
 
-    for (i = 0; i < s; ++i) {
+    if (i < s) {
 	unsigned char c1 = tolower(d1->cd_Data[i]);
 	unsigned char c2 = tolower(d2->cd_Data[i]);
-	if (c1 == c2)
-	    continue;
 	if (c1 < c2)
 	    return(-1);		/* FALSE region #1 (d1 smaller) */
 	return(-2);		/* FALSE region #2 (d1 larger) */
@@ -182,13 +183,11 @@ static int
 OpSameNoStrMatch(const ColData *d1, const ColData *d2)
 {
     int s = (d1->cd_Bytes < d2->cd_Bytes) ? d1->cd_Bytes : d2->cd_Bytes;
-    int i;
+    int i = StrFirstDiffNoCase(d1->cd_Data, d2->cd_Data, s);
 
-    for (i = 0; i < s; ++i) {
+    if (i < s) {
 	unsigned char c1 = tolower(d1->cd_Data[i]);
 	unsigned char c2 = tolower(d2->cd_Data[i]);
-	if (c1 == c2)
-	    continue;
 	if (c1 < c2)
 	    return(1);		/* TRUE region #1 (d1 smaller) */
 	return(2);		/* TRUE region #2 (d1 larger) */
@@ -201,3 +200,89 @@ OpSameNoStrMatch(const ColData *d1, const ColData *d2)
     return(2);			/* TRUE region #2 (d1 larger) */
 }
 
+/*
+ * LikePrefixLen() -	length of the anchored part of a LIKE pattern
+ *
+ *	Returns the number of bytes before the first '%', or bytes if
+ *	there is none.
+ */
+int
+LikePrefixLen(const char *data, int bytes)
+{
+    const char *wc;
+
+    if (bytes > 0 && (wc = memchr(data, '%', bytes)) != NULL)
+	return(wc - data);
+    return(bytes);
+}
+
+/*
+ * likeWildMatch() -	match a LIKE pattern containing '%'s
+ *
+ *	The part of the pattern before the first '%' must match the start
+ *	of the value and every following part must be found after the
+ *	previous one.  Taking the leftmost occurrence of each part is
+ *	always correct since the end of the pattern is open.  Returns 1 on
+ *	a match, 0 otherwise.
+ */
+static int
+likeWildMatch(const ColData *pat, const ColData *val)
+{
+    const char *p = pat->cd_Data;
+    const char *v = val->cd_Data;
+    int pbytes = pat->cd_Bytes;
+    int vbytes = val->cd_Bytes;
+    int n;
+    int i;
+
+    n = LikePrefixLen(p, pbytes);
+    if (n > vbytes || StrFirstDiffNoCase(p, v, n) < n)
+	return(0);
+    i = 0;
+    for (;;) {
+	p += n;
+	pbytes -= n;
+	v += i + n;
+	vbytes -= i + n;
+	if (pbytes == 0)
+	    break;
+	++p;			/* skip '%' */
+	--pbytes;
+	n = LikePrefixLen(p, pbytes);
+	if ((i = likeFind(p, n, v, vbytes)) < 0)
+	    return(0);
+    }
+    return(1);
+}
+
+/*
+ * likeFind() -	locate the first case-insensitive occurrence of pat[n]
+ *
+ *	Candidate positions are anchored on the first byte of the pattern,
+ *	using memchr() when case folding does not apply to it.  Returns
+ *	the offset in val or -1 if not found.
+ */
+static int
+likeFind(const char *pat, int n, const char *val, int bytes)
+{
+    int c;
+    int i;
+
+    if (n == 0)
+	return(0);
+    c = tolower(pat[0]);
+    for (i = 0; i + n <= bytes; ++i) {
+	if (c == toupper(pat[0])) {
+	    const char *ptr = memchr(val + i, pat[0], bytes - n + 1 - i);
+
+	    if (ptr == NULL)
+		break;
+	    i = ptr - val;
+	} else if (tolower(val[i]) != c) {
+	    continue;
+	}
+	if (StrFirstDiffNoCase(pat + 1, val + i + 1, n - 1) == n - 1)
+	    return(i);
+    }
+    return(-1);
+}
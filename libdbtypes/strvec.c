@@ -0,0 +1,229 @@
+/*
+ * LIBDBTYPES/STRVEC.C
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	Implements the first-difference search used by the string and
+ *	default operators.  StrFirstDiff() returns the index of the first
+ *	byte at which two buffers differ, or n if they do not differ.
+ *	StrFirstDiffNoCase() does the same after case folding each byte.
+ *
+ *	On x86-64 the search is done 16 bytes at a time with SSE2, or 32
+ *	bytes at a time with AVX2 if the cpu supports it.  The choice is
+ *	made the first time either function is called.  The scalar loops
+ *	are used for the tail and on other machines, and are the reference
+ *	the vector versions must agree with.
+ *
+ *	The vector versions fold 'A'-'Z' only, which is what tolower()
+ *	does in the C locale the database runs in.
+ */
+
+#include "defs.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define STRVEC_SSE2
+#include <emmintrin.h>
+#if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define STRVEC_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+typedef int (*strdiff_func_t)(const char *s1, const char *s2, int n);
+
+Export int StrFirstDiff(const char *s1, const char *s2, int n);
+Export int StrFirstDiffNoCase(const char *s1, const char *s2, int n);
+
+static int strDiffScalar(const char *s1, const char *s2, int n);
+static int strDiffNoCaseScalar(const char *s1, const char *s2, int n);
+static int strDiffSelect(const char *s1, const char *s2, int n);
+static int strDiffNoCaseSelect(const char *s1, const char *s2, int n);
+static void strVecSelect(void);
+#ifdef STRVEC_SSE2
+static int strDiffSSE2(const char *s1, const char *s2, int n);
+static int strDiffNoCaseSSE2(const char *s1, const char *s2, int n);
+#endif
+#ifdef STRVEC_AVX2
+static int strDiffAVX2(const char *s1, const char *s2, int n);
+static int strDiffNoCaseAVX2(const char *s1, const char *s2, int n);
+#endif
+
+static strdiff_func_t StrDiffFunc = strDiffSelect;
+static strdiff_func_t StrDiffNoCaseFunc = strDiffNoCaseSelect;
+
+int
+StrFirstDiff(const char *s1, const char *s2, int n)
+{
+    return(StrDiffFunc(s1, s2, n));
+}
+
+int
+StrFirstDiffNoCase(const char *s1, const char *s2, int n)
+{
+    return(StrDiffNoCaseFunc(s1, s2, n));
+}
+
+/*
+ * The function pointers start out pointing at these, which pick the
+ * kernels for this cpu and then pass the call through.
+ */
+static int
+strDiffSelect(const char *s1, const char *s2, int n)
+{
+    strVecSelect();
+    return(StrDiffFunc(s1, s2, n));
+}
+
+static int
+strDiffNoCaseSelect(const char *s1, const char *s2, int n)
+{
+    strVecSelect();
+    return(StrDiffNoCaseFunc(s1, s2, n));
+}
+
+static void
+strVecSelect(void)
+{
+    strdiff_func_t diff = strDiffScalar;
+    strdiff_func_t nocase = strDiffNoCaseScalar;
+
+#ifdef STRVEC_SSE2
+    diff = strDiffSSE2;
+    nocase = strDiffNoCaseSSE2;
+#endif
+#ifdef STRVEC_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+	diff = strDiffAVX2;
+	nocase = strDiffNoCaseAVX2;
+    }
+#endif
+    StrDiffFunc = diff;
+    StrDiffNoCaseFunc = nocase;
+}
+
+static int
+strDiffScalar(const char *s1, const char *s2, int n)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+	if (s1[i] != s2[i])
+	    break;
+    }
+    return(i);
+}
+
+static int
+strDiffNoCaseScalar(const char *s1, const char *s2, int n)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+	if (tolower(s1[i]) != tolower(s2[i]))
+	    break;
+    }
+    return(i);
+}
+
+#ifdef STRVEC_SSE2
+
+/*
+ * Fold 'A'-'Z' to lower case.  Shifting the bytes so 'A' lands on -128
+ * turns the range check into a single signed compare.
+ */
+static __inline __m128i
+foldSSE2(__m128i v)
+{
+    __m128i t;
+
+    t = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - 'A')));
+    t = _mm_cmplt_epi8(t, _mm_set1_epi8((char)(0x80 + 26)));
+    return(_mm_or_si128(v, _mm_and_si128(t, _mm_set1_epi8(0x20))));
+}
+
+static int
+strDiffSSE2(const char *s1, const char *s2, int n)
+{
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+	__m128i v1 = _mm_loadu_si128((const __m128i *)(s1 + i));
+	__m128i v2 = _mm_loadu_si128((const __m128i *)(s2 + i));
+	int m = _mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2)) ^ 0xFFFF;
+
+	if (m)
+	    return(i + __builtin_ctz(m));
+    }
+    return(i + strDiffScalar(s1 + i, s2 + i, n - i));
+}
+
+static int
+strDiffNoCaseSSE2(const char *s1, const char *s2, int n)
+{
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+	__m128i v1 = foldSSE2(_mm_loadu_si128((const __m128i *)(s1 + i)));
+	__m128i v2 = foldSSE2(_mm_loadu_si128((const __m128i *)(s2 + i)));
+	int m = _mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2)) ^ 0xFFFF;
+
+	if (m)
+	    return(i + __builtin_ctz(m));
+    }
+    return(i + strDiffNoCaseScalar(s1 + i, s2 + i, n - i));
+}
+
+#endif
+
+#ifdef STRVEC_AVX2
+
+static __inline __attribute__((target("avx2"))) __m256i
+foldAVX2(__m256i v)
+{
+    __m256i t;
+
+    t = _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - 'A')));
+    t = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + 26)), t);
+    return(_mm256_or_si256(v, _mm256_and_si256(t, _mm256_set1_epi8(0x20))));
+}
+
+/*
+ * Less than 32 bytes left over is finished by the SSE2 version.
+ */
+static __attribute__((target("avx2"))) int
+strDiffAVX2(const char *s1, const char *s2, int n)
+{
+    int i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+	__m256i v1 = _mm256_loadu_si256((const __m256i *)(s1 + i));
+	__m256i v2 = _mm256_loadu_si256((const __m256i *)(s2 + i));
+	unsigned int m = ~(unsigned int)_mm256_movemask_epi8(
+			    _mm256_cmpeq_epi8(v1, v2));
+
+	if (m)
+	    return(i + __builtin_ctz(m));
+    }
+    return(i + strDiffSSE2(s1 + i, s2 + i, n - i));
+}
+
+static __attribute__((target("avx2"))) int
+strDiffNoCaseAVX2(const char *s1, const char *s2, int n)
+{
+    int i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+	__m256i v1 = foldAVX2(_mm256_loadu_si256((const __m256i *)(s1 + i)));
+	__m256i v2 = foldAVX2(_mm256_loadu_si256((const __m256i *)(s2 + i)));
+	unsigned int m = ~(unsigned int)_mm256_movemask_epi8(
+			    _mm256_cmpeq_epi8(v1, v2));
+
+	if (m)
+	    return(i + __builtin_ctz(m));
+    }
+    return(i + strDiffNoCaseSSE2(s1 + i, s2 + i, n - i));
+}
+
+#endif
@@ -73,6 +73,11 @@
 #define DBERR_LOST_LINK			-70	/* link lost during strm qry */
 #define DBERR_NOT_BOTH_UNIQUE_PRIMARY	-71	/* can't have both */
 #define DBERR_DUPLICATE_DEFAULT		-72	/* multiple defaults for col */
+#define DBERR_NOT_GROUPED		-73	/* column not in GROUP BY */
+#define DBERR_PARAM_COUNT		-74	/* wrong number of parameters */
+#define DBERR_PARAM_ILLEGAL		-75	/* parameter not allowed here */
+#define DBERR_BAD_VALUE			-76	/* value invalid for col type */
+#define DBERR_TYPE_OPERATOR		-77	/* operator invalid for col type */
 
 #define DBERR_REP_NOT_IN_TREE		-128	/* db not in spanning tree */
 #define DBERR_REP_UNASSOCIATED_COPIES	-129	/* multiple unassoc db's */
@@ -157,11 +162,11 @@
 	/* 70 */	"Link lost during streaming query", \
 	/* 71 */	"Cannot have both UNIQUE and PRIMARY KEY for field", \
 	/* 72 */	"Duplicate default clause", \
-	/* 73 */	UnknownError, \
-	/* 74 */	UnknownError, \
-	/* 75 */	UnknownError, \
-	/* 76 */	UnknownError, \
-	/* 77 */	UnknownError, \
+	/* 73 */	"Column must be in GROUP BY", \
+	/* 74 */	"Wrong number of query parameters", \
+	/* 75 */	"Query parameter not allowed here", \
+	/* 76 */	"Value not valid for the column type", \
+	/* 77 */	"Operator not supported for the column type", \
 	/* 78 */	UnknownError, \
 	/* 79 */	UnknownError, \
 	/* 80 */	UnknownError, \
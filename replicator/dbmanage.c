@@ -61,6 +61,7 @@ CreateDBManageNode(const char *dbname)
     if (pid == 0) {
 	char *debugBuf;
 	char *vhostBuf;
+	char *optsBuf;
 	int ok = 1;
 
 	safe_asprintf(&debugBuf, "-d%d", DebugOpt);
@@ -68,6 +69,10 @@ CreateDBManageNode(const char *dbname)
 	    safe_asprintf(&vhostBuf, "-V%s", VirtualHostName);
 	else
 	    safe_asprintf(&vhostBuf, "-n");
+	if (DatabaseOpts)
+	    safe_asprintf(&optsBuf, "-X%s", DatabaseOpts);
+	else
+	    safe_asprintf(&optsBuf, "-n");
 
 	close(cfds[0]);
 	close(xfds[0]);
@@ -102,7 +107,7 @@ CreateDBManageNode(const char *dbname)
 	 * Use EXEC to clean up all the garbage the master proc may have
 	 * built up.
 	 */
-	execlp(Arg0, Arg0, debugBuf, "-x", "-D", DefaultDBDir(), vhostBuf, dbname, NULL);
+	execlp(Arg0, Arg0, debugBuf, "-x", "-D", DefaultDBDir(), vhostBuf, optsBuf, dbname, NULL);
 	_exit(1);
     }
 
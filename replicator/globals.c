@@ -12,8 +12,10 @@
 Prototype iofd_t LisDFd;
 Prototype iofd_t LisCFd;
 Prototype char *VirtualHostName;
+Prototype char *DatabaseOpts;
 
 iofd_t LisCFd;
 iofd_t LisDFd;
 char *VirtualHostName;
+char *DatabaseOpts;	/* extra drd_database options (-X) */
 
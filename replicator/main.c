@@ -88,6 +88,7 @@ task_main(int ac, char **av)
 	    "    -u <link_string>       remove replication link\n"
 	    "    -O database:level[:file] Set debugging for database\n"
 	    "    -L logfile             Set the initial logfile\n"
+	    "    -X \"options\"           Pass options to drd_database\n"
 	    "    -STOP database         stop replicator & drd for databse\n"
 	    "    -CREATE database       create a new database\n"
 	    "    -SNAP database         create db as SNAP to remote db\n"
@@ -152,6 +153,9 @@ task_main(int ac, char **av)
 	case 'L':	/* log file */
 	    LogFile = (*ptr) ? ptr : av[++i];
 	    break;
+	case 'X':	/* options passed through to drd_database */
+	    DatabaseOpts = (*ptr) ? ptr : av[++i];
+	    break;
 	/*
 	 * Control ops - send to running replicator, get response, and exit
 	 */
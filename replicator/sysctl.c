@@ -189,7 +189,9 @@ ExecDRDDatabase(const char *dbName, int *perror, char **emsg)
     pid_t pid;
     dbstamp_t createTs;
     int fds[2];
+    int ac;
     char fopt[8];
+    char *av[32];
 
     /*
      * Make sure we have access to the database, creating it
@@ -246,20 +248,41 @@ ExecDRDDatabase(const char *dbName, int *perror, char **emsg)
 
     /*
      * Success (child), exec drd_database.  All our other descriptors will
-     * be closed on exec.
+     * be closed on exec.  Any options given to the replicator with -X are
+     * passed along ahead of the database name.
      */
 
     close(fds[0]);
     snprintf(fopt, sizeof(fopt), "%d", fds[1]);
 
+    ac = 0;
+    av[ac++] = "drd_database";
+    av[ac++] = "-D";
+    av[ac++] = (char *)DefaultDBDir();
+    av[ac++] = "-f";
+    av[ac++] = fopt;
+    if (DatabaseOpts) {
+	char *opts = strdup(DatabaseOpts);
+	char *tok;
+
+	for (tok = strtok(opts, " \t\r\n");
+	     tok && ac < arysize(av) - 2;
+	     tok = strtok(NULL, " \t\r\n")
+	) {
+	    av[ac++] = tok;
+	}
+    }
+    av[ac++] = (char *)dbName;
+    av[ac] = NULL;
+
     if (Arg0Path[0]) {
 	char *arg0;
 
 	if (asprintf(&arg0, "%sdrd_database", Arg0Path) < 0)
 	    _exit(1);
-	execl(arg0, "drd_database", "-D", DefaultDBDir(), "-f", fopt, dbName, NULL);
+	execv(arg0, av);
     } else {
-	execlp("drd_database", "drd_database", "-D", DefaultDBDir(), "-f", fopt, dbName, NULL);
+	execvp("drd_database", av);
     }
     _exit(1);
     return(NULL);	/* NOT REACHED */
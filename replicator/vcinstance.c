@@ -13,7 +13,7 @@ Prototype void VCInstanceSlave(InstInfo *ii);
 Prototype void UpdateRouteMinCTs(CLDataBase *parCd);
 
 static void VCSlavePacketLoop(InstInfo *ii, CLDataBase *cd, CLDataBase *parCd);
-static int VCSlaveQueryTrans(CLDataBase *cd, const char *qry, InstInfo *ii);
+static int VCSlaveQueryTrans(CLDataBase *cd, const char *qry, int bytes, InstInfo *ii);
 static int VCSlaveRawRead(CLDataBase *cd, RPRawReadMsg *rpMsg, InstInfo *ii);
 
 /*
@@ -116,7 +116,8 @@ VCSlavePacketLoop(InstInfo *ii, CLDataBase *cd, CLDataBase *parCd)
 	    case RPCMD_RUN_QUERY_TRAN:
 		dbinfo("%p: RUNQUERY(%d): %s\n", ii, ii->i_VCILevel, rpMsg->rpa_Pkt.pk_Data);
 		if (ii->i_VCILevel) {
-		    error = VCSlaveQueryTrans(cd, rpMsg->rpa_Pkt.pk_Data, ii);
+		    error = VCSlaveQueryTrans(cd, rpMsg->rpa_Pkt.pk_Data,
+				rpMsg->rpa_Pkt.pk_Bytes - sizeof(RPPkt), ii);
 		    respond = sizeof(RPMsg);
 		} else {
 		    respond = sizeof(RPMsg);	/* respond (w/ error) */
@@ -125,7 +126,8 @@ VCSlavePacketLoop(InstInfo *ii, CLDataBase *cd, CLDataBase *parCd)
 	    case RPCMD_REC_QUERY_TRAN:
 		dbinfo("%p: RECQUERY(%d): %s\n", ii, ii->i_VCILevel, rpMsg->rpa_Pkt.pk_Data);
 		if (ii->i_VCILevel) {
-		    RecordQueryCLTrans(cd, rpMsg->rpa_Pkt.pk_Data, &error);
+		    RecordQueryCLTransData(cd, rpMsg->rpa_Pkt.pk_Data,
+			rpMsg->rpa_Pkt.pk_Bytes - sizeof(RPPkt), &error);
 		} else {
 		    respond = sizeof(RPMsg);	/* respond (w/ error) */
 		}
@@ -300,10 +302,13 @@ VCSlavePacketLoop(InstInfo *ii, CLDataBase *cd, CLDataBase *parCd)
  *
  *	Second, we need to check for RPCMD_CONTINUE (end-to-end flow control)
  *	packets and forward CLCMD_CONTINUE's to the database core.
+ *
+ *	The whole packet payload is passed on, a prepared query's parameter
+ *	block follows the query text's NUL.
  */
 
 static int
-VCSlaveQueryTrans(CLDataBase *cd, const char *qry, InstInfo *ii)
+VCSlaveQueryTrans(CLDataBase *cd, const char *qry, int bytes, InstInfo *ii)
 {
     CLAnyMsg *msg;
     int error = -1;
@@ -312,7 +317,7 @@ VCSlaveQueryTrans(CLDataBase *cd, const char *qry, InstInfo *ii)
     int drd_stallCount = 0;
     int i;
 
-    msg = BuildCLMsgStr(CLCMD_RUN_QUERY_TRAN, qry);
+    msg = BuildCLMsgData(CLCMD_RUN_QUERY_TRAN, qry, bytes);
     WriteCLMsg(cd->cd_Iow, msg, 1);
 
     /*
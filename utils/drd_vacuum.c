@@ -411,7 +411,7 @@ VacuumScan(
 
     ti->ti_VTable = vtid;
     if (vtid) {
-	ti->ti_Index = ti->ti_Table->ta_GetTableIndex(ti->ti_Table, ti->ti_VTable, colid, ROP_EQEQ);
+	ti->ti_Index = ti->ti_Table->ta_GetTableIndex(ti->ti_Table, ti->ti_VTable, &colid, 1, NULL, -1, ROP_EQEQ);
 	ti->ti_Flags = TABRAN_INDEX|TABRAN_SYNCIDX;
 	ti->ti_Index->i_SetTableRange(ti, ti->ti_Table, GetRawDataCol(rd, colid, DATATYPE_STRING), NULL, TABRAN_INDEX|TABRAN_SYNCIDX|TABRAN_INIT);
     } else {
@@ -459,8 +459,7 @@ VacuumScan(
 	}
 	if (rh->rh_Stamp < hts) {
 	    if (rh->rh_Flags & RHF_DELETE)
-		SaveDelHash(&dh, &ti->ti_RanBeg,
-			    rh->rh_Hv, rh->rh_Size);
+		SaveDelHash(&dh, &ti->ti_RanBeg, rh);
 	}
     }
 
@@ -525,8 +524,11 @@ VacuumScan(
 	    keepCount, delCount + keepCount
 	);
     }
-    if (dh.dh_Count)
+    if (dh.dh_Count) {
 	printf("** WARNING, %d deletions did not match up\n", dh.dh_Count);
+	dh.dh_Flags |= DHF_INTERRUPTED;
+    }
+    DoneDelHash(&dh);
     CloseIndex(&ti->ti_Index, 1);
 }
 
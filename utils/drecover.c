@@ -14,6 +14,8 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <libdbcore/btree.h>
+#include <libdbcore/hash.h>
+#include <libdbcore/trgm.h>
 
 DataBase *Db;
 
@@ -149,6 +151,44 @@ RecoverIndex(const char *dirPath, const char *filePath, int fd)
 	    remove(filePath);
 	}
 	break;
+    case HX_MAGIC:
+	if (ih.ih_Version == HX_VERSION) {
+	    HashHead *hh = safe_malloc(sizeof(HashHead));
+
+	    if (read(fd, hh, sizeof(*hh)) != sizeof(*hh)) {
+		printf("Removing truncated hash index file");
+		remove(filePath);
+	    } else if ((hh->hh_Flags & HXF_SYNCED) == 0) {
+		printf("Removing unsynchronized hash index file");
+		remove(filePath);
+	    } else {
+		printf("FILE OK");
+	    }
+	    free(hh);
+	} else {
+	    printf("Removing version %d index file", ih.ih_Version);
+	    remove(filePath);
+	}
+	break;
+    case TG_MAGIC:
+	if (ih.ih_Version == TG_VERSION) {
+	    TrgmHead *tg = safe_malloc(sizeof(TrgmHead));
+
+	    if (read(fd, tg, sizeof(*tg)) != sizeof(*tg)) {
+		printf("Removing truncated trigram index file");
+		remove(filePath);
+	    } else if ((tg->tg_Flags & TGF_SYNCED) == 0) {
+		printf("Removing unsynchronized trigram index file");
+		remove(filePath);
+	    } else {
+		printf("FILE OK");
+	    }
+	    free(tg);
+	} else {
+	    printf("Removing version %d index file", ih.ih_Version);
+	    remove(filePath);
+	}
+	break;
     default:
 	printf("Removing unknown index file");
 	remove(filePath);
@@ -213,10 +213,15 @@ DSTermRange(Query *q)
 
     for (ci = q->q_ColIQBase; ci; ci = ci->ci_QNext) {
 	ColData *cd = ci->ci_CData;
+	char buf[DATATYPE_FMTSIZE];
+	int n;
 
 	if (cd->cd_Data) {
 	    fputc('\'', stdout);
-	    DSOutputData(cd->cd_Data, cd->cd_Bytes);
+	    if ((n = DataTypeToString(ci->ci_DataType, cd, buf)) >= 0)
+		DSOutputData(buf, n);
+	    else
+		DSOutputData(cd->cd_Data, cd->cd_Bytes);
 	    fputc('\'', stdout);
 	} else {
 	    fprintf(stderr, "NULL");
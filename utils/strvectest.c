@@ -0,0 +1,143 @@
+/*
+ * UTILS/STRVECTEST.C
+ *
+ * (c)Copyright 2000-2002 Backplane, Inc.  Please refer to the COPYRIGHT
+ * file at the base of the distribution tree.
+ *
+ *	STRVECTEST [iterations] [seed]
+ *
+ *	Differential test of StrFirstDiff() and StrFirstDiffNoCase() (see
+ *	libdbtypes/strvec.c) against byte at a time reference loops.  Each
+ *	iteration builds a pair of buffers of random length at random
+ *	alignments, plants a difference (or a case-only difference) at a
+ *	random position and checks that the vector kernels picked for this
+ *	cpu find the same first difference.  The AVX2 kernel finishes its
+ *	tail with the SSE2 kernel and the SSE2 kernel with the scalar loop,
+ *	so lengths up to a few times 32 exercise all of them.
+ *
+ *	Exits 0 if every comparison agrees, 1 otherwise.
+ */
+
+#include "defs.h"
+#include <ctype.h>
+
+#define SVT_MAXLEN	(4 * 32 + 7)
+#define SVT_MAXALIGN	64
+
+static int refDiff(const char *s1, const char *s2, int n);
+static int refDiffNoCase(const char *s1, const char *s2, int n);
+static char randChar(void);
+
+/*
+ * Bytes either side of the 'A'-'Z' and 'a'-'z' ranges and with the high
+ * bit set are the ones a bad fold would get wrong.
+ */
+static const char Edges[] = "@AZ[`az{\x80\xc1\xda\xe1\xfa\xff";
+
+int
+main(int ac, char **av)
+{
+    char *b1;
+    char *b2;
+    long iters = 1000000;
+    long i;
+    int errors = 0;
+
+    if (ac > 1)
+	iters = strtol(av[1], NULL, 0);
+    srandom((ac > 2) ? strtoul(av[2], NULL, 0) : (unsigned long)time(NULL));
+
+    b1 = malloc(SVT_MAXLEN + SVT_MAXALIGN);
+    b2 = malloc(SVT_MAXLEN + SVT_MAXALIGN);
+
+    for (i = 0; i < iters && errors < 10; ++i) {
+	char *s1 = b1 + random() % SVT_MAXALIGN;
+	char *s2 = b2 + random() % SVT_MAXALIGN;
+	int n = random() % (SVT_MAXLEN + 1);
+	int r;
+	int k;
+
+	for (k = 0; k < n; ++k) {
+	    s1[k] = randChar();
+	    s2[k] = s1[k];
+	}
+
+	/*
+	 * Usually flip the case of a few letters so only the case
+	 * insensitive search sees past them, then plant a real
+	 * difference.
+	 */
+	for (k = random() % 4; n && k > 0; --k) {
+	    int j = random() % n;
+
+	    if (isalpha((unsigned char)s2[j]))
+		s2[j] ^= 0x20;
+	}
+	if (n && random() % 8) {
+	    int j = random() % n;
+
+	    s2[j] = randChar();
+	}
+
+	if ((r = StrFirstDiff(s1, s2, n)) != refDiff(s1, s2, n)) {
+	    fprintf(stderr,
+		"StrFirstDiff len %d align %d/%d: got %d expected %d\n",
+		n, (int)(s1 - b1), (int)(s2 - b2), r, refDiff(s1, s2, n));
+	    ++errors;
+	}
+	r = StrFirstDiffNoCase(s1, s2, n);
+	if (r != refDiffNoCase(s1, s2, n)) {
+	    fprintf(stderr,
+		"StrFirstDiffNoCase len %d align %d/%d: got %d expected %d\n",
+		n, (int)(s1 - b1), (int)(s2 - b2), r,
+		refDiffNoCase(s1, s2, n));
+	    ++errors;
+	}
+    }
+    free(b1);
+    free(b2);
+
+    if (errors) {
+	printf("strvectest: FAILED after %ld iterations\n", i);
+	return(1);
+    }
+    printf("strvectest: %ld iterations ok\n", i);
+    return(0);
+}
+
+static int
+refDiff(const char *s1, const char *s2, int n)
+{
+    int i;
+
+    for (i = 0; i < n && s1[i] == s2[i]; ++i)
+	;
+    return(i);
+}
+
+static int
+refDiffNoCase(const char *s1, const char *s2, int n)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+	int c1 = (unsigned char)s1[i];
+	int c2 = (unsigned char)s2[i];
+
+	if (c1 >= 'A' && c1 <= 'Z')
+	    c1 += 'a' - 'A';
+	if (c2 >= 'A' && c2 <= 'Z')
+	    c2 += 'a' - 'A';
+	if (c1 != c2)
+	    break;
+    }
+    return(i);
+}
+
+static char
+randChar(void)
+{
+    if (random() % 4 == 0)
+	return(Edges[random() % (sizeof(Edges) - 1)]);
+    return((char)(random() & 0xFF));
+}